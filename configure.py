@@ -233,6 +233,11 @@ parser.add_option('--with-python', metavar='EXE',
 parser.add_option('--force-pselect', action='store_true',
                   help='ppoll() is used by default where available, '
                        'but some platforms may need to use pselect instead',)
+parser.add_option('--force-ppoll', action='store_true',
+                  help='epoll is used by default on Linux; use ppoll instead',)
+parser.add_option('--usdt-probes', action='store_true',
+                  help='compile in static probes for perf, bpftrace and '
+                       'SystemTap; needs sys/sdt.h',)
 (options, args) = parser.parse_args()
 if args:
     print('ERROR: extra unparsed command-line arguments:', args)
@@ -409,10 +414,19 @@ else:
         cflags.append('-fno-omit-frame-pointer')
         libs.extend(['-Wl,--no-as-needed', '-lprofiler'])
 
+if not platform.is_msvc():
+    # The background log writer uses std::thread.
+    cflags.append('-pthread')
+    ldflags.append('-pthread')
+
 if platform.supports_ppoll() and not options.force_pselect:
     cflags.append('-DUSE_PPOLL')
+    if platform.is_linux() and not options.force_ppoll:
+        cflags.append('-DUSE_EPOLL')
 if platform.supports_ninja_browse():
     cflags.append('-DNINJA_HAVE_BROWSE')
+if options.usdt_probes:
+    cflags.append('-DNINJA_USDT_PROBES')
 
 # Search for generated headers relative to build dir.
 cflags.append('-I.')
@@ -529,10 +543,15 @@ n.newline()
 
 n.comment('Core source files all build into ninja library.')
 objs.extend(re2c_objs)
-for name in ['build',
+for name in ['action_cache',
+             'build',
              'build_log',
+             'build_report',
+             'build_simulator',
+             'builtin_command',
              'clean',
              'clparser',
+             'critical_path',
              'debug_flags',
              'deps_log',
              'disk_interface',
@@ -540,22 +559,34 @@ for name in ['build',
              'dyndep_parser',
              'edit_distance',
              'eval_env',
+             'executor',
              'graph',
              'graphviz',
+             'jobserver',
              'json',
              'line_printer',
+             'log_writer',
              'manifest_parser',
+             'memory_stats',
              'metrics',
              'missing_deps',
+             'output_spool',
              'parser',
+             'remote_cache',
+             'schedule_estimator',
+             'sha256',
              'state',
              'status_printer',
+             'status_stream',
+             'status_tracer',
              'string_piece_util',
              'util',
-             'version']:
+             'version',
+             'worker_pool']:
     objs += cxx(name, variables=cxxvariables)
 if platform.is_windows():
     for name in ['subprocess-win32',
+                 'jobserver-win32',
                  'includes_normalize-win32',
                  'msvc_helper-win32',
                  'msvc_helper_main-win32']:
@@ -565,6 +596,7 @@ if platform.is_windows():
     objs += cc('getopt')
 else:
     objs += cxx('subprocess-posix')
+    objs += cxx('jobserver-posix')
 if platform.is_aix():
     objs += cc('getopt')
 if platform.is_msvc():
@@ -629,26 +661,43 @@ if gtest_src_dir:
         test_variables += [('pdb', 'ninja_test.pdb')]
 
     test_names = [
+        'action_cache_test',
         'build_log_test',
+        'build_report_test',
+        'build_simulator_test',
         'build_test',
+        'builtin_command_test',
         'clean_test',
         'clparser_test',
+        'critical_path_test',
         'depfile_parser_test',
         'deps_log_test',
         'disk_interface_test',
         'dyndep_parser_test',
         'edit_distance_test',
+        'executor_test',
         'explanations_test',
         'graph_test',
+        'jobserver_test',
         'json_test',
         'lexer_test',
+        'log_writer_test',
         'manifest_parser_test',
+        'memory_stats_test',
+        'metrics_test',
         'ninja_test',
+        'output_spool_test',
+        'remote_cache_test',
+        'schedule_estimator_test',
+        'sha256_test',
         'state_test',
+        'status_stream_test',
+        'status_tracer_test',
         'string_piece_util_test',
         'subprocess_test',
         'test',
         'util_test',
+        'worker_pool_test',
     ]
     if platform.is_windows():
         test_names += [
@@ -686,7 +735,8 @@ for name in ['build_log_perftest',
              'depfile_parser_perftest',
              'hash_collision_bench',
              'manifest_parser_perftest',
-             'clparser_perftest']:
+             'clparser_perftest',
+             'subprocess_perftest']:
   if platform.is_msvc():
     cxxvariables = [('pdb', name + '.pdb')]
   objs = cxx(name, variables=cxxvariables)
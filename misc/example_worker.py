@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+
+# Copyright 2024 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""A persistent worker for ninja's "worker" binding.
+
+Each request is the command of an edge; this worker runs it with the shell,
+which is only useful to try the protocol out.  A real worker would handle
+the command in-process, keeping whatever it loaded for earlier requests:
+
+    rule javac
+      command = javac -d $outdir $in
+      worker = python3 misc/example_worker.py
+
+Protocol, on stdin and stdout, with lengths in bytes:
+    request:  "<length>\\n<command>"
+    response: "<exit code> <length>\\n<output>"
+"""
+
+import subprocess
+import sys
+
+
+def read_request(stdin):
+    header = stdin.readline()
+    if not header:
+        return None
+    return stdin.read(int(header)).decode('utf-8', 'replace')
+
+
+def main() -> int:
+    stdin = sys.stdin.buffer
+    stdout = sys.stdout.buffer
+    while True:
+        command = read_request(stdin)
+        if command is None:
+            # ninja closed stdin: the build is over.
+            return 0
+        proc = subprocess.run(command, shell=True, stdin=subprocess.DEVNULL,
+                              stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        stdout.write(b'%d %d\n' % (proc.returncode, len(proc.stdout)))
+        stdout.write(proc.stdout)
+        stdout.flush()
+
+
+if __name__ == '__main__':
+    sys.exit(main())
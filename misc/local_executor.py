@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+
+# Copyright 2024 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""A reference executor for ninja's --executor option.
+
+It runs commands on the local machine, as ninja itself would, which makes
+it a starting point for executors that send them elsewhere:
+
+    ninja --executor='python3 misc/local_executor.py -j 8'
+
+Protocol, on stdin and stdout, with lengths in bytes:
+    executor: "capacity <n>\\n"
+    ninja:    "start <id> <length>\\n<command>"
+    ninja:    "cancel <id>\\n"
+    executor: "done <id> <exit code> <length>\\n<output>"
+"""
+
+import argparse
+import os
+import signal
+import subprocess
+import sys
+import threading
+
+
+class Executor:
+    def __init__(self, stdout):
+        self.stdout = stdout
+        self.lock = threading.Lock()
+        self.processes = {}
+
+    def send(self, message: bytes):
+        with self.lock:
+            self.stdout.write(message)
+            self.stdout.flush()
+
+    def run(self, id: str, command: str):
+        process = subprocess.Popen(command, shell=True,
+                                   stdin=subprocess.DEVNULL,
+                                   stdout=subprocess.PIPE,
+                                   stderr=subprocess.STDOUT,
+                                   start_new_session=True)
+        with self.lock:
+            self.processes[id] = process
+        output, _ = process.communicate()
+        with self.lock:
+            del self.processes[id]
+        self.send(b'done %s %d %d\n' % (id.encode(), process.returncode,
+                                        len(output)) + output)
+
+    def cancel(self, id: str):
+        with self.lock:
+            process = self.processes.get(id)
+        if process:
+            try:
+                os.killpg(process.pid, signal.SIGTERM)
+            except ProcessLookupError:
+                pass
+
+    def cancel_all(self):
+        with self.lock:
+            ids = list(self.processes)
+        for id in ids:
+            self.cancel(id)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count() or 1,
+                        help='number of commands to run at once')
+    args = parser.parse_args()
+
+    stdin = sys.stdin.buffer
+    executor = Executor(sys.stdout.buffer)
+    signal.signal(signal.SIGTERM, lambda *_: (executor.cancel_all(),
+                                              sys.exit(1)))
+    executor.send(b'capacity %d\n' % args.jobs)
+    while True:
+        line = stdin.readline()
+        if not line:
+            # ninja closed stdin: the build is over.
+            executor.cancel_all()
+            return 0
+        words = line.decode().split()
+        if words[0] == 'start':
+            command = stdin.read(int(words[2])).decode('utf-8', 'replace')
+            threading.Thread(target=executor.run, args=(words[1], command),
+                             daemon=True).start()
+        elif words[0] == 'cancel':
+            executor.cancel(words[1])
+        else:
+            print('unknown message %r' % line, file=sys.stderr)
+            return 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
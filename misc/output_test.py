@@ -40,6 +40,7 @@ class BuildDir:
         flags: str = '',
         pipe: bool = False,
         env: Dict[str, str] = default_env,
+        raw: bool = False,
     ) -> str:
         ninja_cmd = '{} {}'.format(NINJA_PATH, flags)
         try:
@@ -55,6 +56,8 @@ class BuildDir:
         except subprocess.CalledProcessError as err:
             sys.stdout.buffer.write(err.output)
             raise err
+        if raw:
+            return output.decode('utf-8')
         final_output = ''
         for line in output.decode('utf-8').splitlines(True):
             if len(line) > 0 and line[-1] == '\r':
@@ -67,9 +70,10 @@ def run(
     flags: str = '',
     pipe: bool = False,
     env: Dict[str, str] = default_env,
+    raw: bool = False,
 ) -> str:
     with BuildDir(build_ninja) as b:
-        return b.run(flags, pipe, env)
+        return b.run(flags, pipe, env, raw)
 
 @unittest.skipIf(platform.system() == 'Windows', 'These test methods do not work on Windows')
 class Output(unittest.TestCase):
@@ -192,6 +196,46 @@ build a: cat
         output = run(Output.BUILD_SIMPLE_ECHO, flags='--quiet')
         self.assertEqual(output, 'do thing\n')
 
+    def test_ninja_status_refresh_millis(self) -> None:
+        'Are status redraws throttled, but output and the final status shown?'
+        env = default_env.copy()
+        env['NINJA_STATUS_REFRESH_MILLIS'] = '100000'
+        self.assertEqual(run(
+'''rule echo
+  command = echo $out
+  description = echo $out
+rule silent
+  command = true
+  description = silent $out
+
+build a: silent
+build b: echo a
+build c: silent b
+''', flags='-j1', env=env),
+'''[2/3] echo b\x1b[K
+b
+[3/3] silent c\x1b[K
+''')
+
+    def test_ninja_status_refresh_millis_timeout(self) -> None:
+        'Is a throttled status drawn once due, even if nothing else happens?'
+        env = default_env.copy()
+        env['NINJA_STATUS_REFRESH_MILLIS'] = '300'
+        output = run(
+'''rule silent
+  command = true
+  description = silent $out
+rule slow
+  command = sleep 2
+  description = slow $out
+
+build a: silent
+build b: slow a
+''', flags='-j1', env=env, raw=True)
+        # The start of b comes right after the first line, and is only
+        # drawn once the interval is over, while b still runs.
+        self.assertIn('[1/2] slow b', output)
+
     def test_entering_directory_on_stdout(self) -> None:
         output = run(Output.BUILD_SIMPLE_ECHO, flags='-C$PWD', pipe=True)
         self.assertEqual(output.splitlines()[0][:25], "ninja: Entering directory")
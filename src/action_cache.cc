@@ -0,0 +1,700 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "action_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+
+#ifdef _WIN32
+#include <direct.h>  // _mkdir
+#include <process.h>  // _getpid
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include "graph.h"
+#include "metrics.h"
+#include "remote_cache.h"
+#include "sha256.h"
+#include "util.h"
+
+using namespace std;
+
+const int ActionCache::kMaxEntries = 8;
+const size_t ActionCache::kMaxRemoteLookups = 8;
+
+namespace {
+
+// Waits below also time out periodically, so that a missed wakeup can
+// only delay the lookups, never hang the build.
+const chrono::milliseconds kWaitTimeout(100);
+
+/// Length of a digest in hex digits.
+const size_t kDigestSize = 64;
+
+bool IsDigest(const string& str) {
+  return str.size() == kDigestSize &&
+         str.find_first_not_of("0123456789abcdef") == string::npos;
+}
+
+int MakeDir(const string& path) {
+#ifdef _WIN32
+  return _mkdir(path.c_str());
+#else
+  return mkdir(path.c_str(), 0777);
+#endif
+}
+
+/// Write |contents| to |path| through a temporary file, so that readers
+/// never see a partial file.
+bool WriteFileAtomically(const string& path, const string& contents,
+                         string* err) {
+  // Lookup threads may write the same file at once.
+  static atomic<unsigned> temp_count(0);
+#ifdef _WIN32
+  string temp_path = path + ".tmp" + to_string(_getpid());
+#else
+  string temp_path = path + ".tmp" + to_string(getpid());
+#endif
+  temp_path += "." + to_string(temp_count++);
+  FILE* fp = fopen(temp_path.c_str(), "wb");
+  if (!fp) {
+    *err = temp_path + ": " + strerror(errno);
+    return false;
+  }
+  bool ok = fwrite(contents.data(), 1, contents.size(), fp) == contents.size();
+  ok = fclose(fp) == 0 && ok;
+#ifdef _WIN32
+  ok = ok && MoveFileExA(temp_path.c_str(), path.c_str(),
+                         MOVEFILE_REPLACE_EXISTING);
+#else
+  ok = ok && rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+  if (!ok) {
+    *err = path + ": " + strerror(errno);
+    remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+/// An exclusive lock on the file |path|, held by ninjas sharing a cache
+/// directory while they append to the index or rewrite it, so that no use
+/// is appended to an index that is being replaced.  Taken as far as the
+/// system allows: without it, uses may only be lost.
+struct IndexLock {
+  explicit IndexLock(const string& path) {
+#ifdef _WIN32
+    handle_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                          OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    OVERLAPPED overlapped = {};
+    if (handle_ != INVALID_HANDLE_VALUE)
+      LockFileEx(handle_, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+#else
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd_ >= 0) {
+      while (flock(fd_, LOCK_EX) < 0 && errno == EINTR) {}
+    }
+#endif
+  }
+
+  /// Closing the file releases the lock.
+  ~IndexLock() {
+#ifdef _WIN32
+    if (handle_ != INVALID_HANDLE_VALUE)
+      CloseHandle(handle_);
+#else
+    if (fd_ >= 0)
+      close(fd_);
+#endif
+  }
+
+#ifdef _WIN32
+  HANDLE handle_;
+#else
+  int fd_;
+#endif
+};
+
+/// Write an output restored from the cache.
+bool WriteOutput(const string& path, const string& contents, int mode) {
+  FILE* fp = fopen(path.c_str(), "wb");
+  if (!fp)
+    return false;
+  bool ok = fwrite(contents.data(), 1, contents.size(), fp) == contents.size();
+  ok = fclose(fp) == 0 && ok;
+#ifndef _WIN32
+  ok = ok && chmod(path.c_str(), mode) == 0;
+#endif
+  return ok;
+}
+
+int FileMode(const string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0)
+    return -1;
+  return st.st_mode & 0777;
+}
+
+/// The outputs of |edge| to store: its outputs and its depfile, if any.
+vector<string> OutputPaths(Edge* edge) {
+  vector<string> paths;
+  for (vector<Node*>::iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o)
+    paths.push_back((*o)->path());
+  string depfile = edge->GetUnescapedDepfile();
+  if (!depfile.empty())
+    paths.push_back(depfile);
+  return paths;
+}
+
+}  // anonymous namespace
+
+ActionCache::ActionCache(const string& dir, int64_t max_size)
+    : dir_(dir), max_size_(max_size), open_(false), lookups_started_(0),
+      quit_(false) {}
+
+ActionCache::~ActionCache() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    quit_ = true;
+    lookups_changed_.notify_all();
+  }
+  for (vector<thread>::iterator t = lookup_threads_.begin();
+       t != lookup_threads_.end(); ++t)
+    t->join();
+  for (deque<RemoteLookup*>::iterator l = lookups_.begin();
+       l != lookups_.end(); ++l)
+    delete *l;
+  for (deque<RemoteLookup*>::iterator l = finished_lookups_.begin();
+       l != finished_lookups_.end(); ++l)
+    delete *l;
+
+  if (!open_)
+    return;
+  IndexLock lock(dir_ + "/lock");
+  if (!uses_.empty()) {
+    FILE* fp = fopen((dir_ + "/index").c_str(), "ab");
+    if (fp) {
+      fwrite(uses_.data(), 1, uses_.size(), fp);
+      fclose(fp);
+    }
+  }
+  Trim();
+}
+
+bool ActionCache::Open(string* err) {
+  const char* subdirs[] = { "", "/ac", "/cas" };
+  for (size_t i = 0; i < sizeof(subdirs) / sizeof(subdirs[0]); ++i) {
+    string path = dir_ + subdirs[i];
+    if (MakeDir(path) < 0 && errno != EEXIST) {
+      *err = "mkdir(" + path + "): " + strerror(errno);
+      return false;
+    }
+  }
+  open_ = true;
+  return true;
+}
+
+void ActionCache::SetRemote(RemoteCache* remote) {
+  remote_.reset(remote);
+}
+
+bool ActionCache::IsCacheable(Edge* edge) {
+  return !edge->is_phony() && !edge->outputs_.empty() &&
+         !edge->use_console() && !edge->GetBindingBool("generator") &&
+         edge->GetBinding("builtin").empty();
+}
+
+string ActionCache::HashFile(const string& path) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    unordered_map<string, string>::iterator i = digests_.find(path);
+    if (i != digests_.end())
+      return i->second;
+  }
+  string contents, err;
+  string digest(kDigestSize, '0');
+  if (::ReadFile(path, &contents, &err) == 0)
+    digest = Sha256Hex(contents);
+  lock_guard<mutex> lock(mutex_);
+  digests_[path] = digest;
+  return digest;
+}
+
+void ActionCache::ForgetOutputs(Edge* edge) {
+  vector<string> paths = OutputPaths(edge);
+  lock_guard<mutex> lock(mutex_);
+  for (vector<string>::iterator p = paths.begin(); p != paths.end(); ++p)
+    digests_.erase(*p);
+}
+
+string ActionCache::ActionKey(Edge* edge) {
+  return Sha256Hex(edge->EvaluateCommand(true));
+}
+
+string ActionCache::ActionPath(const string& key) const {
+  return dir_ + "/ac/" + key;
+}
+
+string ActionCache::BlobPath(const string& digest) const {
+  return dir_ + "/cas/" + digest;
+}
+
+bool ActionCache::ParseEntries(const string& contents,
+                               vector<Entry>* entries) {
+  // Each line is "<tag> <digest> [<mode> ]<path>"; "end" closes an entry.
+  Entry entry;
+  size_t pos = 0;
+  while (pos < contents.size()) {
+    size_t eol = contents.find('\n', pos);
+    if (eol == string::npos)
+      return false;
+    string line = contents.substr(pos, eol - pos);
+    pos = eol + 1;
+
+    if (line == "end") {
+      entries->push_back(entry);
+      entry = Entry();
+      continue;
+    }
+    if (line.size() < 4 + kDigestSize || line[3] != ' ')
+      return false;
+    string tag = line.substr(0, 3);
+    string digest = line.substr(4, kDigestSize);
+    if (!IsDigest(digest))
+      return false;
+    if (tag == "log") {
+      entry.output_digest = digest;
+      continue;
+    }
+    if (line.size() < 6 + kDigestSize || line[4 + kDigestSize] != ' ')
+      return false;
+    string rest = line.substr(5 + kDigestSize);
+    if (tag == "dep") {
+      entry.inputs.push_back(make_pair(rest, digest));
+    } else if (tag == "out") {
+      size_t space = rest.find(' ');
+      if (space == string::npos)
+        return false;
+      Output output;
+      output.digest = digest;
+      output.mode = (int)strtol(rest.substr(0, space).c_str(), NULL, 8);
+      output.path = rest.substr(space + 1);
+      entry.outputs.push_back(output);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+string ActionCache::FormatEntries(const vector<Entry>& entries) {
+  string result;
+  for (vector<Entry>::const_iterator e = entries.begin(); e != entries.end();
+       ++e) {
+    for (size_t i = 0; i < e->inputs.size(); ++i) {
+      result += "dep " + e->inputs[i].second + " " + e->inputs[i].first + "\n";
+    }
+    for (size_t i = 0; i < e->outputs.size(); ++i) {
+      char mode[8];
+      snprintf(mode, sizeof(mode), "%o", e->outputs[i].mode);
+      result += "out " + e->outputs[i].digest + " " + mode + " " +
+                e->outputs[i].path + "\n";
+    }
+    if (!e->output_digest.empty())
+      result += "log " + e->output_digest + "\n";
+    result += "end\n";
+  }
+  return result;
+}
+
+bool ActionCache::Restore(Edge* edge, string* output) {
+  METRIC_RECORD("action cache lookup");
+  if (!open_ || !IsCacheable(edge))
+    return false;
+
+  string key = ActionKey(edge);
+  string contents, err;
+  vector<Entry> entries;
+  if (::ReadFile(ActionPath(key), &contents, &err) < 0 ||
+      !ParseEntries(contents, &entries))
+    entries.clear();
+  err.clear();
+  if (RestoreEntry(OutputPaths(edge), entries, false, output, &err)) {
+    Use("ac/" + key, contents.size());
+    // Only counted, next to the time spent in lookups, with -d stats.
+    { METRIC_RECORD("action cache hit"); }
+    return true;
+  }
+  if (!err.empty())
+    Warning("action cache: %s", err.c_str());
+  // Otherwise counted once the remote lookup finishes.
+  if (!remote_ || !remote_->enabled()) {
+    METRIC_RECORD("action cache miss");
+  }
+  return false;
+}
+
+bool ActionCache::StartRemoteRestore(Edge* edge) {
+  if (!open_ || !IsCacheable(edge) || !remote_ || !remote_->enabled())
+    return false;
+  RemoteLookup* lookup = new RemoteLookup;
+  lookup->edge = edge;
+  lookup->key = ActionKey(edge);
+  lookup->output_paths = OutputPaths(edge);
+  lookup->hit = false;
+
+  lock_guard<mutex> lock(mutex_);
+  lookups_.push_back(lookup);
+  ++lookups_started_;
+  if (lookup_threads_.size() < kMaxRemoteLookups &&
+      lookup_threads_.size() < lookups_started_ - finished_lookups_.size())
+    lookup_threads_.push_back(thread(&ActionCache::RunRemoteLookups, this));
+  lookups_changed_.notify_one();
+  return true;
+}
+
+size_t ActionCache::remote_lookups() const {
+  lock_guard<mutex> lock(mutex_);
+  return lookups_started_;
+}
+
+bool ActionCache::NextRemoteRestored(Edge** edge, bool* hit,
+                                     string* output) {
+  RemoteLookup* lookup;
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (finished_lookups_.empty())
+      return false;
+    lookup = finished_lookups_.front();
+    finished_lookups_.pop_front();
+    --lookups_started_;
+  }
+  *edge = lookup->edge;
+  *hit = lookup->hit;
+  output->swap(lookup->output);
+  if (!lookup->err.empty())
+    Warning("action cache: %s", lookup->err.c_str());
+  if (lookup->hit) {
+    METRIC_RECORD("remote cache hit");
+  } else {
+    METRIC_RECORD("action cache miss");
+  }
+  delete lookup;
+  return true;
+}
+
+void ActionCache::RunRemoteLookups() {
+  unique_lock<mutex> lock(mutex_);
+  // The lookups still queued are dropped on quitting: nobody waits for
+  // them anymore.
+  while (!quit_) {
+    if (lookups_.empty()) {
+      lookups_changed_.wait_for(lock, kWaitTimeout);
+      continue;
+    }
+    RemoteLookup* lookup = lookups_.front();
+    lookups_.pop_front();
+    lock.unlock();
+    RemoteRestore(lookup);
+    lock.lock();
+    finished_lookups_.push_back(lookup);
+    if (wake_) {
+      lock.unlock();
+      wake_();
+      lock.lock();
+    }
+  }
+}
+
+void ActionCache::RemoteRestore(RemoteLookup* lookup) {
+  string contents;
+  vector<Entry> entries;
+  if (remote_->Get("ac/" + lookup->key, &contents) != RemoteCache::kFound ||
+      !ParseEntries(contents, &entries))
+    entries.clear();
+  const Entry* entry = RestoreEntry(lookup->output_paths, entries, true,
+                                    &lookup->output, &lookup->err);
+  if (entry) {
+    // Keep the entry next to the local ones, for the next builds.
+    string action_path = ActionPath(lookup->key);
+    string err;
+    vector<Entry> local_entries;
+    if (::ReadFile(action_path, &contents, &err) < 0 ||
+        !ParseEntries(contents, &local_entries))
+      local_entries.clear();
+    contents = FormatEntries(MergeEntries(*entry, local_entries));
+    if (WriteFileAtomically(action_path, contents, &err))
+      Use("ac/" + lookup->key, contents.size());
+    lookup->hit = true;
+  }
+
+  // Kept for Store() to add to.
+  lock_guard<mutex> lock(mutex_);
+  remote_entries_[lookup->key].swap(entries);
+}
+
+const ActionCache::Entry* ActionCache::RestoreEntry(
+    const vector<string>& output_paths, const vector<Entry>& entries,
+    bool fetch, string* output, string* err) {
+  for (vector<Entry>::const_iterator e = entries.begin(); e != entries.end();
+       ++e) {
+    if (e->outputs.size() != output_paths.size())
+      continue;
+    bool match = true;
+    for (size_t i = 0; match && i < output_paths.size(); ++i)
+      match = e->outputs[i].path == output_paths[i];
+    for (size_t i = 0; match && i < e->inputs.size(); ++i)
+      match = HashFile(e->inputs[i].first) == e->inputs[i].second;
+    if (!match)
+      continue;
+
+    // Read every blob before writing any output, so that a blob evicted
+    // by another ninja leaves the outputs alone.
+    vector<string> blobs(e->outputs.size());
+    for (size_t i = 0; match && i < e->outputs.size(); ++i)
+      match = ReadBlob(e->outputs[i].digest, fetch, &blobs[i]);
+    string log;
+    if (match && !e->output_digest.empty())
+      match = ReadBlob(e->output_digest, fetch, &log);
+    if (!match)
+      return NULL;
+
+    for (size_t i = 0; i < e->outputs.size(); ++i) {
+      if (!WriteOutput(e->outputs[i].path, blobs[i], e->outputs[i].mode)) {
+        *err = "restoring " + e->outputs[i].path + ": " + strerror(errno);
+        return NULL;
+      }
+      {
+        lock_guard<mutex> lock(mutex_);
+        digests_[e->outputs[i].path] = e->outputs[i].digest;
+      }
+      Use("cas/" + e->outputs[i].digest, blobs[i].size());
+    }
+    if (!e->output_digest.empty())
+      Use("cas/" + e->output_digest, log.size());
+    output->swap(log);
+    return &*e;
+  }
+  return NULL;
+}
+
+bool ActionCache::ReadBlob(const string& digest, bool fetch,
+                           string* contents) {
+  string err;
+  if (::ReadFile(BlobPath(digest), contents, &err) == 0)
+    return true;
+  if (!fetch || !remote_ || !remote_->enabled())
+    return false;
+  contents->clear();
+  // Whatever the server sends must have the digest asked for.
+  if (remote_->Get("cas/" + digest, contents) != RemoteCache::kFound ||
+      Sha256Hex(*contents) != digest)
+    return false;
+  // Keep a local copy for the next builds.
+  WriteFileAtomically(BlobPath(digest), *contents, &err);
+  return true;
+}
+
+vector<ActionCache::Entry> ActionCache::MergeEntries(
+    const Entry& entry, const vector<Entry>& old_entries) {
+  // The new entry goes first; an older entry with the same inputs is
+  // replaced, and the oldest beyond kMaxEntries are dropped.
+  vector<Entry> entries(1, entry);
+  for (vector<Entry>::const_iterator e = old_entries.begin();
+       e != old_entries.end() && (int)entries.size() < kMaxEntries; ++e) {
+    if (e->inputs != entry.inputs)
+      entries.push_back(*e);
+  }
+  return entries;
+}
+
+bool ActionCache::PutBlob(const string& contents, string* digest,
+                          string* err) {
+  *digest = Sha256Hex(contents);
+  string path = BlobPath(*digest);
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 &&
+      !WriteFileAtomically(path, contents, err))
+    return false;
+  Use("cas/" + *digest, contents.size());
+  return true;
+}
+
+bool ActionCache::Store(Edge* edge, const vector<Node*>& deps,
+                        const string& output, const string* depfile_contents,
+                        string* err) {
+  METRIC_RECORD("action cache store");
+  if (!open_ || !IsCacheable(edge))
+    return true;
+
+  Entry entry;
+  vector<Node*> inputs(edge->inputs_.begin(),
+                       edge->inputs_.end() - edge->order_only_deps_);
+  inputs.insert(inputs.end(), deps.begin(), deps.end());
+  sort(inputs.begin(), inputs.end());
+  inputs.erase(unique(inputs.begin(), inputs.end()), inputs.end());
+  for (vector<Node*>::iterator i = inputs.begin(); i != inputs.end(); ++i)
+    entry.inputs.push_back(make_pair((*i)->path(), HashFile((*i)->path())));
+  sort(entry.inputs.begin(), entry.inputs.end());
+
+  vector<string> output_paths = OutputPaths(edge);
+  vector<string> blobs;
+  for (vector<string>::iterator o = output_paths.begin();
+       o != output_paths.end(); ++o) {
+    string contents;
+    bool removed_depfile =
+        depfile_contents && *o == edge->GetUnescapedDepfile();
+    int ret = 0;
+    if (removed_depfile)
+      contents = *depfile_contents;
+    else
+      ret = ::ReadFile(*o, &contents, err);
+    if (ret == -ENOENT) {
+      // An implicit output or depfile the command didn't write can't be
+      // restored; leave the action out of the cache.
+      err->clear();
+      return true;
+    }
+    if (ret < 0) {
+      *err = *o + ": " + *err;
+      return false;
+    }
+    Output out;
+    out.path = *o;
+    out.mode = removed_depfile ? 0644 : FileMode(*o);
+    if (!PutBlob(contents, &out.digest, err))
+      return false;
+    {
+      lock_guard<mutex> lock(mutex_);
+      digests_[*o] = out.digest;
+    }
+    entry.outputs.push_back(out);
+    if (remote_)
+      blobs.push_back(contents);
+  }
+  if (!output.empty() && !PutBlob(output, &entry.output_digest, err))
+    return false;
+
+  string key = ActionKey(edge);
+  string action_path = ActionPath(key);
+  string contents, read_err;
+  vector<Entry> old_entries;
+  if (::ReadFile(action_path, &contents, &read_err) < 0 ||
+      !ParseEntries(contents, &old_entries))
+    old_entries.clear();
+  contents = FormatEntries(MergeEntries(entry, old_entries));
+  if (!WriteFileAtomically(action_path, contents, err))
+    return false;
+  Use("ac/" + key, contents.size());
+
+  if (remote_ && remote_->enabled()) {
+    bool uploaded = true;
+    for (size_t i = 0; i < blobs.size(); ++i) {
+      uploaded = remote_->PutAsync("cas/" + entry.outputs[i].digest,
+                                   blobs[i]) && uploaded;
+    }
+    if (!entry.output_digest.empty())
+      uploaded = remote_->PutAsync("cas/" + entry.output_digest, output) &&
+                 uploaded;
+    // An entry whose blobs weren't all uploaded would only be a miss.
+    if (!uploaded)
+      return true;
+    vector<Entry> remote_entries;
+    {
+      lock_guard<mutex> lock(mutex_);
+      remote_entries = remote_entries_[key];
+    }
+    remote_->PutAsync("ac/" + key,
+                      FormatEntries(MergeEntries(entry, remote_entries)));
+  }
+  return true;
+}
+
+void ActionCache::Use(const string& path, int64_t size) {
+  lock_guard<mutex> lock(mutex_);
+  uses_ += to_string(size) + " " + path + "\n";
+}
+
+void ActionCache::Trim() {
+  METRIC_RECORD("action cache trim");
+  string index_path = dir_ + "/index";
+  string contents, err;
+  if (::ReadFile(index_path, &contents, &err) < 0)
+    return;
+
+  // The last use of each file, and its size then.
+  map<string, pair<size_t, int64_t> > files;
+  size_t lines = 0;
+  size_t pos = 0;
+  while (pos < contents.size()) {
+    size_t eol = contents.find('\n', pos);
+    if (eol == string::npos)
+      break;
+    size_t space = contents.find(' ', pos);
+    if (space != string::npos && space < eol) {
+      int64_t size = strtoll(contents.c_str() + pos, NULL, 10);
+      files[contents.substr(space + 1, eol - space - 1)] =
+          make_pair(lines, size);
+    }
+    ++lines;
+    pos = eol + 1;
+  }
+
+  int64_t total = 0;
+  vector<pair<size_t, string> > by_age;
+  for (map<string, pair<size_t, int64_t> >::iterator f = files.begin();
+       f != files.end(); ++f) {
+    total += f->second.second;
+    by_age.push_back(make_pair(f->second.first, f->first));
+  }
+  if (total <= max_size_ && lines < 2 * files.size() + 1000)
+    return;
+  if (trim_hook_)
+    trim_hook_();
+
+  // Evict down to 3/4 of the limit, so that a cache at its limit isn't
+  // trimmed on every run.  Otherwise just drop the stale lines.
+  int64_t target = total > max_size_ ? max_size_ / 4 * 3 : total;
+  sort(by_age.begin(), by_age.end());
+  size_t first_kept = 0;
+  for (; total > target && first_kept < by_age.size(); ++first_kept) {
+    const string& path = by_age[first_kept].second;
+    remove((dir_ + "/" + path).c_str());
+    total -= files[path].second;
+  }
+
+  string index;
+  for (size_t i = first_kept; i < by_age.size(); ++i) {
+    const string& path = by_age[i].second;
+    index += to_string(files[path].second) + " " + path + "\n";
+  }
+  if (!WriteFileAtomically(index_path, index, &err))
+    Warning("action cache: %s", err.c_str());
+}
@@ -0,0 +1,212 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_ACTION_CACHE_H_
+#define NINJA_ACTION_CACHE_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct Edge;
+struct Node;
+struct RemoteCache;
+
+/// ActionCache keeps the outputs of commands in a directory, so that an
+/// edge whose command and inputs were seen before gets its outputs back
+/// without running the command, e.g. after switching branches back and
+/// forth.
+///
+/// Actions are looked up in two steps, as the inputs discovered through
+/// depfiles and the deps log are only known once the command ran:
+/// - ac/<digest of the command> holds up to kMaxEntries entries, newest
+///   first, each listing every input and every output with the digest of
+///   its contents.
+/// - cas/<digest of the contents> holds the contents of outputs, depfiles
+///   and the command's output.
+/// Digests are SHA-256, so that neither a command nor a blob can be passed
+/// off as another.
+/// An entry is a hit if each input it lists has the same contents as now.
+///
+/// Files are written under a temporary name and renamed, so that ninjas
+/// sharing the directory only see complete files.  Uses are appended to an
+/// index, from which the least recently used files are removed when the
+/// cache grows over its size limit; both under a lock on the file "lock",
+/// so that appends aren't lost in a rewrite.
+///
+/// With a RemoteCache, entries and blobs missing locally are fetched from
+/// it on background threads, and those stored are uploaded to it.
+struct ActionCache {
+  static const int kMaxEntries;
+  /// Number of remote lookups made at once.
+  static const size_t kMaxRemoteLookups;
+
+  /// |max_size| is in bytes.
+  ActionCache(const std::string& dir, int64_t max_size);
+  /// Records the uses of files and evicts the oldest if needed.
+  ~ActionCache();
+
+  /// Create the cache directory if needed.  Returns false on error.
+  bool Open(std::string* err);
+
+  /// Share entries with |remote|, which the cache takes ownership of.
+  void SetRemote(RemoteCache* remote);
+
+  /// Whether the results of |edge| can be cached: the edge must produce
+  /// files with a command that ninja doesn't have to treat specially.
+  static bool IsCacheable(Edge* edge);
+
+  /// Restore the outputs and depfile of |edge| from the local cache, if a
+  /// previous run of its command had the same inputs.  Returns true and
+  /// fills in |output| with the output of the command on a hit.
+  bool Restore(Edge* edge, std::string* output);
+
+  /// After Restore() missed, look |edge| up in the remote cache on a
+  /// background thread.  Returns false if there is no remote cache to ask.
+  bool StartRemoteRestore(Edge* edge);
+
+  /// Number of remote lookups started and not yet returned by
+  /// NextRemoteRestored().
+  size_t remote_lookups() const;
+
+  /// Get an edge whose remote lookup finished.  Returns false if there is
+  /// none.  On a hit, sets |hit|, restores the outputs and fills in |output|
+  /// as Restore() does.
+  bool NextRemoteRestored(Edge** edge, bool* hit, std::string* output);
+
+  /// Call |wake| from the lookup threads whenever a lookup finishes.
+  void set_wake(const std::function<void()>& wake) { wake_ = wake; }
+
+  /// Forget the contents of the outputs of |edge|, which ran: the files
+  /// read are otherwise only hashed once, but an edge that isn't cached
+  /// may rewrite the inputs of later ones.
+  void ForgetOutputs(Edge* edge);
+
+  /// Store the outputs and depfile of |edge|, whose command succeeded with
+  /// |output|.  |deps| are the inputs discovered by running the command.
+  /// |depfile_contents|, if not NULL, stands in for a depfile that ninja
+  /// already removed.  Returns false and fills in |err| if they couldn't
+  /// all be stored.
+  bool Store(Edge* edge, const std::vector<Node*>& deps,
+             const std::string& output, const std::string* depfile_contents,
+             std::string* err);
+
+  int64_t max_size() const { return max_size_; }
+
+  /// Used for tests: called by Trim() before it rewrites the index.
+  std::function<void()> trim_hook_;
+
+ private:
+  struct Output {
+    std::string path;
+    std::string digest;
+    int mode;
+  };
+  struct Entry {
+    /// Paths and digests of the inputs.
+    std::vector<std::pair<std::string, std::string> > inputs;
+    std::vector<Output> outputs;
+    /// Digest of the command's output, or empty if it was empty.
+    std::string output_digest;
+  };
+
+  /// A remote lookup, which only refers to |edge| on the main thread.
+  struct RemoteLookup {
+    Edge* edge;
+    std::string key;
+    std::vector<std::string> output_paths;
+    bool hit;
+    std::string output;
+    /// Why a hit couldn't be restored, if it couldn't.
+    std::string err;
+  };
+
+  /// Restore the first of |entries| whose inputs match now, and whose
+  /// outputs are |output_paths|, fetching its blobs from the remote cache
+  /// if |fetch|.  Returns that entry, or NULL if there is none or it can't
+  /// be read; |err| tells why if it couldn't be written.
+  const Entry* RestoreEntry(const std::vector<std::string>& output_paths,
+                            const std::vector<Entry>& entries, bool fetch,
+                            std::string* output, std::string* err);
+
+  /// Look |lookup| up in the remote cache, on a lookup thread.
+  void RemoteRestore(RemoteLookup* lookup);
+  void RunRemoteLookups();
+
+  /// Read the blob |digest|, from the remote cache if it isn't local and
+  /// |fetch|.
+  bool ReadBlob(const std::string& digest, bool fetch, std::string* contents);
+
+  /// Put |entry| before |old_entries|, replacing the one with the same
+  /// inputs, and keeping at most kMaxEntries.
+  static std::vector<Entry> MergeEntries(const Entry& entry,
+                                         const std::vector<Entry>& old_entries);
+
+  /// Digest of the contents of |path|, or all zeros if it can't be read.
+  std::string HashFile(const std::string& path);
+
+  /// SHA-256 of the command of |edge|, which names its ac/ file.
+  static std::string ActionKey(Edge* edge);
+  std::string ActionPath(const std::string& key) const;
+  std::string BlobPath(const std::string& digest) const;
+
+  /// Parse the entries of an ac/ file.
+  static bool ParseEntries(const std::string& contents,
+                           std::vector<Entry>* entries);
+  static std::string FormatEntries(const std::vector<Entry>& entries);
+
+  /// Store |contents| under its digest unless it's there already.
+  bool PutBlob(const std::string& contents, std::string* digest,
+               std::string* err);
+
+  /// Note a use of the file |path|, relative to the cache directory.
+  void Use(const std::string& path, int64_t size);
+
+  /// Remove the least recently used files while the cache is over its size
+  /// limit, and rewrite the index if it has many stale lines.  Called with
+  /// the lock on the index held.
+  void Trim();
+
+  std::string dir_;
+  int64_t max_size_;
+  bool open_;
+
+  std::unique_ptr<RemoteCache> remote_;
+  std::function<void()> wake_;
+
+  /// Guards the members below, which the lookup threads share.
+  mutable std::mutex mutex_;
+  /// Digests of the files read so far in this build.
+  std::unordered_map<std::string, std::string> digests_;
+  /// Index lines to append.
+  std::string uses_;
+  /// Entries fetched from |remote_| for each action key.
+  std::unordered_map<std::string, std::vector<Entry> > remote_entries_;
+  std::condition_variable lookups_changed_;
+  std::deque<RemoteLookup*> lookups_;
+  std::deque<RemoteLookup*> finished_lookups_;
+  size_t lookups_started_;
+  bool quit_;
+  std::vector<std::thread> lookup_threads_;
+};
+
+#endif  // NINJA_ACTION_CACHE_H_
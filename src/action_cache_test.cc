@@ -0,0 +1,284 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "action_cache.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "disk_interface.h"
+#include "graph.h"
+#include "sha256.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+struct ActionCacheTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    // These tests do real disk accesses, so create a temp dir.
+    temp_dir_.CreateAndEnter("Ninja-ActionCacheTest");
+    AssertParse(&state_,
+"rule cc\n"
+"  command = cc $in -o $out\n"
+"  depfile = $out.d\n"
+"build out: cat in1 in2 || oo\n"
+"build obj: cc src\n");
+  }
+
+  virtual void TearDown() {
+    temp_dir_.Cleanup();
+  }
+
+  Edge* GetEdge(const string& output) {
+    return GetNode(output)->in_edge();
+  }
+
+  string Contents(const string& path) {
+    string contents, err;
+    EXPECT_EQ(0, disk_.ReadFile(path, &contents, &err));
+    return contents;
+  }
+
+  ScopedTempDir temp_dir_;
+  RealDiskInterface disk_;
+};
+
+}  // anonymous namespace
+
+TEST_F(ActionCacheTest, StoreAndRestore) {
+  ActionCache cache("cache", 1 << 20);
+  string err, output;
+  ASSERT_TRUE(cache.Open(&err));
+
+  Edge* edge = GetEdge("out");
+  EXPECT_FALSE(cache.Restore(edge, &output));
+
+  ASSERT_TRUE(disk_.WriteFile("in1", "one"));
+  ASSERT_TRUE(disk_.WriteFile("in2", "two"));
+  ASSERT_TRUE(disk_.WriteFile("out", "onetwo"));
+  EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "printed", NULL, &err));
+  EXPECT_EQ("", err);
+
+  ASSERT_EQ(0, disk_.RemoveFile("out"));
+  EXPECT_TRUE(cache.Restore(edge, &output));
+  EXPECT_EQ("printed", output);
+  EXPECT_EQ("onetwo", Contents("out"));
+}
+
+TEST_F(ActionCacheTest, InputChanged) {
+  string err, output;
+  Edge* edge = GetEdge("out");
+  ASSERT_TRUE(disk_.WriteFile("in1", "one"));
+  ASSERT_TRUE(disk_.WriteFile("in2", "two"));
+  ASSERT_TRUE(disk_.WriteFile("out", "onetwo"));
+  {
+    ActionCache cache("cache", 1 << 20);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "", NULL, &err));
+  }
+
+  // Inputs are hashed once per cache, as only the edges building them
+  // change them during a build (see InputRebuilt).
+  ASSERT_TRUE(disk_.WriteFile("in2", "three"));
+  {
+    ActionCache cache("cache", 1 << 20);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_FALSE(cache.Restore(edge, &output));
+    ASSERT_TRUE(disk_.WriteFile("out", "onethree"));
+    EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "", NULL, &err));
+  }
+
+  // Both versions of the inputs are kept.
+  ASSERT_TRUE(disk_.WriteFile("in2", "two"));
+  {
+    ActionCache cache("cache", 1 << 20);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_TRUE(cache.Restore(edge, &output));
+    EXPECT_EQ("", output);
+    EXPECT_EQ("onetwo", Contents("out"));
+  }
+}
+
+TEST_F(ActionCacheTest, InputRebuilt) {
+  AssertParse(&state_,
+"build in1: cat gen\n");
+  string err, output;
+  Edge* edge = GetEdge("out");
+  ASSERT_TRUE(disk_.WriteFile("in1", "one"));
+  ASSERT_TRUE(disk_.WriteFile("in2", "two"));
+  ASSERT_TRUE(disk_.WriteFile("out", "onetwo"));
+  ActionCache cache("cache", 1 << 20);
+  ASSERT_TRUE(cache.Open(&err));
+  EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "", NULL, &err));
+
+  // The edge building in1 ran again, and changed it.
+  ASSERT_TRUE(disk_.WriteFile("in1", "uno"));
+  cache.ForgetOutputs(GetEdge("in1"));
+  EXPECT_FALSE(cache.Restore(edge, &output));
+}
+
+TEST_F(ActionCacheTest, OrderOnlyInputsIgnored) {
+  string err, output;
+  Edge* edge = GetEdge("out");
+  ASSERT_TRUE(disk_.WriteFile("in1", "one"));
+  ASSERT_TRUE(disk_.WriteFile("in2", "two"));
+  ASSERT_TRUE(disk_.WriteFile("oo", "old"));
+  ASSERT_TRUE(disk_.WriteFile("out", "onetwo"));
+  {
+    ActionCache cache("cache", 1 << 20);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "", NULL, &err));
+  }
+
+  ASSERT_TRUE(disk_.WriteFile("oo", "new"));
+  ActionCache cache("cache", 1 << 20);
+  ASSERT_TRUE(cache.Open(&err));
+  EXPECT_TRUE(cache.Restore(edge, &output));
+}
+
+TEST_F(ActionCacheTest, DiscoveredDeps) {
+  string err, output;
+  Edge* edge = GetEdge("obj");
+  ASSERT_TRUE(disk_.WriteFile("src", "#include \"header\""));
+  ASSERT_TRUE(disk_.WriteFile("header", "v1"));
+  ASSERT_TRUE(disk_.WriteFile("obj", "object v1"));
+  {
+    ActionCache cache("cache", 1 << 20);
+    ASSERT_TRUE(cache.Open(&err));
+    // The depfile was already removed, as for deps = gcc.
+    string depfile = "obj: src header\n";
+    vector<Node*> deps(1, state_.GetNode("header", 0));
+    EXPECT_TRUE(cache.Store(edge, deps, "", &depfile, &err));
+    EXPECT_EQ("", err);
+  }
+
+  ASSERT_TRUE(disk_.WriteFile("header", "v2"));
+  {
+    ActionCache cache("cache", 1 << 20);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_FALSE(cache.Restore(edge, &output));
+  }
+
+  ASSERT_TRUE(disk_.WriteFile("header", "v1"));
+  ASSERT_EQ(0, disk_.RemoveFile("obj"));
+  ActionCache cache("cache", 1 << 20);
+  ASSERT_TRUE(cache.Open(&err));
+  EXPECT_TRUE(cache.Restore(edge, &output));
+  EXPECT_EQ("object v1", Contents("obj"));
+  EXPECT_EQ("obj: src header\n", Contents("obj.d"));
+}
+
+TEST_F(ActionCacheTest, MissingDepfileNotStored) {
+  string err, output;
+  Edge* edge = GetEdge("obj");
+  ASSERT_TRUE(disk_.WriteFile("src", ""));
+  ASSERT_TRUE(disk_.WriteFile("obj", "object"));
+  ActionCache cache("cache", 1 << 20);
+  ASSERT_TRUE(cache.Open(&err));
+  EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "", NULL, &err));
+  EXPECT_EQ("", err);
+  EXPECT_FALSE(cache.Restore(edge, &output));
+}
+
+TEST_F(ActionCacheTest, NotCacheable) {
+  AssertParse(&state_,
+"rule gen\n"
+"  command = gen\n"
+"  generator = 1\n"
+"build build.ninja: gen\n"
+"build ph: phony in1\n");
+  EXPECT_TRUE(ActionCache::IsCacheable(GetEdge("out")));
+  EXPECT_FALSE(ActionCache::IsCacheable(GetEdge("build.ninja")));
+  EXPECT_FALSE(ActionCache::IsCacheable(GetEdge("ph")));
+}
+
+TEST_F(ActionCacheTest, Trim) {
+  string err, output;
+  Edge* edge = GetEdge("out");
+  ASSERT_TRUE(disk_.WriteFile("in1", "one"));
+  ASSERT_TRUE(disk_.WriteFile("in2", "two"));
+  ASSERT_TRUE(disk_.WriteFile("out", string(1000, 'x')));
+  {
+    ActionCache cache("cache", 100000);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "", NULL, &err));
+  }
+  {
+    ActionCache cache("cache", 100000);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_TRUE(cache.Restore(edge, &output));
+  }
+
+  // Storing a second, larger, version of the output pushes the cache over
+  // its limit, which evicts the least recently used files.
+  ASSERT_TRUE(disk_.WriteFile("in2", "three"));
+  ASSERT_TRUE(disk_.WriteFile("out", string(1500, 'y')));
+  {
+    ActionCache cache("cache", 2800);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "", NULL, &err));
+  }
+  ASSERT_TRUE(disk_.WriteFile("in2", "two"));
+  {
+    ActionCache cache("cache", 2800);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_FALSE(cache.Restore(edge, &output));
+  }
+  ASSERT_TRUE(disk_.WriteFile("in2", "three"));
+  ASSERT_EQ(0, disk_.RemoveFile("out"));
+  ActionCache cache("cache", 2800);
+  ASSERT_TRUE(cache.Open(&err));
+  EXPECT_TRUE(cache.Restore(edge, &output));
+  EXPECT_EQ(string(1500, 'y'), Contents("out"));
+}
+
+TEST_F(ActionCacheTest, TrimKeepsConcurrentUses) {
+  string err;
+  Edge* edge = GetEdge("out");
+  ASSERT_TRUE(disk_.WriteFile("in1", "one"));
+  ASSERT_TRUE(disk_.WriteFile("in2", "two"));
+  ASSERT_TRUE(disk_.WriteFile("out", string(1000, 'x')));
+  {
+    ActionCache cache("cache", 100000);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "", NULL, &err));
+  }
+
+  // Another ninja, which appends its uses when it's done.
+  ASSERT_TRUE(disk_.WriteFile("in2", "four"));
+  ASSERT_TRUE(disk_.WriteFile("out", string(10, 'z')));
+  unique_ptr<ActionCache> other(new ActionCache("cache", 100000));
+  ASSERT_TRUE(other->Open(&err));
+  EXPECT_TRUE(other->Store(edge, vector<Node*>(), "", NULL, &err));
+
+  // It is done while this one rewrites the index, after reading it.
+  ASSERT_TRUE(disk_.WriteFile("in2", "three"));
+  ASSERT_TRUE(disk_.WriteFile("out", string(1500, 'y')));
+  thread other_done;
+  {
+    ActionCache cache("cache", 2800);
+    ASSERT_TRUE(cache.Open(&err));
+    EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "", NULL, &err));
+    cache.trim_hook_ = [&]() {
+      other_done = thread([&]() { other.reset(); });
+      this_thread::sleep_for(chrono::milliseconds(100));
+    };
+  }
+  other_done.join();
+  EXPECT_NE(string::npos,
+            Contents("cache/index").find("cas/" + Sha256Hex(string(10, 'z'))));
+}
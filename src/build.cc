@@ -20,27 +20,35 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <atomic>
 #include <climits>
 #include <functional>
-#include <unordered_set>
 
 #if defined(__SVR4) && defined(__sun)
 #include <sys/termios.h>
 #endif
 
+#include "action_cache.h"
 #include "build_log.h"
+#include "builtin_command.h"
 #include "clparser.h"
+#include "critical_path.h"
 #include "debug_flags.h"
 #include "depfile_parser.h"
 #include "deps_log.h"
 #include "disk_interface.h"
+#include "executor.h"
 #include "explanations.h"
 #include "graph.h"
+#include "jobserver.h"
 #include "metrics.h"
+#include "probes.h"
+#include "remote_cache.h"
 #include "state.h"
 #include "status.h"
 #include "subprocess.h"
 #include "util.h"
+#include "worker_pool.h"
 
 using namespace std;
 
@@ -53,7 +61,7 @@ struct DryRunCommandRunner : public CommandRunner {
   // Overridden from CommandRunner:
   virtual size_t CanRunMore() const;
   virtual bool StartCommand(Edge* edge);
-  virtual bool WaitForCommand(Result* result);
+  virtual bool WaitForCommand(Result* result, int64_t timeout_millis);
 
  private:
   queue<Edge*> finished_;
@@ -68,7 +76,8 @@ bool DryRunCommandRunner::StartCommand(Edge* edge) {
   return true;
 }
 
-bool DryRunCommandRunner::WaitForCommand(Result* result) {
+bool DryRunCommandRunner::WaitForCommand(Result* result,
+                                         int64_t timeout_millis) {
    if (finished_.empty())
      return false;
 
@@ -84,6 +93,7 @@ Plan::Plan(Builder* builder)
   : builder_(builder)
   , command_edges_(0)
   , wanted_edges_(0)
+  , critical_path_weight_(kWeightByCount)
 {}
 
 void Plan::Reset() {
@@ -161,6 +171,7 @@ void Plan::EdgeWanted(const Edge* edge) {
 }
 
 Edge* Plan::FindWork() {
+  NINJA_PROBE1(plan_find_work, ready_.size());
   if (ready_.empty())
     return NULL;
 
@@ -455,9 +466,14 @@ void Plan::UnmarkDependents(const Node* node, set<Node*>* dependents) {
 namespace {
 
 // Heuristic for edge priority weighting.
-// Phony edges are free (0 cost), all other edges are weighted equally.
-int64_t EdgeWeightHeuristic(Edge *edge) {
-  return edge->is_phony() ? 0 : 1;
+// Phony edges are free (0 cost), all other edges are weighted equally
+// unless weighing them by their previous durations.
+int64_t EdgeWeightHeuristic(Edge *edge, Plan::CriticalPathWeight weight) {
+  if (edge->is_phony())
+    return 0;
+  if (weight == Plan::kWeightByTime && edge->prev_elapsed_time_millis > 1)
+    return edge->prev_elapsed_time_millis;
+  return 1;
 }
 
 }  // namespace
@@ -465,59 +481,7 @@ int64_t EdgeWeightHeuristic(Edge *edge) {
 void Plan::ComputeCriticalPath() {
   METRIC_RECORD("ComputeCriticalPath");
 
-  // Convenience class to perform a topological sort of all edges
-  // reachable from a set of unique targets. Usage is:
-  //
-  // 1) Create instance.
-  //
-  // 2) Call VisitTarget() as many times as necessary.
-  //    Note that duplicate targets are properly ignored.
-  //
-  // 3) Call result() to get a sorted list of edges,
-  //    where each edge appears _after_ its parents,
-  //    i.e. the edges producing its inputs, in the list.
-  //
-  struct TopoSort {
-    void VisitTarget(const Node* target) {
-      Edge* producer = target->in_edge();
-      if (producer)
-        Visit(producer);
-    }
-
-    const std::vector<Edge*>& result() const { return sorted_edges_; }
-
-   private:
-    // Implementation note:
-    //
-    // This is the regular depth-first-search algorithm described
-    // at https://en.wikipedia.org/wiki/Topological_sorting, except
-    // that:
-    //
-    // - Edges are appended to the end of the list, for performance
-    //   reasons. Hence the order used in result().
-    //
-    // - Since the graph cannot have any cycles, temporary marks
-    //   are not necessary, and a simple set is used to record
-    //   which edges have already been visited.
-    //
-    void Visit(Edge* edge) {
-      auto insertion = visited_set_.emplace(edge);
-      if (!insertion.second)
-        return;
-
-      for (const Node* input : edge->inputs_) {
-        Edge* producer = input->in_edge();
-        if (producer)
-          Visit(producer);
-      }
-      sorted_edges_.push_back(edge);
-    }
-
-    std::unordered_set<Edge*> visited_set_;
-    std::vector<Edge*> sorted_edges_;
-  };
-
-  TopoSort topo_sort;
+  EdgeTopoSort topo_sort;
   for (const Node* target : targets_) {
     topo_sort.VisitTarget(target);
   }
@@ -526,7 +490,8 @@ void Plan::ComputeCriticalPath() {
 
   // First, reset all weights to 1.
   for (Edge* edge : sorted_edges)
-    edge->set_critical_path_weight(EdgeWeightHeuristic(edge));
+    edge->set_critical_path_weight(
+        EdgeWeightHeuristic(edge, critical_path_weight_));
 
   // Second propagate / increment weidghts from
   // children to parents. Scan the list
@@ -542,7 +507,8 @@ void Plan::ComputeCriticalPath() {
         continue;
 
       int64_t producer_weight = producer->critical_path_weight();
-      int64_t candidate_weight = edge_weight + EdgeWeightHeuristic(producer);
+      int64_t candidate_weight =
+          edge_weight + EdgeWeightHeuristic(producer, critical_path_weight_);
       if (candidate_weight > producer_weight)
         producer->set_critical_path_weight(candidate_weight);
     }
@@ -579,6 +545,7 @@ void Plan::ScheduleInitialEdges() {
 }
 
 void Plan::PrepareQueue() {
+  METRIC_RECORD("plan");
   ComputeCriticalPath();
   ScheduleInitialEdges();
 }
@@ -594,17 +561,52 @@ void Plan::Dump() const {
 }
 
 struct RealCommandRunner : public CommandRunner {
-  explicit RealCommandRunner(const BuildConfig& config) : config_(config) {}
+  explicit RealCommandRunner(const BuildConfig& config)
+      : config_(config), workers_(&subprocs_),
+        jobserver_(JobserverClient::CreateFromEnvironment()), tokens_(0),
+        woken_(false) {}
   virtual ~RealCommandRunner() {}
   virtual size_t CanRunMore() const;
   virtual bool StartCommand(Edge* edge);
-  virtual bool WaitForCommand(Result* result);
+  virtual bool WaitForCommand(Result* result, int64_t timeout_millis);
+  virtual void Wake();
   virtual vector<Edge*> GetActiveEdges();
   virtual void Abort();
 
+  /// Hand the commands to the executor started by |command| from now on.
+  bool StartExecutor(const string& command, string* err);
+
+  /// Number of commands started and not yet reaped.
+  size_t RunningCommands() const {
+    return subproc_to_edge_.size() + request_to_edge_.size() +
+           builtin_results_.size() + id_to_edge_.size();
+  }
+
+  /// Give back the jobserver tokens beyond those needed by the commands
+  /// that haven't been reaped yet.
+  void ReleaseUnusedTokens();
+
   const BuildConfig& config_;
   SubprocessSet subprocs_;
   map<const Subprocess*, Edge*> subproc_to_edge_;
+  /// Persistent workers, for edges with a "worker" binding.  Declared after
+  /// |subprocs_|, which it wakes up.
+  WorkerPool workers_;
+  map<const WorkerRequest*, Edge*> request_to_edge_;
+  /// Results of the edges with a "builtin" binding, which are run within
+  /// StartCommand().
+  queue<Result> builtin_results_;
+  /// The external executor running commands instead of |subprocs_|, if
+  /// any.  Declared after |subprocs_|, which it wakes up.
+  unique_ptr<Executor> executor_;
+  map<int, Edge*> id_to_edge_;
+  /// The jobserver shared with the process running ninja, if any.
+  unique_ptr<JobserverClient> jobserver_;
+  /// Number of tokens taken from |jobserver_|.  One command may always run
+  /// without a token.
+  mutable size_t tokens_;
+  /// Set by Wake() until WaitForCommand() returns for it.
+  atomic<bool> woken_;
 };
 
 vector<Edge*> RealCommandRunner::GetActiveEdges() {
@@ -612,29 +614,82 @@ vector<Edge*> RealCommandRunner::GetActiveEdges() {
   for (map<const Subprocess*, Edge*>::iterator e = subproc_to_edge_.begin();
        e != subproc_to_edge_.end(); ++e)
     edges.push_back(e->second);
+  for (map<const WorkerRequest*, Edge*>::iterator e = request_to_edge_.begin();
+       e != request_to_edge_.end(); ++e)
+    edges.push_back(e->second);
+  for (queue<Result> results = builtin_results_; !results.empty();
+       results.pop())
+    edges.push_back(results.front().edge);
+  for (map<int, Edge*>::iterator e = id_to_edge_.begin();
+       e != id_to_edge_.end(); ++e)
+    edges.push_back(e->second);
   return edges;
 }
 
 void RealCommandRunner::Abort() {
   subprocs_.Clear();
+  workers_.Clear();
+  builtin_results_ = queue<Result>();
+  for (map<int, Edge*>::iterator e = id_to_edge_.begin();
+       e != id_to_edge_.end(); ++e)
+    executor_->Cancel(e->first);
+  id_to_edge_.clear();
+  if (jobserver_) {
+    for (; tokens_ > 0; --tokens_)
+      jobserver_->Release();
+  }
+}
+
+bool RealCommandRunner::StartExecutor(const string& command, string* err) {
+  executor_.reset(Executor::Create(command, &subprocs_, err));
+  if (!executor_) {
+    *err = "executor '" + command + "': " + *err;
+    return false;
+  }
+  return true;
+}
+
+void RealCommandRunner::ReleaseUnusedTokens() {
+  if (!jobserver_)
+    return;
+  size_t needed = RunningCommands();
+  for (; tokens_ > 0 && tokens_ + 1 > needed; --tokens_)
+    jobserver_->Release();
 }
 
 size_t RealCommandRunner::CanRunMore() const {
-  size_t subproc_number =
-      subprocs_.running_.size() + subprocs_.finished_.size();
+  size_t subproc_number = RunningCommands();
 
-  int64_t capacity = config_.parallelism - subproc_number;
+  // An executor tells how many commands it takes, in place of -j, -l and
+  // the jobserver.
+  int64_t capacity = executor_ ? (int64_t)executor_->capacity()
+                               : (int64_t)config_.parallelism;
+  capacity -= subproc_number;
 
-  if (config_.max_load_average > 0.0f) {
+  if (config_.max_load_average > 0.0f && !executor_) {
     int load_capacity = config_.max_load_average - GetLoadAverage();
     if (load_capacity < capacity)
       capacity = load_capacity;
   }
 
+  if (jobserver_ && !executor_) {
+    // Take as many tokens as there are commands to run, as far as the
+    // jobserver has them.
+    int64_t token_capacity = (int64_t)tokens_ + 1 - (int64_t)subproc_number;
+    while (token_capacity < capacity && jobserver_->Acquire()) {
+      ++tokens_;
+      ++token_capacity;
+    }
+    if (token_capacity < capacity)
+      capacity = token_capacity;
+  }
+
   if (capacity < 0)
     capacity = 0;
 
-  if (capacity == 0 && subprocs_.running_.empty())
+  if (capacity == 0 && subprocs_.running_.empty() &&
+      request_to_edge_.empty() && id_to_edge_.empty() &&
+      builtin_results_.empty())
     // Ensure that we make progress.
     capacity = 1;
 
@@ -642,8 +697,44 @@ size_t RealCommandRunner::CanRunMore() const {
 }
 
 bool RealCommandRunner::StartCommand(Edge* edge) {
+  string builtin = edge->GetBinding("builtin");
+  if (!builtin.empty()) {
+    vector<string> inputs, outputs;
+    for (size_t i = 0; i < edge->inputs_.size(); ++i) {
+      if (!edge->is_implicit(i) && !edge->is_order_only(i))
+        inputs.push_back(edge->inputs_[i]->path());
+    }
+    for (size_t i = 0; i < edge->outputs_.size(); ++i) {
+      if (!edge->is_implicit_out(i))
+        outputs.push_back(edge->outputs_[i]->path());
+    }
+
+    Result result;
+    result.edge = edge;
+    result.status = RunBuiltinCommand(builtin, inputs, outputs,
+                                      &result.output);
+    builtin_results_.push(result);
+    return true;
+  }
+
   string command = edge->EvaluateCommand();
-  Subprocess* subproc = subprocs_.Add(command, edge->use_console());
+
+  if (executor_ && !edge->use_console()) {
+    id_to_edge_.insert(make_pair(executor_->Start(command), edge));
+    return true;
+  }
+
+  string worker = edge->GetBinding("worker");
+  if (!worker.empty() && !edge->use_console()) {
+    if (WorkerRequest* request = workers_.Add(worker, command)) {
+      request_to_edge_.insert(make_pair(request, edge));
+      return true;
+    }
+    // Workers aren't supported here; run the command on its own.
+  }
+
+  Subprocess* subproc = subprocs_.Add(command, edge->use_console(),
+                                      edge->GetBindingBool("direct_exec"));
   if (!subproc)
     return false;
   subproc_to_edge_.insert(make_pair(subproc, edge));
@@ -651,22 +742,74 @@ bool RealCommandRunner::StartCommand(Edge* edge) {
   return true;
 }
 
-bool RealCommandRunner::WaitForCommand(Result* result) {
+void RealCommandRunner::Wake() {
+  woken_ = true;
+  subprocs_.Wake();
+}
+
+bool RealCommandRunner::WaitForCommand(Result* result,
+                                       int64_t timeout_millis) {
+  // Tokens taken for commands that were never started aren't needed while
+  // waiting.
+  ReleaseUnusedTokens();
+
+  if (!builtin_results_.empty()) {
+    swap(*result, builtin_results_.front());
+    builtin_results_.pop();
+    ReleaseUnusedTokens();
+    return true;
+  }
+
+  int64_t deadline_millis =
+      timeout_millis < 0 ? -1 : GetTimeMillis() + timeout_millis;
   Subprocess* subproc;
   while ((subproc = subprocs_.NextFinished()) == NULL) {
-    bool interrupted = subprocs_.DoWork();
+    int id;
+    if (executor_ &&
+        executor_->NextFinished(&id, &result->status, &result->output)) {
+      map<int, Edge*>::iterator e = id_to_edge_.find(id);
+      result->edge = e->second;
+      id_to_edge_.erase(e);
+      return true;
+    }
+
+    if (WorkerRequest* request = workers_.NextFinished()) {
+      result->status = request->status();
+      result->output = request->TakeOutput();
+
+      map<const WorkerRequest*, Edge*>::iterator e =
+          request_to_edge_.find(request);
+      result->edge = e->second;
+      request_to_edge_.erase(e);
+
+      delete request;
+      ReleaseUnusedTokens();
+      return true;
+    }
+
+    int64_t remaining_millis = -1;
+    if (deadline_millis >= 0)
+      remaining_millis = max<int64_t>(deadline_millis - GetTimeMillis(), 0);
+    if (woken_.exchange(false) || remaining_millis == 0) {
+      result->edge = NULL;
+      return true;
+    }
+
+    bool interrupted = subprocs_.DoWork(remaining_millis);
     if (interrupted)
       return false;
   }
 
   result->status = subproc->Finish();
-  result->output = subproc->GetOutput();
+  result->output = subproc->TakeOutput();
+  result->usage = subproc->usage();
 
   map<const Subprocess*, Edge*>::iterator e = subproc_to_edge_.find(subproc);
   result->edge = e->second;
   subproc_to_edge_.erase(e);
 
   delete subproc;
+  ReleaseUnusedTokens();
   return true;
 }
 
@@ -683,6 +826,23 @@ Builder::Builder(State* state, const BuildConfig& config, BuildLog* build_log,
   if (!build_dir.empty())
     lock_file_path_ = build_dir + "/" + lock_file_path_;
   status_->SetExplanations(explanations_.get());
+
+  if (!config_.action_cache_dir.empty() && !config_.dry_run) {
+    action_cache_.reset(new ActionCache(config_.action_cache_dir,
+                                        config_.action_cache_max_size));
+    string err;
+    if (!action_cache_->Open(&err)) {
+      Warning("action cache disabled: %s", err.c_str());
+      action_cache_.reset();
+    } else if (!config_.remote_cache_url.empty()) {
+      RemoteCache* remote = RemoteCache::Create(
+          config_.remote_cache_url, config_.remote_cache_timeout_ms, &err);
+      if (remote)
+        action_cache_->SetRemote(remote);
+      else
+        Warning("remote cache disabled: %s", err.c_str());
+    }
+  }
 }
 
 Builder::~Builder() {
@@ -779,7 +939,16 @@ bool Builder::Build(string* err) {
       command_runner_.reset(new DryRunCommandRunner);
     else
       command_runner_.reset(new RealCommandRunner(config_));
+
+    if (!config_.dry_run && !config_.executor.empty() &&
+        !static_cast<RealCommandRunner*>(command_runner_.get())
+             ->StartExecutor(config_.executor, err)) {
+      command_runner_.reset();
+      return false;
+    }
   }
+  if (action_cache_)
+    action_cache_->set_wake([this]() { command_runner_->Wake(); });
 
   // We are about to start the build process.
   status_->BuildStarted();
@@ -792,7 +961,7 @@ bool Builder::Build(string* err) {
   while (plan_.more_to_do()) {
     // See if we can start any more commands.
     if (failures_allowed) {
-      size_t capacity = command_runner_->CanRunMore();
+      size_t capacity = CanRunMore();
       while (capacity > 0) {
         Edge* edge = plan_.FindWork();
         if (!edge)
@@ -820,7 +989,7 @@ bool Builder::Build(string* err) {
           --capacity;
 
           // Re-evaluate capacity.
-          size_t current_capacity = command_runner_->CanRunMore();
+          size_t current_capacity = CanRunMore();
           if (current_capacity < capacity)
             capacity = current_capacity;
         }
@@ -833,14 +1002,33 @@ bool Builder::Build(string* err) {
 
     // See if we can reap any finished commands.
     if (pending_commands) {
+      if (!FinishRemoteRestores(err)) {
+        Cleanup();
+        status_->BuildFinished();
+        return false;
+      }
+
+      // Don't wait past the time the status is due to be refreshed, as
+      // no command may finish for a long time.
+      int64_t timeout_millis =
+          status_->RefreshTimeoutMillis(GetTimeMillis() - start_time_millis_);
       CommandRunner::Result result;
-      if (!command_runner_->WaitForCommand(&result) ||
-          result.status == ExitInterrupted) {
+      if (!cached_results_.empty()) {
+        swap(result, cached_results_.front());
+        cached_results_.pop();
+      } else if (!command_runner_->WaitForCommand(&result, timeout_millis) ||
+                 result.status == ExitInterrupted) {
         Cleanup();
         status_->BuildFinished();
         *err = "interrupted by user";
         return false;
       }
+      // Woken up by a remote lookup, which is reaped above, or by the
+      // timeout.
+      if (!result.edge) {
+        status_->Refresh(GetTimeMillis() - start_time_millis_);
+        continue;
+      }
 
       --pending_commands;
       if (!FinishCommand(&result, err)) {
@@ -877,6 +1065,34 @@ bool Builder::Build(string* err) {
   return true;
 }
 
+size_t Builder::CanRunMore() const {
+  size_t capacity = command_runner_->CanRunMore();
+  size_t lookups = action_cache_ ? action_cache_->remote_lookups() : 0;
+  return capacity > lookups ? capacity - lookups : 0;
+}
+
+bool Builder::FinishRemoteRestores(string* err) {
+  if (!action_cache_)
+    return true;
+  Edge* edge;
+  bool hit;
+  string output;
+  while (action_cache_->NextRemoteRestored(&edge, &hit, &output)) {
+    if (hit) {
+      CommandRunner::Result result;
+      result.edge = edge;
+      result.status = ExitSuccess;
+      result.cached = true;
+      result.output.swap(output);
+      cached_results_.push(result);
+    } else if (!command_runner_->StartCommand(edge)) {
+      err->assign("command '" + edge->EvaluateCommand() + "' failed.");
+      return false;
+    }
+  }
+  return true;
+}
+
 bool Builder::StartEdge(Edge* edge, string* err) {
   METRIC_RECORD("StartEdge");
   if (edge->is_phony())
@@ -886,6 +1102,7 @@ bool Builder::StartEdge(Edge* edge, string* err) {
   running_edges_.insert(make_pair(edge, start_time_millis));
 
   status_->BuildEdgeStarted(edge, start_time_millis);
+  NINJA_PROBE2(edge_start, edge->id_, edge->outputs_[0]->path().c_str());
 
   TimeStamp build_start = config_.dry_run ? 0 : -1;
 
@@ -915,6 +1132,21 @@ bool Builder::StartEdge(Edge* edge, string* err) {
       return false;
   }
 
+  // Restore the outputs instead if they are in the action cache.
+  if (action_cache_) {
+    CommandRunner::Result result;
+    if (action_cache_->Restore(edge, &result.output)) {
+      result.edge = edge;
+      result.status = ExitSuccess;
+      result.cached = true;
+      cached_results_.push(result);
+      return true;
+    }
+    // The command starts once the remote cache missed too.
+    if (action_cache_->StartRemoteRestore(edge))
+      return true;
+  }
+
   // start command computing and run it
   if (!command_runner_->StartCommand(edge)) {
     err->assign("command '" + edge->EvaluateCommand() + "' failed.");
@@ -929,6 +1161,11 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
 
   Edge* edge = result->edge;
 
+  // Whether or not it is cached, the command may have rewritten files that
+  // the action cache read as inputs of other edges.
+  if (action_cache_ && !result->cached)
+    action_cache_->ForgetOutputs(edge);
+
   // First try to extract dependencies from the result, if any.
   // This must happen first as it filters the command output (we want
   // to filter /showIncludes output, even on compile failure) and
@@ -937,9 +1174,20 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
   vector<Node*> deps_nodes;
   string deps_type = edge->GetBinding("deps");
   const string deps_prefix = edge->GetBinding("msvc_deps_prefix");
+
+  // The action cache keeps the output as the command printed it, and the
+  // depfile that deps=gcc removes.
+  bool store_in_cache = action_cache_ && !result->cached &&
+                        result->success() && !config_.dry_run &&
+                        ActionCache::IsCacheable(edge);
+  string raw_output, depfile_contents;
+  if (store_in_cache)
+    raw_output = result->output;
+
   if (!deps_type.empty()) {
     string extract_err;
     if (!ExtractDeps(result, deps_type, deps_prefix, &deps_nodes,
+                     store_in_cache ? &depfile_contents : NULL,
                      &extract_err) &&
         result->success()) {
       if (!result->output.empty())
@@ -956,7 +1204,10 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
   running_edges_.erase(it);
 
   status_->BuildEdgeFinished(edge, start_time_millis, end_time_millis,
-                             result->success(), result->output);
+                             result->usage, result->success(),
+                             result->output);
+  NINJA_PROBE3(edge_finish, edge->id_, edge->outputs_[0]->path().c_str(),
+               result->success());
 
   // The rest of this function only applies to successful commands.
   if (!result->success()) {
@@ -1009,7 +1260,8 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
 
   if (scan_.build_log()) {
     if (!scan_.build_log()->RecordCommand(edge, start_time_millis,
-                                          end_time_millis, record_mtime)) {
+                                          end_time_millis, record_mtime,
+                                          result->usage)) {
       *err = string("Error writing to build log: ") + strerror(errno);
       return false;
     }
@@ -1028,6 +1280,21 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
       }
     }
   }
+
+  if (store_in_cache && result->success()) {
+    // Without a deps type, the depfile is read on the next run; its deps
+    // must match for the cached outputs to be reused.
+    string cache_err;
+    if (deps_type.empty() && !edge->GetUnescapedDepfile().empty() &&
+        !LoadDepfileDeps(edge, &deps_nodes, NULL, &cache_err)) {
+      Warning("action cache: %s", cache_err.c_str());
+    } else if (!action_cache_->Store(
+                   edge, deps_nodes, raw_output,
+                   deps_type == "gcc" ? &depfile_contents : NULL,
+                   &cache_err)) {
+      Warning("action cache: %s", cache_err.c_str());
+    }
+  }
   return true;
 }
 
@@ -1035,13 +1302,14 @@ bool Builder::ExtractDeps(CommandRunner::Result* result,
                           const string& deps_type,
                           const string& deps_prefix,
                           vector<Node*>* deps_nodes,
+                          string* depfile_contents,
                           string* err) {
   if (deps_type == "msvc") {
     CLParser parser;
     string output;
     if (!parser.Parse(result->output, deps_prefix, &output, err))
       return false;
-    result->output = output;
+    result->output.swap(output);
     for (set<string>::iterator i = parser.includes_.begin();
          i != parser.includes_.end(); ++i) {
       // ~0 is assuming that with MSVC-parsed headers, it's ok to always make
@@ -1057,32 +1325,13 @@ bool Builder::ExtractDeps(CommandRunner::Result* result,
       return false;
     }
 
-    // Read depfile content.  Treat a missing depfile as empty.
     string content;
-    switch (disk_interface_->ReadFile(depfile, &content, err)) {
-    case DiskInterface::Okay:
-      break;
-    case DiskInterface::NotFound:
-      err->clear();
-      break;
-    case DiskInterface::OtherError:
+    if (!LoadDepfileDeps(result->edge, deps_nodes, &content, err))
       return false;
-    }
     if (content.empty())
       return true;
-
-    DepfileParser deps(config_.depfile_parser_options);
-    if (!deps.Parse(&content, err))
-      return false;
-
-    // XXX check depfile matches expected output.
-    deps_nodes->reserve(deps.ins_.size());
-    for (vector<StringPiece>::iterator i = deps.ins_.begin();
-         i != deps.ins_.end(); ++i) {
-      uint64_t slash_bits;
-      CanonicalizePath(const_cast<char*>(i->str_), &i->len_, &slash_bits);
-      deps_nodes->push_back(state_->GetNode(*i, slash_bits));
-    }
+    if (depfile_contents)
+      depfile_contents->swap(content);
 
     if (!g_keep_depfile) {
       if (disk_interface_->RemoveFile(depfile) < 0) {
@@ -1097,6 +1346,42 @@ bool Builder::ExtractDeps(CommandRunner::Result* result,
   return true;
 }
 
+bool Builder::LoadDepfileDeps(Edge* edge, vector<Node*>* deps_nodes,
+                              string* depfile_contents, string* err) {
+  string depfile = edge->GetUnescapedDepfile();
+
+  // Read depfile content.  Treat a missing depfile as empty.
+  string content;
+  switch (disk_interface_->ReadFile(depfile, &content, err)) {
+  case DiskInterface::Okay:
+    break;
+  case DiskInterface::NotFound:
+    err->clear();
+    break;
+  case DiskInterface::OtherError:
+    return false;
+  }
+  METRIC_COUNT("depfile bytes", content.size());
+  if (depfile_contents)
+    *depfile_contents = content;
+  if (content.empty())
+    return true;
+
+  DepfileParser deps(config_.depfile_parser_options);
+  if (!deps.Parse(&content, err))
+    return false;
+
+  // XXX check depfile matches expected output.
+  deps_nodes->reserve(deps_nodes->size() + deps.ins_.size());
+  for (vector<StringPiece>::iterator i = deps.ins_.begin();
+       i != deps.ins_.end(); ++i) {
+    uint64_t slash_bits;
+    CanonicalizePath(const_cast<char*>(i->str_), &i->len_, &slash_bits);
+    deps_nodes->push_back(state_->GetNode(*i, slash_bits));
+  }
+  return true;
+}
+
 bool Builder::LoadDyndeps(Node* node, string* err) {
   // Load the dyndep information provided by this node.
   DyndepFile ddf;
@@ -18,14 +18,17 @@
 #include <cstdio>
 #include <map>
 #include <memory>
+#include <queue>
 #include <string>
 #include <vector>
 
 #include "depfile_parser.h"
 #include "exit_status.h"
 #include "graph.h"
+#include "resource_usage.h"
 #include "util.h"  // int64_t
 
+struct ActionCache;
 struct BuildLog;
 struct Builder;
 struct DiskInterface;
@@ -84,6 +87,18 @@ struct Plan {
   bool DyndepsLoaded(DependencyScan* scan, const Node* node,
                      const DyndepFile& ddf, std::string* err);
 
+  /// How ComputeCriticalPath() weighs the edges for the ready queue to
+  /// start those on the longest chains first.
+  enum CriticalPathWeight {
+    /// All commands weigh the same.
+    kWeightByCount,
+    /// Commands weigh what they took in the previous build, at least 1 ms.
+    kWeightByTime
+  };
+  void set_critical_path_weight(CriticalPathWeight weight) {
+    critical_path_weight_ = weight;
+  }
+
   /// Enumerate possible steps we want for an edge.
   enum Want
   {
@@ -139,6 +154,8 @@ private:
 
   /// Total remaining number of wanted edges.
   int wanted_edges_;
+
+  CriticalPathWeight critical_path_weight_;
 };
 
 /// CommandRunner is an interface that wraps running the build
@@ -151,14 +168,22 @@ struct CommandRunner {
 
   /// The result of waiting for a command.
   struct Result {
-    Result() : edge(NULL) {}
+    Result() : edge(NULL), cached(false) {}
     Edge* edge;
     ExitStatus status;
     std::string output;
+    ResourceUsage usage;
+    /// Whether the outputs were restored from a cache rather than built.
+    bool cached;
     bool success() const { return status == ExitSuccess; }
   };
   /// Wait for a command to complete, or return false if interrupted.
-  virtual bool WaitForCommand(Result* result) = 0;
+  /// Returns true without an edge after |timeout_millis|, unless it is
+  /// negative.
+  virtual bool WaitForCommand(Result* result, int64_t timeout_millis) = 0;
+  /// Make WaitForCommand() return true without an edge.  May be called
+  /// from any thread.
+  virtual void Wake() {}
 
   virtual std::vector<Edge*> GetActiveEdges() { return std::vector<Edge*>(); }
   virtual void Abort() {}
@@ -167,7 +192,9 @@ struct CommandRunner {
 /// Options (e.g. verbosity, parallelism) passed to a build.
 struct BuildConfig {
   BuildConfig() : verbosity(NORMAL), dry_run(false), parallelism(1),
-                  failures_allowed(1), max_load_average(-0.0f) {}
+                  failures_allowed(1), max_load_average(-0.0f),
+                  async_logs(false), action_cache_max_size(10LL << 30),
+                  remote_cache_timeout_ms(10000) {}
 
   enum Verbosity {
     QUIET,  // No output -- used when testing.
@@ -182,6 +209,18 @@ struct BuildConfig {
   /// The maximum load average we must not exceed. A negative value
   /// means that we do not have any limit.
   double max_load_average;
+  /// Whether the build and deps logs are written, and recompacted if
+  /// needed, by background threads.
+  bool async_logs;
+  /// Directory of the local action cache, or empty for none.
+  std::string action_cache_dir;
+  /// Size in bytes over which the action cache is trimmed.
+  int64_t action_cache_max_size;
+  /// URL of a remote cache shared through the action cache, or empty.
+  std::string remote_cache_url;
+  int remote_cache_timeout_ms;
+  /// Command starting an external executor to run commands, or empty.
+  std::string executor;
   DepfileParserOptions depfile_parser_options;
 };
 
@@ -229,9 +268,27 @@ struct Builder {
   Status* status_;
 
  private:
+  /// Find the deps of a finished command.  For deps=gcc, the contents of
+  /// the depfile are kept in |depfile_contents| if it isn't NULL, as the
+  /// file is removed.
   bool ExtractDeps(CommandRunner::Result* result, const std::string& deps_type,
                    const std::string& deps_prefix,
-                   std::vector<Node*>* deps_nodes, std::string* err);
+                   std::vector<Node*>* deps_nodes,
+                   std::string* depfile_contents, std::string* err);
+
+  /// Read the deps in the depfile of |edge|, of which there are none if it
+  /// is missing.  Keeps the contents of the file in |depfile_contents| if
+  /// it isn't NULL.
+  bool LoadDepfileDeps(Edge* edge, std::vector<Node*>* deps_nodes,
+                       std::string* depfile_contents, std::string* err);
+
+  /// Number of commands that may start now.  Remote lookups of the action
+  /// cache hold a slot each, as the command runs in it on a miss.
+  size_t CanRunMore() const;
+
+  /// Queue the edges restored by the finished remote lookups to be reaped,
+  /// and start the commands of those that missed.
+  bool FinishRemoteRestores(std::string* err);
 
   /// Map of running edge to time the edge started running.
   typedef std::map<const Edge*, int> RunningEdgeMap;
@@ -248,6 +305,12 @@ struct Builder {
 
   DependencyScan scan_;
 
+  /// The local action cache, if enabled.
+  std::unique_ptr<ActionCache> action_cache_;
+  /// Results of the edges restored from |action_cache_|, to be reaped like
+  /// those of commands.
+  std::queue<CommandRunner::Result> cached_results_;
+
   // Unimplemented copy ctor and operator= ensure we don't copy the auto_ptr.
   Builder(const Builder &other);        // DO NOT IMPLEMENT
   void operator=(const Builder &other); // DO NOT IMPLEMENT
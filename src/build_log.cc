@@ -23,19 +23,27 @@
 #include "build_log.h"
 #include "disk_interface.h"
 
+#include <algorithm>
 #include <cassert>
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <thread>
 
 #ifndef _WIN32
 #include <inttypes.h>
 #include <unistd.h>
+#elif defined(_MSC_VER) && (_MSC_VER < 1900)
+typedef __int32 int32_t;
+typedef unsigned __int32 uint32_t;
 #endif
 
 #include "build.h"
 #include "graph.h"
+#include "log_writer.h"
 #include "metrics.h"
+#include "probes.h"
 #include "util.h"
 #if defined(_MSC_VER) && (_MSC_VER < 1800)
 #define strtoll _strtoi64
@@ -49,12 +57,40 @@ using namespace std;
 // older runs.
 // Once the number of redundant entries exceeds a threshold, we write
 // out a new file and replace the existing one with it.
+// The binary format (kBinaryVersion) shares the text header line, so that
+// older versions of ninja report it as "too new" and start over.
 
 namespace {
 
 const char kFileSignature[] = "# ninja log v%d\n";
 const int kOldestSupportedVersion = 6;
 const int kCurrentVersion = 6;
+const int kBinaryVersion = 7;
+
+// Record size is limited to less than the full 32 bit, as in the deps log.
+const unsigned kMaxBinaryRecordSize = (1 << 19) - 1;
+
+// [path id, start time, end time, mtime, command hash, resource usage]
+const unsigned kEntryRecordSize = 4 + 4 + 4 + 8 + 8 + 5 * 4;
+// Entry records from before resource usage was recorded.
+const unsigned kEntryRecordSizeWithoutUsage = 4 + 4 + 4 + 8 + 8;
+// [-1], marking the start of a build.
+const unsigned kBuildRecordSize = 4;
+const int32_t kBuildRecordId = -1;
+
+// The resource usage fields, in the order they are serialized.
+const size_t kUsageFieldCount = 5;
+void GetUsageFields(ResourceUsage* usage, int** fields) {
+  fields[0] = &usage->user_time_millis;
+  fields[1] = &usage->system_time_millis;
+  fields[2] = &usage->max_rss_kb;
+  fields[3] = &usage->input_blocks;
+  fields[4] = &usage->output_blocks;
+}
+
+void AppendBytes(const void* data, size_t size, string* out) {
+  out->append(static_cast<const char*>(data), size);
+}
 
 // 64bit MurmurHash2, by Austin Appleby
 #if defined(_MSC_VER)
@@ -107,22 +143,49 @@ uint64_t MurmurHash64A(const void* key, size_t len) {
 
 }  // namespace
 
+/// A recompaction running concurrently with the build.
+struct BuildLog::BackgroundRecompaction {
+  ~BackgroundRecompaction() {
+    for (Entries::iterator i = log.entries_.begin(); i != log.entries_.end();
+         ++i)
+      delete i->second;
+  }
+
+  string path;
+  string temp_path;
+  /// Copies of the live entries, in the path id space of the new file.
+  BuildLog log;
+  /// Entries recorded since the copy was taken.
+  vector<LogEntry*> recorded;
+
+  /// Result of the helper thread.
+  bool success;
+  string err;
+  std::thread thread;
+};
+
 // static
 uint64_t BuildLog::LogEntry::HashCommand(StringPiece command) {
   return MurmurHash64A(command.str_, command.len_);
 }
 
 BuildLog::LogEntry::LogEntry(const string& output)
-  : output(output) {}
+  : output(output), command_hash(0), start_time(0), end_time(0), mtime(0),
+    path_id(-1) {}
 
 BuildLog::LogEntry::LogEntry(const string& output, uint64_t command_hash,
   int start_time, int end_time, TimeStamp mtime)
   : output(output), command_hash(command_hash),
-    start_time(start_time), end_time(end_time), mtime(mtime)
+    start_time(start_time), end_time(end_time), mtime(mtime), path_id(-1)
 {}
 
 BuildLog::BuildLog()
-  : log_file_(NULL), needs_recompaction_(false) {}
+  : generation_(0), log_file_(NULL), needs_recompaction_(false), binary_(false),
+    next_path_id_(0), writer_(NULL), recompact_in_background_(false),
+    keep_last_build_(false), last_build_approximate_(false),
+    last_end_time_(0), build_started_(false) {
+  InvalidateCachedEntries();
+}
 
 BuildLog::~BuildLog() {
   Close();
@@ -131,23 +194,30 @@ BuildLog::~BuildLog() {
 bool BuildLog::OpenForWrite(const string& path, const BuildLogUser& user,
                             string* err) {
   if (needs_recompaction_) {
-    if (!Recompact(path, user, err))
+    if (recompact_in_background_) {
+      if (!StartRecompaction(path, user, err))
+        return false;
+    } else if (!Recompact(path, user, err)) {
       return false;
+    }
   }
 
   assert(!log_file_);
   log_file_path_ = path;  // we don't actually open the file right now, but will
                           // do so on the first write attempt
+  build_started_ = false;
   return true;
 }
 
 bool BuildLog::RecordCommand(Edge* edge, int start_time, int end_time,
-                             TimeStamp mtime) {
-  string command = edge->EvaluateCommand(true);
-  uint64_t command_hash = LogEntry::HashCommand(command);
+                             TimeStamp mtime, const ResourceUsage& usage) {
+  uint64_t command_hash = edge->GetCommandHash();
+  vector<LogEntry*> log_entries;
+  log_entries.reserve(edge->outputs_.size());
   for (vector<Node*>::iterator out = edge->outputs_.begin();
        out != edge->outputs_.end(); ++out) {
     const string& path = (*out)->path();
+    NINJA_PROBE1(build_log_write, path.c_str());
     Entries::iterator i = entries_.find(path);
     LogEntry* log_entry;
     if (i != entries_.end()) {
@@ -160,16 +230,38 @@ bool BuildLog::RecordCommand(Edge* edge, int start_time, int end_time,
     log_entry->start_time = start_time;
     log_entry->end_time = end_time;
     log_entry->mtime = mtime;
+    log_entry->usage = usage;
+    (*out)->set_log_entry(log_entry, generation_);
+    log_entries.push_back(log_entry);
+    if (recompaction_)
+      recompaction_->recorded.push_back(log_entry);
+  }
 
-    if (!OpenForWriteIfNeeded()) {
-      return false;
+  if (!OpenForWriteIfNeeded()) {
+    return false;
+  }
+  if (log_file_) {
+    // Write all outputs of the edge with a single call, so that an
+    // interrupted build leaves at most one partial record behind.
+    string records;
+    SerializeBuildStart(&records);
+    for (vector<LogEntry*>::iterator i = log_entries.begin();
+         i != log_entries.end(); ++i) {
+      if (!SerializeEntry(*i, &records))
+        return false;
     }
-    if (log_file_) {
-      if (!WriteEntry(log_file_, *log_entry))
+    if (writer_) {
+      if (int error = writer_->error()) {
+        errno = error;
         return false;
-      if (fflush(log_file_) != 0) {
-          return false;
       }
+      writer_->Append(log_file_, &records);
+      return true;
+    }
+    if (fwrite(records.data(), records.size(), 1, log_file_) < 1)
+      return false;
+    if (fflush(log_file_) != 0) {
+        return false;
     }
   }
   return true;
@@ -177,9 +269,146 @@ bool BuildLog::RecordCommand(Edge* edge, int start_time, int end_time,
 
 void BuildLog::Close() {
   OpenForWriteIfNeeded();  // create the file even if nothing has been recorded
-  if (log_file_)
+  if (log_file_) {
+    if (writer_)
+      writer_->Flush();
     fclose(log_file_);
+  }
   log_file_ = NULL;
+
+  if (recompaction_) {
+    string err;
+    if (!FinishRecompaction(&err))
+      Warning("build log recompaction failed: %s", err.c_str());
+  }
+}
+
+bool BuildLog::StartRecompaction(const string& path, const BuildLogUser& user,
+                                 string* err) {
+  METRIC_RECORD(".ninja_log start recompaction");
+
+  Close();
+  recompaction_.reset(new BackgroundRecompaction);
+  BackgroundRecompaction* r = recompaction_.get();
+  r->path = path;
+  r->temp_path = path + ".recompact";
+  r->log.binary_ = binary_;
+
+  // Deciding what is dead needs the graph, so do it here on the main thread.
+  vector<StringPiece> dead_outputs;
+  for (Entries::iterator i = entries_.begin(); i != entries_.end(); ++i) {
+    if (user.IsPathDead(i->first)) {
+      dead_outputs.push_back(i->first);
+      continue;
+    }
+    LogEntry* entry = new LogEntry(*i->second);
+    entry->path_id = -1;
+    r->log.entries_.insert(Entries::value_type(entry->output, entry));
+  }
+  for (size_t i = 0; i < dead_outputs.size(); ++i)
+    entries_.erase(dead_outputs[i]);
+  InvalidateCachedEntries();
+
+  r->success = false;
+  r->thread = std::thread([r]() {
+    FILE* f = fopen(r->temp_path.c_str(), "wb");
+    if (!f) {
+      r->err = strerror(errno);
+      return;
+    }
+    bool success = r->log.WriteHeader(f);
+    for (Entries::iterator i = r->log.entries_.begin();
+         success && i != r->log.entries_.end(); ++i) {
+      success = r->log.WriteEntry(f, i->second);
+    }
+    if (!success)
+      r->err = strerror(errno);
+    if (fclose(f) != 0 && success) {
+      r->err = strerror(errno);
+      success = false;
+    }
+    r->success = success;
+  });
+  return true;
+}
+
+bool BuildLog::FinishRecompaction(string* err) {
+  METRIC_RECORD(".ninja_log finish recompaction");
+
+  std::unique_ptr<BackgroundRecompaction> r;
+  r.swap(recompaction_);
+  r->thread.join();
+  if (!r->success) {
+    *err = r->err;
+    unlink(r->temp_path.c_str());
+    return false;
+  }
+
+  // Append what the build recorded meanwhile; the old file has it already.
+  sort(r->recorded.begin(), r->recorded.end());
+  r->recorded.erase(unique(r->recorded.begin(), r->recorded.end()),
+                    r->recorded.end());
+  FILE* f = fopen(r->temp_path.c_str(), "ab");
+  if (!f) {
+    *err = strerror(errno);
+    unlink(r->temp_path.c_str());
+    return false;
+  }
+  string records;
+  if (!r->recorded.empty())
+    r->log.SerializeBuildStart(&records);
+  for (vector<LogEntry*>::iterator i = r->recorded.begin();
+       i != r->recorded.end(); ++i) {
+    LogEntry* entry = r->log.LookupByOutput((*i)->output);
+    if (!entry) {
+      entry = new LogEntry((*i)->output);
+      r->log.entries_.insert(Entries::value_type(entry->output, entry));
+    }
+    int path_id = entry->path_id;
+    *entry = **i;
+    entry->path_id = path_id;
+    if (!r->log.SerializeEntry(entry, &records)) {
+      *err = strerror(errno);
+      fclose(f);
+      unlink(r->temp_path.c_str());
+      return false;
+    }
+  }
+  if (!records.empty() &&
+      fwrite(records.data(), records.size(), 1, f) < 1) {
+    *err = strerror(errno);
+    fclose(f);
+    unlink(r->temp_path.c_str());
+    return false;
+  }
+  if (fclose(f) != 0) {
+    *err = strerror(errno);
+    unlink(r->temp_path.c_str());
+    return false;
+  }
+
+#ifdef _WIN32
+  // Windows can't rename onto an existing file.  Elsewhere, rename()
+  // swaps the files atomically, so a crash leaves one of them in place.
+  if (unlink(r->path.c_str()) < 0) {
+    *err = strerror(errno);
+    return false;
+  }
+#endif
+  if (rename(r->temp_path.c_str(), r->path.c_str()) < 0) {
+    *err = strerror(errno);
+    return false;
+  }
+
+  // Later appends go to the new file, so adopt its path ids.
+  for (Entries::iterator i = entries_.begin(); i != entries_.end(); ++i) {
+    Entries::iterator new_entry = r->log.entries_.find(i->first);
+    i->second->path_id =
+        new_entry != r->log.entries_.end() ? new_entry->second->path_id : -1;
+  }
+  next_path_id_ = r->log.next_path_id_;
+  needs_recompaction_ = false;
+  return true;
 }
 
 bool BuildLog::OpenForWriteIfNeeded() {
@@ -190,7 +419,9 @@ bool BuildLog::OpenForWriteIfNeeded() {
   if (!log_file_) {
     return false;
   }
-  if (setvbuf(log_file_, NULL, _IOLBF, BUFSIZ) != 0) {
+  // RecordCommand() flushes explicitly after each edge, and line buffering
+  // would split binary records at arbitrary bytes.
+  if (setvbuf(log_file_, NULL, _IOFBF, BUFSIZ) != 0) {
     return false;
   }
   SetCloseOnExec(fileno(log_file_));
@@ -200,13 +431,25 @@ bool BuildLog::OpenForWriteIfNeeded() {
   fseek(log_file_, 0, SEEK_END);
 
   if (ftell(log_file_) == 0) {
-    if (fprintf(log_file_, kFileSignature, kCurrentVersion) < 0) {
+    ResetPathIds();
+    if (!WriteHeader(log_file_)) {
       return false;
     }
   }
   return true;
 }
 
+bool BuildLog::WriteHeader(FILE* f) {
+  return fprintf(f, kFileSignature,
+                 binary_ ? kBinaryVersion : kCurrentVersion) > 0;
+}
+
+void BuildLog::ResetPathIds() {
+  for (Entries::iterator i = entries_.begin(); i != entries_.end(); ++i)
+    i->second->path_id = -1;
+  next_path_id_ = 0;
+}
+
 struct LineReader {
   explicit LineReader(FILE* file)
     : file_(file), buf_end_(buf_), line_start_(buf_), line_end_(NULL) {
@@ -258,9 +501,21 @@ struct LineReader {
   char* line_end_;
 };
 
+void BuildLog::NoteLoadedEntry(LogEntry* entry) {
+  // Without build records, guess: entries are appended as commands finish,
+  // so their end times only grow within a build, and an earlier one starts
+  // the next build.
+  if (last_build_approximate_ && !last_build_.empty() &&
+      entry->end_time < last_end_time_)
+    last_build_.clear();
+  last_build_.push_back(entry);
+  last_end_time_ = entry->end_time;
+}
+
 LoadStatus BuildLog::Load(const string& path, string* err) {
   METRIC_RECORD(".ninja_log load");
-  FILE* file = fopen(path.c_str(), "r");
+  NINJA_PROBE_SCOPE(build_log_load, path.c_str());
+  FILE* file = fopen(path.c_str(), "rb");
   if (!file) {
     if (errno == ENOENT)
       return LOAD_NOT_FOUND;
@@ -268,7 +523,24 @@ LoadStatus BuildLog::Load(const string& path, string* err) {
     return LOAD_ERROR;
   }
 
+  InvalidateCachedEntries();
+  ResetPathIds();
+  last_build_.clear();
+  last_build_approximate_ = true;
   int log_version = 0;
+  char header[64];
+  if (fgets(header, sizeof(header), file))
+    sscanf(header, kFileSignature, &log_version);
+  if (log_version == kBinaryVersion) {
+    binary_ = true;
+    LoadStatus status = LoadBinary(file, path, err);
+    fclose(file);
+    return status;
+  }
+  binary_ = false;
+  rewind(file);
+  log_version = 0;
+
   int unique_entry_count = 0;
   int total_entry_count = 0;
 
@@ -353,7 +625,19 @@ LoadStatus BuildLog::Load(const string& path, string* err) {
     entry->mtime = mtime;
     char c = *end; *end = '\0';
     entry->command_hash = (uint64_t)strtoull(start, NULL, 16);
+    // Resource usage fields are optional and follow the hash.
+    entry->usage = ResourceUsage();
+    start = static_cast<char*>(memchr(start, kFieldSeparator, end - start));
+    int* fields[kUsageFieldCount];
+    GetUsageFields(&entry->usage, fields);
+    for (size_t f = 0; start && f < kUsageFieldCount; ++f) {
+      *fields[f] = strtol(start + 1, &start, 10);
+      if (*start != kFieldSeparator)
+        break;
+    }
     *end = c;
+    if (keep_last_build_)
+      NoteLoadedEntry(entry);
   }
   fclose(file);
 
@@ -376,6 +660,148 @@ LoadStatus BuildLog::Load(const string& path, string* err) {
   return LOAD_SUCCESS;
 }
 
+LoadStatus BuildLog::LoadBinary(FILE* file, const string& path, string* err) {
+  // Entries indexed by path id, and whether each one is in |entries_| yet.
+  // An entry is only added once an entry record refers to its path.
+  vector<LogEntry*> path_entries;
+  vector<bool> path_entry_added;
+  int unique_entry_count = 0;
+  int total_entry_count = 0;
+
+  string buf;
+  long offset;
+  bool read_failed = false;
+  for (;;) {
+    offset = ftell(file);
+
+    uint32_t size;
+    if (fread(&size, 4, 1, file) < 1) {
+      // A partial size field must be truncated, or appends would be
+      // misaligned.
+      if (!feof(file) || ftell(file) != offset)
+        read_failed = true;
+      break;
+    }
+    bool is_entry = (size >> 31) != 0;
+    size = size & 0x7FFFFFFF;
+
+    if (size > kMaxBinaryRecordSize || size < 4 || size % 4 != 0) {
+      read_failed = true;
+      break;
+    }
+    buf.resize(size);
+    if (fread(&buf[0], size, 1, file) < 1) {
+      read_failed = true;
+      break;
+    }
+
+    if (is_entry) {
+      int32_t id;
+      memcpy(&id, &buf[0], 4);
+      if (size == kBuildRecordSize && id == kBuildRecordId) {
+        last_build_.clear();
+        last_build_approximate_ = false;
+        continue;
+      }
+      if ((size != kEntryRecordSize &&
+           size != kEntryRecordSizeWithoutUsage) ||
+          id < 0 || id >= (int)path_entries.size()) {
+        read_failed = true;
+        break;
+      }
+      LogEntry* entry = path_entries[id];
+      int32_t start_time, end_time;
+      memcpy(&start_time, &buf[4], 4);
+      memcpy(&end_time, &buf[8], 4);
+      memcpy(&entry->mtime, &buf[12], 8);
+      memcpy(&entry->command_hash, &buf[20], 8);
+      entry->start_time = start_time;
+      entry->end_time = end_time;
+      entry->usage = ResourceUsage();
+      if (size == kEntryRecordSize) {
+        int* fields[kUsageFieldCount];
+        GetUsageFields(&entry->usage, fields);
+        for (size_t f = 0; f < kUsageFieldCount; ++f)
+          memcpy(fields[f], &buf[28 + 4 * f], 4);
+      }
+
+      if (!path_entry_added[id]) {
+        path_entry_added[id] = true;
+        if (entries_.insert(Entries::value_type(entry->output, entry)).second)
+          ++unique_entry_count;
+      }
+      ++total_entry_count;
+      if (keep_last_build_)
+        NoteLoadedEntry(entry);
+    } else {
+      int path_size = size - 4;
+      // There can be up to 3 bytes of padding.
+      if (path_size > 0 && buf[path_size - 1] == '\0') --path_size;
+      if (path_size > 0 && buf[path_size - 1] == '\0') --path_size;
+      if (path_size > 0 && buf[path_size - 1] == '\0') --path_size;
+
+      // Check that the expected index matches the actual index, as in the
+      // deps log.  This catches concurrent writers and garbage records.
+      uint32_t checksum;
+      memcpy(&checksum, &buf[size - 4], 4);
+      int expected_id = ~checksum;
+      int id = path_entries.size();
+      if (path_size == 0 || id != expected_id) {
+        read_failed = true;
+        break;
+      }
+
+      string output(buf.data(), path_size);
+      Entries::iterator i = entries_.find(output);
+      LogEntry* entry;
+      if (i != entries_.end()) {
+        entry = i->second;
+        path_entry_added.push_back(true);
+      } else {
+        entry = new LogEntry(output);
+        path_entry_added.push_back(false);
+      }
+      entry->path_id = id;
+      path_entries.push_back(entry);
+    }
+  }
+
+  // Drop paths whose entry records never made it into the file.
+  for (size_t id = 0; id < path_entries.size(); ++id) {
+    if (!path_entry_added[id])
+      delete path_entries[id];
+  }
+  next_path_id_ = path_entries.size();
+
+  if (read_failed) {
+    // An error occurred while loading; try to recover by truncating the
+    // file to the last fully-read record.
+    if (ferror(file)) {
+      *err = strerror(ferror(file));
+    } else {
+      *err = "premature end of file";
+    }
+
+    if (!Truncate(path, offset, err))
+      return LOAD_ERROR;
+
+    // The truncate succeeded; we'll just report the load error as a
+    // warning because the build can proceed.
+    *err += "; recovering";
+    return LOAD_SUCCESS;
+  }
+
+  // Rebuild the log if it's getting large, as for the text format.
+  int kMinCompactionEntryCount = 100;
+  int kCompactionRatio = 3;
+  if (total_entry_count > kMinCompactionEntryCount &&
+      total_entry_count > unique_entry_count * kCompactionRatio) {
+    needs_recompaction_ = true;
+  }
+
+  return LOAD_SUCCESS;
+}
+
 BuildLog::LogEntry* BuildLog::LookupByOutput(const string& path) {
   Entries::iterator i = entries_.find(path);
   if (i != entries_.end())
@@ -383,10 +809,86 @@ BuildLog::LogEntry* BuildLog::LookupByOutput(const string& path) {
   return NULL;
 }
 
-bool BuildLog::WriteEntry(FILE* f, const LogEntry& entry) {
-  return fprintf(f, "%d\t%d\t%" PRId64 "\t%s\t%" PRIx64 "\n",
-          entry.start_time, entry.end_time, entry.mtime,
-          entry.output.c_str(), entry.command_hash) > 0;
+BuildLog::LogEntry* BuildLog::LookupByOutput(Node* output) {
+  if (output->log_entry_generation() != generation_)
+    output->set_log_entry(LookupByOutput(output->path()), generation_);
+  return output->log_entry();
+}
+
+void BuildLog::InvalidateCachedEntries() {
+  static uint64_t next_generation = 1;
+  generation_ = next_generation++;
+}
+
+void BuildLog::SerializeBuildStart(string* out) {
+  if (build_started_)
+    return;
+  build_started_ = true;
+  if (!binary_)
+    return;
+  uint32_t size = kBuildRecordSize | 0x80000000;
+  AppendBytes(&size, 4, out);
+  AppendBytes(&kBuildRecordId, 4, out);
+}
+
+bool BuildLog::SerializeEntry(LogEntry* entry, string* out) {
+  if (!binary_) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%d\t%d\t%" PRId64 "\t",
+             entry->start_time, entry->end_time, entry->mtime);
+    out->append(buf);
+    out->append(entry->output);
+    snprintf(buf, sizeof(buf), "\t%" PRIx64, entry->command_hash);
+    out->append(buf);
+    if (!entry->usage.empty()) {
+      const ResourceUsage& usage = entry->usage;
+      snprintf(buf, sizeof(buf), "\t%d\t%d\t%d\t%d\t%d",
+               usage.user_time_millis, usage.system_time_millis,
+               usage.max_rss_kb, usage.input_blocks, usage.output_blocks);
+      out->append(buf);
+    }
+    out->append("\n");
+    return true;
+  }
+
+  if (entry->path_id < 0) {
+    unsigned path_size = entry->output.size();
+    unsigned padding = (4 - path_size % 4) % 4;  // Pad path to 4 byte boundary.
+    uint32_t size = path_size + padding + 4;
+    if (size > kMaxBinaryRecordSize) {
+      errno = ERANGE;
+      return false;
+    }
+    AppendBytes(&size, 4, out);
+    out->append(entry->output);
+    out->append(padding, '\0');
+    entry->path_id = next_path_id_++;
+    uint32_t checksum = ~(uint32_t)entry->path_id;
+    AppendBytes(&checksum, 4, out);
+  }
+
+  uint32_t size = kEntryRecordSize | 0x80000000;
+  int32_t id = entry->path_id;
+  int32_t start_time = entry->start_time;
+  int32_t end_time = entry->end_time;
+  AppendBytes(&size, 4, out);
+  AppendBytes(&id, 4, out);
+  AppendBytes(&start_time, 4, out);
+  AppendBytes(&end_time, 4, out);
+  AppendBytes(&entry->mtime, 8, out);
+  AppendBytes(&entry->command_hash, 8, out);
+  int* fields[kUsageFieldCount];
+  GetUsageFields(&entry->usage, fields);
+  for (size_t f = 0; f < kUsageFieldCount; ++f)
+    AppendBytes(fields[f], 4, out);
+  return true;
+}
+
+bool BuildLog::WriteEntry(FILE* f, LogEntry* entry) {
+  string record;
+  if (!SerializeEntry(entry, &record))
+    return false;
+  return fwrite(record.data(), record.size(), 1, f) == 1;
 }
 
 bool BuildLog::Recompact(const string& path, const BuildLogUser& user,
@@ -401,7 +903,8 @@ bool BuildLog::Recompact(const string& path, const BuildLogUser& user,
     return false;
   }
 
-  if (fprintf(f, kFileSignature, kCurrentVersion) < 0) {
+  ResetPathIds();
+  if (!WriteHeader(f)) {
     *err = strerror(errno);
     fclose(f);
     return false;
@@ -414,7 +917,7 @@ bool BuildLog::Recompact(const string& path, const BuildLogUser& user,
       continue;
     }
 
-    if (!WriteEntry(f, *i->second)) {
+    if (!WriteEntry(f, i->second)) {
       *err = strerror(errno);
       fclose(f);
       return false;
@@ -423,6 +926,7 @@ bool BuildLog::Recompact(const string& path, const BuildLogUser& user,
 
   for (size_t i = 0; i < dead_outputs.size(); ++i)
     entries_.erase(dead_outputs[i]);
+  InvalidateCachedEntries();
 
   fclose(f);
   if (unlink(path.c_str()) < 0) {
@@ -452,7 +956,8 @@ bool BuildLog::Restat(const StringPiece path,
     return false;
   }
 
-  if (fprintf(f, kFileSignature, kCurrentVersion) < 0) {
+  ResetPathIds();
+  if (!WriteHeader(f)) {
     *err = strerror(errno);
     fclose(f);
     return false;
@@ -474,7 +979,7 @@ bool BuildLog::Restat(const StringPiece path,
       i->second->mtime = mtime;
     }
 
-    if (!WriteEntry(f, *i->second)) {
+    if (!WriteEntry(f, i->second)) {
       *err = strerror(errno);
       fclose(f);
       return false;
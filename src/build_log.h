@@ -15,16 +15,21 @@
 #ifndef NINJA_BUILD_LOG_H_
 #define NINJA_BUILD_LOG_H_
 
+#include <memory>
 #include <string>
+#include <vector>
 #include <stdio.h>
 
 #include "hash_map.h"
 #include "load_status.h"
+#include "resource_usage.h"
 #include "timestamp.h"
 #include "util.h"  // uint64_t
 
 struct DiskInterface;
 struct Edge;
+struct LogWriter;
+struct Node;
 
 /// Can answer questions about the manifest for the BuildLog.
 struct BuildLogUser {
@@ -40,6 +45,23 @@ struct BuildLogUser {
 ///    when we need to rebuild due to the command changing
 /// 2) timing information, perhaps for generating reports
 /// 3) restat information
+///
+/// The log is stored either as tab-separated text, or in a binary format
+/// that is cheaper to parse and append to.  The binary format is modeled
+/// after the deps log: a version header followed by a sequence of records,
+/// each prefixed by four bytes of record length, with the high bit set for
+/// entry records.
+///   path records contain the output path, padded to 4 bytes, followed by
+///     the one's complement of the path's index in the file;
+///   entry records are fixed-width: [path id, start time, end time,
+///     mtime (8 bytes), command hash (8 bytes), user time, system time,
+///     max rss, input blocks, output blocks];
+///   build records have -1 in place of the path id and nothing else, and
+///     come before the entries of each build.
+/// In the text format, the resource usage fields follow the command hash
+/// when the platform reported any, so older readers skip them.
+/// Appends keep the format of the existing file; Recompact() rewrites the
+/// file in the format selected by set_binary().
 struct BuildLog {
   BuildLog();
   ~BuildLog();
@@ -49,18 +71,39 @@ struct BuildLog {
   bool OpenForWrite(const std::string& path, const BuildLogUser& user,
                     std::string* err);
   bool RecordCommand(Edge* edge, int start_time, int end_time,
-                     TimeStamp mtime = 0);
+                     TimeStamp mtime = 0,
+                     const ResourceUsage& usage = ResourceUsage());
   void Close();
 
   /// Load the on-disk log.
   LoadStatus Load(const std::string& path, std::string* err);
 
+  /// Whether the log is written in the binary format.  Load() sets this
+  /// to match the file it read.
+  bool binary() const { return binary_; }
+  void set_binary(bool binary) { binary_ = binary; }
+
+  /// Hand records to |writer| instead of writing them on the calling
+  /// thread.  Close() waits for them to reach the file.
+  void set_writer(LogWriter* writer) { writer_ = writer; }
+
+  /// If set, a recompaction needed by OpenForWrite() runs in a helper
+  /// thread while the build appends to the old file.  Close() merges the
+  /// records appended meanwhile and swaps the new file in.
+  void set_recompact_in_background(bool background) {
+    recompact_in_background_ = background;
+  }
+
   struct LogEntry {
     std::string output;
     uint64_t command_hash;
     int start_time;
     int end_time;
     TimeStamp mtime;
+    ResourceUsage usage;
+    /// Index of the path record for |output| in a binary log file,
+    /// or -1 if none has been written yet.
+    int path_id;
 
     static uint64_t HashCommand(StringPiece command);
 
@@ -68,7 +111,7 @@ struct BuildLog {
     bool operator==(const LogEntry& o) const {
       return output == o.output && command_hash == o.command_hash &&
           start_time == o.start_time && end_time == o.end_time &&
-          mtime == o.mtime;
+          mtime == o.mtime && usage == o.usage;
     }
 
     explicit LogEntry(const std::string& output);
@@ -76,11 +119,23 @@ struct BuildLog {
              int start_time, int end_time, TimeStamp mtime);
   };
 
+  /// If set, Load() keeps the entries of the last build in the log, in the
+  /// order they were recorded, for tools that look into that build.
+  void set_keep_last_build(bool keep) { keep_last_build_ = keep; }
+  const std::vector<LogEntry*>& last_build() const { return last_build_; }
+  /// Whether last_build() was guessed from the entries' times rather than
+  /// split off at a build record, which only the binary format has.  The
+  /// guess merges builds whose commands' times happen to keep growing.
+  bool last_build_approximate() const { return last_build_approximate_; }
+
   /// Lookup a previously-run command by its output path.
   LogEntry* LookupByOutput(const std::string& path);
+  /// Like LookupByOutput(output->path()), but the result is cached on
+  /// |output| so that repeated scans don't hash the path again.
+  LogEntry* LookupByOutput(Node* output);
 
   /// Serialize an entry into a log file.
-  bool WriteEntry(FILE* f, const LogEntry& entry);
+  bool WriteEntry(FILE* f, LogEntry* entry);
 
   /// Rewrite the known log entries, throwing away old data.
   bool Recompact(const std::string& path, const BuildLogUser& user,
@@ -98,10 +153,56 @@ struct BuildLog {
   /// will be set.
   bool OpenForWriteIfNeeded();
 
+  /// Write the version header for the current format to |f|.
+  bool WriteHeader(FILE* f);
+
+  /// Append the serialized form of |entry| to |out|.
+  bool SerializeEntry(LogEntry* entry, std::string* out);
+
+  /// Parse the records of a binary log, positioned right after the header.
+  LoadStatus LoadBinary(FILE* file, const std::string& path, std::string* err);
+
+  /// Forget all path ids, before starting a new binary log file.
+  void ResetPathIds();
+
+  /// Note that Load() read |entry|, for last_build().
+  void NoteLoadedEntry(LogEntry* entry);
+
+  /// Append a build record to |out| if the current build has none yet.
+  void SerializeBuildStart(std::string* out);
+
+  struct BackgroundRecompaction;
+
+  /// Start writing the live entries to a new file in a helper thread.
+  bool StartRecompaction(const std::string& path, const BuildLogUser& user,
+                         std::string* err);
+  /// Wait for the helper thread, append the entries recorded since it
+  /// started and replace the log file with the new one.
+  bool FinishRecompaction(std::string* err);
+
+  /// Bumped whenever entries may have been added or removed other than
+  /// through RecordCommand(), invalidating the entries cached on nodes.
+  /// Unique across logs, so a node never trusts another log's entry.
+  void InvalidateCachedEntries();
+
   Entries entries_;
+  uint64_t generation_;
   FILE* log_file_;
   std::string log_file_path_;
   bool needs_recompaction_;
+  bool binary_;
+  /// Id to assign to the next path record of a binary log.
+  int next_path_id_;
+  LogWriter* writer_;
+  bool recompact_in_background_;
+  std::unique_ptr<BackgroundRecompaction> recompaction_;
+  bool keep_last_build_;
+  std::vector<LogEntry*> last_build_;
+  bool last_build_approximate_;
+  /// End time of the last entry Load() read.
+  int last_end_time_;
+  /// Whether the build since OpenForWrite() has its build record.
+  bool build_started_;
 };
 
 #endif // NINJA_BUILD_LOG_H_
@@ -72,6 +72,78 @@ TEST_F(BuildLogTest, WriteRead) {
   ASSERT_EQ("out", e1->output);
 }
 
+TEST_F(BuildLogTest, LastBuild) {
+  AssertParse(&state_,
+"build out: cat mid\n"
+"build mid: cat in\n");
+
+  BuildLog log1;
+  string err;
+  EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+  ASSERT_EQ("", err);
+  // A first build of both, then a second one of "out" only.
+  log1.RecordCommand(state_.edges_[1], 10, 20);
+  log1.RecordCommand(state_.edges_[0], 20, 30);
+  log1.RecordCommand(state_.edges_[0], 0, 5);
+  log1.Close();
+
+  BuildLog log2;
+  log2.set_keep_last_build(true);
+  EXPECT_TRUE(log2.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(1u, log2.last_build().size());
+  EXPECT_EQ("out", log2.last_build()[0]->output);
+  EXPECT_EQ(5, log2.last_build()[0]->end_time);
+  // The text format has no build records, so this was a guess.
+  EXPECT_TRUE(log2.last_build_approximate());
+
+  // Not kept unless asked for.
+  BuildLog log3;
+  EXPECT_TRUE(log3.Load(kTestFilename, &err));
+  EXPECT_TRUE(log3.last_build().empty());
+}
+
+TEST_F(BuildLogTest, LastBuildBinary) {
+  AssertParse(&state_,
+"build out: cat mid\n"
+"build mid: cat in\n");
+
+  // Two builds whose times keep growing, as for "ninja mid; ninja out",
+  // which only the build records tell apart.
+  string err;
+  {
+    BuildLog log1;
+    log1.set_binary(true);
+    EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+    log1.RecordCommand(state_.edges_[1], 0, 10);
+    log1.Close();
+  }
+  {
+    BuildLog log1;
+    EXPECT_TRUE(log1.Load(kTestFilename, &err));
+    EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+    log1.RecordCommand(state_.edges_[0], 20, 30);
+    log1.Close();
+  }
+  {
+    // A build without commands leaves the last one alone.
+    BuildLog log1;
+    EXPECT_TRUE(log1.Load(kTestFilename, &err));
+    EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+    log1.Close();
+  }
+
+  BuildLog log2;
+  log2.set_keep_last_build(true);
+  EXPECT_TRUE(log2.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  ASSERT_TRUE(log2.binary());
+  EXPECT_EQ(2u, log2.entries().size());
+  ASSERT_EQ(1u, log2.last_build().size());
+  EXPECT_EQ("out", log2.last_build()[0]->output);
+  EXPECT_FALSE(log2.last_build_approximate());
+}
+
 TEST_F(BuildLogTest, FirstWriteAddsSignature) {
   const char kExpectedVersion[] = "# ninja log vX\n";
   const size_t kVersionPos = strlen(kExpectedVersion) - 2;  // Points at 'X'.
@@ -325,6 +397,245 @@ TEST_F(BuildLogTest, MultiTargetEdge) {
   ASSERT_EQ(22, e2->end_time);
 }
 
+TEST_F(BuildLogTest, BinaryWriteRead) {
+  AssertParse(&state_,
+"build out: cat mid\n"
+"build mid: cat in\n");
+
+  string err;
+  {
+    BuildLog log1;
+    log1.set_binary(true);
+    EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+    log1.RecordCommand(state_.edges_[0], 15, 18, 123);
+    log1.RecordCommand(state_.edges_[1], 20, 25);
+    log1.Close();
+  }
+
+  // Append to the existing file; the format is taken from the file, and
+  // the path of "mid" must not be written again.
+  {
+    BuildLog log2;
+    EXPECT_TRUE(log2.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    ASSERT_TRUE(log2.binary());
+    EXPECT_TRUE(log2.OpenForWrite(kTestFilename, *this, &err));
+    log2.RecordCommand(state_.edges_[1], 30, 35);
+    log2.Close();
+  }
+
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+  EXPECT_EQ(0u, contents.find("# ninja log v7\n"));
+  EXPECT_EQ(contents.find("mid"), contents.rfind("mid"));
+
+  BuildLog log3;
+  EXPECT_TRUE(log3.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  ASSERT_TRUE(log3.binary());
+  ASSERT_EQ(2u, log3.entries().size());
+  BuildLog::LogEntry* e = log3.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  ASSERT_EQ(15, e->start_time);
+  ASSERT_EQ(18, e->end_time);
+  ASSERT_EQ(123, e->mtime);
+  ASSERT_NO_FATAL_FAILURE(AssertHash("cat mid > out", e->command_hash));
+  e = log3.LookupByOutput("mid");
+  ASSERT_TRUE(e);
+  ASSERT_EQ(30, e->start_time);
+  ASSERT_EQ(35, e->end_time);
+}
+
+TEST_F(BuildLogTest, BinaryTruncate) {
+  AssertParse(&state_,
+"build out: cat mid\n"
+"build mid: cat in\n");
+
+  string err;
+  {
+    BuildLog log1;
+    log1.set_binary(true);
+    EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+    log1.RecordCommand(state_.edges_[0], 15, 18);
+    log1.RecordCommand(state_.edges_[1], 20, 25);
+    log1.Close();
+  }
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+
+  // For all possible truncations of the binary records, assert that loading
+  // recovers the complete records and that appending afterwards works.
+  const size_t kHeaderSize = strlen("# ninja log v7\n");
+  for (size_t size = contents.size(); size > kHeaderSize; --size) {
+    FILE* f = fopen(kTestFilename, "wb");
+    ASSERT_TRUE(f);
+    ASSERT_EQ(1u, fwrite(contents.data(), size, 1, f));
+    fclose(f);
+
+    BuildLog log2;
+    err.clear();
+    ASSERT_EQ(LOAD_SUCCESS, log2.Load(kTestFilename, &err));
+    ASSERT_TRUE(log2.binary());
+    EXPECT_TRUE(log2.OpenForWrite(kTestFilename, *this, &err));
+    log2.RecordCommand(state_.edges_[1], 30, 35);
+    log2.Close();
+
+    BuildLog log3;
+    err.clear();
+    ASSERT_EQ(LOAD_SUCCESS, log3.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    BuildLog::LogEntry* e = log3.LookupByOutput("mid");
+    ASSERT_TRUE(e);
+    ASSERT_EQ(30, e->start_time);
+  }
+}
+
+TEST_F(BuildLogTest, ConvertFormat) {
+  AssertParse(&state_,
+"build out: cat mid\n"
+"build mid: cat in\n");
+
+  string err;
+  {
+    BuildLog log1;
+    EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+    log1.RecordCommand(state_.edges_[0], 15, 18, 42);
+    log1.RecordCommand(state_.edges_[1], 20, 25);
+    log1.Close();
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    bool binary = i == 0;
+    BuildLog log2;
+    EXPECT_TRUE(log2.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    ASSERT_EQ(!binary, log2.binary());
+    log2.set_binary(binary);
+    ASSERT_TRUE(log2.Recompact(kTestFilename, *this, &err));
+
+    BuildLog log3;
+    EXPECT_TRUE(log3.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    ASSERT_EQ(binary, log3.binary());
+    ASSERT_EQ(2u, log3.entries().size());
+    BuildLog::LogEntry* e = log3.LookupByOutput("out");
+    ASSERT_TRUE(e);
+    ASSERT_TRUE(*e == *log2.LookupByOutput("out"));
+    ASSERT_EQ(42, e->mtime);
+  }
+}
+
+TEST_F(BuildLogTest, CachedLookup) {
+  AssertParse(&state_,
+"build out: cat mid\n"
+"build mid: cat in\n");
+  Node* out = state_.GetNode("out", 0);
+  Node* mid = state_.GetNode("mid", 0);
+
+  string err;
+  {
+    BuildLog log1;
+    EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+    log1.RecordCommand(state_.edges_[0], 15, 18);
+    log1.Close();
+  }
+
+  BuildLog log;
+  EXPECT_TRUE(log.LookupByOutput(out) == NULL);
+  EXPECT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+
+  // Loading invalidates the negative result cached above.
+  BuildLog::LogEntry* e = log.LookupByOutput(out);
+  ASSERT_TRUE(e);
+  EXPECT_EQ(e, log.LookupByOutput(out));
+  EXPECT_EQ(state_.edges_[0]->GetCommandHash(), e->command_hash);
+  ASSERT_NO_FATAL_FAILURE(AssertHash("cat mid > out", e->command_hash));
+
+  // Recording a command updates the cached entry of its outputs.
+  EXPECT_TRUE(log.LookupByOutput(mid) == NULL);
+  log.RecordCommand(state_.edges_[1], 20, 25);
+  e = log.LookupByOutput(mid);
+  ASSERT_TRUE(e);
+  EXPECT_EQ(e, log.LookupByOutput("mid"));
+
+  // Another log doesn't see the entries cached for this one.
+  BuildLog other;
+  EXPECT_TRUE(other.LookupByOutput(mid) == NULL);
+}
+
+TEST_F(BuildLogTest, ResourceUsage) {
+  AssertParse(&state_,
+"build out: cat mid\n"
+"build mid: cat in\n");
+
+  ResourceUsage usage;
+  usage.user_time_millis = 1200;
+  usage.system_time_millis = 340;
+  usage.max_rss_kb = 56789;
+  usage.input_blocks = 7;
+  usage.output_blocks = 8;
+
+  for (int i = 0; i < 2; ++i) {
+    bool binary = i == 1;
+    string err;
+    {
+      BuildLog log1;
+      log1.set_binary(binary);
+      EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+      ASSERT_EQ("", err);
+      log1.RecordCommand(state_.edges_[0], 15, 18, 0, usage);
+      log1.RecordCommand(state_.edges_[1], 20, 25);
+      log1.Close();
+    }
+
+    BuildLog log2;
+    EXPECT_TRUE(log2.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    BuildLog::LogEntry* e = log2.LookupByOutput("out");
+    ASSERT_TRUE(e);
+    EXPECT_TRUE(usage == e->usage);
+    ASSERT_NO_FATAL_FAILURE(AssertHash("cat mid > out", e->command_hash));
+    e = log2.LookupByOutput("mid");
+    ASSERT_TRUE(e);
+    EXPECT_TRUE(e->usage.empty());
+
+    unlink(kTestFilename);
+  }
+}
+
+TEST_F(BuildLogTest, ResourceUsageInTextLog) {
+  // Usage fields follow the hash; a partial set is tolerated.
+  FILE* f = fopen(kTestFilename, "wb");
+  fprintf(f, "# ninja log v6\n");
+  fprintf(f, "1\t2\t3\tout\t%" PRIx64 "\t100\t20\t3000\t4\t5\n",
+      BuildLog::LogEntry::HashCommand("command"));
+  fprintf(f, "1\t2\t3\tout2\t%" PRIx64 "\t100\t20\n",
+      BuildLog::LogEntry::HashCommand("command2"));
+  fclose(f);
+
+  string err;
+  BuildLog log;
+  EXPECT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+
+  BuildLog::LogEntry* e = log.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  ASSERT_NO_FATAL_FAILURE(AssertHash("command", e->command_hash));
+  EXPECT_EQ(100, e->usage.user_time_millis);
+  EXPECT_EQ(20, e->usage.system_time_millis);
+  EXPECT_EQ(3000, e->usage.max_rss_kb);
+  EXPECT_EQ(4, e->usage.input_blocks);
+  EXPECT_EQ(5, e->usage.output_blocks);
+
+  e = log.LookupByOutput("out2");
+  ASSERT_TRUE(e);
+  ASSERT_NO_FATAL_FAILURE(AssertHash("command2", e->command_hash));
+  EXPECT_EQ(20, e->usage.system_time_millis);
+  EXPECT_EQ(0, e->usage.max_rss_kb);
+}
+
 struct BuildLogRecompactTest : public BuildLogTest {
   virtual bool IsPathDead(StringPiece s) const { return s == "out2"; }
 };
@@ -365,4 +676,61 @@ TEST_F(BuildLogRecompactTest, Recompact) {
   ASSERT_FALSE(log2.LookupByOutput("out2"));
 }
 
+TEST_F(BuildLogRecompactTest, RecompactInBackground) {
+  AssertParse(&state_,
+"build out: cat in\n"
+"build out2: cat in\n"
+"build out3: cat in\n");
+
+  for (int binary = 0; binary < 2; ++binary) {
+    unlink(kTestFilename);
+    string err;
+    {
+      BuildLog log1;
+      log1.set_binary(binary);
+      EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+      for (int i = 0; i < 200; ++i)
+        log1.RecordCommand(state_.edges_[0], 15, 18 + i);
+      log1.RecordCommand(state_.edges_[1], 21, 22);
+      log1.Close();
+    }
+
+    // The recompaction runs while more commands are recorded.
+    {
+      BuildLog log2;
+      EXPECT_TRUE(log2.Load(kTestFilename, &err));
+      ASSERT_EQ("", err);
+      log2.set_recompact_in_background(true);
+      EXPECT_TRUE(log2.OpenForWrite(kTestFilename, *this, &err));
+      ASSERT_EQ("", err);
+      log2.RecordCommand(state_.edges_[0], 30, 31);
+      log2.RecordCommand(state_.edges_[2], 40, 41);
+      log2.Close();
+      ASSERT_EQ(2u, log2.entries().size());
+
+      // Appends after the swap go to the new file.
+      log2.RecordCommand(state_.edges_[2], 50, 51);
+      log2.Close();
+    }
+
+    BuildLog log3;
+    EXPECT_TRUE(log3.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    ASSERT_EQ(binary != 0, log3.binary());
+    ASSERT_EQ(2u, log3.entries().size());
+    BuildLog::LogEntry* e = log3.LookupByOutput("out");
+    ASSERT_TRUE(e);
+    ASSERT_EQ(30, e->start_time);
+    ASSERT_FALSE(log3.LookupByOutput("out2"));
+    e = log3.LookupByOutput("out3");
+    ASSERT_TRUE(e);
+    ASSERT_EQ(50, e->start_time);
+
+    // The file no longer needs recompaction.
+    string contents;
+    ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+    ASSERT_LT(contents.size(), 400u);
+  }
+}
+
 }  // anonymous namespace
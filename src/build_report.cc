@@ -0,0 +1,273 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "build_report.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+
+#include "critical_path.h"
+#include "graph.h"
+#include "json.h"
+
+using namespace std;
+
+const int BuildReport::kTimelineBuckets = 20;
+
+namespace {
+
+bool SlowerCommand(const BuildReport::Command& a,
+                   const BuildReport::Command& b) {
+  return a.duration_millis() > b.duration_millis();
+}
+
+bool LongerGap(const BuildReport::Gap& a, const BuildReport::Gap& b) {
+  return a.end_millis - a.start_millis > b.end_millis - b.start_millis;
+}
+
+bool SlowerRule(const BuildReport::RuleTotal& a,
+                const BuildReport::RuleTotal& b) {
+  return a.millis > b.millis;
+}
+
+double Seconds(int64_t millis) {
+  return millis / 1000.0;
+}
+
+double Percent(int64_t part, int64_t whole) {
+  return whole ? 100.0 * part / whole : 0;
+}
+
+}  // anonymous namespace
+
+void BuildReport::Analyze(DepsLog* deps_log) {
+  wall_millis_ = command_millis_ = cpu_millis_ = 0;
+  peak_parallelism_ = 0;
+  critical_path_millis_ = underused_millis_ = 0;
+  gaps_.clear();
+  rules_.clear();
+  timeline_.clear();
+  if (commands_.empty())
+    return;
+
+  // Sweep the starts and ends of the commands in time order, ends first
+  // at the same time, counting the commands running in between.
+  vector<pair<int, int> > events;
+  map<string, RuleTotal> rules;
+  int first_start = commands_[0].start_millis;
+  int last_end = commands_[0].end_millis;
+  for (vector<Command>::const_iterator c = commands_.begin();
+       c != commands_.end(); ++c) {
+    events.push_back(make_pair(c->start_millis, 1));
+    events.push_back(make_pair(c->end_millis, -1));
+    first_start = min(first_start, c->start_millis);
+    last_end = max(last_end, c->end_millis);
+    command_millis_ += c->duration_millis();
+    cpu_millis_ += c->cpu_millis;
+
+    string rule = c->rule.empty() ? "(unknown)" : c->rule;
+    RuleTotal& total = rules[rule];
+    total.rule = rule;
+    ++total.count;
+    total.millis += c->duration_millis();
+  }
+  wall_millis_ = last_end - first_start;
+  sort(events.begin(), events.end());
+
+  int running = 0;
+  int64_t gap_job_millis = 0;
+  Gap gap = { -1, -1, 0 };
+  for (size_t i = 0; i < events.size(); ++i) {
+    int time = events[i].first;
+    if (i > 0 && time > events[i - 1].first) {
+      int last = events[i - 1].first;
+      if (running < parallelism_) {
+        if (gap.start_millis < 0)
+          gap.start_millis = last;
+        gap.end_millis = time;
+        gap_job_millis += (int64_t)running * (time - last);
+        underused_millis_ += time - last;
+      } else if (gap.start_millis >= 0) {
+        gap.average_jobs =
+            (double)gap_job_millis / (gap.end_millis - gap.start_millis);
+        gaps_.push_back(gap);
+        gap.start_millis = -1;
+        gap_job_millis = 0;
+      }
+    }
+    running += events[i].second;
+    peak_parallelism_ = max(peak_parallelism_, running);
+  }
+  if (gap.start_millis >= 0) {
+    gap.average_jobs =
+        (double)gap_job_millis / (gap.end_millis - gap.start_millis);
+    gaps_.push_back(gap);
+  }
+  sort(gaps_.begin(), gaps_.end(), LongerGap);
+
+  if (wall_millis_ > 0) {
+    double width = (double)wall_millis_ / kTimelineBuckets;
+    timeline_.resize(kTimelineBuckets);
+    for (vector<Command>::const_iterator c = commands_.begin();
+         c != commands_.end(); ++c) {
+      for (int b = 0; b < kTimelineBuckets; ++b) {
+        double bucket_start = first_start + b * width;
+        double overlap = min((double)c->end_millis, bucket_start + width) -
+                         max((double)c->start_millis, bucket_start);
+        if (overlap > 0)
+          timeline_[b] += overlap / width;
+      }
+    }
+  }
+
+  // Edges that didn't run in the build take no time, but the path goes on
+  // through them.
+  CriticalPath critical_path(deps_log);
+  for (vector<Command>::const_iterator c = commands_.begin();
+       c != commands_.end(); ++c) {
+    if (c->edge) {
+      critical_path.SetDuration(c->edge, c->duration_millis());
+      critical_path.AddTarget(c->edge->outputs_[0]);
+    } else {
+      critical_path_millis_ = max(critical_path_millis_,
+                                  (int64_t)c->duration_millis());
+    }
+  }
+  critical_path.Analyze();
+  critical_path_millis_ = max(critical_path_millis_, critical_path.length_);
+
+  for (map<string, RuleTotal>::const_iterator r = rules.begin();
+       r != rules.end(); ++r) {
+    rules_.push_back(r->second);
+  }
+  sort(rules_.begin(), rules_.end(), SlowerRule);
+  stable_sort(commands_.begin(), commands_.end(), SlowerCommand);
+}
+
+void BuildReport::PrintText(size_t top_count) const {
+  if (commands_.empty()) {
+    printf("no commands in the build log\n");
+    return;
+  }
+
+  printf("last build: %zu commands\n", commands_.size());
+  if (approximate_) {
+    printf("(approximate: a text log doesn't mark where builds start, so this "
+           "may include\nearlier builds; see ninja -t logformat)\n");
+  }
+  printf("\n");
+  printf("wall time      %10.1f s\n", Seconds(wall_millis_));
+  printf("command time   %10.1f s  sum of the commands' durations\n",
+         Seconds(command_millis_));
+  if (cpu_millis_)
+    printf("cpu time       %10.1f s  user and system\n", Seconds(cpu_millis_));
+  printf("parallelism    %10.1f    average, %d peak, -j %d\n",
+         wall_millis_ ? (double)command_millis_ / wall_millis_ : 0,
+         peak_parallelism_, parallelism_);
+  printf("critical path  %10.1f s  %.0f%% of wall time\n",
+         Seconds(critical_path_millis_),
+         Percent(critical_path_millis_, wall_millis_));
+  printf("under -j       %10.1f s  %.0f%% of wall time\n",
+         Seconds(underused_millis_), Percent(underused_millis_, wall_millis_));
+
+  if (!timeline_.empty()) {
+    printf("\nparallelism over time:\n");
+    for (size_t b = 0; b < timeline_.size(); ++b) {
+      int bar = parallelism_ > 0
+                    ? (int)(40 * min(timeline_[b], (double)parallelism_) /
+                            parallelism_ + 0.5)
+                    : 0;
+      printf("%8.1f s  %5.1f  %s\n",
+             Seconds(wall_millis_ * b / kTimelineBuckets), timeline_[b],
+             string(bar, '#').c_str());
+    }
+  }
+
+  if (!gaps_.empty()) {
+    printf("\nlongest periods under -j:\n");
+    for (size_t i = 0; i < gaps_.size() && i < top_count; ++i) {
+      printf("%8.1f s  from %.1f s, %.1f jobs on average\n",
+             Seconds(gaps_[i].end_millis - gaps_[i].start_millis),
+             Seconds(gaps_[i].start_millis), gaps_[i].average_jobs);
+    }
+  }
+
+  printf("\nslowest commands:\n");
+  for (size_t i = 0; i < commands_.size() && i < top_count; ++i) {
+    const Command& command = commands_[i];
+    printf("%8.1f s  %s", Seconds(command.duration_millis()),
+           command.name.c_str());
+    if (!command.rule.empty())
+      printf(" (%s)", command.rule.c_str());
+    printf("\n");
+  }
+
+  printf("\nslowest rules:\n");
+  for (size_t i = 0; i < rules_.size() && i < top_count; ++i) {
+    printf("%8.1f s  %s, %d commands, %.0f ms on average\n",
+           Seconds(rules_[i].millis), rules_[i].rule.c_str(), rules_[i].count,
+           (double)rules_[i].millis / rules_[i].count);
+  }
+}
+
+void BuildReport::PrintJSON(size_t top_count) const {
+  printf("{\n  \"commands\": %zu,\n", commands_.size());
+  printf("  \"approximate\": %s,\n", approximate_ ? "true" : "false");
+  printf("  \"parallelism\": %d,\n", parallelism_);
+  printf("  \"wall_ms\": %" PRId64 ",\n", wall_millis_);
+  printf("  \"command_ms\": %" PRId64 ",\n", command_millis_);
+  printf("  \"cpu_ms\": %" PRId64 ",\n", cpu_millis_);
+  printf("  \"average_parallelism\": %.2f,\n",
+         wall_millis_ ? (double)command_millis_ / wall_millis_ : 0);
+  printf("  \"peak_parallelism\": %d,\n", peak_parallelism_);
+  printf("  \"critical_path_ms\": %" PRId64 ",\n", critical_path_millis_);
+  printf("  \"underused_ms\": %" PRId64 ",\n", underused_millis_);
+
+  printf("  \"timeline\": [");
+  for (size_t b = 0; b < timeline_.size(); ++b)
+    printf("%s%.2f", b ? ", " : "", timeline_[b]);
+  printf("],\n");
+
+  printf("  \"gaps\": [");
+  for (size_t i = 0; i < gaps_.size() && i < top_count; ++i) {
+    printf("%s\n    {\"start_ms\": %d, \"end_ms\": %d, \"average_jobs\": %.2f}",
+           i ? "," : "", gaps_[i].start_millis, gaps_[i].end_millis,
+           gaps_[i].average_jobs);
+  }
+  printf("\n  ],\n");
+
+  printf("  \"slowest_commands\": [");
+  for (size_t i = 0; i < commands_.size() && i < top_count; ++i) {
+    const Command& command = commands_[i];
+    printf("%s\n    {\"name\": \"", i ? "," : "");
+    PrintJSONString(command.name);
+    printf("\", \"rule\": \"");
+    PrintJSONString(command.rule);
+    printf("\", \"start_ms\": %d, \"end_ms\": %d}", command.start_millis,
+           command.end_millis);
+  }
+  printf("\n  ],\n");
+
+  printf("  \"slowest_rules\": [");
+  for (size_t i = 0; i < rules_.size() && i < top_count; ++i) {
+    printf("%s\n    {\"rule\": \"", i ? "," : "");
+    PrintJSONString(rules_[i].rule);
+    printf("\", \"commands\": %d, \"ms\": %" PRId64 "}", rules_[i].count,
+           rules_[i].millis);
+  }
+  printf("\n  ]\n}\n");
+}
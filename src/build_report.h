@@ -0,0 +1,106 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_BUILD_REPORT_H_
+#define NINJA_BUILD_REPORT_H_
+
+#include <string>
+#include <vector>
+
+#include "util.h"  // int64_t
+
+struct DepsLog;
+struct Edge;
+
+/// Summary of how well a build used the machine, from the commands it ran
+/// as recorded in .ninja_log: for `ninja -t report`.
+struct BuildReport {
+  /// A command of the build.
+  struct Command {
+    Command() : start_millis(0), end_millis(0), cpu_millis(0), edge(NULL) {}
+
+    int duration_millis() const { return end_millis - start_millis; }
+
+    /// The command's first output.
+    std::string name;
+    /// Empty if the manifest no longer has the command.
+    std::string rule;
+    int start_millis;
+    int end_millis;
+    /// User and system CPU time, 0 if the log doesn't have it.
+    int cpu_millis;
+    /// The edge of the command in the manifest, if any.
+    const Edge* edge;
+  };
+
+  /// A period in which fewer commands than |parallelism| ran.
+  struct Gap {
+    int start_millis;
+    int end_millis;
+    /// Average number of commands that ran during the period.
+    double average_jobs;
+  };
+
+  /// Time taken by all the commands of a rule.
+  struct RuleTotal {
+    std::string rule;
+    int count;
+    int64_t millis;
+  };
+
+  /// Number of periods of the build for which the timeline gives the
+  /// average parallelism.
+  static const int kTimelineBuckets;
+
+  /// |parallelism| is the number of commands that could have run at once.
+  explicit BuildReport(int parallelism)
+      : parallelism_(parallelism), approximate_(false) {}
+
+  void AddCommand(const Command& command) { commands_.push_back(command); }
+
+  /// Compute the summary.  Dependencies recorded in |deps_log|, which can be
+  /// NULL, count for the critical path in addition to the manifest's.
+  void Analyze(DepsLog* deps_log);
+
+  /// Print the summary to stdout, listing the |top_count| slowest commands,
+  /// rules and longest gaps.
+  void PrintText(size_t top_count) const;
+  void PrintJSON(size_t top_count) const;
+
+  int parallelism_;
+  /// Whether the commands may be those of more than one build, as told by
+  /// BuildLog::last_build_approximate().
+  bool approximate_;
+  /// Slowest first once analyzed.
+  std::vector<Command> commands_;
+
+  // Results of Analyze().
+  int64_t wall_millis_;
+  /// Sum of the durations of the commands.
+  int64_t command_millis_;
+  int64_t cpu_millis_;
+  int peak_parallelism_;
+  /// Longest chain of dependent commands.
+  int64_t critical_path_millis_;
+  /// Time with fewer than |parallelism_| commands running.
+  int64_t underused_millis_;
+  /// Longest first.
+  std::vector<Gap> gaps_;
+  /// Slowest first.
+  std::vector<RuleTotal> rules_;
+  /// Average parallelism over each of kTimelineBuckets periods.
+  std::vector<double> timeline_;
+};
+
+#endif  // NINJA_BUILD_REPORT_H_
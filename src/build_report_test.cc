@@ -0,0 +1,102 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "build_report.h"
+
+#include "graph.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+struct BuildReportTest : public StateTestWithBuiltinRules {
+  void Add(BuildReport* report, const char* output, int start, int end) {
+    BuildReport::Command command;
+    command.name = output;
+    command.start_millis = start;
+    command.end_millis = end;
+    Node* node = state_.LookupNode(output);
+    if (node && node->in_edge()) {
+      command.edge = node->in_edge();
+      command.rule = command.edge->rule().name();
+    }
+    report->AddCommand(command);
+  }
+};
+
+}  // anonymous namespace
+
+TEST_F(BuildReportTest, Empty) {
+  BuildReport report(4);
+  report.Analyze(NULL);
+  EXPECT_EQ(0, report.wall_millis_);
+  EXPECT_EQ(0, report.critical_path_millis_);
+  EXPECT_TRUE(report.timeline_.empty());
+}
+
+TEST_F(BuildReportTest, Utilization) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat in\n"
+"build c: cat a b\n");
+
+  // a and b run together, then c runs alone.
+  BuildReport report(2);
+  Add(&report, "a", 0, 100);
+  Add(&report, "b", 0, 40);
+  Add(&report, "c", 100, 300);
+  report.Analyze(NULL);
+
+  EXPECT_EQ(300, report.wall_millis_);
+  EXPECT_EQ(340, report.command_millis_);
+  EXPECT_EQ(2, report.peak_parallelism_);
+  EXPECT_EQ(300, report.critical_path_millis_);
+  EXPECT_EQ(260, report.underused_millis_);
+
+  ASSERT_EQ(1u, report.gaps_.size());
+  EXPECT_EQ(40, report.gaps_[0].start_millis);
+  EXPECT_EQ(300, report.gaps_[0].end_millis);
+  EXPECT_DOUBLE_EQ(1.0, report.gaps_[0].average_jobs);
+
+  ASSERT_EQ((size_t)BuildReport::kTimelineBuckets, report.timeline_.size());
+  EXPECT_DOUBLE_EQ(2.0, report.timeline_[0]);
+  EXPECT_DOUBLE_EQ(1.0, report.timeline_[BuildReport::kTimelineBuckets - 1]);
+
+  ASSERT_EQ(3u, report.commands_.size());
+  EXPECT_EQ("c", report.commands_[0].name);
+  EXPECT_EQ("a", report.commands_[1].name);
+  ASSERT_EQ(1u, report.rules_.size());
+  EXPECT_EQ("cat", report.rules_[0].rule);
+  EXPECT_EQ(3, report.rules_[0].count);
+}
+
+TEST_F(BuildReportTest, CriticalPathThroughEdgesThatDidNotRun) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat a\n"
+"build c: cat b\n"
+"build d: cat in\n");
+
+  // b was up to date, but c still waited for a.
+  BuildReport report(4);
+  Add(&report, "a", 0, 50);
+  Add(&report, "c", 50, 80);
+  Add(&report, "d", 0, 70);
+  Add(&report, "gone", 0, 10);
+  report.Analyze(NULL);
+
+  EXPECT_EQ(80, report.critical_path_millis_);
+  EXPECT_EQ("(unknown)", report.rules_.back().rule);
+}
@@ -0,0 +1,133 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "build_simulator.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <queue>
+
+#include "graph.h"
+#include "metrics.h"
+#include "state.h"
+
+using namespace std;
+
+bool BuildSimulator::Run(const vector<Node*>& targets, int parallelism,
+                         Plan::CriticalPathWeight weight, string* err) {
+  METRIC_RECORD("simulate build");
+  parallelism_ = parallelism;
+  wall_millis_ = command_millis_ = 0;
+  commands_ = unknown_commands_ = 0;
+  pools_.clear();
+
+  // Pretend that every output is missing, and that dyndep files hold
+  // nothing more than the manifest says.
+  state_->Reset();
+  map<const Rule*, pair<int64_t, int> > rule_totals;
+  for (Edge* edge : state_->edges_) {
+    for (Node* output : edge->outputs_)
+      output->MarkDirty();
+    if (edge->dyndep_)
+      edge->dyndep_->set_dyndep_pending(false);
+    if (edge->prev_elapsed_time_millis != -1) {
+      pair<int64_t, int>& total = rule_totals[&edge->rule()];
+      total.first += edge->prev_elapsed_time_millis;
+      ++total.second;
+    }
+  }
+
+  Plan plan;
+  plan.set_critical_path_weight(weight);
+  for (Node* target : targets) {
+    if (!plan.AddTarget(target, err) && !err->empty())
+      return false;
+  }
+  plan.PrepareQueue();
+
+  // Commands running, the one finishing first on top.
+  typedef pair<int64_t, Edge*> Finish;
+  priority_queue<Finish, vector<Finish>, greater<Finish> > running;
+  map<const Edge*, int64_t> end_times;
+  map<const Pool*, PoolStats> pools;
+  map<const Pool*, int> pool_use;
+  int64_t now = 0;
+  while (plan.more_to_do()) {
+    Edge* edge;
+    while ((int)running.size() < parallelism_ && (edge = plan.FindWork())) {
+      if (edge->is_phony()) {
+        end_times[edge] = now;
+        if (!plan.EdgeFinished(edge, Plan::kEdgeSucceeded, err))
+          return false;
+        continue;
+      }
+
+      int64_t duration = edge->prev_elapsed_time_millis;
+      if (duration == -1) {
+        ++unknown_commands_;
+        map<const Rule*, pair<int64_t, int> >::iterator total =
+            rule_totals.find(&edge->rule());
+        duration = total != rule_totals.end()
+                       ? total->second.first / total->second.second
+                       : 0;
+      }
+      ++commands_;
+      command_millis_ += duration;
+      running.push(make_pair(now + duration, edge));
+
+      // The command could have started when the last of its inputs was
+      // built.
+      int64_t ready = 0;
+      for (Node* input : edge->inputs_) {
+        map<const Edge*, int64_t>::iterator end =
+            end_times.find(input->in_edge());
+        if (end != end_times.end())
+          ready = max(ready, end->second);
+      }
+      PoolStats& stats = pools[edge->pool()];
+      stats.pool = edge->pool();
+      ++stats.commands;
+      stats.peak = max(stats.peak, ++pool_use[edge->pool()]);
+      stats.wait_millis += now - ready;
+      stats.max_wait_millis = max(stats.max_wait_millis, now - ready);
+    }
+
+    if (running.empty()) {
+      if (!plan.more_to_do())
+        break;  // The last edges were phony.
+      *err = "simulated build stalled";
+      return false;
+    }
+    now = running.top().first;
+    edge = running.top().second;
+    running.pop();
+    end_times[edge] = now;
+    --pool_use[edge->pool()];
+    if (!plan.EdgeFinished(edge, Plan::kEdgeSucceeded, err))
+      return false;
+  }
+  wall_millis_ = now;
+
+  map<string, PoolStats> by_name;
+  for (map<const Pool*, PoolStats>::iterator p = pools.begin();
+       p != pools.end(); ++p) {
+    by_name[p->first->name()] = p->second;
+  }
+  for (map<string, PoolStats>::iterator p = by_name.begin();
+       p != by_name.end(); ++p) {
+    pools_.push_back(p->second);
+  }
+  return true;
+}
@@ -0,0 +1,76 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_BUILD_SIMULATOR_H_
+#define NINJA_BUILD_SIMULATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "build.h"
+
+struct Node;
+struct Pool;
+struct State;
+
+/// Replays a full build of some targets in virtual time, scheduled by the
+/// real Plan and pools, each command taking as long as it did in the
+/// previous build (Edge::prev_elapsed_time_millis): for `ninja -t simulate`.
+struct BuildSimulator {
+  /// How long the commands of a pool waited once they could have started.
+  struct PoolStats {
+    PoolStats()
+        : pool(NULL), commands(0), peak(0), wait_millis(0),
+          max_wait_millis(0) {}
+
+    const Pool* pool;
+    int commands;
+    /// Most commands of the pool that ran at once.
+    int peak;
+    int64_t wait_millis;
+    int64_t max_wait_millis;
+  };
+
+  explicit BuildSimulator(State* state) : state_(state) {}
+
+  /// Simulate building |targets| from scratch with |parallelism| commands
+  /// at most at once.  Commands that have no previous duration take the
+  /// average of their rule's, or none.
+  /// @return false on error.
+  bool Run(const std::vector<Node*>& targets, int parallelism,
+           Plan::CriticalPathWeight weight, std::string* err);
+
+  // Results of Run().
+  int parallelism_;
+  int64_t wall_millis_;
+  /// Sum of the durations of the commands.
+  int64_t command_millis_;
+  int commands_;
+  /// Commands whose duration was guessed.
+  int unknown_commands_;
+  /// Pools that ran commands, by name.
+  std::vector<PoolStats> pools_;
+
+  /// Share of the |parallelism_| slots that the commands kept busy.
+  double utilization() const {
+    return wall_millis_ ? (double)command_millis_ /
+                              ((double)wall_millis_ * parallelism_)
+                        : 0;
+  }
+
+ private:
+  State* state_;
+};
+
+#endif  // NINJA_BUILD_SIMULATOR_H_
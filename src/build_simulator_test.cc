@@ -0,0 +1,132 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "build_simulator.h"
+
+#include "graph.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+struct BuildSimulatorTest : public StateTestWithBuiltinRules {
+  BuildSimulatorTest() : simulator_(&state_) {}
+
+  void SetDuration(const char* output, int64_t millis) {
+    GetNode(output)->in_edge()->prev_elapsed_time_millis = millis;
+  }
+
+  bool Run(const char* target, int parallelism,
+           Plan::CriticalPathWeight weight = Plan::kWeightByCount) {
+    vector<Node*> targets(1, GetNode(target));
+    string err;
+    bool success = simulator_.Run(targets, parallelism, weight, &err);
+    EXPECT_EQ("", err);
+    return success;
+  }
+
+  BuildSimulator simulator_;
+};
+
+}  // anonymous namespace
+
+TEST_F(BuildSimulatorTest, Parallelism) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat in\n"
+"build c: cat in\n"
+"build all: phony a b c\n");
+  SetDuration("a", 30);
+  SetDuration("b", 10);
+  SetDuration("c", 20);
+
+  ASSERT_TRUE(Run("all", 1));
+  EXPECT_EQ(60, simulator_.wall_millis_);
+  EXPECT_EQ(3, simulator_.commands_);
+  EXPECT_DOUBLE_EQ(1.0, simulator_.utilization());
+
+  // a and b start, then c once b is done.
+  ASSERT_TRUE(Run("all", 2));
+  EXPECT_EQ(30, simulator_.wall_millis_);
+  ASSERT_EQ(1u, simulator_.pools_.size());
+  EXPECT_EQ("", simulator_.pools_[0].pool->name());
+  EXPECT_EQ(2, simulator_.pools_[0].peak);
+  EXPECT_EQ(10, simulator_.pools_[0].wait_millis);
+
+  ASSERT_TRUE(Run("all", 8));
+  EXPECT_EQ(30, simulator_.wall_millis_);
+  EXPECT_DOUBLE_EQ(60.0 / (30 * 8), simulator_.utilization());
+}
+
+TEST_F(BuildSimulatorTest, Pool) {
+  AssertParse(&state_,
+"pool link\n"
+"  depth = 1\n"
+"rule link\n"
+"  command = link $out\n"
+"  pool = link\n"
+"build a: link in\n"
+"build b: link in\n"
+"build all: phony a b\n");
+  SetDuration("a", 10);
+  SetDuration("b", 10);
+
+  ASSERT_TRUE(Run("all", 4));
+  EXPECT_EQ(20, simulator_.wall_millis_);
+  ASSERT_EQ(1u, simulator_.pools_.size());
+  EXPECT_EQ("link", simulator_.pools_[0].pool->name());
+  EXPECT_EQ(1, simulator_.pools_[0].peak);
+  EXPECT_EQ(10, simulator_.pools_[0].max_wait_millis);
+
+  state_.LookupPool("link")->set_depth(2);
+  ASSERT_TRUE(Run("all", 4));
+  EXPECT_EQ(10, simulator_.wall_millis_);
+}
+
+TEST_F(BuildSimulatorTest, WeightByTime) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat in\n"
+"build c: cat b\n"
+"build d: cat in\n"
+"build e: cat d\n"
+"build all: phony a c e\n");
+  SetDuration("a", 100);
+  SetDuration("b", 10);
+  SetDuration("c", 10);
+  SetDuration("d", 10);
+  SetDuration("e", 10);
+
+  // The longer chains by count go first, holding a back.
+  ASSERT_TRUE(Run("all", 2));
+  EXPECT_EQ(110, simulator_.wall_millis_);
+
+  ASSERT_TRUE(Run("all", 2, Plan::kWeightByTime));
+  EXPECT_EQ(100, simulator_.wall_millis_);
+}
+
+TEST_F(BuildSimulatorTest, UnknownDurations) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat in\n"
+"build c: cat in\n"
+"build all: phony a b c\n");
+  SetDuration("a", 10);
+  SetDuration("b", 30);
+
+  ASSERT_TRUE(Run("all", 1));
+  EXPECT_EQ(60, simulator_.wall_millis_);
+  EXPECT_EQ(1, simulator_.unknown_commands_);
+}
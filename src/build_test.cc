@@ -523,7 +523,7 @@ struct FakeCommandRunner : public CommandRunner {
   // CommandRunner impl
   virtual size_t CanRunMore() const;
   virtual bool StartCommand(Edge* edge);
-  virtual bool WaitForCommand(Result* result);
+  virtual bool WaitForCommand(Result* result, int64_t timeout_millis);
   virtual vector<Edge*> GetActiveEdges();
   virtual void Abort();
 
@@ -720,7 +720,8 @@ bool FakeCommandRunner::StartCommand(Edge* edge) {
   return true;
 }
 
-bool FakeCommandRunner::WaitForCommand(Result* result) {
+bool FakeCommandRunner::WaitForCommand(Result* result,
+                                       int64_t timeout_millis) {
   if (active_edges_.empty())
     return false;
 
@@ -0,0 +1,146 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "builtin_command.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <direct.h>  // _mkdir
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+/// Fill in |output| with an error about |path|, from errno.
+bool Failed(const string& name, const string& path, string* output) {
+  *output += "ninja: " + name + ": " + path + ": " + strerror(errno) + "\n";
+  return false;
+}
+
+bool WriteContents(const string& name, const string& path,
+                   const string& contents, string* output) {
+  FILE* fp = fopen(path.c_str(), "wb");
+  if (!fp)
+    return Failed(name, path, output);
+  if (fwrite(contents.data(), 1, contents.size(), fp) < contents.size()) {
+    Failed(name, path, output);
+    fclose(fp);
+    return false;
+  }
+  if (fclose(fp) == EOF)
+    return Failed(name, path, output);
+  return true;
+}
+
+bool Copy(const string& name, const string& from, const string& to,
+          string* output) {
+  FILE* in = fopen(from.c_str(), "rb");
+  if (!in)
+    return Failed(name, from, output);
+  FILE* out = fopen(to.c_str(), "wb");
+  if (!out) {
+    Failed(name, to, output);
+    fclose(in);
+    return false;
+  }
+  // Copy a chunk at a time, so that large files don't need as much memory.
+  char buf[64 << 10];
+  bool success = true;
+  while (success) {
+    size_t len = fread(buf, 1, sizeof(buf), in);
+    if (len == 0) {
+      if (ferror(in))
+        success = Failed(name, from, output);
+      break;
+    }
+    if (fwrite(buf, 1, len, out) < len)
+      success = Failed(name, to, output);
+  }
+  fclose(in);
+  if (fclose(out) == EOF && success)
+    success = Failed(name, to, output);
+  if (!success)
+    return false;
+#ifndef _WIN32
+  // Keep the mode, and so whether the file is executable, as cp does.
+  struct stat st;
+  if (stat(from.c_str(), &st) < 0 || chmod(to.c_str(), st.st_mode) < 0)
+    return Failed(name, to, output);
+#endif
+  return true;
+}
+
+int MakeOneDir(const string& path) {
+#ifdef _WIN32
+  return _mkdir(path.c_str());
+#else
+  return mkdir(path.c_str(), 0777);
+#endif
+}
+
+bool MakeDirs(const string& name, const string& path, string* output) {
+  // Create each prefix of |path| that ends before a separator, then |path|.
+  for (size_t i = 1; i <= path.size(); ++i) {
+    if (i < path.size() && path[i] != '/' && path[i] != '\\')
+      continue;
+    if (MakeOneDir(path.substr(0, i)) < 0 && errno != EEXIST)
+      return Failed(name, path.substr(0, i), output);
+  }
+  return true;
+}
+
+bool Touch(const string& name, const string& path, string* output) {
+  if (utime(path.c_str(), NULL) == 0)
+    return true;
+  if (errno != ENOENT)
+    return Failed(name, path, output);
+  return WriteContents(name, path, "", output);
+}
+
+}  // anonymous namespace
+
+ExitStatus RunBuiltinCommand(const string& name, const vector<string>& inputs,
+                             const vector<string>& outputs, string* output) {
+  bool success = true;
+  if (name == "copy") {
+    if (inputs.size() != outputs.size()) {
+      *output += "ninja: copy: needs as many outputs as inputs\n";
+      return ExitFailure;
+    }
+    for (size_t i = 0; success && i < inputs.size(); ++i)
+      success = Copy(name, inputs[i], outputs[i], output);
+  } else if (name == "mkdir") {
+    for (size_t i = 0; success && i < outputs.size(); ++i)
+      success = MakeDirs(name, outputs[i], output);
+  } else if (name == "stamp") {
+    for (size_t i = 0; success && i < outputs.size(); ++i)
+      success = WriteContents(name, outputs[i], "", output);
+  } else if (name == "touch") {
+    for (size_t i = 0; success && i < outputs.size(); ++i)
+      success = Touch(name, outputs[i], output);
+  } else {
+    *output += "ninja: unknown builtin '" + name + "'\n";
+    success = false;
+  }
+  return success ? ExitSuccess : ExitFailure;
+}
@@ -0,0 +1,38 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_BUILTIN_COMMAND_H_
+#define NINJA_BUILTIN_COMMAND_H_
+
+#include <string>
+#include <vector>
+
+#include "exit_status.h"
+
+/// Run the builtin command |name|, for an edge with the explicit |inputs|
+/// and |outputs|, within ninja rather than in a new process.  Rules opt in
+/// with the "builtin" binding:
+///   copy:  copy each input to the output at the same position.
+///   mkdir: create each output as a directory, and its parents.
+///   stamp: create each output as an empty file.
+///   touch: update the modification time of each output, creating it if
+///          it doesn't exist.
+/// Returns ExitFailure with a message in |output| on error, like a command
+/// that failed.
+ExitStatus RunBuiltinCommand(const std::string& name,
+                             const std::vector<std::string>& inputs,
+                             const std::vector<std::string>& outputs,
+                             std::string* output);
+
+#endif  // NINJA_BUILTIN_COMMAND_H_
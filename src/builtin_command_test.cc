@@ -0,0 +1,135 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "builtin_command.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+#include "disk_interface.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+struct BuiltinCommandTest : public testing::Test {
+  virtual void SetUp() {
+    // These tests do real disk accesses, so create a temp dir.
+    temp_dir_.CreateAndEnter("Ninja-BuiltinCommandTest");
+  }
+
+  virtual void TearDown() {
+    temp_dir_.Cleanup();
+  }
+
+  ExitStatus Run(const string& name, const char* input, const char* output) {
+    vector<string> inputs, outputs;
+    if (input)
+      inputs.push_back(input);
+    outputs.push_back(output);
+    output_.clear();
+    return RunBuiltinCommand(name, inputs, outputs, &output_);
+  }
+
+  string Contents(const string& path) {
+    string contents, err;
+    EXPECT_EQ(0, disk_.ReadFile(path, &contents, &err));
+    return contents;
+  }
+
+  ScopedTempDir temp_dir_;
+  RealDiskInterface disk_;
+  string output_;
+};
+
+}  // anonymous namespace
+
+TEST_F(BuiltinCommandTest, Copy) {
+  ASSERT_TRUE(disk_.WriteFile("in", "contents"));
+  ASSERT_TRUE(disk_.WriteFile("out", "old contents, longer"));
+#ifndef _WIN32
+  ASSERT_EQ(0, chmod("in", 0755));
+#endif
+
+  EXPECT_EQ(ExitSuccess, Run("copy", "in", "out"));
+  EXPECT_EQ("", output_);
+  EXPECT_EQ("contents", Contents("out"));
+#ifndef _WIN32
+  struct stat st;
+  ASSERT_EQ(0, stat("out", &st));
+  EXPECT_EQ(0755, st.st_mode & 0777);
+#endif
+
+  // Larger than a chunk.
+  string large;
+  for (int i = 0; i < 100000; ++i)
+    large += to_string(i);
+  ASSERT_TRUE(disk_.WriteFile("in", large));
+  EXPECT_EQ(ExitSuccess, Run("copy", "in", "out"));
+  EXPECT_EQ(large, Contents("out"));
+
+  EXPECT_EQ(ExitFailure, Run("copy", "missing", "out"));
+  EXPECT_EQ(0u, output_.find("ninja: copy: missing: "));
+
+  EXPECT_EQ(ExitFailure, Run("copy", NULL, "out"));
+  EXPECT_EQ("ninja: copy: needs as many outputs as inputs\n", output_);
+}
+
+TEST_F(BuiltinCommandTest, Mkdir) {
+  EXPECT_EQ(ExitSuccess, Run("mkdir", NULL, "a/b/c"));
+  EXPECT_EQ("", output_);
+  string err;
+  EXPECT_GT(disk_.Stat("a/b/c", &err), 0);
+
+  // Existing directories are fine, as with mkdir -p.
+  EXPECT_EQ(ExitSuccess, Run("mkdir", NULL, "a/b"));
+
+  ASSERT_TRUE(disk_.WriteFile("file", ""));
+  EXPECT_EQ(ExitFailure, Run("mkdir", NULL, "file/sub"));
+  EXPECT_EQ(0u, output_.find("ninja: mkdir: file/sub: "));
+}
+
+TEST_F(BuiltinCommandTest, Stamp) {
+  ASSERT_TRUE(disk_.WriteFile("out", "contents"));
+  EXPECT_EQ(ExitSuccess, Run("stamp", "in", "out"));
+  EXPECT_EQ("", Contents("out"));
+}
+
+TEST_F(BuiltinCommandTest, Touch) {
+  EXPECT_EQ(ExitSuccess, Run("touch", NULL, "new"));
+  EXPECT_EQ("", Contents("new"));
+
+  ASSERT_TRUE(disk_.WriteFile("old", "contents"));
+  struct utimbuf times = { 1000, 1000 };
+  ASSERT_EQ(0, utime("old", &times));
+  string err;
+  TimeStamp mtime = disk_.Stat("old", &err);
+  ASSERT_GT(mtime, 0);
+
+  EXPECT_EQ(ExitSuccess, Run("touch", NULL, "old"));
+  EXPECT_GT(disk_.Stat("old", &err), mtime);
+  EXPECT_EQ("contents", Contents("old"));
+}
+
+TEST_F(BuiltinCommandTest, Unknown) {
+  EXPECT_EQ(ExitFailure, Run("rm", NULL, "out"));
+  EXPECT_EQ("ninja: unknown builtin 'rm'\n", output_);
+}
@@ -0,0 +1,156 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "critical_path.h"
+
+#include <algorithm>
+
+#include "deps_log.h"
+#include "graph.h"
+
+using namespace std;
+
+void EdgeTopoSort::VisitTarget(const Node* target) {
+  Edge* producer = target->in_edge();
+  if (producer)
+    Visit(producer);
+}
+
+void EdgeTopoSort::GetProducers(const Edge* edge,
+                                vector<Edge*>* producers) const {
+  size_t begin = producers->size();
+  GetAllProducers(edge, producers);
+  size_t position = positions_.find(edge)->second;
+  producers->erase(
+      remove_if(producers->begin() + begin, producers->end(),
+                [&](const Edge* producer) {
+                  return positions_.find(producer)->second >= position;
+                }),
+      producers->end());
+}
+
+void EdgeTopoSort::GetAllProducers(const Edge* edge,
+                                   vector<Edge*>* producers) const {
+  for (const Node* input : edge->inputs_) {
+    if (input->in_edge())
+      producers->push_back(input->in_edge());
+  }
+  if (!deps_log_ || edge->outputs_.empty())
+    return;
+  DepsLog::Deps* deps = deps_log_->GetDeps(edge->outputs_[0]);
+  for (int i = 0; deps && i < deps->node_count; ++i) {
+    if (deps->nodes[i]->in_edge())
+      producers->push_back(deps->nodes[i]->in_edge());
+  }
+}
+
+void EdgeTopoSort::Visit(Edge* edge) {
+  if (positions_.count(edge))
+    return;
+  // An edge still being visited depends on this one: a cycle.
+  if (!visiting_set_.insert(edge).second)
+    return;
+
+  if (!deps_log_) {
+    for (const Node* input : edge->inputs_) {
+      Edge* producer = input->in_edge();
+      if (producer)
+        Visit(producer);
+    }
+  } else {
+    vector<Edge*> producers;
+    GetAllProducers(edge, &producers);
+    for (Edge* producer : producers)
+      Visit(producer);
+  }
+  visiting_set_.erase(edge);
+  positions_[edge] = sorted_edges_.size();
+  sorted_edges_.push_back(edge);
+}
+
+void CriticalPath::Analyze() {
+  const vector<Edge*>& sorted_edges = topo_sort_.result();
+  timings_.clear();
+  path_.clear();
+  length_ = 0;
+
+  // Forward: an edge starts once all its producers are done.  The path
+  // ends at the last edge finishing last, which is a target's rather than
+  // one of its inputs' on ties.
+  vector<Edge*> producers;
+  Edge* last = NULL;
+  for (Edge* edge : sorted_edges) {
+    Timing& timing = timings_[edge];
+    map<const Edge*, int64_t>::const_iterator duration =
+        durations_.find(edge);
+    if (duration != durations_.end()) {
+      timing.duration = duration->second;
+      timing.known = true;
+    }
+    producers.clear();
+    topo_sort_.GetProducers(edge, &producers);
+    for (Edge* producer : producers) {
+      const Timing& before = timings_[producer];
+      timing.earliest_start = max(timing.earliest_start,
+                                  before.earliest_start + before.duration);
+    }
+    int64_t finish = timing.earliest_start + timing.duration;
+    if (!last || finish >= length_) {
+      length_ = finish;
+      last = edge;
+    }
+  }
+
+  // Backward: an edge must be done by the time the first of the edges
+  // depending on it has to start.
+  map<const Edge*, int64_t> latest_finish;
+  for (auto it = sorted_edges.rbegin(); it != sorted_edges.rend(); ++it) {
+    Edge* edge = *it;
+    Timing& timing = timings_[edge];
+    map<const Edge*, int64_t>::iterator finish = latest_finish.find(edge);
+    int64_t latest = finish != latest_finish.end() ? finish->second : length_;
+    timing.slack = latest - timing.earliest_start - timing.duration;
+    producers.clear();
+    topo_sort_.GetProducers(edge, &producers);
+    for (Edge* producer : producers) {
+      int64_t start = latest - timing.duration;
+      map<const Edge*, int64_t>::iterator i = latest_finish.find(producer);
+      if (i == latest_finish.end())
+        latest_finish[producer] = start;
+      else
+        i->second = min(i->second, start);
+    }
+  }
+
+  // Walk back from the edge finishing last through the producers that
+  // held up each edge.  GetProducers() leaves out the links closing cycles,
+  // but an edge must not come up twice even so.
+  unordered_set<const Edge*> on_path;
+  for (Edge* edge = last; edge && on_path.insert(edge).second;) {
+    path_.push_back(edge);
+    const Timing& timing = timings_[edge];
+    producers.clear();
+    topo_sort_.GetProducers(edge, &producers);
+    edge = NULL;
+    for (Edge* producer : producers) {
+      const Timing& before = timings_[producer];
+      if (before.earliest_start + before.duration == timing.earliest_start &&
+          before.slack == 0) {
+        edge = producer;
+        break;
+      }
+    }
+  }
+  reverse(path_.begin(), path_.end());
+}
@@ -0,0 +1,128 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_CRITICAL_PATH_H_
+#define NINJA_CRITICAL_PATH_H_
+
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "util.h"  // int64_t
+
+struct DepsLog;
+struct Edge;
+struct Node;
+
+/// Topological sort of all the edges reachable from a set of unique
+/// targets.  Usage is:
+///
+/// 1) Create instance.
+///
+/// 2) Call VisitTarget() as many times as necessary.
+///    Note that duplicate targets are properly ignored.
+///
+/// 3) Call result() to get a sorted list of edges,
+///    where each edge appears _after_ its parents,
+///    i.e. the edges producing its inputs, in the list.
+struct EdgeTopoSort {
+  /// Inputs recorded in |deps_log|, if not NULL, count as the edges' own.
+  explicit EdgeTopoSort(DepsLog* deps_log = NULL) : deps_log_(deps_log) {}
+
+  void VisitTarget(const Node* target);
+
+  const std::vector<Edge*>& result() const { return sorted_edges_; }
+
+  /// Append the edges producing the inputs of |edge|, a visited edge, to
+  /// |producers|.  A producer that result() has after |edge| closes a cycle
+  /// (see below) and is left out.
+  void GetProducers(const Edge* edge, std::vector<Edge*>* producers) const;
+
+ private:
+  // Implementation note:
+  //
+  // This is the regular depth-first-search algorithm described
+  // at https://en.wikipedia.org/wiki/Topological_sorting, except
+  // that:
+  //
+  // - Edges are appended to the end of the list, for performance
+  //   reasons. Hence the order used in result().
+  //
+  // - The manifest's graph has no cycles, but the inputs recorded in a
+  //   deps log can form them, e.g. when a header an object file includes
+  //   is generated from that object file.  Edges being visited carry a
+  //   temporary mark, and the back edge reaching one of them again is
+  //   skipped.
+  //
+  void Visit(Edge* edge);
+
+  /// Append the producers of the inputs of |edge|, cycles or not.
+  void GetAllProducers(const Edge* edge, std::vector<Edge*>* producers) const;
+
+  DepsLog* deps_log_;
+  /// Temporary marks.
+  std::unordered_set<Edge*> visiting_set_;
+  /// Permanent marks: the position of each sorted edge in sorted_edges_.
+  std::unordered_map<const Edge*, size_t> positions_;
+  std::vector<Edge*> sorted_edges_;
+};
+
+/// The longest chain of dependent commands needed for a set of targets,
+/// weighted with their durations, and how much each other command could
+/// take longer without making the chain longer: for `ninja -t critpath`.
+struct CriticalPath {
+  /// Timing of an edge in a build with unlimited parallelism.
+  struct Timing {
+    Timing() : duration(0), earliest_start(0), slack(0), known(false) {}
+
+    int64_t duration;
+    int64_t earliest_start;
+    /// How much later the edge could finish without delaying the targets.
+    int64_t slack;
+    /// Whether the duration was set rather than taken to be 0.
+    bool known;
+  };
+
+  explicit CriticalPath(DepsLog* deps_log = NULL) : topo_sort_(deps_log) {}
+
+  /// Set how long |edge| takes.  Edges without a duration take none.
+  void SetDuration(const Edge* edge, int64_t millis) {
+    durations_[edge] = millis;
+  }
+
+  void AddTarget(const Node* target) { topo_sort_.VisitTarget(target); }
+
+  /// Compute the results below.
+  void Analyze();
+
+  /// Edges that the targets need, each after the edges it depends on.
+  const std::vector<Edge*>& edges() const { return topo_sort_.result(); }
+
+  const Timing& timing(const Edge* edge) const {
+    return timings_.find(edge)->second;
+  }
+
+  // Results of Analyze().
+  int64_t length_;
+  /// The critical path, from its first edge to its last.
+  std::vector<Edge*> path_;
+
+ private:
+  EdgeTopoSort topo_sort_;
+  std::map<const Edge*, int64_t> durations_;
+  std::map<const Edge*, Timing> timings_;
+};
+
+#endif  // NINJA_CRITICAL_PATH_H_
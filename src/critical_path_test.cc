@@ -0,0 +1,132 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "critical_path.h"
+
+#include "deps_log.h"
+#include "graph.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+const char kTestDepsLogFilename[] = "CriticalPathTest-tempdepslog";
+
+struct CriticalPathTest : public StateTestWithBuiltinRules {
+  Edge* GetEdge(const char* output) { return GetNode(output)->in_edge(); }
+
+  ScopedFilePath scoped_file_path_ = kTestDepsLogFilename;
+};
+
+}  // anonymous namespace
+
+TEST_F(CriticalPathTest, TopoSort) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat a\n"
+"build c: cat a b\n");
+
+  EdgeTopoSort topo_sort;
+  topo_sort.VisitTarget(GetNode("c"));
+  topo_sort.VisitTarget(GetNode("b"));
+  topo_sort.VisitTarget(GetNode("in"));
+  ASSERT_EQ(3u, topo_sort.result().size());
+  EXPECT_EQ(GetEdge("a"), topo_sort.result()[0]);
+  EXPECT_EQ(GetEdge("b"), topo_sort.result()[1]);
+  EXPECT_EQ(GetEdge("c"), topo_sort.result()[2]);
+}
+
+TEST_F(CriticalPathTest, PathAndSlack) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat in\n"
+"build c: cat a b\n"
+"build d: cat in\n"
+"build all: phony c d\n");
+
+  CriticalPath critical_path;
+  critical_path.SetDuration(GetEdge("a"), 30);
+  critical_path.SetDuration(GetEdge("b"), 10);
+  critical_path.SetDuration(GetEdge("c"), 20);
+  critical_path.SetDuration(GetEdge("d"), 15);
+  critical_path.AddTarget(GetNode("all"));
+  critical_path.Analyze();
+
+  EXPECT_EQ(50, critical_path.length_);
+  ASSERT_EQ(3u, critical_path.path_.size());
+  EXPECT_EQ(GetEdge("a"), critical_path.path_[0]);
+  EXPECT_EQ(GetEdge("c"), critical_path.path_[1]);
+  EXPECT_EQ(GetEdge("all"), critical_path.path_[2]);
+
+  EXPECT_EQ(0, critical_path.timing(GetEdge("a")).slack);
+  EXPECT_EQ(20, critical_path.timing(GetEdge("b")).slack);
+  EXPECT_EQ(30, critical_path.timing(GetEdge("c")).earliest_start);
+  EXPECT_EQ(35, critical_path.timing(GetEdge("d")).slack);
+  EXPECT_TRUE(critical_path.timing(GetEdge("d")).known);
+  EXPECT_FALSE(critical_path.timing(GetEdge("all")).known);
+}
+
+TEST_F(CriticalPathTest, DepsLogInputs) {
+  AssertParse(&state_,
+"build gen.h: cat in\n"
+"build out.o: cat out.c\n");
+
+  DepsLog deps_log;
+  string err;
+  ASSERT_TRUE(deps_log.OpenForWrite(kTestDepsLogFilename, &err));
+  Node* deps[] = { GetNode("gen.h") };
+  deps_log.RecordDeps(GetNode("out.o"), 0, 1, deps);
+
+  CriticalPath critical_path(&deps_log);
+  critical_path.SetDuration(GetEdge("gen.h"), 40);
+  critical_path.SetDuration(GetEdge("out.o"), 10);
+  critical_path.AddTarget(GetNode("out.o"));
+  critical_path.Analyze();
+  deps_log.Close();
+
+  EXPECT_EQ(50, critical_path.length_);
+  ASSERT_EQ(2u, critical_path.path_.size());
+  EXPECT_EQ(GetEdge("gen.h"), critical_path.path_[0]);
+}
+
+TEST_F(CriticalPathTest, CyclicDepsLog) {
+  // a.o includes gen.h, which is generated from a.o: the deps log makes a
+  // cycle that the manifest doesn't have.
+  AssertParse(&state_,
+"build a.o: cat a.c\n"
+"build gen.h: cat a.o\n");
+
+  DepsLog deps_log;
+  string err;
+  ASSERT_TRUE(deps_log.OpenForWrite(kTestDepsLogFilename, &err));
+  Node* deps[] = { GetNode("gen.h") };
+  deps_log.RecordDeps(GetNode("a.o"), 0, 1, deps);
+
+  CriticalPath critical_path(&deps_log);
+  critical_path.SetDuration(GetEdge("a.o"), 0);
+  critical_path.SetDuration(GetEdge("gen.h"), 0);
+  critical_path.AddTarget(GetNode("gen.h"));
+  critical_path.AddTarget(GetNode("a.o"));
+  critical_path.Analyze();
+  deps_log.Close();
+
+  ASSERT_EQ(2u, critical_path.edges().size());
+  EXPECT_EQ(GetEdge("a.o"), critical_path.edges()[0]);
+  EXPECT_EQ(GetEdge("gen.h"), critical_path.edges()[1]);
+  EXPECT_EQ(0, critical_path.length_);
+  ASSERT_EQ(2u, critical_path.path_.size());
+  EXPECT_EQ(GetEdge("a.o"), critical_path.path_[0]);
+  EXPECT_EQ(GetEdge("gen.h"), critical_path.path_[1]);
+}
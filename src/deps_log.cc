@@ -18,6 +18,10 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
 #ifndef _WIN32
 #include <unistd.h>
 #elif defined(_MSC_VER) && (_MSC_VER < 1900)
@@ -26,7 +30,9 @@ typedef unsigned __int32 uint32_t;
 #endif
 
 #include "graph.h"
+#include "log_writer.h"
 #include "metrics.h"
+#include "probes.h"
 #include "state.h"
 #include "util.h"
 
@@ -41,13 +47,83 @@ const int kCurrentVersion = 4;
 // internal buffers having to have this size.
 const unsigned kMaxRecordSize = (1 << 19) - 1;
 
+namespace {
+
+void AppendInt(uint32_t value, string* records) {
+  records->append(reinterpret_cast<const char*>(&value), 4);
+}
+
+/// Append a path record for |path| with index |id| to |records|.
+bool AppendPathRecord(const string& path, int id, string* records) {
+  int path_size = path.size();
+  int padding = (4 - path_size % 4) % 4;  // Pad path to 4 byte boundary.
+
+  unsigned size = path_size + padding + 4;
+  if (size > kMaxRecordSize) {
+    errno = ERANGE;
+    return false;
+  }
+
+  assert(!path.empty());
+  AppendInt(size, records);
+  records->append(path);
+  records->append(padding, '\0');
+  AppendInt(~(unsigned)id, records);
+  return true;
+}
+
+}  // anonymous namespace
+
+/// A recompaction running concurrently with the build.  The helper thread
+/// only reads node paths; it numbers the nodes of the new file in |ids|
+/// rather than through Node::id(), which the build keeps using for the old
+/// file.
+struct DepsLog::BackgroundRecompaction {
+  /// Append the records for the deps of |node| to |records|, including
+  /// path records for nodes new to the file.
+  bool AppendDeps(Node* node, TimeStamp mtime, int node_count,
+                  Node* const* inputs, string* records);
+  /// The id of |node| in the new file, appending its path record if needed.
+  int Id(Node* node, string* records);
+
+  string path;
+  string temp_path;
+
+  /// Live deps at the time the recompaction started.
+  struct Entry {
+    Node* node;
+    TimeStamp mtime;
+    vector<Node*> inputs;
+  };
+  vector<Entry> entries;
+  /// Outputs whose deps were recorded since then.
+  vector<Node*> recorded;
+
+  /// Maps id in the new file -> Node, and back.
+  vector<Node*> nodes;
+  unordered_map<Node*, int> ids;
+  /// Whether the node with a given id has a deps record in the new file.
+  vector<bool> has_deps;
+
+  /// Result of the helper thread.
+  bool success;
+  string err;
+  std::thread thread;
+};
+
+DepsLog::DepsLog()
+    : needs_recompaction_(false), file_(NULL), writer_(NULL),
+      recompact_in_background_(false) {}
+
 DepsLog::~DepsLog() {
   Close();
 }
 
 bool DepsLog::OpenForWrite(const string& path, string* err) {
   if (needs_recompaction_) {
-    if (!Recompact(path, err))
+    if (recompact_in_background_)
+      StartRecompaction(path);
+    else if (!Recompact(path, err))
       return false;
   }
 
@@ -65,19 +141,28 @@ bool DepsLog::RecordDeps(Node* node, TimeStamp mtime,
 
 bool DepsLog::RecordDeps(Node* node, TimeStamp mtime,
                          int node_count, Node** nodes) {
+  NINJA_PROBE2(deps_log_write, node->path().c_str(), node_count);
+  unsigned size = 4 * (1 + 2 + node_count);
+  if (size > kMaxRecordSize) {
+    errno = ERANGE;
+    return false;
+  }
+
   // Track whether there's any new data to be recorded.
   bool made_change = false;
 
-  // Assign ids to all nodes that are missing one.
+  // Assign ids to all nodes that are missing one.  All records of this call
+  // are collected in |records| and written at once.
+  string records;
+  size_t old_node_count = nodes_.size();
+  bool success = true;
   if (node->id() < 0) {
-    if (!RecordId(node))
-      return false;
+    success = RecordId(node, &records);
     made_change = true;
   }
-  for (int i = 0; i < node_count; ++i) {
+  for (int i = 0; success && i < node_count; ++i) {
     if (nodes[i]->id() < 0) {
-      if (!RecordId(nodes[i]))
-        return false;
+      success = RecordId(nodes[i], &records);
       made_change = true;
     }
   }
@@ -104,34 +189,28 @@ bool DepsLog::RecordDeps(Node* node, TimeStamp mtime,
     return true;
 
   // Update on-disk representation.
-  unsigned size = 4 * (1 + 2 + node_count);
-  if (size > kMaxRecordSize) {
-    errno = ERANGE;
-    return false;
+  if (success) {
+    size |= 0x80000000;  // Deps record: set high bit.
+    AppendInt(size, &records);
+    AppendInt(node->id(), &records);
+    AppendInt(static_cast<uint32_t>(mtime & 0xffffffff), &records);
+    AppendInt(static_cast<uint32_t>((mtime >> 32) & 0xffffffff), &records);
+    for (int i = 0; i < node_count; ++i)
+      AppendInt(nodes[i]->id(), &records);
+    success = WriteRecords(&records);
   }
-
-  if (!OpenForWriteIfNeeded()) {
+  if (!success) {
+    // Forget the ids that did not make it to disk.
+    int saved_errno = errno;
+    for (size_t i = old_node_count; i < nodes_.size(); ++i)
+      nodes_[i]->set_id(-1);
+    nodes_.resize(old_node_count);
+    errno = saved_errno;
     return false;
   }
-  size |= 0x80000000;  // Deps record: set high bit.
-  if (fwrite(&size, 4, 1, file_) < 1)
-    return false;
-  int id = node->id();
-  if (fwrite(&id, 4, 1, file_) < 1)
-    return false;
-  uint32_t mtime_part = static_cast<uint32_t>(mtime & 0xffffffff);
-  if (fwrite(&mtime_part, 4, 1, file_) < 1)
-    return false;
-  mtime_part = static_cast<uint32_t>((mtime >> 32) & 0xffffffff);
-  if (fwrite(&mtime_part, 4, 1, file_) < 1)
-    return false;
-  for (int i = 0; i < node_count; ++i) {
-    id = nodes[i]->id();
-    if (fwrite(&id, 4, 1, file_) < 1)
-      return false;
-  }
-  if (fflush(file_) != 0)
-    return false;
+
+  if (recompaction_)
+    recompaction_->recorded.push_back(node);
 
   // Update in-memory representation.
   Deps* deps = new Deps(mtime, node_count);
@@ -144,13 +223,188 @@ bool DepsLog::RecordDeps(Node* node, TimeStamp mtime,
 
 void DepsLog::Close() {
   OpenForWriteIfNeeded();  // create the file even if nothing has been recorded
-  if (file_)
+  if (file_) {
+    if (writer_)
+      writer_->Flush();
     fclose(file_);
+  }
   file_ = NULL;
+
+  if (recompaction_) {
+    string err;
+    if (!FinishRecompaction(&err))
+      Warning("deps log recompaction failed: %s", err.c_str());
+  }
+}
+
+int DepsLog::BackgroundRecompaction::Id(Node* node, string* records) {
+  unordered_map<Node*, int>::iterator i = ids.find(node);
+  if (i != ids.end())
+    return i->second;
+  int id = nodes.size();
+  if (!AppendPathRecord(node->path(), id, records))
+    return -1;
+  ids[node] = id;
+  nodes.push_back(node);
+  has_deps.push_back(false);
+  return id;
+}
+
+bool DepsLog::BackgroundRecompaction::AppendDeps(Node* node, TimeStamp mtime,
+                                                 int node_count,
+                                                 Node* const* inputs,
+                                                 string* records) {
+  int out_id = Id(node, records);
+  if (out_id < 0)
+    return false;
+  vector<int> input_ids(node_count);
+  for (int i = 0; i < node_count; ++i) {
+    if ((input_ids[i] = Id(inputs[i], records)) < 0)
+      return false;
+  }
+  has_deps[out_id] = true;
+
+  AppendInt((4 * (1 + 2 + node_count)) | 0x80000000, records);
+  AppendInt(out_id, records);
+  AppendInt(static_cast<uint32_t>(mtime & 0xffffffff), records);
+  AppendInt(static_cast<uint32_t>((mtime >> 32) & 0xffffffff), records);
+  for (int i = 0; i < node_count; ++i)
+    AppendInt(input_ids[i], records);
+  return true;
+}
+
+void DepsLog::StartRecompaction(const string& path) {
+  METRIC_RECORD(".ninja_deps start recompaction");
+
+  Close();
+  recompaction_.reset(new BackgroundRecompaction);
+  BackgroundRecompaction* r = recompaction_.get();
+  r->path = path;
+  r->temp_path = path + ".recompact";
+
+  // Deciding what is live needs the graph, so do it here on the main thread.
+  for (int old_id = 0; old_id < (int)deps_.size(); ++old_id) {
+    Deps* deps = deps_[old_id];
+    if (!deps || !IsDepsEntryLiveFor(nodes_[old_id]))
+      continue;
+    BackgroundRecompaction::Entry entry;
+    entry.node = nodes_[old_id];
+    entry.mtime = deps->mtime;
+    entry.inputs.assign(deps->nodes, deps->nodes + deps->node_count);
+    r->entries.push_back(entry);
+  }
+
+  r->success = false;
+  r->thread = std::thread([r]() {
+    FILE* f = fopen(r->temp_path.c_str(), "wb");
+    if (!f) {
+      r->err = strerror(errno);
+      return;
+    }
+    string records(kFileSignature);
+    AppendInt(kCurrentVersion, &records);
+    bool success = true;
+    for (vector<BackgroundRecompaction::Entry>::iterator i = r->entries.begin();
+         success && i != r->entries.end(); ++i) {
+      success = r->AppendDeps(i->node, i->mtime, i->inputs.size(),
+                              i->inputs.data(), &records) &&
+                fwrite(records.data(), records.size(), 1, f) == 1;
+      records.clear();
+    }
+    if (!success)
+      r->err = strerror(errno);
+    if (fclose(f) != 0 && success) {
+      r->err = strerror(errno);
+      success = false;
+    }
+    r->success = success;
+  });
+}
+
+bool DepsLog::FinishRecompaction(string* err) {
+  METRIC_RECORD(".ninja_deps finish recompaction");
+
+  std::unique_ptr<BackgroundRecompaction> r;
+  r.swap(recompaction_);
+  r->thread.join();
+  if (!r->success) {
+    *err = r->err;
+    unlink(r->temp_path.c_str());
+    return false;
+  }
+
+  // Append what the build recorded meanwhile; the old file has it already.
+  sort(r->recorded.begin(), r->recorded.end());
+  r->recorded.erase(unique(r->recorded.begin(), r->recorded.end()),
+                    r->recorded.end());
+  string records;
+  for (vector<Node*>::iterator i = r->recorded.begin();
+       i != r->recorded.end(); ++i) {
+    Deps* deps = GetDeps(*i);
+    if (deps && !r->AppendDeps(*i, deps->mtime, deps->node_count, deps->nodes,
+                               &records)) {
+      *err = strerror(errno);
+      unlink(r->temp_path.c_str());
+      return false;
+    }
+  }
+  FILE* f = fopen(r->temp_path.c_str(), "ab");
+  if (!f) {
+    *err = strerror(errno);
+    unlink(r->temp_path.c_str());
+    return false;
+  }
+  if (!records.empty() &&
+      fwrite(records.data(), records.size(), 1, f) < 1) {
+    *err = strerror(errno);
+    fclose(f);
+    unlink(r->temp_path.c_str());
+    return false;
+  }
+  if (fclose(f) != 0) {
+    *err = strerror(errno);
+    unlink(r->temp_path.c_str());
+    return false;
+  }
+
+#ifdef _WIN32
+  // Windows can't rename onto an existing file.  Elsewhere, rename()
+  // swaps the files atomically, so a crash leaves one of them in place.
+  if (unlink(r->path.c_str()) < 0) {
+    *err = strerror(errno);
+    return false;
+  }
+#endif
+  if (rename(r->temp_path.c_str(), r->path.c_str()) < 0) {
+    *err = strerror(errno);
+    return false;
+  }
+
+  // Renumber the nodes to match the new file, keeping the deps that were
+  // written to it and dropping the rest, as Recompact() does.
+  vector<Deps*> deps(r->nodes.size());
+  for (size_t id = 0; id < r->nodes.size(); ++id) {
+    int old_id = r->nodes[id]->id();
+    if (r->has_deps[id] && old_id >= 0 && old_id < (int)deps_.size()) {
+      deps[id] = deps_[old_id];
+      deps_[old_id] = NULL;
+    }
+  }
+  for (vector<Deps*>::iterator i = deps_.begin(); i != deps_.end(); ++i)
+    delete *i;
+  for (vector<Node*>::iterator i = nodes_.begin(); i != nodes_.end(); ++i)
+    (*i)->set_id(-1);
+  for (size_t id = 0; id < r->nodes.size(); ++id)
+    r->nodes[id]->set_id(id);
+  nodes_.swap(r->nodes);
+  deps_.swap(deps);
+  needs_recompaction_ = false;
+  return true;
 }
 
 LoadStatus DepsLog::Load(const string& path, State* state, string* err) {
   METRIC_RECORD(".ninja_deps load");
+  NINJA_PROBE_SCOPE(deps_log_load, path.c_str());
   char buf[kMaxRecordSize + 1];
   FILE* f = fopen(path.c_str(), "rb");
   if (!f) {
@@ -382,37 +636,33 @@ bool DepsLog::UpdateDeps(int out_id, Deps* deps) {
   return delete_old;
 }
 
-bool DepsLog::RecordId(Node* node) {
-  int path_size = node->path().size();
-  int padding = (4 - path_size % 4) % 4;  // Pad path to 4 byte boundary.
-
-  unsigned size = path_size + padding + 4;
-  if (size > kMaxRecordSize) {
-    errno = ERANGE;
+bool DepsLog::RecordId(Node* node, string* records) {
+  int id = nodes_.size();
+  if (!AppendPathRecord(node->path(), id, records))
     return false;
-  }
 
+  node->set_id(id);
+  nodes_.push_back(node);
+
+  return true;
+}
+
+bool DepsLog::WriteRecords(string* records) {
   if (!OpenForWriteIfNeeded()) {
     return false;
   }
-  if (fwrite(&size, 4, 1, file_) < 1)
-    return false;
-  if (fwrite(node->path().data(), path_size, 1, file_) < 1) {
-    assert(!node->path().empty());
-    return false;
+  if (writer_) {
+    if (int error = writer_->error()) {
+      errno = error;
+      return false;
+    }
+    writer_->Append(file_, records);
+    return true;
   }
-  if (padding && fwrite("\0\0", padding, 1, file_) < 1)
-    return false;
-  int id = nodes_.size();
-  unsigned checksum = ~(unsigned)id;
-  if (fwrite(&checksum, 4, 1, file_) < 1)
+  if (fwrite(records->data(), records->size(), 1, file_) < 1)
     return false;
   if (fflush(file_) != 0)
     return false;
-
-  node->set_id(id);
-  nodes_.push_back(node);
-
   return true;
 }
 
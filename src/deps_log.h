@@ -15,6 +15,7 @@
 #ifndef NINJA_DEPS_LOG_H_
 #define NINJA_DEPS_LOG_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -23,6 +24,7 @@
 #include "load_status.h"
 #include "timestamp.h"
 
+struct LogWriter;
 struct Node;
 struct State;
 
@@ -66,7 +68,7 @@ struct State;
 /// wins, allowing updates to just be appended to the file.  A separate
 /// repacking step can run occasionally to remove dead records.
 struct DepsLog {
-  DepsLog() : needs_recompaction_(false), file_(NULL) {}
+  DepsLog();
   ~DepsLog();
 
   // Writing (build-time) interface.
@@ -75,6 +77,18 @@ struct DepsLog {
   bool RecordDeps(Node* node, TimeStamp mtime, int node_count, Node** nodes);
   void Close();
 
+  /// Hand records to |writer| instead of writing them on the calling
+  /// thread.  Close() waits for them to reach the file.
+  void set_writer(LogWriter* writer) { writer_ = writer; }
+
+  /// If set, a recompaction needed by OpenForWrite() runs in a helper
+  /// thread while the build appends to the old file.  Close() merges the
+  /// records appended meanwhile, swaps the new file in and renumbers the
+  /// nodes to match it.
+  void set_recompact_in_background(bool background) {
+    recompact_in_background_ = background;
+  }
+
   // Reading (startup-time) interface.
   struct Deps {
     Deps(int64_t mtime, int node_count)
@@ -107,16 +121,29 @@ struct DepsLog {
   // Updates the in-memory representation.  Takes ownership of |deps|.
   // Returns true if a prior deps record was deleted.
   bool UpdateDeps(int out_id, Deps* deps);
-  // Write a node name record, assigning it an id.
-  bool RecordId(Node* node);
+  // Append a node name record to |records|, assigning the node an id.
+  bool RecordId(Node* node, std::string* records);
+  // Append |records| to the file, directly or through |writer_|.
+  bool WriteRecords(std::string* records);
 
   /// Should be called before using file_. When false is returned, errno will
   /// be set.
   bool OpenForWriteIfNeeded();
 
+  struct BackgroundRecompaction;
+
+  /// Start writing the live deps to a new file in a helper thread.
+  void StartRecompaction(const std::string& path);
+  /// Wait for the helper thread, append the deps recorded since it started,
+  /// replace the log file with the new one and adopt its ids.
+  bool FinishRecompaction(std::string* err);
+
   bool needs_recompaction_;
   FILE* file_;
   std::string file_path_;
+  LogWriter* writer_;
+  bool recompact_in_background_;
+  std::unique_ptr<BackgroundRecompaction> recompaction_;
 
   /// Maps id -> Node.
   std::vector<Node*> nodes_;
@@ -351,6 +351,82 @@ TEST_F(DepsLogTest, Recompact) {
   }
 }
 
+TEST_F(DepsLogTest, RecompactInBackground) {
+  const char kManifest[] =
+"rule cc\n"
+"  command = cc\n"
+"  deps = gcc\n"
+"build out.o: cc\n"
+"build other_out.o: cc\n";
+
+  // Write enough redundant records to trigger a recompaction.
+  {
+    State state;
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, kManifest));
+    DepsLog log;
+    string err;
+    ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+    vector<Node*> deps;
+    deps.push_back(state.GetNode("foo.h", 0));
+    for (int i = 0; i < 1100; ++i)
+      log.RecordDeps(state.GetNode("out.o", 0), i, deps);
+    deps.push_back(state.GetNode("bar.h", 0));
+    log.RecordDeps(state.GetNode("dead.o", 0), 1, deps);
+    log.Close();
+  }
+
+  // Record more deps while the recompaction runs.
+  {
+    State state;
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, kManifest));
+    DepsLog log;
+    string err;
+    ASSERT_TRUE(log.Load(kTestFilename, &state, &err));
+    ASSERT_EQ("", err);
+    log.set_recompact_in_background(true);
+    ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+    ASSERT_EQ("", err);
+
+    vector<Node*> deps;
+    deps.push_back(state.GetNode("foo.h", 0));
+    deps.push_back(state.GetNode("baz.h", 0));
+    ASSERT_TRUE(log.RecordDeps(state.GetNode("out.o", 0), 5000, deps));
+    deps.clear();
+    deps.push_back(state.GetNode("qux.h", 0));
+    ASSERT_TRUE(log.RecordDeps(state.GetNode("other_out.o", 0), 1, deps));
+    log.Close();
+
+    // The in-memory ids now refer to the new file.
+    for (size_t i = 0; i < log.nodes().size(); ++i)
+      ASSERT_EQ((int)i, log.nodes()[i]->id());
+    ASSERT_EQ(-1, state.GetNode("bar.h", 0)->id());
+    ASSERT_FALSE(log.GetDeps(state.GetNode("dead.o", 0)));
+    DepsLog::Deps* log_deps = log.GetDeps(state.GetNode("out.o", 0));
+    ASSERT_TRUE(log_deps);
+    ASSERT_EQ(5000, log_deps->mtime);
+    ASSERT_EQ(2, log_deps->node_count);
+  }
+
+  State state;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state, kManifest));
+  DepsLog log;
+  string err;
+  ASSERT_TRUE(log.Load(kTestFilename, &state, &err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(5u, log.nodes().size());  // out.o foo.h baz.h other_out.o qux.h
+  DepsLog::Deps* log_deps = log.GetDeps(state.GetNode("out.o", 0));
+  ASSERT_TRUE(log_deps);
+  ASSERT_EQ(5000, log_deps->mtime);
+  ASSERT_EQ(2, log_deps->node_count);
+  ASSERT_EQ("foo.h", log_deps->nodes[0]->path());
+  ASSERT_EQ("baz.h", log_deps->nodes[1]->path());
+  log_deps = log.GetDeps(state.GetNode("other_out.o", 0));
+  ASSERT_TRUE(log_deps);
+  ASSERT_EQ(1, log_deps->node_count);
+  ASSERT_EQ("qux.h", log_deps->nodes[0]->path());
+  ASSERT_FALSE(log.GetDeps(state.GetNode("dead.o", 0)));
+}
+
 // Verify that invalid file headers cause a new build.
 TEST_F(DepsLogTest, InvalidHeader) {
   const char *kInvalidHeaders[] = {
@@ -32,6 +32,7 @@
 #endif
 
 #include "metrics.h"
+#include "probes.h"
 #include "util.h"
 
 using namespace std;
@@ -178,6 +179,7 @@ RealDiskInterface::RealDiskInterface()
 
 TimeStamp RealDiskInterface::Stat(const string& path, string* err) const {
   METRIC_RECORD("node stat");
+  NINJA_PROBE_SCOPE(stat, path.c_str());
 #ifdef _WIN32
   // MSDN: "Naming Files, Paths, and Namespaces"
   // http://msdn.microsoft.com/en-us/library/windows/desktop/aa365247(v=vs.85).aspx
@@ -65,17 +65,20 @@ const EvalString* Rule::GetBinding(const string& key) const {
 
 // static
 bool Rule::IsReservedBinding(const string& var) {
-  return var == "command" ||
+  return var == "builtin" ||
+      var == "command" ||
       var == "depfile" ||
       var == "dyndep" ||
       var == "description" ||
       var == "deps" ||
+      var == "direct_exec" ||
       var == "generator" ||
       var == "pool" ||
       var == "restat" ||
       var == "rspfile" ||
       var == "rspfile_content" ||
-      var == "msvc_deps_prefix";
+      var == "msvc_deps_prefix" ||
+      var == "worker";
 }
 
 const map<string, const Rule*>& BindingEnv::GetRules() const {
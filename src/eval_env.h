@@ -50,6 +50,8 @@ struct EvalString {
   std::string Serialize() const;
 
 private:
+  friend struct MemoryStats;
+
   enum TokenType { RAW, SPECIAL };
   typedef std::vector<std::pair<std::string, TokenType> > TokenList;
   TokenList parsed_;
@@ -70,6 +72,7 @@ struct Rule {
  private:
   // Allow the parsers to reach into this object and fill out its fields.
   friend struct ManifestParser;
+  friend struct MemoryStats;
 
   std::string name_;
   typedef std::map<std::string, EvalString> Bindings;
@@ -101,6 +104,8 @@ struct BindingEnv : public Env {
                                  Env* env);
 
 private:
+  friend struct MemoryStats;
+
   std::map<std::string, std::string> bindings_;
   std::map<std::string, const Rule*> rules_;
   BindingEnv* parent_;
@@ -0,0 +1,227 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "executor.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+#include "subprocess.h"
+#include "worker_pool.h"
+
+using namespace std;
+
+#ifndef _WIN32
+
+namespace {
+
+/// Parse a "capacity <n>" message.
+bool ParseCapacity(const string& line, size_t* capacity) {
+  unsigned long value;
+  char trailing;
+  if (sscanf(line.c_str(), "capacity %lu%c", &value, &trailing) != 1)
+    return false;
+  *capacity = value;
+  return true;
+}
+
+}  // anonymous namespace
+
+Executor* Executor::Create(const string& command, SubprocessSet* set,
+                           string* err) {
+  Worker* process = new Worker(command);
+  string line;
+  size_t capacity;
+  if (!process->Start(set, err)) {
+    delete process;
+    return NULL;
+  }
+  if (!process->ReadLine(&line, err)) {
+    if (errno == 0)
+      *err = "exited before giving its capacity";
+    delete process;
+    return NULL;
+  }
+  if (!ParseCapacity(line, &capacity)) {
+    *err = "expected 'capacity <n>', got '" + line + "'";
+    delete process;
+    return NULL;
+  }
+  return new Executor(process, set, capacity);
+}
+
+Executor::Executor(Worker* process, SubprocessSet* set, size_t capacity)
+    : process_(process), set_(set), next_id_(1), capacity_(capacity) {
+  thread_ = thread(&Executor::Run, this);
+}
+
+Executor::~Executor() {
+  // Closing stdin asks the executor to stop; its stdout closes once it
+  // exits, which ends the reading thread.
+  close(process_->in_fd_);
+  process_->in_fd_ = -1;
+  kill(-process_->pid_, SIGTERM);
+  thread_.join();
+  delete process_;
+}
+
+size_t Executor::capacity() const {
+  lock_guard<mutex> lock(mutex_);
+  return capacity_;
+}
+
+int Executor::Start(const string& command) {
+  int id = next_id_++;
+  running_.insert(id);
+  Send("start " + to_string(id) + " " + to_string(command.size()) + "\n" +
+       command);
+  return id;
+}
+
+void Executor::Cancel(int id) {
+  if (running_.count(id))
+    Send("cancel " + to_string(id) + "\n");
+}
+
+void Executor::Send(const string& data) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (!error_.empty())
+      return;
+  }
+
+  // Writing to an executor that exited must fail rather than kill ninja:
+  // block SIGPIPE, and take it if the write raised it.
+  sigset_t pipe_set, old_set;
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+  string err;
+  bool ok = process_->Send(data, &err);
+  sigset_t pending;
+  sigpending(&pending);
+  if (sigismember(&pending, SIGPIPE) && !sigismember(&old_set, SIGPIPE)) {
+    int sig;
+    sigwait(&pipe_set, &sig);
+  }
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+  if (!ok) {
+    lock_guard<mutex> lock(mutex_);
+    if (error_.empty())
+      error_ = err;
+  }
+}
+
+bool Executor::NextFinished(int* id, ExitStatus* status, string* output) {
+  lock_guard<mutex> lock(mutex_);
+  while (!finished_.empty()) {
+    Finished& finished = finished_.front();
+    bool known = running_.erase(finished.id) > 0;
+    if (known) {
+      *id = finished.id;
+      *status = finished.status;
+      output->swap(finished.output);
+    }
+    finished_.pop();
+    if (known)
+      return true;
+  }
+  if (!error_.empty() && !running_.empty()) {
+    *id = *running_.begin();
+    running_.erase(running_.begin());
+    *status = ExitFailure;
+    *output = "ninja: executor '" + process_->command_ + "': " + error_ + "\n";
+    return true;
+  }
+  return false;
+}
+
+void Executor::Run() {
+  string err;
+  for (;;) {
+    string line;
+    if (!process_->ReadLine(&line, &err)) {
+      if (errno == 0)
+        err = "exited";
+      break;
+    }
+
+    size_t capacity;
+    if (ParseCapacity(line, &capacity)) {
+      lock_guard<mutex> lock(mutex_);
+      capacity_ = capacity;
+      continue;
+    }
+
+    Finished finished;
+    int exit_code;
+    unsigned long length;
+    char trailing;
+    if (sscanf(line.c_str(), "done %d %d %lu%c", &finished.id, &exit_code,
+               &length, &trailing) != 3) {
+      err = "malformed message '" + line + "'";
+      break;
+    }
+    if (!process_->Read(length, &finished.output, &err)) {
+      if (errno == 0)
+        err = "exited";
+      break;
+    }
+    finished.status = exit_code == 0 ? ExitSuccess : ExitFailure;
+    {
+      lock_guard<mutex> lock(mutex_);
+      finished_.push(finished);
+    }
+    set_->Wake();
+  }
+
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (error_.empty())
+      error_ = err;
+  }
+  set_->Wake();
+}
+
+#else  // _WIN32
+
+Executor* Executor::Create(const string& command, SubprocessSet* set,
+                           string* err) {
+  *err = "executors are not supported on Windows";
+  return NULL;
+}
+
+Executor::~Executor() {}
+
+size_t Executor::capacity() const {
+  return 0;
+}
+
+int Executor::Start(const string& command) {
+  return 0;
+}
+
+void Executor::Cancel(int id) {}
+
+bool Executor::NextFinished(int* id, ExitStatus* status, string* output) {
+  return false;
+}
+
+#endif  // _WIN32
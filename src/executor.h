@@ -0,0 +1,103 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_EXECUTOR_H_
+#define NINJA_EXECUTOR_H_
+
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "exit_status.h"
+
+struct SubprocessSet;
+struct Worker;
+
+/// Executor hands commands to an external executor process, which runs
+/// them wherever it likes: on a build farm, in containers, or batched.
+///
+/// The protocol is on the executor's stdin and stdout, with lengths in
+/// bytes and numbers in decimal:
+///   executor: "capacity <n>\n"
+///     The number of commands it accepts at once.  This must be its first
+///     message, and may be sent again at any time.
+///   ninja:    "start <id> <length>\n<command>"
+///     Run a command.  Ids are unique within the build.
+///   ninja:    "cancel <id>\n"
+///     Stop a command, e.g. as the build was interrupted.
+///   executor: "done <id> <exit code> <length>\n<output>"
+///     A command finished, or was cancelled, with its combined stdout and
+///     stderr.
+/// Once its stdin is closed, the executor should stop its commands and
+/// exit.  Commands still running when the executor exits or sends a
+/// malformed message fail.
+struct Executor {
+  /// Start the executor |command| and wait for its capacity.  |set| is
+  /// woken up whenever a message arrives.  Returns NULL and fills in |err|
+  /// on error, and on Windows, where executors aren't supported.
+  static Executor* Create(const std::string& command, SubprocessSet* set,
+                          std::string* err);
+  /// Stops the executor.
+  ~Executor();
+
+  /// Number of commands the executor accepts at once.
+  size_t capacity() const;
+
+  /// Send |command| to the executor.  Returns its id.
+  int Start(const std::string& command);
+
+  /// Ask the executor to stop the command |id|.  It still finishes.
+  void Cancel(int id);
+
+  /// Fill in the id, status and output of the next finished command, and
+  /// return true, or return false if there is none.
+  bool NextFinished(int* id, ExitStatus* status, std::string* output);
+
+ private:
+  Executor(Worker* process, SubprocessSet* set, size_t capacity);
+
+  /// Send |data|, and note that the executor is broken if it can't be.
+  void Send(const std::string& data);
+
+  /// Body of the thread reading messages.
+  void Run();
+
+  struct Finished {
+    int id;
+    ExitStatus status;
+    std::string output;
+  };
+
+  Worker* process_;
+  SubprocessSet* set_;
+  int next_id_;
+  /// Ids sent and not yet returned by NextFinished().
+  std::set<int> running_;
+
+  mutable std::mutex mutex_;
+  /// Guarded by |mutex_|.
+  size_t capacity_;
+  std::queue<Finished> finished_;
+  /// Why the executor can't be used anymore, if it can't.
+  std::string error_;
+
+  std::thread thread_;
+
+  Executor(const Executor&);
+  void operator=(const Executor&);
+};
+
+#endif  // NINJA_EXECUTOR_H_
@@ -0,0 +1,137 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "executor.h"
+
+#include <memory>
+
+#include "subprocess.h"
+#include "test.h"
+
+using namespace std;
+
+#ifndef _WIN32
+
+namespace {
+
+/// An executor that runs one command at a time in a shell.
+const char kShellExecutor[] =
+    "sh -c '"
+    "echo capacity 2; "
+    "while read kind id len; do "
+    "  case $kind in "
+    "  start) "
+    "    cmd=$(head -c \"$len\"); "
+    "    out=$(eval \"$cmd\" 2>&1); code=$?; "
+    "    printf \"done %d %d %d\\n%s\" \"$id\" \"$code\" \"${#out}\" \"$out\";; "
+    "  esac; "
+    "done'";
+
+struct ExecutorTest : public testing::Test {
+  /// Wait for the next command to finish, as RealCommandRunner does.
+  int Wait(ExitStatus* status, string* output) {
+    int id;
+    while (!executor_->NextFinished(&id, status, output))
+      subprocs_.DoWork();
+    return id;
+  }
+
+  SubprocessSet subprocs_;
+  unique_ptr<Executor> executor_;
+};
+
+}  // anonymous namespace
+
+TEST_F(ExecutorTest, Run) {
+  string err, output;
+  executor_.reset(Executor::Create(kShellExecutor, &subprocs_, &err));
+  ASSERT_TRUE(executor_.get()) << err;
+  EXPECT_EQ(2u, executor_->capacity());
+
+  int first = executor_->Start("echo hello");
+  int second = executor_->Start("echo failed; false");
+  EXPECT_NE(first, second);
+
+  ExitStatus status;
+  EXPECT_EQ(first, Wait(&status, &output));
+  EXPECT_EQ(ExitSuccess, status);
+  EXPECT_EQ("hello", output);
+
+  EXPECT_EQ(second, Wait(&status, &output));
+  EXPECT_EQ(ExitFailure, status);
+  EXPECT_EQ("failed", output);
+}
+
+TEST_F(ExecutorTest, CapacityChanges) {
+  string err, output;
+  executor_.reset(Executor::Create(
+      "sh -c 'echo capacity 1; read kind id len; head -c $len >/dev/null; "
+      "echo capacity 3; printf \"done $id 0 0\\n\"; cat >/dev/null'",
+      &subprocs_, &err));
+  ASSERT_TRUE(executor_.get()) << err;
+  EXPECT_EQ(1u, executor_->capacity());
+
+  ExitStatus status;
+  executor_->Start("true");
+  Wait(&status, &output);
+  EXPECT_EQ(3u, executor_->capacity());
+}
+
+TEST_F(ExecutorTest, BadHandshake) {
+  string err;
+  executor_.reset(Executor::Create("echo hello", &subprocs_, &err));
+  EXPECT_FALSE(executor_.get());
+  EXPECT_EQ("expected 'capacity <n>', got 'hello'", err);
+
+  executor_.reset(Executor::Create("true", &subprocs_, &err));
+  EXPECT_FALSE(executor_.get());
+  EXPECT_EQ("exited before giving its capacity", err);
+}
+
+TEST_F(ExecutorTest, ExitFailsRunningCommands) {
+  // Exits after reading the request, so that it can't exit before the
+  // request is written and fail it with EPIPE instead.
+  string err, output;
+  executor_.reset(Executor::Create("echo capacity 4; read request",
+                                   &subprocs_, &err));
+  ASSERT_TRUE(executor_.get()) << err;
+
+  int id = executor_->Start("echo hello");
+  ExitStatus status;
+  EXPECT_EQ(id, Wait(&status, &output));
+  EXPECT_EQ(ExitFailure, status);
+  EXPECT_EQ("ninja: executor 'echo capacity 4; read request': exited\n",
+            output);
+
+  // Later commands fail too.
+  id = executor_->Start("echo hello");
+  EXPECT_EQ(id, Wait(&status, &output));
+  EXPECT_EQ(ExitFailure, status);
+}
+
+TEST_F(ExecutorTest, MalformedMessage) {
+  string err, output;
+  executor_.reset(Executor::Create("echo capacity 4; echo nonsense; cat",
+                                   &subprocs_, &err));
+  ASSERT_TRUE(executor_.get()) << err;
+
+  executor_->Start("echo hello");
+  ExitStatus status;
+  Wait(&status, &output);
+  EXPECT_EQ(ExitFailure, status);
+  EXPECT_EQ("ninja: executor 'echo capacity 4; echo nonsense; cat': "
+            "malformed message 'nonsense'\n", output);
+}
+
+#endif  // _WIN32
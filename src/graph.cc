@@ -26,6 +26,7 @@
 #include "disk_interface.h"
 #include "manifest_parser.h"
 #include "metrics.h"
+#include "probes.h"
 #include "state.h"
 #include "util.h"
 
@@ -49,6 +50,8 @@ void Node::UpdatePhonyMtime(TimeStamp mtime) {
 bool DependencyScan::RecomputeDirty(Node* initial_node,
                                     std::vector<Node*>* validation_nodes,
                                     string* err) {
+  METRIC_RECORD("dirty scan");
+  NINJA_PROBE_SCOPE(dirty_scan, initial_node->path().c_str());
   std::vector<Node*> stack;
   std::vector<Node*> new_validation_nodes;
 
@@ -264,10 +267,9 @@ bool DependencyScan::VerifyDAG(Node* node, vector<Node*>* stack, string* err) {
 
 bool DependencyScan::RecomputeOutputsDirty(Edge* edge, Node* most_recent_input,
                                            bool* outputs_dirty, string* err) {
-  string command = edge->EvaluateCommand(/*incl_rsp_file=*/true);
   for (vector<Node*>::iterator o = edge->outputs_.begin();
        o != edge->outputs_.end(); ++o) {
-    if (RecomputeOutputDirty(edge, most_recent_input, command, *o)) {
+    if (RecomputeOutputDirty(edge, most_recent_input, *o)) {
       *outputs_dirty = true;
       return true;
     }
@@ -275,9 +277,8 @@ bool DependencyScan::RecomputeOutputsDirty(Edge* edge, Node* most_recent_input,
   return true;
 }
 
-bool DependencyScan::RecomputeOutputDirty(const Edge* edge,
+bool DependencyScan::RecomputeOutputDirty(Edge* edge,
                                           const Node* most_recent_input,
-                                          const string& command,
                                           Node* output) {
   if (edge->is_phony()) {
     // Phony edges don't write any output.  Outputs are only dirty if
@@ -316,7 +317,7 @@ bool DependencyScan::RecomputeOutputDirty(const Edge* edge,
   // the log against the most recent input's mtime (see below)
   bool used_restat = false;
   if (edge->GetBindingBool("restat") && build_log() &&
-      (entry = build_log()->LookupByOutput(output->path()))) {
+      (entry = build_log()->LookupByOutput(output))) {
     used_restat = true;
   }
 
@@ -333,9 +334,8 @@ bool DependencyScan::RecomputeOutputDirty(const Edge* edge,
 
   if (build_log()) {
     bool generator = edge->GetBindingBool("generator");
-    if (entry || (entry = build_log()->LookupByOutput(output->path()))) {
-      if (!generator &&
-          BuildLog::LogEntry::HashCommand(command) != entry->command_hash) {
+    if (entry || (entry = build_log()->LookupByOutput(output))) {
+      if (!generator && edge->GetCommandHash() != entry->command_hash) {
         // May also be dirty due to the command changing since the last build.
         // But if this is a generator rule, the command changing does not make us
         // dirty.
@@ -528,6 +528,14 @@ std::string Edge::EvaluateCommand(const bool incl_rsp_file) const {
   return command;
 }
 
+uint64_t Edge::GetCommandHash() {
+  if (!command_hash_valid_) {
+    command_hash_ = BuildLog::LogEntry::HashCommand(EvaluateCommand(true));
+    command_hash_valid_ = true;
+  }
+  return command_hash_;
+}
+
 std::string Edge::GetBinding(const std::string& key) const {
   EdgeEnv env(this, EdgeEnv::kShellEscape);
   return env.LookupVariable(key);
@@ -662,6 +670,7 @@ struct matches {
 bool ImplicitDepLoader::LoadDepFile(Edge* edge, const string& path,
                                     string* err) {
   METRIC_RECORD("depfile load");
+  NINJA_PROBE_SCOPE(depfile_load, path.c_str());
   // Read depfile content.  Treat a missing depfile as empty.
   string content;
   switch (disk_interface_->ReadFile(path, &content, err)) {
@@ -674,6 +683,7 @@ bool ImplicitDepLoader::LoadDepFile(Edge* edge, const string& path,
     *err = "loading '" + path + "': " + *err;
     return false;
   }
+  METRIC_COUNT("depfile bytes", content.size());
   // On a missing depfile: return false and empty *err.
   Node* first_output = edge->outputs_[0];
   if (content.empty()) {
@@ -746,6 +756,7 @@ bool ImplicitDepLoader::ProcessDepfileDeps(
 bool ImplicitDepLoader::LoadDepsFromLog(Edge* edge, string* err) {
   // NOTE: deps are only supported for single-target edges.
   Node* output = edge->outputs_[0];
+  NINJA_PROBE1(deps_log_lookup, output->path().c_str());
   DepsLog::Deps* deps = deps_log_ ? deps_log_->GetDeps(output) : NULL;
   if (!deps) {
     explanations_.Record(output, "deps for '%s' are missing",
@@ -21,13 +21,13 @@
 #include <string>
 #include <vector>
 
+#include "build_log.h"
 #include "dyndep.h"
 #include "eval_env.h"
 #include "explanations.h"
 #include "timestamp.h"
 #include "util.h"
 
-struct BuildLog;
 struct DepfileParserOptions;
 struct DiskInterface;
 struct DepsLog;
@@ -110,6 +110,15 @@ struct Node {
   int id() const { return id_; }
   void set_id(int id) { id_ = id; }
 
+  /// The build log entry for this node, cached by BuildLog::LookupByOutput.
+  /// Only meaningful while |log_entry_generation()| matches the log's.
+  BuildLog::LogEntry* log_entry() const { return log_entry_; }
+  uint64_t log_entry_generation() const { return log_entry_generation_; }
+  void set_log_entry(BuildLog::LogEntry* entry, uint64_t generation) {
+    log_entry_ = entry;
+    log_entry_generation_ = generation;
+  }
+
   const std::vector<Edge*>& out_edges() const { return out_edges_; }
   const std::vector<Edge*>& validation_out_edges() const { return validation_out_edges_; }
   void AddOutEdge(Edge* edge) { out_edges_.push_back(edge); }
@@ -168,6 +177,10 @@ private:
 
   /// A dense integer id for the node, assigned and used by DepsLog.
   int id_ = -1;
+
+  /// Cached build log entry, or NULL if the log has none; see log_entry().
+  BuildLog::LogEntry* log_entry_ = nullptr;
+  uint64_t log_entry_generation_ = 0;
 };
 
 /// An edge in the dependency graph; links between Nodes using Rules.
@@ -188,6 +201,13 @@ struct Edge {
   /// full contents of a response file (if applicable)
   std::string EvaluateCommand(bool incl_rsp_file = false) const;
 
+  /// Hash of EvaluateCommand(true), as stored in the build log.  Computed
+  /// on first use and cached, since it is needed for every output during
+  /// each scan and again when the edge finishes.
+  uint64_t GetCommandHash();
+  /// Forget the cached command hash after the edge's bindings change.
+  void ResetCommandHash() { command_hash_valid_ = false; }
+
   /// Returns the shell-escaped value of |key|.
   std::string GetBinding(const std::string& key) const;
   bool GetBindingBool(const std::string& key) const;
@@ -228,6 +248,8 @@ struct Edge {
   bool deps_missing_ = false;
   bool generated_by_dep_loader_ = false;
   TimeStamp command_start_time_ = 0;
+  uint64_t command_hash_ = 0;
+  bool command_hash_valid_ = false;
 
   const Rule& rule() const { return *rule_; }
   Pool* pool() const { return pool_; }
@@ -377,8 +399,8 @@ struct DependencyScan {
 
   /// Recompute whether a given single output should be marked dirty.
   /// Returns true if so.
-  bool RecomputeOutputDirty(const Edge* edge, const Node* most_recent_input,
-                            const std::string& command, Node* output);
+  bool RecomputeOutputDirty(Edge* edge, const Node* most_recent_input,
+                            Node* output);
 
   void RecordExplanation(const Node* node, const char* fmt, ...);
 
@@ -0,0 +1,155 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "jobserver.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+/// Write the token |c| to |fd|, retrying if interrupted.
+bool WriteToken(int fd, char c) {
+  ssize_t len;
+  do {
+    len = write(fd, &c, 1);
+  } while (len < 0 && errno == EINTR);
+  return len == 1;
+}
+
+/// Open the fifo at |path| for both reading and writing, so that writes
+/// never fail for want of a reader.  The descriptor isn't inherited by
+/// commands: they find the fifo through MAKEFLAGS.
+int OpenFifo(const string& path, string* err) {
+  int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    *err = "open(" + path + "): " + strerror(errno);
+  return fd;
+}
+
+struct FifoJobserverClient : public JobserverClient {
+  explicit FifoJobserverClient(int fd) : fd_(fd) {}
+  virtual ~FifoJobserverClient();
+
+  virtual bool Acquire();
+  virtual void Release();
+
+  int fd_;
+  /// The tokens taken so far.  GNU make may give tokens different values,
+  /// so each is given back as it was read.
+  vector<char> tokens_;
+};
+
+FifoJobserverClient::~FifoJobserverClient() {
+  while (!tokens_.empty())
+    Release();
+  close(fd_);
+}
+
+bool FifoJobserverClient::Acquire() {
+  char c;
+  ssize_t len;
+  do {
+    len = read(fd_, &c, 1);
+  } while (len < 0 && errno == EINTR);
+  if (len != 1)
+    return false;
+  tokens_.push_back(c);
+  return true;
+}
+
+void FifoJobserverClient::Release() {
+  if (tokens_.empty())
+    return;
+  WriteToken(fd_, tokens_.back());
+  tokens_.pop_back();
+}
+
+struct FifoJobserverPool : public JobserverPool {
+  FifoJobserverPool(int slots, int fd, const string& path)
+      : JobserverPool(slots), fd_(fd) {
+    config_.mode = JobserverConfig::kModePosixFifo;
+    config_.path = path;
+  }
+  virtual ~FifoJobserverPool();
+
+  /// Kept open so that the tokens in the fifo outlive the commands using it.
+  int fd_;
+};
+
+FifoJobserverPool::~FifoJobserverPool() {
+  close(fd_);
+  unlink(config_.path.c_str());
+}
+
+}  // anonymous namespace
+
+JobserverClient* JobserverClient::Create(const JobserverConfig& config,
+                                         string* err) {
+  switch (config.mode) {
+  case JobserverConfig::kModePosixFifo: {
+    int fd = OpenFifo(config.path, err);
+    if (fd < 0)
+      return NULL;
+    return new FifoJobserverClient(fd);
+  }
+  case JobserverConfig::kModePipe:
+    *err = "pipe-based jobservers are not supported; "
+           "use --jobserver-style=fifo with GNU make 4.4 or later";
+    return NULL;
+  default:
+    *err = "unsupported jobserver";
+    return NULL;
+  }
+}
+
+JobserverPool* JobserverPool::Create(int slots, string* err) {
+  if (slots < 1) {
+    *err = "a jobserver needs at least one job slot";
+    return NULL;
+  }
+
+  const char* tmpdir = getenv("TMPDIR");
+  string path = string(tmpdir && *tmpdir ? tmpdir : "/tmp") +
+                "/ninja-jobserver-" + to_string(getpid());
+  if (mkfifo(path.c_str(), 0600) < 0) {
+    *err = "mkfifo(" + path + "): " + strerror(errno);
+    return NULL;
+  }
+
+  int fd = OpenFifo(path, err);
+  if (fd < 0) {
+    unlink(path.c_str());
+    return NULL;
+  }
+
+  // Ninja and the commands it runs always have the first slot.
+  for (int i = 1; i < slots; ++i) {
+    if (!WriteToken(fd, '+')) {
+      *err = "too many job slots for a jobserver fifo";
+      close(fd);
+      unlink(path.c_str());
+      return NULL;
+    }
+  }
+  return new FifoJobserverPool(slots, fd, path);
+}
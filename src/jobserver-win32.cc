@@ -0,0 +1,102 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "jobserver.h"
+
+#include <windows.h>
+
+#include "util.h"
+
+using namespace std;
+
+namespace {
+
+struct SemaphoreJobserverClient : public JobserverClient {
+  explicit SemaphoreJobserverClient(HANDLE semaphore)
+      : semaphore_(semaphore), tokens_(0) {}
+  virtual ~SemaphoreJobserverClient();
+
+  virtual bool Acquire();
+  virtual void Release();
+
+  HANDLE semaphore_;
+  /// Number of tokens taken so far.
+  int tokens_;
+};
+
+SemaphoreJobserverClient::~SemaphoreJobserverClient() {
+  while (tokens_ > 0)
+    Release();
+  CloseHandle(semaphore_);
+}
+
+bool SemaphoreJobserverClient::Acquire() {
+  if (WaitForSingleObject(semaphore_, 0) != WAIT_OBJECT_0)
+    return false;
+  ++tokens_;
+  return true;
+}
+
+void SemaphoreJobserverClient::Release() {
+  if (tokens_ == 0)
+    return;
+  ReleaseSemaphore(semaphore_, 1, NULL);
+  --tokens_;
+}
+
+struct SemaphoreJobserverPool : public JobserverPool {
+  SemaphoreJobserverPool(int slots, HANDLE semaphore, const string& name)
+      : JobserverPool(slots), semaphore_(semaphore) {
+    config_.mode = JobserverConfig::kModeWin32Semaphore;
+    config_.path = name;
+  }
+  virtual ~SemaphoreJobserverPool() { CloseHandle(semaphore_); }
+
+  HANDLE semaphore_;
+};
+
+}  // anonymous namespace
+
+JobserverClient* JobserverClient::Create(const JobserverConfig& config,
+                                         string* err) {
+  if (config.mode != JobserverConfig::kModeWin32Semaphore) {
+    *err = "unsupported jobserver";
+    return NULL;
+  }
+  HANDLE semaphore = OpenSemaphoreA(SEMAPHORE_MODIFY_STATE | SYNCHRONIZE,
+                                    FALSE, config.path.c_str());
+  if (!semaphore) {
+    *err = "OpenSemaphore(" + config.path + "): " + GetLastErrorString();
+    return NULL;
+  }
+  return new SemaphoreJobserverClient(semaphore);
+}
+
+JobserverPool* JobserverPool::Create(int slots, string* err) {
+  if (slots < 1) {
+    *err = "a jobserver needs at least one job slot";
+    return NULL;
+  }
+
+  // Ninja and the commands it runs always have the first slot.
+  string name = "ninja-jobserver-" + to_string(GetCurrentProcessId());
+  HANDLE semaphore =
+      CreateSemaphoreA(NULL, slots - 1, slots - 1 > 0 ? slots - 1 : 1,
+                       name.c_str());
+  if (!semaphore) {
+    *err = "CreateSemaphore(" + name + "): " + GetLastErrorString();
+    return NULL;
+  }
+  return new SemaphoreJobserverPool(slots, semaphore, name);
+}
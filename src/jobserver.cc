@@ -0,0 +1,153 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "jobserver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "util.h"
+
+using namespace std;
+
+namespace {
+
+/// Split |str| into whitespace-separated words.
+vector<string> SplitWords(const string& str) {
+  vector<string> words;
+  size_t pos = 0;
+  for (;;) {
+    pos = str.find_first_not_of(" \t", pos);
+    if (pos == string::npos)
+      break;
+    size_t end = str.find_first_of(" \t", pos);
+    if (end == string::npos)
+      end = str.size();
+    words.push_back(str.substr(pos, end - pos));
+    pos = end;
+  }
+  return words;
+}
+
+bool StartsWith(const string& str, const char* prefix) {
+  return str.compare(0, strlen(prefix), prefix) == 0;
+}
+
+const char kAuthPrefix[] = "--jobserver-auth=";
+const char kFdsPrefix[] = "--jobserver-fds=";
+
+/// Whether |word| of MAKEFLAGS is about jobs, and so is replaced when ninja
+/// hands out its own jobserver.
+bool IsJobsFlag(const string& word) {
+  return StartsWith(word, "-j") || StartsWith(word, "--jobs") ||
+         StartsWith(word, kAuthPrefix) || StartsWith(word, kFdsPrefix);
+}
+
+}  // anonymous namespace
+
+bool ParseJobserverMakeFlags(const string& makeflags, JobserverConfig* config,
+                             string* err) {
+  *config = JobserverConfig();
+  vector<string> words = SplitWords(makeflags);
+  for (vector<string>::const_iterator w = words.begin(); w != words.end();
+       ++w) {
+    string value;
+    if (StartsWith(*w, kAuthPrefix))
+      value = w->substr(strlen(kAuthPrefix));
+    else if (StartsWith(*w, kFdsPrefix))
+      value = w->substr(strlen(kFdsPrefix));
+    else
+      continue;
+
+    if (value.empty()) {
+      *err = "empty jobserver option '" + *w + "'";
+      return false;
+    }
+
+    *config = JobserverConfig();
+    if (StartsWith(value, "fifo:")) {
+      config->mode = JobserverConfig::kModePosixFifo;
+      config->path = value.substr(strlen("fifo:"));
+      if (config->path.empty()) {
+        *err = "empty jobserver fifo path";
+        return false;
+      }
+      continue;
+    }
+
+    int read_fd, write_fd;
+    char trailing;
+    if (sscanf(value.c_str(), "%d,%d%c", &read_fd, &write_fd, &trailing) == 2) {
+      // Make passes -1,-1 when the jobserver isn't open to this command.
+      if (read_fd >= 0 && write_fd >= 0)
+        config->mode = JobserverConfig::kModePipe;
+      continue;
+    }
+
+    config->mode = JobserverConfig::kModeWin32Semaphore;
+    config->path = value;
+  }
+  return true;
+}
+
+JobserverClient* JobserverClient::CreateFromEnvironment() {
+  const char* makeflags = getenv("MAKEFLAGS");
+  if (!makeflags)
+    return NULL;
+
+  JobserverConfig config;
+  string err;
+  if (!ParseJobserverMakeFlags(makeflags, &config, &err)) {
+    Warning("ignoring jobserver in MAKEFLAGS: %s", err.c_str());
+    return NULL;
+  }
+  if (config.mode == JobserverConfig::kModeNone)
+    return NULL;
+
+  JobserverClient* client = Create(config, &err);
+  if (!client)
+    Warning("ignoring jobserver in MAKEFLAGS: %s", err.c_str());
+  return client;
+}
+
+string JobserverPool::GetMakeFlags(const string& makeflags) const {
+  string result;
+  vector<string> words = SplitWords(makeflags);
+  for (vector<string>::const_iterator w = words.begin(); w != words.end();
+       ++w) {
+    if (IsJobsFlag(*w))
+      continue;
+    result += *w;
+    result += ' ';
+  }
+
+  result += "-j" + to_string(slots_) + " " + kAuthPrefix;
+  if (config_.mode == JobserverConfig::kModePosixFifo)
+    result += "fifo:";
+  result += config_.path;
+  return result;
+}
+
+void JobserverPool::SetMakeFlagsEnvironment() const {
+  const char* makeflags = getenv("MAKEFLAGS");
+  string value = GetMakeFlags(makeflags ? makeflags : "");
+#ifdef _WIN32
+  _putenv_s("MAKEFLAGS", value.c_str());
+#else
+  setenv("MAKEFLAGS", value.c_str(), 1);
+#endif
+}
@@ -0,0 +1,101 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_JOBSERVER_H_
+#define NINJA_JOBSERVER_H_
+
+#include <string>
+
+/// Support for the GNU make jobserver protocol, which lets nested builds
+/// share a single parallelism limit.  The jobserver holds one token per
+/// job slot but the first; a client may always run one job on the slot it
+/// was started with, and must acquire a token for each job beyond that and
+/// return it when the job is done.
+///
+/// On Posix, only the fifo style of GNU make 4.4 is supported: the older
+/// anonymous pipe style cannot be read without blocking, since the pipe is
+/// shared with other processes.  On Windows, tokens are a named semaphore.
+
+/// How to reach a jobserver, as found in MAKEFLAGS.
+struct JobserverConfig {
+  enum Mode {
+    kModeNone,
+    /// --jobserver-auth=R,W or --jobserver-fds=R,W (unsupported).
+    kModePipe,
+    /// --jobserver-auth=fifo:PATH
+    kModePosixFifo,
+    /// --jobserver-auth=NAME
+    kModeWin32Semaphore,
+  };
+
+  JobserverConfig() : mode(kModeNone) {}
+
+  Mode mode;
+  /// The fifo path or semaphore name.
+  std::string path;
+};
+
+/// Parse the value of MAKEFLAGS.  The last jobserver option wins, as in
+/// GNU make.  Returns false and fills in |err| if it is malformed.
+bool ParseJobserverMakeFlags(const std::string& makeflags,
+                             JobserverConfig* config, std::string* err);
+
+/// A connection to a jobserver.
+struct JobserverClient {
+  /// Connect to the jobserver described by |config|.  Returns NULL and fills
+  /// in |err| if that isn't possible.
+  static JobserverClient* Create(const JobserverConfig& config,
+                                 std::string* err);
+
+  /// Connect to the jobserver in the MAKEFLAGS environment variable, if
+  /// any.  Returns NULL, and warns if MAKEFLAGS names a jobserver that
+  /// can't be used.
+  static JobserverClient* CreateFromEnvironment();
+
+  virtual ~JobserverClient() {}
+
+  /// Take a token if one is available, without blocking.
+  virtual bool Acquire() = 0;
+  /// Give back a token taken with Acquire().
+  virtual void Release() = 0;
+};
+
+/// A jobserver run by ninja for the commands it starts, so that those that
+/// are build tools themselves share ninja's -j limit.
+struct JobserverPool {
+  /// Create a jobserver with |slots| job slots.  Returns NULL and fills in
+  /// |err| on failure.
+  static JobserverPool* Create(int slots, std::string* err);
+
+  virtual ~JobserverPool() {}
+
+  /// How clients reach this jobserver.
+  const JobserverConfig& config() const { return config_; }
+
+  /// The value to give MAKEFLAGS so that commands use this jobserver,
+  /// keeping the options in |makeflags| that aren't about jobs.
+  std::string GetMakeFlags(const std::string& makeflags) const;
+
+  /// Point MAKEFLAGS in ninja's environment, which commands inherit, at
+  /// this jobserver.
+  void SetMakeFlagsEnvironment() const;
+
+ protected:
+  JobserverPool(int slots) : slots_(slots) {}
+
+  int slots_;
+  JobserverConfig config_;
+};
+
+#endif  // NINJA_JOBSERVER_H_
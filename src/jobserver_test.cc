@@ -0,0 +1,98 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "jobserver.h"
+
+#include <memory>
+
+#include "test.h"
+
+using namespace std;
+
+TEST(JobserverTest, ParseMakeFlags) {
+  JobserverConfig config;
+  string err;
+
+  EXPECT_TRUE(ParseJobserverMakeFlags("", &config, &err));
+  EXPECT_EQ(JobserverConfig::kModeNone, config.mode);
+
+  EXPECT_TRUE(ParseJobserverMakeFlags("kw -j4", &config, &err));
+  EXPECT_EQ(JobserverConfig::kModeNone, config.mode);
+
+  EXPECT_TRUE(ParseJobserverMakeFlags(
+      "kw -j4 --jobserver-auth=fifo:/tmp/GMfifo123", &config, &err));
+  EXPECT_EQ(JobserverConfig::kModePosixFifo, config.mode);
+  EXPECT_EQ("/tmp/GMfifo123", config.path);
+
+  EXPECT_TRUE(ParseJobserverMakeFlags(" -j4 --jobserver-fds=3,4", &config,
+                                      &err));
+  EXPECT_EQ(JobserverConfig::kModePipe, config.mode);
+
+  EXPECT_TRUE(ParseJobserverMakeFlags("--jobserver-auth=-1,-1", &config,
+                                      &err));
+  EXPECT_EQ(JobserverConfig::kModeNone, config.mode);
+
+  EXPECT_TRUE(ParseJobserverMakeFlags("-j4 --jobserver-auth=gmake_semaphore_1",
+                                      &config, &err));
+  EXPECT_EQ(JobserverConfig::kModeWin32Semaphore, config.mode);
+  EXPECT_EQ("gmake_semaphore_1", config.path);
+
+  // The last option wins.
+  EXPECT_TRUE(ParseJobserverMakeFlags(
+      "--jobserver-auth=3,4 --jobserver-auth=fifo:/tmp/f", &config, &err));
+  EXPECT_EQ(JobserverConfig::kModePosixFifo, config.mode);
+  EXPECT_EQ("/tmp/f", config.path);
+
+  EXPECT_FALSE(ParseJobserverMakeFlags("--jobserver-auth=fifo:", &config,
+                                       &err));
+  EXPECT_EQ("empty jobserver fifo path", err);
+}
+
+TEST(JobserverTest, PoolAndClient) {
+  string err;
+  unique_ptr<JobserverPool> pool(JobserverPool::Create(3, &err));
+  ASSERT_TRUE(pool) << err;
+  EXPECT_NE(string::npos,
+            pool->GetMakeFlags("kw -j8").find("kw -j3 --jobserver-auth="));
+
+  unique_ptr<JobserverClient> client(
+      JobserverClient::Create(pool->config(), &err));
+  ASSERT_TRUE(client) << err;
+
+  // Three slots: the implicit one and two tokens.
+  EXPECT_TRUE(client->Acquire());
+  EXPECT_TRUE(client->Acquire());
+  EXPECT_FALSE(client->Acquire());
+
+  client->Release();
+  EXPECT_TRUE(client->Acquire());
+  EXPECT_FALSE(client->Acquire());
+
+  // A client gives back its tokens when it goes away.
+  client.reset(JobserverClient::Create(pool->config(), &err));
+  ASSERT_TRUE(client) << err;
+  EXPECT_TRUE(client->Acquire());
+  EXPECT_TRUE(client->Acquire());
+  EXPECT_FALSE(client->Acquire());
+}
+
+#ifndef _WIN32
+TEST(JobserverTest, PipeUnsupported) {
+  JobserverConfig config;
+  config.mode = JobserverConfig::kModePipe;
+  string err;
+  EXPECT_EQ(NULL, JobserverClient::Create(config, &err));
+  EXPECT_NE("", err);
+}
+#endif
@@ -0,0 +1,133 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "log_writer.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Waits below also time out periodically, so that a missed wakeup can
+// only delay the writer, never hang the build.
+const chrono::milliseconds kWaitTimeout(100);
+
+}  // namespace
+
+LogWriter::LogWriter()
+    : head_(NULL), waiting_(false), error_(0), queued_(0), written_(0),
+      quit_(false) {
+  thread_ = thread(&LogWriter::Run, this);
+}
+
+LogWriter::~LogWriter() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    quit_ = true;
+    work_available_.notify_one();
+  }
+  thread_.join();
+}
+
+void LogWriter::Append(FILE* file, string* data) {
+  Record* record = new Record;
+  record->file = file;
+  record->data.swap(*data);
+  queued_.fetch_add(1);
+
+  record->next = head_.load(memory_order_relaxed);
+  while (!head_.compare_exchange_weak(record->next, record))
+    ;
+
+  // The writer thread sets |waiting_| before checking |head_| one last time,
+  // so either it sees this record, or we see that it needs a wakeup.
+  if (waiting_.load()) {
+    lock_guard<mutex> lock(mutex_);
+    work_available_.notify_one();
+  }
+}
+
+bool LogWriter::Flush() {
+  uint64_t queued = queued_.load();
+  unique_lock<mutex> lock(mutex_);
+  while (written_ < queued)
+    work_done_.wait_for(lock, kWaitTimeout);
+  if (error_) {
+    errno = error_;
+    return false;
+  }
+  return true;
+}
+
+void LogWriter::Run() {
+  for (;;) {
+    Record* records = head_.exchange(NULL);
+    if (records) {
+      uint64_t count = WriteBatch(records);
+      lock_guard<mutex> lock(mutex_);
+      written_ += count;
+      work_done_.notify_all();
+      continue;
+    }
+
+    unique_lock<mutex> lock(mutex_);
+    waiting_.store(true);
+    if (!head_.load()) {
+      if (quit_)
+        return;
+      work_available_.wait_for(lock, kWaitTimeout);
+    }
+    waiting_.store(false);
+  }
+}
+
+uint64_t LogWriter::WriteBatch(Record* records) {
+  // The list is newest first; reverse it to write in queueing order.
+  Record* oldest = NULL;
+  while (records) {
+    Record* next = records->next;
+    records->next = oldest;
+    oldest = records;
+    records = next;
+  }
+
+  uint64_t count = 0;
+  vector<FILE*> files;
+  while (oldest) {
+    Record* record = oldest;
+    oldest = record->next;
+    ++count;
+    if (!error_ && !record->data.empty()) {
+      if (fwrite(record->data.data(), record->data.size(), 1,
+                 record->file) < 1) {
+        error_ = errno ? errno : EIO;
+      } else if (find(files.begin(), files.end(), record->file) ==
+                 files.end()) {
+        files.push_back(record->file);
+      }
+    }
+    delete record;
+  }
+
+  for (vector<FILE*>::iterator i = files.begin(); i != files.end(); ++i) {
+    if (fflush(*i) != 0 && !error_)
+      error_ = errno ? errno : EIO;
+  }
+  return count;
+}
@@ -0,0 +1,81 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_LOG_WRITER_H_
+#define NINJA_LOG_WRITER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/// LogWriter appends records to the build and deps logs from a background
+/// thread, so that a slow file system does not stall the main loop that
+/// reaps and starts commands.
+///
+/// Records are queued on a lock-free list; the writer thread takes the
+/// whole list at once, writes it in order and flushes each file once per
+/// batch.  After the first failed write, later records are dropped so that
+/// the file still ends in a complete record, and the error is reported by
+/// error() and Flush().
+struct LogWriter {
+  LogWriter();
+  /// Flushes all queued records and stops the thread.
+  ~LogWriter();
+
+  /// Queue the bytes of |data| to be appended to |file|.  |data| is left
+  /// empty.  |file| must stay open until the next Flush().
+  void Append(FILE* file, std::string* data);
+
+  /// Block until every record queued so far is written and flushed.
+  /// Returns false and sets errno if any write failed.
+  bool Flush();
+
+  /// The errno of the first failed write, or 0.
+  int error() const { return error_; }
+
+ private:
+  struct Record {
+    FILE* file;
+    std::string data;
+    Record* next;
+  };
+
+  void Run();
+  /// Write a batch of records, oldest first, and delete them.
+  /// Returns the number of records.
+  uint64_t WriteBatch(Record* records);
+
+  /// Most recently queued record; linked towards older ones.
+  std::atomic<Record*> head_;
+  /// Set by the writer thread while it waits for work.
+  std::atomic<bool> waiting_;
+  std::atomic<int> error_;
+  std::atomic<uint64_t> queued_;
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable work_done_;
+  /// Guarded by |mutex_|.
+  uint64_t written_;
+  bool quit_;
+
+  std::thread thread_;
+};
+
+#endif  // NINJA_LOG_WRITER_H_
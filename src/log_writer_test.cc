@@ -0,0 +1,138 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "log_writer.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "build_log.h"
+#include "deps_log.h"
+#include "graph.h"
+#include "util.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+const char kTestFilename[] = "LogWriterTest-tempfile";
+const char kTestFilename2[] = "LogWriterTest-tempfile2";
+
+struct LogWriterTest : public StateTestWithBuiltinRules, public BuildLogUser {
+  virtual void SetUp() {
+    // In case a crashing test left a stale file behind.
+    unlink(kTestFilename);
+    unlink(kTestFilename2);
+  }
+  virtual void TearDown() {
+    unlink(kTestFilename);
+    unlink(kTestFilename2);
+  }
+  virtual bool IsPathDead(StringPiece s) const { return false; }
+};
+
+TEST_F(LogWriterTest, WritesInOrder) {
+  FILE* f1 = fopen(kTestFilename, "wb");
+  FILE* f2 = fopen(kTestFilename2, "wb");
+  ASSERT_TRUE(f1);
+  ASSERT_TRUE(f2);
+
+  string expected1, expected2;
+  {
+    LogWriter writer;
+    for (int i = 0; i < 1000; ++i) {
+      string record = "record " + to_string(i) + "\n";
+      expected1 += record;
+      writer.Append(f1, &record);
+      EXPECT_EQ("", record);
+      if (i % 3 == 0) {
+        record = to_string(i);
+        expected2 += record;
+        writer.Append(f2, &record);
+      }
+    }
+    EXPECT_TRUE(writer.Flush());
+    EXPECT_EQ(0, writer.error());
+
+    string contents, err;
+    ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+    EXPECT_EQ(expected1, contents);
+    contents.clear();
+    ASSERT_EQ(0, ReadFile(kTestFilename2, &contents, &err));
+    EXPECT_EQ(expected2, contents);
+
+    // Records queued right before destruction are written too.
+    string record = "last\n";
+    expected1 += record;
+    writer.Append(f1, &record);
+  }
+  fclose(f1);
+  fclose(f2);
+
+  string contents, err;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+  EXPECT_EQ(expected1, contents);
+}
+
+TEST_F(LogWriterTest, BuildAndDepsLogs) {
+  AssertParse(&state_,
+"build out: cat mid\n"
+"build mid: cat in\n");
+
+  string err;
+  {
+    LogWriter writer;
+    BuildLog build_log;
+    build_log.set_writer(&writer);
+    EXPECT_TRUE(build_log.OpenForWrite(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+    EXPECT_TRUE(build_log.RecordCommand(state_.edges_[0], 15, 18));
+    EXPECT_TRUE(build_log.RecordCommand(state_.edges_[1], 20, 25));
+
+    DepsLog deps_log;
+    deps_log.set_writer(&writer);
+    EXPECT_TRUE(deps_log.OpenForWrite(kTestFilename2, &err));
+    ASSERT_EQ("", err);
+    vector<Node*> deps;
+    deps.push_back(state_.GetNode("foo.h", 0));
+    deps.push_back(state_.GetNode("bar.h", 0));
+    EXPECT_TRUE(deps_log.RecordDeps(state_.GetNode("out", 0), 1, deps));
+
+    // Close() waits for the writer.
+    build_log.Close();
+    deps_log.Close();
+    EXPECT_EQ(0, writer.error());
+  }
+
+  BuildLog build_log;
+  EXPECT_TRUE(build_log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(2u, build_log.entries().size());
+  BuildLog::LogEntry* e = build_log.LookupByOutput("mid");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(20, e->start_time);
+
+  State state;
+  DepsLog deps_log;
+  EXPECT_TRUE(deps_log.Load(kTestFilename2, &state, &err));
+  ASSERT_EQ("", err);
+  DepsLog::Deps* deps = deps_log.GetDeps(state.GetNode("out", 0));
+  ASSERT_TRUE(deps);
+  ASSERT_EQ(2, deps->node_count);
+  EXPECT_EQ("bar.h", deps->nodes[1]->path());
+}
+
+}  // anonymous namespace
@@ -0,0 +1,210 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "memory_stats.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <set>
+
+#include "build_log.h"
+#include "deps_log.h"
+#include "eval_env.h"
+#include "graph.h"
+#include "state.h"
+
+using namespace std;
+
+namespace {
+
+/// Heap taken by |s|, nothing if it fits in the string itself.
+int64_t StringBytes(const string& s) {
+  static const size_t kInlineCapacity = string().capacity();
+  return s.capacity() > kInlineCapacity ? s.capacity() + 1 : 0;
+}
+
+template <typename T>
+int64_t VectorBytes(const vector<T>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+/// A std::map node has three pointers and a color besides the value.
+template <typename Map>
+int64_t MapBytes(const Map& map) {
+  return map.size() * (sizeof(typename Map::value_type) + 4 * sizeof(void*));
+}
+
+/// A std::unordered_map has a pointer a bucket, and a node an element
+/// with the value, the next pointer and the cached hash.
+template <typename Map>
+int64_t HashTableBytes(const Map& map) {
+  return map.bucket_count() * sizeof(void*) +
+         map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+}
+
+}  // anonymous namespace
+
+int64_t MemoryStats::EvalStringBytes(const EvalString& eval) {
+  int64_t bytes = VectorBytes(eval.parsed_);
+  for (EvalString::TokenList::const_iterator t = eval.parsed_.begin();
+       t != eval.parsed_.end(); ++t) {
+    bytes += StringBytes(t->first);
+  }
+  return bytes;
+}
+
+void MemoryStats::Add(const string& name, int64_t count, int64_t bytes) {
+  Item item = { name, count, bytes };
+  items_.push_back(item);
+}
+
+void MemoryStats::AddState(const State& state) {
+  int64_t path_bytes = 0, node_list_bytes = 0;
+  for (State::Paths::const_iterator p = state.paths_.begin();
+       p != state.paths_.end(); ++p) {
+    const Node* node = p->second;
+    path_bytes += StringBytes(node->path());
+    node_list_bytes += VectorBytes(node->out_edges()) +
+                       VectorBytes(node->validation_out_edges());
+  }
+  int64_t nodes = state.paths_.size();
+  Add("Node objects", nodes, nodes * sizeof(Node));
+  Add("Node paths", nodes, path_bytes);
+  Add("Node out edge lists", nodes, node_list_bytes);
+  Add("State paths hash table", nodes, HashTableBytes(state.paths_));
+
+  // Edges share the scope of their build statement if it has bindings of
+  // its own, and otherwise the enclosing file's.
+  int64_t edge_list_bytes = VectorBytes(state.edges_);
+  set<const BindingEnv*> envs;
+  envs.insert(&state.bindings_);
+  for (vector<Edge*>::const_iterator e = state.edges_.begin();
+       e != state.edges_.end(); ++e) {
+    const Edge* edge = *e;
+    edge_list_bytes += VectorBytes(edge->inputs_) +
+                       VectorBytes(edge->outputs_) +
+                       VectorBytes(edge->validations_);
+    for (const BindingEnv* env = edge->env_; env && envs.insert(env).second;
+         env = env->parent_) {
+    }
+  }
+  int64_t edges = state.edges_.size();
+  Add("Edge objects", edges, edges * sizeof(Edge));
+  Add("Edge node lists", edges, edge_list_bytes);
+
+  int64_t env_bytes = 0, rules = 0, rule_bytes = 0;
+  for (set<const BindingEnv*>::const_iterator e = envs.begin();
+       e != envs.end(); ++e) {
+    const BindingEnv* env = *e;
+    env_bytes += sizeof(BindingEnv) + MapBytes(env->bindings_) +
+                 MapBytes(env->rules_);
+    for (map<string, string>::const_iterator b = env->bindings_.begin();
+         b != env->bindings_.end(); ++b) {
+      env_bytes += StringBytes(b->first) + StringBytes(b->second);
+    }
+    for (map<string, const Rule*>::const_iterator r = env->rules_.begin();
+         r != env->rules_.end(); ++r) {
+      env_bytes += StringBytes(r->first);
+      const Rule* rule = r->second;
+      if (rule == &State::kPhonyRule)
+        continue;
+      ++rules;
+      rule_bytes += sizeof(Rule) + StringBytes(rule->name_) +
+                    MapBytes(rule->bindings_);
+      for (Rule::Bindings::const_iterator b = rule->bindings_.begin();
+           b != rule->bindings_.end(); ++b) {
+        rule_bytes += StringBytes(b->first) + EvalStringBytes(b->second);
+      }
+    }
+  }
+  Add("BindingEnv scopes", envs.size(), env_bytes);
+  Add("Rules and EvalStrings", rules, rule_bytes);
+
+  int64_t pool_bytes = MapBytes(state.pools_);
+  for (map<string, Pool*>::const_iterator p = state.pools_.begin();
+       p != state.pools_.end(); ++p) {
+    pool_bytes += StringBytes(p->first) + sizeof(Pool) +
+                  StringBytes(p->second->name());
+  }
+  Add("Pools", state.pools_.size(), pool_bytes);
+}
+
+void MemoryStats::AddBuildLog(const BuildLog& build_log) {
+  const BuildLog::Entries& entries = build_log.entries();
+  int64_t entry_bytes = 0;
+  for (BuildLog::Entries::const_iterator e = entries.begin();
+       e != entries.end(); ++e) {
+    entry_bytes += sizeof(BuildLog::LogEntry) + StringBytes(e->second->output);
+  }
+  Add("BuildLog entries", entries.size(), entry_bytes);
+  Add("BuildLog entries hash table", entries.size(), HashTableBytes(entries));
+}
+
+void MemoryStats::AddDepsLog(const DepsLog& deps_log) {
+  const vector<DepsLog::Deps*>& deps = deps_log.deps();
+  int64_t count = 0;
+  int64_t bytes = VectorBytes(deps) + VectorBytes(deps_log.nodes());
+  for (vector<DepsLog::Deps*>::const_iterator d = deps.begin();
+       d != deps.end(); ++d) {
+    if (!*d)
+      continue;
+    ++count;
+    bytes += sizeof(DepsLog::Deps) + (*d)->node_count * sizeof(Node*);
+  }
+  Add("DepsLog deps", count, bytes);
+}
+
+int64_t MemoryStats::total_bytes() const {
+  int64_t total = 0;
+  for (vector<Item>::const_iterator i = items_.begin(); i != items_.end();
+       ++i) {
+    total += i->bytes;
+  }
+  return total;
+}
+
+void MemoryStats::Report() const {
+  int width = 5;
+  for (vector<Item>::const_iterator i = items_.begin(); i != items_.end();
+       ++i) {
+    width = max((int)i->name.size(), width);
+  }
+
+  printf("%-*s\t%-9s\t%s\n", width, "memory", "count", "size (KB)");
+  for (vector<Item>::const_iterator i = items_.begin(); i != items_.end();
+       ++i) {
+    printf("%-*s\t%-9" PRId64 "\t%.1f\n", width, i->name.c_str(), i->count,
+           i->bytes / 1024.0);
+  }
+  printf("%-*s\t%-9s\t%.1f\n", width, "total", "", total_bytes() / 1024.0);
+
+#ifndef _WIN32
+  // For comparison: the difference goes to the allocator, the code, the
+  // stacks, and what isn't accounted for above.
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+    double max_rss_kb = usage.ru_maxrss / 1024.0;  // In bytes on macOS.
+#else
+    double max_rss_kb = usage.ru_maxrss;
+#endif
+    printf("%-*s\t%-9s\t%.1f\n", width, "max RSS", "", max_rss_kb);
+  }
+#endif
+}
@@ -0,0 +1,57 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_MEMORY_STATS_H_
+#define NINJA_MEMORY_STATS_H_
+
+#include <string>
+#include <vector>
+
+#include "util.h"  // int64_t
+
+struct BuildLog;
+struct DepsLog;
+struct EvalString;
+struct State;
+
+/// Estimate of the memory taken by ninja's data structures, for
+/// `-d memstats`.  The sizes are computed from the objects' sizes and
+/// their containers' capacities, assuming a typical standard library: the
+/// allocator's own overhead isn't counted.
+struct MemoryStats {
+  struct Item {
+    std::string name;
+    int64_t count;
+    int64_t bytes;
+  };
+
+  void Add(const std::string& name, int64_t count, int64_t bytes);
+
+  /// Account for the graph and the scopes of the manifest.
+  void AddState(const State& state);
+  void AddBuildLog(const BuildLog& build_log);
+  void AddDepsLog(const DepsLog& deps_log);
+
+  int64_t total_bytes() const;
+
+  /// Print the items to stdout.
+  void Report() const;
+
+  std::vector<Item> items_;
+
+ private:
+  static int64_t EvalStringBytes(const EvalString& eval);
+};
+
+#endif  // NINJA_MEMORY_STATS_H_
@@ -0,0 +1,103 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "memory_stats.h"
+
+#include "build_log.h"
+#include "deps_log.h"
+#include "graph.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+const char kTestDepsLogFilename[] = "MemoryStatsTest-tempdepslog";
+
+struct MemoryStatsTest : public StateTestWithBuiltinRules {
+  const MemoryStats::Item* Find(const char* name) {
+    for (size_t i = 0; i < stats_.items_.size(); ++i) {
+      if (stats_.items_[i].name == name)
+        return &stats_.items_[i];
+    }
+    ADD_FAILURE() << "no " << name;
+    return NULL;
+  }
+
+  MemoryStats stats_;
+};
+
+}  // anonymous namespace
+
+TEST_F(MemoryStatsTest, State) {
+  AssertParse(&state_,
+"pool link\n"
+"  depth = 1\n"
+"build out: cat in1 in2\n"
+"  description = concatenating inputs into an output file\n"
+"build a_rather_long_path_to_some_output_file: cat out\n");
+  stats_.AddState(state_);
+
+  const MemoryStats::Item* nodes = Find("Node objects");
+  ASSERT_TRUE(nodes);
+  EXPECT_EQ(4, nodes->count);
+  EXPECT_EQ(4 * (int64_t)sizeof(Node), nodes->bytes);
+  const MemoryStats::Item* paths = Find("Node paths");
+  ASSERT_TRUE(paths);
+  EXPECT_GE(paths->bytes, (int64_t)strlen("a_rather_long_path_to_some_output_file"));
+
+  const MemoryStats::Item* edges = Find("Edge objects");
+  ASSERT_TRUE(edges);
+  EXPECT_EQ(2, edges->count);
+
+  // The file's scope and the one of the first build statement.
+  const MemoryStats::Item* envs = Find("BindingEnv scopes");
+  ASSERT_TRUE(envs);
+  EXPECT_EQ(2, envs->count);
+  const MemoryStats::Item* rules = Find("Rules and EvalStrings");
+  ASSERT_TRUE(rules);
+  EXPECT_EQ(1, rules->count);
+  EXPECT_GT(rules->bytes, (int64_t)sizeof(Rule));
+
+  EXPECT_GT(stats_.total_bytes(), nodes->bytes + edges->bytes);
+}
+
+TEST_F(MemoryStatsTest, Logs) {
+  AssertParse(&state_,
+"build out: cat in\n");
+  Edge* edge = GetNode("out")->in_edge();
+
+  BuildLog build_log;
+  build_log.RecordCommand(edge, 0, 1);
+
+  ScopedFilePath scoped_file_path(kTestDepsLogFilename);
+  DepsLog deps_log;
+  string err;
+  ASSERT_TRUE(deps_log.OpenForWrite(kTestDepsLogFilename, &err));
+  Node* deps[] = { GetNode("in"), GetNode("out") };
+  deps_log.RecordDeps(GetNode("out"), 1, 2, deps);
+
+  stats_.AddBuildLog(build_log);
+  stats_.AddDepsLog(deps_log);
+  deps_log.Close();
+
+  const MemoryStats::Item* entries = Find("BuildLog entries");
+  ASSERT_TRUE(entries);
+  EXPECT_EQ(1, entries->count);
+  const MemoryStats::Item* deps_item = Find("DepsLog deps");
+  ASSERT_TRUE(deps_item);
+  EXPECT_EQ(1, deps_item->count);
+  EXPECT_GE(deps_item->bytes,
+            (int64_t)(sizeof(DepsLog::Deps) + 2 * sizeof(Node*)));
+}
@@ -15,12 +15,14 @@
 #include "metrics.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 
 #include <algorithm>
 #include <chrono>
 
+#include "json.h"
 #include "util.h"
 
 using namespace std;
@@ -29,6 +31,9 @@ Metrics* g_metrics = NULL;
 
 namespace {
 
+/// The metric of the innermost scope being measured on this thread.
+thread_local Metric* g_current_metric = NULL;
+
 /// Compute a platform-specific high-res timer value that fits into an int64.
 int64_t HighResTimer() {
   auto now = chrono::steady_clock::now();
@@ -61,12 +66,47 @@ int64_t TimerToMicros(double dt) {
       .count();
 }
 
+/// The histogram bucket of a measurement of |micros|.
+int HistogramBucket(int64_t micros) {
+  int bucket = 0;
+  while (micros > 0 && bucket < Metric::kHistogramBuckets - 1) {
+    micros >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+/// Put |metrics| in the order of a depth-first walk of the tree their
+/// parents make, keeping the order of creation among siblings.
+void SortByNesting(const vector<Metric*>& metrics, Metric* parent,
+                   int depth, vector<pair<Metric*, int> >* sorted) {
+  for (vector<Metric*>::const_iterator i = metrics.begin();
+       i != metrics.end(); ++i) {
+    if ((*i)->parent != parent)
+      continue;
+    sorted->push_back(make_pair(*i, depth));
+    SortByNesting(metrics, *i, depth + 1, sorted);
+  }
+}
+
 }  // anonymous namespace
 
+int64_t Metric::Percentile(double fraction) const {
+  int64_t seen = 0;
+  for (int i = 0; i < kHistogramBuckets - 1; ++i) {
+    seen += histogram[i];
+    if (seen >= fraction * count)
+      return (int64_t)1 << i;
+  }
+  return -1;
+}
+
 ScopedMetric::ScopedMetric(Metric* metric) {
   metric_ = metric;
   if (!metric_)
     return;
+  enclosing_ = g_current_metric;
+  g_current_metric = metric_;
   start_ = HighResTimer();
 }
 ScopedMetric::~ScopedMetric() {
@@ -77,6 +117,12 @@ ScopedMetric::~ScopedMetric() {
   // on every measurement.
   int64_t dt = HighResTimer() - start_;
   metric_->sum += dt;
+  metric_->histogram[HistogramBucket(TimerToMicros(dt))]++;
+  g_current_metric = enclosing_;
+  if (MetricsObserver* observer = g_metrics->observer()) {
+    observer->MetricRecorded(metric_, TimerToMicros(start_),
+                             TimerToMicros(start_ + dt));
+  }
 }
 
 Metric* Metrics::NewMetric(const string& name) {
@@ -84,30 +130,96 @@ Metric* Metrics::NewMetric(const string& name) {
   metric->name = name;
   metric->count = 0;
   metric->sum = 0;
+  metric->parent = g_current_metric;
+  metric->counter = false;
+  fill(metric->histogram, metric->histogram + Metric::kHistogramBuckets, 0);
   metrics_.push_back(metric);
   return metric;
 }
 
+Metric* Metrics::NewCounter(const string& name) {
+  Metric* metric = NewMetric(name);
+  metric->counter = true;
+  return metric;
+}
+
 void Metrics::Report() {
+  vector<pair<Metric*, int> > sorted;
+  SortByNesting(metrics_, NULL, 0, &sorted);
+
+  // Nested metrics are indented by two spaces a level.
   int width = 0;
-  for (vector<Metric*>::iterator i = metrics_.begin();
-       i != metrics_.end(); ++i) {
-    width = max((int)(*i)->name.size(), width);
+  for (vector<pair<Metric*, int> >::iterator i = sorted.begin();
+       i != sorted.end(); ++i) {
+    width = max((int)i->first->name.size() + 2 * i->second, width);
   }
 
-  printf("%-*s\t%-6s\t%-9s\t%s\n", width,
-         "metric", "count", "avg (us)", "total (ms)");
-  for (vector<Metric*>::iterator i = metrics_.begin();
-       i != metrics_.end(); ++i) {
-    Metric* metric = *i;
+  printf("%-*s\t%-6s\t%-9s\t%-9s\t%s\n", width,
+         "metric", "count", "avg (us)", "p90 (us)", "total (ms)");
+  for (vector<pair<Metric*, int> >::iterator i = sorted.begin();
+       i != sorted.end(); ++i) {
+    Metric* metric = i->first;
+    if (metric->counter)
+      continue;
+    string name = string(2 * i->second, ' ') + metric->name;
     uint64_t micros = TimerToMicros(metric->sum);
     double total = micros / (double)1000;
     double avg = micros / (double)metric->count;
-    printf("%-*s\t%-6d\t%-8.1f\t%.1f\n", width, metric->name.c_str(),
-           metric->count, avg, total);
+    int64_t p90 = metric->Percentile(0.9);
+    string p90_text = p90 < 0 ? "-" : "<" + to_string(p90);
+    printf("%-*s\t%-6d\t%-8.1f\t%-9s\t%.1f\n", width, name.c_str(),
+           metric->count, avg, p90_text.c_str(), total);
+  }
+
+  bool counters = false;
+  for (vector<pair<Metric*, int> >::iterator i = sorted.begin();
+       i != sorted.end(); ++i) {
+    Metric* metric = i->first;
+    if (!metric->counter)
+      continue;
+    if (!counters) {
+      printf("\n%-*s\t%-6s\t%s\n", width, "counter", "count", "total");
+      counters = true;
+    }
+    printf("%-*s\t%-6d\t%" PRId64 "\n", width, metric->name.c_str(),
+           metric->count, metric->sum);
   }
 }
 
+void Metrics::ReportJSON(FILE* file) {
+  // Parents are referred to by their index in the list.
+  fputs("{\"metrics\":[", file);
+  for (size_t i = 0; i < metrics_.size(); ++i) {
+    Metric* metric = metrics_[i];
+    int parent = -1;
+    for (size_t j = 0; j < metrics_.size(); ++j) {
+      if (metrics_[j] == metric->parent)
+        parent = (int)j;
+    }
+    fprintf(file, "%s\n{\"name\":\"%s\",\"parent\":", i ? "," : "",
+            EncodeJSONString(metric->name).c_str());
+    if (parent < 0)
+      fputs("null", file);
+    else
+      fprintf(file, "%d", parent);
+    fprintf(file, ",\"count\":%d", metric->count);
+    if (metric->counter) {
+      fprintf(file, ",\"total\":%" PRId64 "}", metric->sum);
+      continue;
+    }
+    fprintf(file, ",\"total_us\":%" PRId64 ",\"histogram\":[",
+            TimerToMicros(metric->sum));
+    // Trailing empty buckets are left out.
+    int buckets = Metric::kHistogramBuckets;
+    while (buckets > 0 && metric->histogram[buckets - 1] == 0)
+      --buckets;
+    for (int j = 0; j < buckets; ++j)
+      fprintf(file, "%s%d", j ? "," : "", metric->histogram[j]);
+    fputs("]}", file);
+  }
+  fputs("\n]}\n", file);
+}
+
 double Stopwatch::Elapsed() const {
   // Convert to micros after converting to double to minimize error.
   return 1e-6 * TimerToMicros(static_cast<double>(NowRaw() - started_));
@@ -120,3 +232,7 @@ uint64_t Stopwatch::NowRaw() const {
 int64_t GetTimeMillis() {
   return TimerToMicros(HighResTimer()) / 1000;
 }
+
+int64_t GetTimeMicros() {
+  return TimerToMicros(HighResTimer());
+}
@@ -15,21 +15,46 @@
 #ifndef NINJA_METRICS_H_
 #define NINJA_METRICS_H_
 
+#include <stdio.h>
+
 #include <string>
 #include <vector>
 
 #include "util.h"  // For int64_t.
 
 /// The Metrics module is used for the debug mode that dumps timing stats of
-/// various actions.  To use, see METRIC_RECORD below.
+/// various actions.  To use, see METRIC_RECORD and METRIC_COUNT below.
 
 /// A single metrics we're tracking, like "depfile load time".
 struct Metric {
+  /// Number of buckets of |histogram|.
+  static const int kHistogramBuckets = 24;
+
   std::string name;
   /// Number of times we've hit the code path.
   int count;
-  /// Total time (in platform-dependent units) we've spent on the code path.
+  /// Total time (in platform-dependent units) we've spent on the code path,
+  /// or for a counter, the total of the amounts added.
   int64_t sum;
+  /// The metric whose scope this one was first reached in, or NULL.
+  Metric* parent;
+  /// Whether this counts events (see METRIC_COUNT) rather than timing them.
+  bool counter;
+  /// Distribution of the times: bucket 0 counts the measurements shorter
+  /// than 1us, and bucket i those between 2^(i-1) and 2^i us, the last
+  /// bucket taking all the longer ones.
+  int histogram[kHistogramBuckets];
+
+  /// Add |amount| to a counter.
+  void Add(int64_t amount) {
+    ++count;
+    sum += amount;
+  }
+
+  /// An upper bound, in microseconds, of the time under which a |fraction|
+  /// of the measurements fall, per the histogram.  -1 for the last bucket,
+  /// which is unbounded.
+  int64_t Percentile(double fraction) const;
 };
 
 /// A scoped object for recording a metric across the body of a function.
@@ -40,26 +65,53 @@ struct ScopedMetric {
 
 private:
   Metric* metric_;
+  /// The metric of the scope this one is nested in, to restore at the end.
+  Metric* enclosing_;
   /// Timestamp when the measurement started.
   /// Value is platform-dependent.
   int64_t start_;
 };
 
+/// Receives every measurement while it is set, e.g. to write a trace of
+/// the build.  Called from whichever thread made the measurement.
+struct MetricsObserver {
+  virtual ~MetricsObserver() {}
+  /// |start_micros| and |end_micros| are on the clock of GetTimeMicros().
+  virtual void MetricRecorded(const Metric* metric, int64_t start_micros,
+                              int64_t end_micros) = 0;
+};
+
 /// The singleton that stores metrics and prints the report.
 struct Metrics {
+  Metrics() : observer_(NULL) {}
+
+  /// Create a metric, nested in the innermost scope being measured on this
+  /// thread, if any.
   Metric* NewMetric(const std::string& name);
+  /// Like NewMetric(), for a counter.
+  Metric* NewCounter(const std::string& name);
 
   /// Print a summary report to stdout.
   void Report();
 
+  /// Write all the metrics to |file| as JSON, for tools to collect.
+  void ReportJSON(FILE* file);
+
+  void set_observer(MetricsObserver* observer) { observer_ = observer; }
+  MetricsObserver* observer() const { return observer_; }
+
 private:
   std::vector<Metric*> metrics_;
+  MetricsObserver* observer_;
 };
 
 /// Get the current time as relative to some epoch.
 /// Epoch varies between platforms; only useful for measuring elapsed time.
 int64_t GetTimeMillis();
 
+/// Like GetTimeMillis(), in microseconds.
+int64_t GetTimeMicros();
+
 /// A simple stopwatch which returns the time
 /// in seconds since Restart() was called.
 struct Stopwatch {
@@ -92,6 +144,16 @@ struct Stopwatch {
       g_metrics ? g_metrics->NewMetric(name) : NULL; \
   ScopedMetric metrics_h_scoped((condition) ? metrics_h_metric : NULL);
 
+/// Add |amount| to a counter of how many times, or how much of, something
+/// happened, like "depfile bytes", that is too cheap to be timed.
+#define METRIC_COUNT(name, amount)                                  \
+  do {                                                              \
+    static Metric* metrics_h_counter =                              \
+        g_metrics ? g_metrics->NewCounter(name) : NULL;             \
+    if (metrics_h_counter)                                          \
+      metrics_h_counter->Add(amount);                               \
+  } while (0)
+
 extern Metrics* g_metrics;
 
 #endif // NINJA_METRICS_H_
@@ -0,0 +1,106 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "metrics.h"
+
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+struct MetricsTest : public testing::Test {
+  virtual void SetUp() {
+    old_metrics_ = g_metrics;
+    g_metrics = &metrics_;
+  }
+  virtual void TearDown() { g_metrics = old_metrics_; }
+
+  Metrics metrics_;
+  Metrics* old_metrics_;
+};
+
+}  // anonymous namespace
+
+TEST_F(MetricsTest, Nesting) {
+  Metric* outer = metrics_.NewMetric("outer");
+  Metric* inner = NULL;
+  Metric* counter = NULL;
+  {
+    ScopedMetric scoped(outer);
+    inner = metrics_.NewMetric("inner");
+    {
+      ScopedMetric scoped(inner);
+      counter = metrics_.NewCounter("counter");
+    }
+  }
+  Metric* after = metrics_.NewMetric("after");
+
+  EXPECT_EQ(NULL, outer->parent);
+  EXPECT_EQ(outer, inner->parent);
+  EXPECT_EQ(inner, counter->parent);
+  EXPECT_EQ(NULL, after->parent);
+  EXPECT_EQ(1, outer->count);
+  EXPECT_EQ(1, inner->count);
+  EXPECT_FALSE(outer->counter);
+  EXPECT_TRUE(counter->counter);
+}
+
+TEST_F(MetricsTest, Counter) {
+  for (int i = 0; i < 3; ++i)
+    METRIC_COUNT("bytes", 10);
+
+  string json;
+  {
+    ScopedFilePath path("metrics_test.json");
+    FILE* file = fopen(path.c_str(), "w");
+    ASSERT_TRUE(file);
+    metrics_.ReportJSON(file);
+    fclose(file);
+    char buf[256];
+    file = fopen(path.c_str(), "r");
+    ASSERT_TRUE(file);
+    json.assign(buf, fread(buf, 1, sizeof(buf), file));
+    fclose(file);
+  }
+  EXPECT_EQ("{\"metrics\":[\n"
+            "{\"name\":\"bytes\",\"parent\":null,\"count\":3,\"total\":30}\n"
+            "]}\n", json);
+}
+
+TEST_F(MetricsTest, Histogram) {
+  Metric* metric = metrics_.NewMetric("metric");
+  EXPECT_EQ(1, metric->Percentile(0.9));
+  {
+    ScopedMetric scoped(metric);
+  }
+  EXPECT_EQ(1, metric->count);
+  int total = 0;
+  for (int i = 0; i < Metric::kHistogramBuckets; ++i)
+    total += metric->histogram[i];
+  EXPECT_EQ(1, total);
+
+  // 9 measurements under 1us and one of 3us.
+  metric->count = 10;
+  metric->histogram[0] = 9;
+  for (int i = 1; i < Metric::kHistogramBuckets; ++i)
+    metric->histogram[i] = 0;
+  metric->histogram[2] = 1;
+  EXPECT_EQ(1, metric->Percentile(0.9));
+  EXPECT_EQ(4, metric->Percentile(1));
+
+  metric->histogram[2] = 0;
+  metric->histogram[Metric::kHistogramBuckets - 1] = 1;
+  EXPECT_EQ(-1, metric->Percentile(1));
+}
@@ -36,19 +36,27 @@
 #include "browse.h"
 #include "build.h"
 #include "build_log.h"
+#include "build_report.h"
+#include "build_simulator.h"
 #include "deps_log.h"
 #include "clean.h"
+#include "critical_path.h"
 #include "debug_flags.h"
 #include "depfile_parser.h"
 #include "disk_interface.h"
 #include "graph.h"
 #include "graphviz.h"
+#include "jobserver.h"
 #include "json.h"
+#include "log_writer.h"
 #include "manifest_parser.h"
+#include "memory_stats.h"
 #include "metrics.h"
 #include "missing_deps.h"
 #include "state.h"
 #include "status.h"
+#include "status_stream.h"
+#include "status_tracer.h"
 #include "util.h"
 #include "version.h"
 
@@ -79,6 +87,18 @@ struct Options {
 
   /// Whether phony cycles should warn or print an error.
   bool phony_cycle_should_err;
+
+  /// Whether to run a jobserver for the commands of the build.
+  bool jobserver_pool;
+
+  /// File to write a Chrome trace of the build to, if any.
+  const char* chrome_trace;
+
+  /// File to write the metrics of -d stats to as JSON, if any.
+  const char* metrics_json;
+
+  /// File or FIFO to write the events of the build to, if any.
+  const char* event_stream;
 };
 
 /// The Ninja main() loads up a series of data structures; various tools need
@@ -103,6 +123,11 @@ struct NinjaMain : public BuildLogUser {
   /// The build directory, used for storing the build log etc.
   string build_dir_;
 
+  /// Background writer for the logs, if enabled by --async-logs.  That
+  /// option also lets the logs recompact concurrently with the build.
+  /// Declared before the logs so that it outlives them.
+  std::unique_ptr<LogWriter> log_writer_;
+
   BuildLog build_log_;
   DepsLog deps_log_;
 
@@ -132,8 +157,12 @@ struct NinjaMain : public BuildLogUser {
   int ToolCompilationDatabase(const Options* options, int argc, char* argv[]);
   int ToolRecompact(const Options* options, int argc, char* argv[]);
   int ToolRestat(const Options* options, int argc, char* argv[]);
+  int ToolLogFormat(const Options* options, int argc, char* argv[]);
   int ToolUrtle(const Options* options, int argc, char** argv);
   int ToolRules(const Options* options, int argc, char* argv[]);
+  int ToolReport(const Options* options, int argc, char* argv[]);
+  int ToolCritPath(const Options* options, int argc, char* argv[]);
+  int ToolSimulate(const Options* options, int argc, char* argv[]);
   int ToolWinCodePage(const Options* options, int argc, char* argv[]);
 
   /// Open the build log.
@@ -144,6 +173,11 @@ struct NinjaMain : public BuildLogUser {
   /// @return false on error.
   bool OpenDepsLog(bool recompact_only = false);
 
+  /// Wait for records queued for the background log writer to reach the
+  /// disk, since the process exits without destroying NinjaMain.
+  /// @return false on error.
+  bool FlushLogs();
+
   /// Ensure the build directory exists, creating it if necessary.
   /// @return false on error.
   bool EnsureBuildDirExists();
@@ -164,6 +198,12 @@ struct NinjaMain : public BuildLogUser {
   /// Dump the output requested by '-d stats'.
   void DumpMetrics();
 
+  /// Write the metrics to |path| as JSON.
+  bool WriteMetricsJSON(const char* path);
+
+  /// Dump the output requested by '-d memstats'.
+  void DumpMemoryStats();
+
   virtual bool IsPathDead(StringPiece s) const {
     Node* n = state_.LookupNode(s);
     if (n && n->in_edge())
@@ -223,6 +263,17 @@ void Usage(const BuildConfig& config) {
 "  --version      print ninja version (\"%s\")\n"
 "  -v, --verbose  show all command lines while building\n"
 "  --quiet        don't show progress status, just command output\n"
+"  --async-logs   write and recompact .ninja_log and .ninja_deps in the\n"
+"                 background\n"
+"  --jobserver-pool  share the -j limit with commands through a GNU make\n"
+"                 jobserver\n"
+"  --action-cache=DIR  reuse outputs of commands from the cache in DIR\n"
+"  --action-cache-size=MB  limit the size of the action cache [default=10240]\n"
+"  --remote-cache=URL  share the action cache through the HTTP server at URL\n"
+"  --executor=COMMAND  run commands through the executor started by COMMAND\n"
+"  --chrome-trace=FILE  write a trace of the build in Chrome's format to FILE\n"
+"  --metrics-json=FILE  write operation counts/timing info as JSON to FILE\n"
+"  --event-stream=FILE  write the events of the build as JSON lines to FILE\n"
 "\n"
 "  -C DIR   change to DIR before doing anything else\n"
 "  -f FILE  specify input build file [default=build.ninja]\n"
@@ -293,7 +344,7 @@ bool NinjaMain::RebuildManifest(const char* input_file, string* err,
 void NinjaMain::ParsePreviousElapsedTimes() {
   for (Edge* edge : state_.edges_) {
     for (Node* out : edge->outputs_) {
-      BuildLog::LogEntry* log_entry = build_log_.LookupByOutput(out->path());
+      BuildLog::LogEntry* log_entry = build_log_.LookupByOutput(out);
       if (!log_entry)
         continue;  // Maybe we'll have log entry for next output of this edge?
       edge->prev_elapsed_time_millis =
@@ -641,6 +692,323 @@ int NinjaMain::ToolTargets(const Options* options, int argc, char* argv[]) {
   }
 }
 
+int NinjaMain::ToolReport(const Options* options, int argc, char* argv[]) {
+  // The report tool uses getopt, and expects argv[0] to contain the name of
+  // the tool, i.e. "report".
+  argc++;
+  argv--;
+  optind = 1;
+  bool json = false;
+  int top_count = 10;
+  int opt;
+  enum { OPT_JSON = 1, OPT_TOP = 2 };
+  const option kLongOptions[] = { { "help", no_argument, NULL, 'h' },
+                                  { "json", no_argument, NULL, OPT_JSON },
+                                  { "top", required_argument, NULL, OPT_TOP },
+                                  { NULL, 0, NULL, 0 } };
+  while ((opt = getopt_long(argc, argv, "h", kLongOptions, NULL)) != -1) {
+    switch (opt) {
+    case OPT_JSON:
+      json = true;
+      break;
+    case OPT_TOP: {
+      char* end;
+      top_count = strtol(optarg, &end, 10);
+      if (*end != 0 || top_count < 0)
+        Fatal("invalid --top parameter");
+      break;
+    }
+    case 'h':
+    default:
+      // clang-format off
+      printf(
+"Usage '-t report [options]\n"
+"\n"
+"Summarize how well the last build recorded in the build log used the\n"
+"machine: wall time against the critical path, parallelism over time,\n"
+"periods with fewer commands running than -j allows, and the slowest\n"
+"commands and rules.\n\n"
+"Options:\n"
+"  --json       Print the summary as JSON.\n"
+"  --top=N      List the N slowest commands and rules [default=10].\n"
+"  -h, --help   Print this message.\n");
+      // clang-format on
+      return 1;
+    }
+  }
+
+  // Load the logs without opening them for writing, which could recompact
+  // them and lose the last build.
+  string log_path = ".ninja_log";
+  string deps_path = ".ninja_deps";
+  if (!build_dir_.empty()) {
+    log_path = build_dir_ + "/" + log_path;
+    deps_path = build_dir_ + "/" + deps_path;
+  }
+  string err;
+  build_log_.set_keep_last_build(true);
+  if (build_log_.Load(log_path, &err) == LOAD_ERROR) {
+    Error("loading build log %s: %s", log_path.c_str(), err.c_str());
+    return 1;
+  }
+  err.clear();
+  if (deps_log_.Load(deps_path, &state_, &err) == LOAD_ERROR) {
+    Error("loading deps log %s: %s", deps_path.c_str(), err.c_str());
+    return 1;
+  }
+
+  // A command with several outputs has an entry for each of them.
+  BuildReport report(config_.parallelism);
+  report.approximate_ = build_log_.last_build_approximate();
+  set<const Edge*> seen;
+  const vector<BuildLog::LogEntry*>& entries = build_log_.last_build();
+  for (vector<BuildLog::LogEntry*>::const_iterator e = entries.begin();
+       e != entries.end(); ++e) {
+    BuildReport::Command command;
+    Node* node = state_.LookupNode((*e)->output);
+    if (node && node->in_edge()) {
+      command.edge = node->in_edge();
+      if (!seen.insert(command.edge).second)
+        continue;
+      command.rule = command.edge->rule().name();
+    }
+    command.name = (*e)->output;
+    command.start_millis = (*e)->start_time;
+    command.end_millis = (*e)->end_time;
+    command.cpu_millis =
+        (*e)->usage.user_time_millis + (*e)->usage.system_time_millis;
+    report.AddCommand(command);
+  }
+  report.Analyze(&deps_log_);
+  if (json)
+    report.PrintJSON(top_count);
+  else
+    report.PrintText(top_count);
+  return 0;
+}
+
+int NinjaMain::ToolCritPath(const Options* options, int argc,
+                            char* argv[]) {
+  // The critpath tool uses getopt, and expects argv[0] to contain the name
+  // of the tool, i.e. "critpath".
+  argc++;
+  argv--;
+  optind = 1;
+  int top_count = 10;
+  int opt;
+  enum { OPT_TOP = 1 };
+  const option kLongOptions[] = { { "help", no_argument, NULL, 'h' },
+                                  { "top", required_argument, NULL, OPT_TOP },
+                                  { NULL, 0, NULL, 0 } };
+  while ((opt = getopt_long(argc, argv, "h", kLongOptions, NULL)) != -1) {
+    switch (opt) {
+    case OPT_TOP: {
+      char* end;
+      top_count = strtol(optarg, &end, 10);
+      if (*end != 0 || top_count < 0)
+        Fatal("invalid --top parameter");
+      break;
+    }
+    case 'h':
+    default:
+      // clang-format off
+      printf(
+"Usage '-t critpath [options] [targets]\n"
+"\n"
+"Print the longest chain of commands the targets depend on, weighted with\n"
+"the durations of the commands in the build log, followed by the other\n"
+"commands that have the least slack: how much longer they could take\n"
+"without making the targets take longer with unlimited parallelism.\n\n"
+"Options:\n"
+"  --top=N      List the N commands with the least slack [default=10].\n"
+"  -h, --help   Print this message.\n");
+      // clang-format on
+      return 1;
+    }
+  }
+  argv += optind;
+  argc -= optind;
+
+  vector<Node*> nodes;
+  string err;
+  if (!CollectTargetsFromArgs(argc, argv, &nodes, &err)) {
+    Error("%s", err.c_str());
+    return 1;
+  }
+
+  CriticalPath critical_path(&deps_log_);
+  for (vector<Node*>::iterator n = nodes.begin(); n != nodes.end(); ++n)
+    critical_path.AddTarget(*n);
+  ParsePreviousElapsedTimes();
+  int unknown = 0;
+  for (Edge* edge : critical_path.edges()) {
+    if (edge->prev_elapsed_time_millis != -1)
+      critical_path.SetDuration(edge, edge->prev_elapsed_time_millis);
+    else if (!edge->is_phony())
+      ++unknown;
+  }
+  critical_path.Analyze();
+
+  int commands = 0;
+  for (Edge* edge : critical_path.path_)
+    commands += !edge->is_phony();
+  printf("critical path: %.1f s over %d commands\n",
+         critical_path.length_ / 1000.0, commands);
+  if (unknown)
+    printf("%d commands not in the build log count for 0 s\n", unknown);
+
+  printf("\n   start  duration  output\n");
+  for (Edge* edge : critical_path.path_) {
+    if (edge->is_phony())
+      continue;
+    const CriticalPath::Timing& timing = critical_path.timing(edge);
+    printf("%7.1fs  %7.1fs  %s (%s)%s\n", timing.earliest_start / 1000.0,
+           timing.duration / 1000.0, edge->outputs_[0]->path().c_str(),
+           edge->rule().name().c_str(), timing.known ? "" : " [no time]");
+  }
+
+  // The rest by increasing slack, then decreasing duration.
+  vector<pair<pair<int64_t, int64_t>, Edge*> > others;
+  set<const Edge*> on_path(critical_path.path_.begin(),
+                           critical_path.path_.end());
+  for (Edge* edge : critical_path.edges()) {
+    if (edge->is_phony() || on_path.count(edge))
+      continue;
+    const CriticalPath::Timing& timing = critical_path.timing(edge);
+    others.push_back(
+        make_pair(make_pair(timing.slack, -timing.duration), edge));
+  }
+  sort(others.begin(), others.end());
+  if (!others.empty() && top_count > 0) {
+    printf("\n   slack  duration  output\n");
+    for (size_t i = 0; i < others.size() && i < (size_t)top_count; ++i) {
+      Edge* edge = others[i].second;
+      const CriticalPath::Timing& timing = critical_path.timing(edge);
+      printf("%7.1fs  %7.1fs  %s (%s)%s\n", timing.slack / 1000.0,
+             timing.duration / 1000.0, edge->outputs_[0]->path().c_str(),
+             edge->rule().name().c_str(), timing.known ? "" : " [no time]");
+    }
+  }
+  return 0;
+}
+
+int NinjaMain::ToolSimulate(const Options* options, int argc,
+                            char* argv[]) {
+  // The simulate tool uses getopt, and expects argv[0] to contain the name
+  // of the tool, i.e. "simulate".
+  argc++;
+  argv--;
+  optind = 1;
+  vector<int> jobs;
+  Plan::CriticalPathWeight weight = Plan::kWeightByCount;
+  int opt;
+  enum { OPT_JOBS = 1, OPT_POOL = 2, OPT_WEIGHT = 3 };
+  const option kLongOptions[] = {
+    { "help", no_argument, NULL, 'h' },
+    { "jobs", required_argument, NULL, OPT_JOBS },
+    { "pool", required_argument, NULL, OPT_POOL },
+    { "weight", required_argument, NULL, OPT_WEIGHT },
+    { NULL, 0, NULL, 0 }
+  };
+  while ((opt = getopt_long(argc, argv, "h", kLongOptions, NULL)) != -1) {
+    switch (opt) {
+    case OPT_JOBS: {
+      for (char* arg = optarg;; ++arg) {
+        char* end;
+        long value = strtol(arg, &end, 10);
+        if (end == arg || value <= 0 || (*end != ',' && *end != 0))
+          Fatal("invalid --jobs parameter");
+        jobs.push_back((int)value);
+        if (*end == 0)
+          break;
+        arg = end;
+      }
+      break;
+    }
+    case OPT_POOL: {
+      const char* equals = strchr(optarg, '=');
+      char* end;
+      long depth = equals ? strtol(equals + 1, &end, 10) : -1;
+      if (!equals || depth < 0 || end == equals + 1 || *end != 0)
+        Fatal("invalid --pool parameter, expected NAME=DEPTH");
+      string name(optarg, equals - optarg);
+      Pool* pool = state_.LookupPool(name);
+      if (!pool || pool == &State::kDefaultPool ||
+          pool == &State::kConsolePool)
+        Fatal("unknown pool '%s'", name.c_str());
+      pool->set_depth((int)depth);
+      break;
+    }
+    case OPT_WEIGHT:
+      if (strcmp(optarg, "count") == 0)
+        weight = Plan::kWeightByCount;
+      else if (strcmp(optarg, "time") == 0)
+        weight = Plan::kWeightByTime;
+      else
+        Fatal("invalid --weight parameter, expected 'count' or 'time'");
+      break;
+    case 'h':
+    default:
+      // clang-format off
+      printf(
+"Usage '-t simulate [options] [targets]\n"
+"\n"
+"Predict how long building the targets from scratch would take, with the\n"
+"real scheduling and every command taking as long as it did last time\n"
+"according to the build log.\n\n"
+"Options:\n"
+"  --jobs=N[,N...]    Simulate these -j values [default=the -j of ninja].\n"
+"  --pool=NAME=DEPTH  Give a pool another depth (repeatable).\n"
+"  --weight=WEIGHT    Weigh the critical path that orders the commands by\n"
+"                     'count' of commands [default] or previous 'time'.\n"
+"  -h, --help         Print this message.\n");
+      // clang-format on
+      return 1;
+    }
+  }
+  argv += optind;
+  argc -= optind;
+  if (jobs.empty())
+    jobs.push_back(config_.parallelism);
+
+  vector<Node*> nodes;
+  string err;
+  if (!CollectTargetsFromArgs(argc, argv, &nodes, &err)) {
+    Error("%s", err.c_str());
+    return 1;
+  }
+  ParsePreviousElapsedTimes();
+
+  BuildSimulator simulator(&state_);
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    if (!simulator.Run(nodes, jobs[i], weight, &err)) {
+      Error("%s", err.c_str());
+      return 1;
+    }
+    if (i == 0) {
+      printf("%d commands", simulator.commands_);
+      if (simulator.unknown_commands_) {
+        printf(", %d not in the build log and taking their rule's average",
+               simulator.unknown_commands_);
+      }
+      printf("\n");
+    }
+    printf("\n-j %d: %.1f s, %.0f%% utilization\n", simulator.parallelism_,
+           simulator.wall_millis_ / 1000.0, 100 * simulator.utilization());
+    printf("  %-16s %6s %9s %6s %9s %9s\n", "pool", "depth", "commands",
+           "peak", "avg wait", "max wait");
+    for (const BuildSimulator::PoolStats& stats : simulator.pools_) {
+      const string& name = stats.pool->name();
+      printf("  %-16s %6d %9d %6d %8.1fs %8.1fs\n",
+             name.empty() ? "(default)" : name.c_str(),
+             stats.pool->depth(), stats.commands,
+             stats.peak, stats.wait_millis / 1000.0 / stats.commands,
+             stats.max_wait_millis / 1000.0);
+    }
+  }
+  return 0;
+}
+
 int NinjaMain::ToolRules(const Options* options, int argc, char* argv[]) {
   // Parse options.
 
@@ -1074,6 +1442,58 @@ int NinjaMain::ToolRestat(const Options* options, int argc, char* argv[]) {
   return EXIT_SUCCESS;
 }
 
+int NinjaMain::ToolLogFormat(const Options* options, int argc, char* argv[]) {
+  bool binary = argc == 1 && strcmp(argv[0], "binary") == 0;
+  if (argc > 1 || (argc == 1 && !binary && strcmp(argv[0], "text") != 0)) {
+    printf("usage: ninja -t logformat [text|binary]\n");
+    return 1;
+  }
+
+  if (!EnsureBuildDirExists())
+    return 1;
+
+  string log_path = ".ninja_log";
+  if (!build_dir_.empty())
+    log_path = build_dir_ + "/" + log_path;
+
+  string err;
+  const LoadStatus status = build_log_.Load(log_path, &err);
+  if (status == LOAD_ERROR) {
+    Error("loading build log %s: %s", log_path.c_str(), err.c_str());
+    return EXIT_FAILURE;
+  }
+  if (!err.empty()) {
+    // Hack: Load() can return a warning via err by returning LOAD_SUCCESS.
+    Warning("%s", err.c_str());
+    err.clear();
+  }
+
+  if (argc == 0) {
+    if (status == LOAD_NOT_FOUND)
+      printf("none\n");
+    else
+      printf("%s\n", build_log_.binary() ? "binary" : "text");
+    return EXIT_SUCCESS;
+  }
+
+  build_log_.set_binary(binary);
+  if (status == LOAD_NOT_FOUND) {
+    // Start an empty log in the requested format; later builds keep it.
+    if (!build_log_.OpenForWrite(log_path, *this, &err)) {
+      Error("opening build log: %s", err.c_str());
+      return EXIT_FAILURE;
+    }
+    build_log_.Close();
+    return EXIT_SUCCESS;
+  }
+
+  if (!build_log_.Recompact(log_path, *this, &err)) {
+    Error("failed recompaction: %s", err.c_str());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
 int NinjaMain::ToolUrtle(const Options* options, int argc, char** argv) {
   // RLE encoded.
   const char* urtle =
@@ -1132,8 +1552,16 @@ const Tool* ChooseTool(const string& tool_name) {
       Tool::RUN_AFTER_LOAD, &NinjaMain::ToolRecompact },
     { "restat",  "restats all outputs in the build log",
       Tool::RUN_AFTER_FLAGS, &NinjaMain::ToolRestat },
+    { "logformat",  "show or convert the format of the build log",
+      Tool::RUN_AFTER_LOAD, &NinjaMain::ToolLogFormat },
     { "rules",  "list all rules",
       Tool::RUN_AFTER_LOAD, &NinjaMain::ToolRules },
+    { "report",  "summarize how well the last build used the machine",
+      Tool::RUN_AFTER_LOAD, &NinjaMain::ToolReport },
+    { "critpath",  "show the longest chain of commands the targets need",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolCritPath },
+    { "simulate",  "predict build times for other -j values and pool depths",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolSimulate },
     { "cleandead",  "clean built files that are no longer produced by the manifest",
       Tool::RUN_AFTER_LOGS, &NinjaMain::ToolCleanDead },
     { "urtle", NULL,
@@ -1178,6 +1606,7 @@ bool DebugEnable(const string& name) {
   if (name == "list") {
     printf("debugging modes:\n"
 "  stats        print operation counts/timing info\n"
+"  memstats     print the memory taken by ninja's data structures\n"
 "  explain      explain what caused a command to execute\n"
 "  keepdepfile  don't delete depfiles after they're read by ninja\n"
 "  keeprsp      don't delete @response files on success\n"
@@ -1189,6 +1618,9 @@ bool DebugEnable(const string& name) {
   } else if (name == "stats") {
     g_metrics = new Metrics;
     return true;
+  } else if (name == "memstats") {
+    g_memstats = true;
+    return true;
   } else if (name == "explain") {
     g_explaining = true;
     return true;
@@ -1204,8 +1636,8 @@ bool DebugEnable(const string& name) {
   } else {
     const char* suggestion =
         SpellcheckString(name.c_str(),
-                         "stats", "explain", "keepdepfile", "keeprsp",
-                         "nostatcache", NULL);
+                         "stats", "memstats", "explain", "keepdepfile",
+                         "keeprsp", "nostatcache", NULL);
     if (suggestion) {
       Error("unknown debug setting '%s', did you mean '%s'?",
             name.c_str(), suggestion);
@@ -1275,10 +1707,16 @@ bool NinjaMain::OpenBuildLog(bool recompact_only) {
   }
 
   if (!config_.dry_run) {
+    build_log_.set_recompact_in_background(config_.async_logs);
     if (!build_log_.OpenForWrite(log_path, *this, &err)) {
       Error("opening build log: %s", err.c_str());
       return false;
     }
+    if (config_.async_logs) {
+      if (!log_writer_)
+        log_writer_.reset(new LogWriter);
+      build_log_.set_writer(log_writer_.get());
+    }
   }
 
   return true;
@@ -1314,15 +1752,33 @@ bool NinjaMain::OpenDepsLog(bool recompact_only) {
   }
 
   if (!config_.dry_run) {
+    deps_log_.set_recompact_in_background(config_.async_logs);
     if (!deps_log_.OpenForWrite(path, &err)) {
       Error("opening deps log: %s", err.c_str());
       return false;
     }
+    if (config_.async_logs) {
+      if (!log_writer_)
+        log_writer_.reset(new LogWriter);
+      deps_log_.set_writer(log_writer_.get());
+    }
   }
 
   return true;
 }
 
+bool NinjaMain::FlushLogs() {
+  if (!log_writer_)
+    return true;
+  build_log_.Close();
+  deps_log_.Close();
+  if (int error = log_writer_->error()) {
+    Error("writing logs: %s", strerror(error));
+    return false;
+  }
+  return true;
+}
+
 void NinjaMain::DumpMetrics() {
   g_metrics->Report();
 
@@ -1333,6 +1789,25 @@ void NinjaMain::DumpMetrics() {
          count / (double) buckets, count, buckets);
 }
 
+bool NinjaMain::WriteMetricsJSON(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    Error("--metrics-json: opening %s: %s", path, strerror(errno));
+    return false;
+  }
+  g_metrics->ReportJSON(file);
+  fclose(file);
+  return true;
+}
+
+void NinjaMain::DumpMemoryStats() {
+  MemoryStats stats;
+  stats.AddState(state_);
+  stats.AddBuildLog(build_log_);
+  stats.AddDepsLog(deps_log_);
+  stats.Report();
+}
+
 bool NinjaMain::EnsureBuildDirExists() {
   build_dir_ = state_.bindings_.LookupVariable("builddir");
   if (!build_dir_.empty() && !config_.dry_run) {
@@ -1436,12 +1911,33 @@ int ReadFlags(int* argc, char*** argv,
               Options* options, BuildConfig* config) {
   DeferGuessParallelism deferGuessParallelism(config);
 
-  enum { OPT_VERSION = 1, OPT_QUIET = 2 };
+  enum {
+    OPT_VERSION = 1,
+    OPT_QUIET = 2,
+    OPT_ASYNC_LOGS = 3,
+    OPT_JOBSERVER_POOL = 4,
+    OPT_ACTION_CACHE = 5,
+    OPT_ACTION_CACHE_SIZE = 6,
+    OPT_REMOTE_CACHE = 7,
+    OPT_EXECUTOR = 8,
+    OPT_CHROME_TRACE = 9,
+    OPT_METRICS_JSON = 10,
+    OPT_EVENT_STREAM = 11,
+  };
   const option kLongOptions[] = {
     { "help", no_argument, NULL, 'h' },
     { "version", no_argument, NULL, OPT_VERSION },
     { "verbose", no_argument, NULL, 'v' },
     { "quiet", no_argument, NULL, OPT_QUIET },
+    { "async-logs", no_argument, NULL, OPT_ASYNC_LOGS },
+    { "jobserver-pool", no_argument, NULL, OPT_JOBSERVER_POOL },
+    { "action-cache", required_argument, NULL, OPT_ACTION_CACHE },
+    { "action-cache-size", required_argument, NULL, OPT_ACTION_CACHE_SIZE },
+    { "remote-cache", required_argument, NULL, OPT_REMOTE_CACHE },
+    { "executor", required_argument, NULL, OPT_EXECUTOR },
+    { "chrome-trace", required_argument, NULL, OPT_CHROME_TRACE },
+    { "metrics-json", required_argument, NULL, OPT_METRICS_JSON },
+    { "event-stream", required_argument, NULL, OPT_EVENT_STREAM },
     { NULL, 0, NULL, 0 }
   };
 
@@ -1503,6 +1999,38 @@ int ReadFlags(int* argc, char*** argv,
       case OPT_QUIET:
         config->verbosity = BuildConfig::NO_STATUS_UPDATE;
         break;
+      case OPT_ASYNC_LOGS:
+        config->async_logs = true;
+        break;
+      case OPT_JOBSERVER_POOL:
+        options->jobserver_pool = true;
+        break;
+      case OPT_ACTION_CACHE:
+        config->action_cache_dir = optarg;
+        break;
+      case OPT_ACTION_CACHE_SIZE: {
+        char* end;
+        long long value = strtoll(optarg, &end, 10);
+        if (*end != 0 || value <= 0)
+          Fatal("invalid --action-cache-size parameter");
+        config->action_cache_max_size = value << 20;
+        break;
+      }
+      case OPT_REMOTE_CACHE:
+        config->remote_cache_url = optarg;
+        break;
+      case OPT_EXECUTOR:
+        config->executor = optarg;
+        break;
+      case OPT_CHROME_TRACE:
+        options->chrome_trace = optarg;
+        break;
+      case OPT_METRICS_JSON:
+        options->metrics_json = optarg;
+        break;
+      case OPT_EVENT_STREAM:
+        options->event_stream = optarg;
+        break;
       case 'w':
         if (!WarningEnable(optarg, options))
           return 1;
@@ -1523,9 +2051,50 @@ int ReadFlags(int* argc, char*** argv,
   *argv += optind;
   *argc -= optind;
 
+  if (!config->remote_cache_url.empty() && config->action_cache_dir.empty()) {
+    Error("--remote-cache needs --action-cache, to keep local copies");
+    return 1;
+  }
+
   return -1;
 }
 
+/// The jobserver run for --jobserver-pool.  Static so that it is cleaned
+/// up on exit().
+std::unique_ptr<JobserverPool> g_jobserver_pool;
+
+/// Start a jobserver for the commands of the build, unless ninja is already
+/// part of one.  Returns false on error.
+bool StartJobserverPool(const BuildConfig& config, Status* status) {
+  const char* makeflags = getenv("MAKEFLAGS");
+  JobserverConfig existing;
+  string err;
+  if (makeflags && ParseJobserverMakeFlags(makeflags, &existing, &err) &&
+      existing.mode != JobserverConfig::kModeNone) {
+    status->Warning("--jobserver-pool: already using a jobserver from "
+                    "MAKEFLAGS");
+    return true;
+  }
+  if (config.parallelism == INT_MAX) {
+    status->Error("--jobserver-pool: needs a limit on jobs, not -j0");
+    return false;
+  }
+
+  g_jobserver_pool.reset(JobserverPool::Create(config.parallelism, &err));
+  if (!g_jobserver_pool) {
+    status->Error("--jobserver-pool: %s", err.c_str());
+    return false;
+  }
+  // Ninja takes its own tokens from the pool too, as its commands do.
+  g_jobserver_pool->SetMakeFlagsEnvironment();
+  return true;
+}
+
+/// The outermost of the Status decorators of --event-stream and
+/// --chrome-trace, which own the Status they wrap.  Static so that they
+/// complete their output when ninja exits.
+std::unique_ptr<Status> g_status;
+
 NORETURN void real_main(int argc, char** argv) {
   // Use exit() instead of return in this function to avoid potentially
   // expensive cleanup when destructing NinjaMain.
@@ -1542,6 +2111,38 @@ NORETURN void real_main(int argc, char** argv) {
 
   Status* status = Status::factory(config);
 
+  // The trace gets the measurements of -d stats, whether or not they are
+  // printed.
+  bool dump_metrics = g_metrics != NULL;
+  if (options.metrics_json && !g_metrics)
+    g_metrics = new Metrics;
+  if (options.event_stream && !options.tool) {
+    string err;
+    StatusStream* stream =
+        StatusStream::Create(status, options.event_stream, &err);
+    if (!stream) {
+      status->Error("--event-stream: %s", err.c_str());
+      exit(1);
+    }
+    g_status.reset(stream);
+    status = stream;
+  }
+  if (options.chrome_trace && !options.tool) {
+    if (!g_metrics)
+      g_metrics = new Metrics;
+    string err;
+    StatusTracer* tracer =
+        StatusTracer::Create(status, options.chrome_trace, &err);
+    if (!tracer) {
+      status->Error("--chrome-trace: %s", err.c_str());
+      exit(1);
+    }
+    // The tracer owns the stream, if any.
+    g_status.release();
+    g_status.reset(tracer);
+    status = tracer;
+  }
+
   if (options.working_dir) {
     // The formatting of this string, complete with funny quotes, is
     // so Emacs can properly identify that the cwd has changed for
@@ -1562,6 +2163,10 @@ NORETURN void real_main(int argc, char** argv) {
     exit((ninja.*options.tool->func)(&options, argc, argv));
   }
 
+  if (options.jobserver_pool && !options.tool && !config.dry_run &&
+      !StartJobserverPool(config, status))
+    exit(1);
+
   // Limit number of rebuilds, to prevent infinite loops.
   const int kCycleLimit = 100;
   for (int cycle = 1; cycle <= kCycleLimit; ++cycle) {
@@ -1606,8 +2211,14 @@ NORETURN void real_main(int argc, char** argv) {
     ninja.ParsePreviousElapsedTimes();
 
     int result = ninja.RunBuild(argc, argv, status);
-    if (g_metrics)
+    if (!ninja.FlushLogs() && result == 0)
+      result = 1;
+    if (dump_metrics)
       ninja.DumpMetrics();
+    if (g_memstats)
+      ninja.DumpMemoryStats();
+    if (options.metrics_json && !ninja.WriteMetricsJSON(options.metrics_json))
+      result = 1;
     exit(result);
   }
 
@@ -0,0 +1,81 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "output_spool.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <utility>
+
+#include "util.h"
+
+using namespace std;
+
+const size_t OutputSpool::kDefaultThreshold = 1 << 20;
+
+OutputSpool::OutputSpool(size_t threshold)
+    : threshold_(threshold), file_(NULL), spooled_(0) {}
+
+OutputSpool::~OutputSpool() {
+  if (file_)
+    fclose(file_);
+}
+
+void OutputSpool::Append(const char* data, size_t len) {
+  if (!file_ && buf_.size() + len > threshold_) {
+    file_ = tmpfile();
+    // Writes are large already; don't copy them through a stdio buffer.
+    if (file_) {
+      SetCloseOnExec(fileno(file_));
+      setvbuf(file_, NULL, _IONBF, 0);
+    }
+  }
+  if (file_) {
+    size_t written = fwrite(data, 1, len, file_);
+    spooled_ += written;
+    if (written == len)
+      return;
+    // Out of space for the temporary file; keep the rest in memory.
+    Unspool();
+    data += written;
+    len -= written;
+  }
+  buf_.append(data, len);
+}
+
+const string& OutputSpool::str() {
+  Unspool();
+  return buf_;
+}
+
+string OutputSpool::Take() {
+  Unspool();
+  string output;
+  output.swap(buf_);
+  return output;
+}
+
+void OutputSpool::Unspool() {
+  if (!file_)
+    return;
+  size_t offset = buf_.size();
+  buf_.resize(offset + spooled_);
+  rewind(file_);
+  if (spooled_ > 0 && fread(&buf_[offset], spooled_, 1, file_) < 1)
+    Fatal("reading spooled output: %s", strerror(errno));
+  fclose(file_);
+  file_ = NULL;
+  spooled_ = 0;
+}
@@ -0,0 +1,59 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_OUTPUT_SPOOL_H_
+#define NINJA_OUTPUT_SPOOL_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <string>
+
+/// OutputSpool collects the output of a running command.  The first
+/// |threshold| bytes are kept in memory; anything beyond that goes to an
+/// anonymous temporary file until the command is done, so that many chatty
+/// commands running at once don't all hold their output in memory.
+/// If no temporary file can be created or written, output stays in memory.
+struct OutputSpool {
+  static const size_t kDefaultThreshold;
+
+  explicit OutputSpool(size_t threshold = kDefaultThreshold);
+  ~OutputSpool();
+
+  void Append(const char* data, size_t len);
+
+  /// The output so far, read back from the temporary file if needed.
+  const std::string& str();
+
+  /// Move the output out, leaving the spool empty.
+  std::string Take();
+
+  size_t size() const { return buf_.size() + spooled_; }
+  bool spooling() const { return file_ != NULL; }
+
+ private:
+  /// Move the contents of the temporary file into |buf_| and close it.
+  void Unspool();
+
+  size_t threshold_;
+  std::string buf_;
+  FILE* file_;
+  /// Number of bytes in |file_|, which follow those in |buf_|.
+  size_t spooled_;
+
+  OutputSpool(const OutputSpool&);
+  void operator=(const OutputSpool&);
+};
+
+#endif  // NINJA_OUTPUT_SPOOL_H_
@@ -0,0 +1,49 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "output_spool.h"
+
+#include "test.h"
+
+using namespace std;
+
+TEST(OutputSpoolTest, SmallOutputStaysInMemory) {
+  OutputSpool spool(16);
+  spool.Append("hello ", 6);
+  spool.Append("world\n", 6);
+  EXPECT_FALSE(spool.spooling());
+  EXPECT_EQ(12u, spool.size());
+  EXPECT_EQ("hello world\n", spool.str());
+}
+
+TEST(OutputSpoolTest, LargeOutputIsSpooled) {
+  OutputSpool spool(16);
+  string expected;
+  for (int i = 0; i < 1000; ++i) {
+    string line = "line " + to_string(i) + "\n";
+    expected += line;
+    spool.Append(line.data(), line.size());
+  }
+  EXPECT_TRUE(spool.spooling());
+  EXPECT_EQ(expected.size(), spool.size());
+
+  EXPECT_EQ(expected, spool.str());
+  EXPECT_FALSE(spool.spooling());
+
+  // Output appended after reading it back goes on the end.
+  spool.Append("more", 4);
+  EXPECT_EQ(expected + "more", spool.Take());
+  EXPECT_EQ(0u, spool.size());
+  EXPECT_EQ("", spool.str());
+}
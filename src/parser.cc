@@ -16,6 +16,7 @@
 
 #include "disk_interface.h"
 #include "metrics.h"
+#include "probes.h"
 
 using namespace std;
 
@@ -24,6 +25,7 @@ bool Parser::Load(const string& filename, string* err, Lexer* parent) {
   // Parser::Load() in our call stack. Do not start a new one here to avoid
   // over-counting parsing times.
   METRIC_RECORD_IF(".ninja parse", parent == NULL);
+  NINJA_PROBE_SCOPE(manifest_parse, filename.c_str());
   string contents;
   string read_err;
   if (file_reader_->ReadFile(filename, &contents, &read_err) !=
@@ -0,0 +1,54 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_PROBES_H_
+#define NINJA_PROBES_H_
+
+/// Static tracepoints ("USDT probes") at ninja's key points, for perf,
+/// bpftrace or SystemTap to attach to in a running ninja, e.g.:
+///
+///   bpftrace -e 'usdt:./ninja:ninja:edge_start { printf("%s\n", str(arg1)); }'
+///
+/// They are compiled in with the NINJA_USDT_PROBES CMake option, which
+/// needs <sys/sdt.h> from SystemTap.  A probe is then a nop instruction
+/// until a tracer attaches to it, and otherwise compiles to nothing, its
+/// arguments not even being evaluated.  Keep the arguments cheap.
+
+#ifdef NINJA_USDT_PROBES
+
+#include <sys/sdt.h>
+
+#define NINJA_PROBE1(name, a) DTRACE_PROBE1(ninja, name, a)
+#define NINJA_PROBE2(name, a, b) DTRACE_PROBE2(ninja, name, a, b)
+#define NINJA_PROBE3(name, a, b, c) DTRACE_PROBE3(ninja, name, a, b, c)
+
+/// Fire |name|_start now and |name|_done at the end of the scope, both with
+/// the string |arg|, which must live until then.
+#define NINJA_PROBE_SCOPE(name, arg)                                   \
+  NINJA_PROBE1(name##_start, arg);                                     \
+  struct probes_h_##name##_scope {                                     \
+    const char* arg_;                                                  \
+    ~probes_h_##name##_scope() { NINJA_PROBE1(name##_done, arg_); }    \
+  } probes_h_scope = { arg }
+
+#else
+
+#define NINJA_PROBE1(name, a) do {} while (0)
+#define NINJA_PROBE2(name, a, b) do {} while (0)
+#define NINJA_PROBE3(name, a, b, c) do {} while (0)
+#define NINJA_PROBE_SCOPE(name, arg) do {} while (0)
+
+#endif  // NINJA_USDT_PROBES
+
+#endif  // NINJA_PROBES_H_
@@ -0,0 +1,391 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "remote_cache.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include "metrics.h"
+#include "util.h"
+
+using namespace std;
+
+const int RemoteCache::kMaxErrors = 3;
+const size_t RemoteCache::kMaxUploads = 4;
+const size_t RemoteCache::kMaxPendingUploadBytes = 64 << 20;
+
+namespace {
+
+// Waits below also time out periodically, so that a missed wakeup can
+// only delay the uploads, never hang the build.
+const chrono::milliseconds kWaitTimeout(100);
+
+/// Decode a body sent with "Transfer-Encoding: chunked".
+bool DecodeChunked(const string& body, string* decoded) {
+  size_t pos = 0;
+  for (;;) {
+    size_t eol = body.find("\r\n", pos);
+    if (eol == string::npos)
+      return false;
+    char* end;
+    unsigned long size = strtoul(body.c_str() + pos, &end, 16);
+    if (end == body.c_str() + pos)
+      return false;
+    pos = eol + 2;
+    if (size == 0)
+      return true;
+    if (body.size() < pos + size + 2)
+      return false;
+    decoded->append(body, pos, size);
+    pos += size + 2;
+  }
+}
+
+/// Find the value of the header |name|, which must be lower case, in the
+/// |headers| of a response.
+string HeaderValue(const string& headers, const string& name) {
+  size_t pos = 0;
+  while ((pos = headers.find("\r\n", pos)) != string::npos) {
+    pos += 2;
+    size_t colon = headers.find(':', pos);
+    size_t eol = headers.find("\r\n", pos);
+    if (colon == string::npos || (eol != string::npos && colon > eol))
+      continue;
+    string key = headers.substr(pos, colon - pos);
+    for (size_t i = 0; i < key.size(); ++i)
+      key[i] = (char)tolower(key[i]);
+    if (key != name)
+      continue;
+    size_t start = headers.find_first_not_of(" \t", colon + 1);
+    if (start == string::npos || (eol != string::npos && start > eol))
+      return "";
+    return headers.substr(start, eol - start);
+  }
+  return "";
+}
+
+/// Split a response into its status code and body.
+bool ParseResponse(const string& response, int* status, string* body,
+                   string* err) {
+  size_t end_of_headers = response.find("\r\n\r\n");
+  if (response.compare(0, 5, "HTTP/") != 0 || end_of_headers == string::npos ||
+      response.find(' ') == string::npos) {
+    *err = "malformed response";
+    return false;
+  }
+  *status = atoi(response.c_str() + response.find(' ') + 1);
+  string headers = response.substr(0, end_of_headers + 2);
+  body->assign(response, end_of_headers + 4, string::npos);
+
+  if (HeaderValue(headers, "transfer-encoding") == "chunked") {
+    string decoded;
+    if (!DecodeChunked(*body, &decoded)) {
+      *err = "truncated response";
+      return false;
+    }
+    body->swap(decoded);
+    return true;
+  }
+  string length = HeaderValue(headers, "content-length");
+  if (!length.empty()) {
+    size_t expected = strtoul(length.c_str(), NULL, 10);
+    if (body->size() < expected) {
+      *err = "truncated response";
+      return false;
+    }
+    body->resize(expected);
+  }
+  return true;
+}
+
+#ifndef _WIN32
+/// Bound the next send(), recv() or connect() on |fd| by the time left
+/// until |deadline_millis|, as the socket timeouts only bound each call.
+/// Returns false if there is none left.
+bool SetTimeout(int fd, int64_t deadline_millis) {
+  int64_t left = deadline_millis - GetTimeMillis();
+  if (left <= 0)
+    return false;
+  struct timeval timeout;
+  timeout.tv_sec = left / 1000;
+  timeout.tv_usec = (left % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  return true;
+}
+#endif
+
+}  // anonymous namespace
+
+RemoteCache* RemoteCache::Create(const string& url, int timeout_ms,
+                                 string* err) {
+#ifdef _WIN32
+  *err = "remote caching is not supported on Windows";
+  return NULL;
+#else
+  const char kScheme[] = "http://";
+  if (url.compare(0, sizeof(kScheme) - 1, kScheme) != 0) {
+    *err = "unsupported URL '" + url + "', expected http://host[:port][/path]";
+    return NULL;
+  }
+  string rest = url.substr(sizeof(kScheme) - 1);
+  size_t slash = rest.find('/');
+  string host = rest.substr(0, slash);
+  string prefix = slash == string::npos ? "" : rest.substr(slash);
+  while (!prefix.empty() && prefix[prefix.size() - 1] == '/')
+    prefix.resize(prefix.size() - 1);
+  string port = "80";
+  size_t colon = host.rfind(':');
+  if (colon != string::npos && host.find(']', colon) == string::npos) {
+    port = host.substr(colon + 1);
+    host.resize(colon);
+  }
+  if (host.size() > 2 && host[0] == '[' && host[host.size() - 1] == ']')
+    host = host.substr(1, host.size() - 2);
+  if (host.empty() || port.empty()) {
+    *err = "no host in URL '" + url + "'";
+    return NULL;
+  }
+  return new RemoteCache(host, port, prefix, timeout_ms);
+#endif
+}
+
+RemoteCache::RemoteCache(const string& host, const string& port,
+                         const string& prefix, int timeout_ms)
+    : host_(host), port_(port), prefix_(prefix), timeout_ms_(timeout_ms),
+      errors_(0), uploads_running_(0), pending_upload_bytes_(0),
+      quit_(false) {}
+
+RemoteCache::~RemoteCache() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    quit_ = true;
+    uploads_changed_.notify_all();
+  }
+  for (vector<thread>::iterator t = threads_.begin(); t != threads_.end(); ++t)
+    t->join();
+}
+
+bool RemoteCache::enabled() const {
+  lock_guard<mutex> lock(mutex_);
+  return errors_ < kMaxErrors;
+}
+
+RemoteCache::GetResult RemoteCache::Get(const string& path, string* contents) {
+  if (!enabled())
+    return kError;
+  int status;
+  string err;
+  if (!Request("GET", path, "", &status, contents, &err)) {
+    Failed("GET " + path, err);
+    return kError;
+  }
+  if (status == 200)
+    return kFound;
+  if (status == 404)
+    return kNotFound;
+  Failed("GET " + path, "HTTP status " + to_string(status));
+  return kError;
+}
+
+bool RemoteCache::PutAsync(const string& path, const string& contents) {
+  lock_guard<mutex> lock(mutex_);
+  if (errors_ >= kMaxErrors)
+    return false;
+  // A slow server must not hold the build up, nor let the uploads pile up
+  // in memory.  One upload is always taken, however large.
+  if (pending_upload_bytes_ > 0 &&
+      pending_upload_bytes_ + contents.size() > kMaxPendingUploadBytes) {
+    METRIC_RECORD("remote cache upload dropped");
+    return false;
+  }
+  pending_upload_bytes_ += contents.size();
+  uploads_.push_back(make_pair(path, contents));
+  if (threads_.size() < kMaxUploads &&
+      threads_.size() < uploads_.size() + uploads_running_)
+    threads_.push_back(thread(&RemoteCache::RunUploads, this));
+  uploads_changed_.notify_one();
+  return true;
+}
+
+void RemoteCache::RunUploads() {
+  unique_lock<mutex> lock(mutex_);
+  for (;;) {
+    if (uploads_.empty() || errors_ >= kMaxErrors) {
+      // Finish the queued uploads before quitting.
+      if (quit_)
+        return;
+      uploads_changed_.wait_for(lock, kWaitTimeout);
+      continue;
+    }
+    pair<string, string> upload;
+    upload.swap(uploads_.front());
+    uploads_.pop_front();
+    ++uploads_running_;
+    lock.unlock();
+
+    int status;
+    string response, err;
+    bool ok = Request("PUT", upload.first, upload.second, &status, &response,
+                      &err);
+    if (ok && (status < 200 || status >= 300)) {
+      err = "HTTP status " + to_string(status);
+      ok = false;
+    }
+    if (!ok)
+      Failed("PUT " + upload.first, err);
+
+    lock.lock();
+    --uploads_running_;
+    pending_upload_bytes_ -= upload.second.size();
+  }
+}
+
+void RemoteCache::Failed(const string& what, const string& err) {
+  lock_guard<mutex> lock(mutex_);
+  if (++errors_ == kMaxErrors) {
+    Warning("remote cache disabled after %d errors, last: %s: %s", errors_,
+            what.c_str(), err.c_str());
+  }
+}
+
+bool RemoteCache::Request(const string& method, const string& path,
+                          const string& body, int* status, string* response,
+                          string* err) {
+#ifdef _WIN32
+  *err = "not supported";
+  return false;
+#else
+  // The whole request must be done by then, however slowly the server
+  // trickles its bytes.
+  int64_t deadline_millis = GetTimeMillis() + timeout_ms_;
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* addrs;
+  int ret = getaddrinfo(host_.c_str(), port_.c_str(), &hints, &addrs);
+  if (ret != 0) {
+    *err = host_ + ": " + gai_strerror(ret);
+    return false;
+  }
+
+  int fd = -1;
+  for (struct addrinfo* a = addrs; a; a = a->ai_next) {
+    // Keep the socket out of the commands that the main thread starts
+    // meanwhile: setting FD_CLOEXEC afterwards leaves a window open.
+    int type = a->ai_socktype;
+#ifdef SOCK_CLOEXEC
+    type |= SOCK_CLOEXEC;
+#endif
+    fd = socket(a->ai_family, type, a->ai_protocol);
+    if (fd < 0)
+      continue;
+#ifndef SOCK_CLOEXEC
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    // On Linux, the send timeout also bounds connect().
+    if (!SetTimeout(fd, deadline_millis)) {
+      *err = "connect: timed out";
+      close(fd);
+      fd = -1;
+      break;
+    }
+    if (connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+      break;
+    *err = string("connect: ") + strerror(errno);
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addrs);
+  if (fd < 0)
+    return false;
+
+  // An IPv6 address is bracketed in the Host header, as in the URL.
+  string host = host_.find(':') == string::npos ? host_ : "[" + host_ + "]";
+  string request = method + " " + prefix_ + "/" + path + " HTTP/1.1\r\n" +
+                   "Host: " + host + ":" + port_ + "\r\n" +
+                   "Connection: close\r\n";
+  if (method == "PUT") {
+    request += "Content-Type: application/octet-stream\r\n"
+               "Content-Length: " + to_string(body.size()) + "\r\n";
+  }
+  request += "\r\n";
+  request += body;
+
+#ifdef MSG_NOSIGNAL
+  const int kSendFlags = MSG_NOSIGNAL;
+#else
+  const int kSendFlags = 0;
+#endif
+  for (size_t sent = 0; sent < request.size();) {
+    if (!SetTimeout(fd, deadline_millis)) {
+      *err = "send: timed out";
+      close(fd);
+      return false;
+    }
+    ssize_t len = send(fd, request.data() + sent, request.size() - sent,
+                       kSendFlags);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0) {
+      *err = string("send: ") +
+             (errno == EAGAIN ? "timed out" : strerror(errno));
+      close(fd);
+      return false;
+    }
+    sent += len;
+  }
+
+  string data;
+  char buf[64 << 10];
+  for (;;) {
+    if (!SetTimeout(fd, deadline_millis)) {
+      *err = "recv: timed out";
+      close(fd);
+      return false;
+    }
+    ssize_t len = recv(fd, buf, sizeof(buf), 0);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0) {
+      *err = string("recv: ") +
+             (errno == EAGAIN ? "timed out" : strerror(errno));
+      close(fd);
+      return false;
+    }
+    if (len == 0)
+      break;
+    data.append(buf, len);
+  }
+  close(fd);
+  return ParseResponse(data, status, response, err);
+#endif
+}
@@ -0,0 +1,108 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_REMOTE_CACHE_H_
+#define NINJA_REMOTE_CACHE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// RemoteCache reads and writes the files of an ActionCache on an HTTP
+/// server, so that machines sharing the server share build outputs.
+///
+/// The protocol is plain HTTP/1.1, one request per connection:
+/// - "GET <prefix>/<path>" returns 200 with the contents of the file, or
+///   404 if there is none.
+/// - "PUT <prefix>/<path>" with a Content-Length stores the file, and
+///   returns any 2xx status.
+/// where |path| is "ac/<hash>" or "cas/<hash>", as in the local cache.
+///
+/// Every request gives up after a timeout, and after a few failed requests
+/// the cache stops making them for the rest of the build, so that an
+/// unreachable server only costs a few timeouts before falling back to
+/// running commands.  Uploads run on a few background threads, and are
+/// dropped rather than waited for when too many are pending.
+struct RemoteCache {
+  enum GetResult {
+    kFound,
+    kNotFound,
+    kError,
+  };
+
+  /// Number of failed requests after which the cache is disabled.
+  static const int kMaxErrors;
+  /// Number of uploads in flight at once.
+  static const size_t kMaxUploads;
+  /// Size of the uploads pending, queued or in flight, beyond which more
+  /// are dropped.
+  static const size_t kMaxPendingUploadBytes;
+
+  /// Returns NULL and fills in |err| if |url|, of the form
+  /// "http://host[:port][/prefix]", isn't supported.
+  static RemoteCache* Create(const std::string& url, int timeout_ms,
+                             std::string* err);
+
+  /// Waits for the uploads queued so far.
+  ~RemoteCache();
+
+  /// Fetch |path| into |contents|.  May be called from any thread.
+  GetResult Get(const std::string& path, std::string* contents);
+
+  /// Store |contents| as |path| from a background thread.  Returns false
+  /// if the upload is dropped, as too many are pending or the cache is
+  /// disabled.  Never waits for the server.  Main thread only, as the
+  /// drops are counted in a metric.
+  bool PutAsync(const std::string& path, const std::string& contents);
+
+  /// Whether requests are still made.
+  bool enabled() const;
+
+ private:
+  RemoteCache(const std::string& host, const std::string& port,
+              const std::string& prefix, int timeout_ms);
+
+  /// Send one request and read the response.  Returns false and fills in
+  /// |err| if there is no response.
+  bool Request(const std::string& method, const std::string& path,
+               const std::string& body, int* status, std::string* response,
+               std::string* err);
+
+  /// Count a failed request, and disable the cache after too many.
+  void Failed(const std::string& what, const std::string& err);
+
+  void RunUploads();
+
+  std::string host_;
+  std::string port_;
+  std::string prefix_;
+  int timeout_ms_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable uploads_changed_;
+  /// Guarded by |mutex_|.
+  int errors_;
+  std::deque<std::pair<std::string, std::string> > uploads_;
+  size_t uploads_running_;
+  /// Size of the contents of |uploads_| and of the uploads running.
+  size_t pending_upload_bytes_;
+  bool quit_;
+  std::vector<std::thread> threads_;
+};
+
+#endif  // NINJA_REMOTE_CACHE_H_
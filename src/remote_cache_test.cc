@@ -0,0 +1,431 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "remote_cache.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "action_cache.h"
+#include "disk_interface.h"
+#include "graph.h"
+#include "sha256.h"
+#include "test.h"
+
+using namespace std;
+
+#ifndef _WIN32
+
+namespace {
+
+/// A tiny HTTP server for the cache protocol, on a port of the loopback
+/// interface, that keeps the files it is sent in memory.
+struct TestServer {
+  explicit TestServer(bool ipv6 = false)
+      : ipv6_(ipv6), quit_(false), silent_(false), trickle_(false), status_(0),
+        requests_(0) {
+    fd_ = socket(ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_storage addr;
+    socklen_t len = Address(0, &addr);
+    bound_ = bind(fd_, (struct sockaddr*)&addr, len) == 0;
+    listen(fd_, 16);
+    getsockname(fd_, (struct sockaddr*)&addr, &len);
+    port_ = ntohs(ipv6 ? ((struct sockaddr_in6*)&addr)->sin6_port
+                       : ((struct sockaddr_in*)&addr)->sin_port);
+    thread_ = thread(&TestServer::Run, this);
+  }
+
+  ~TestServer() {
+    // Wake up accept() with a connection of our own.
+    quit_ = true;
+    int fd = socket(ipv6_ ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_storage addr;
+    socklen_t len = Address(port_, &addr);
+    connect(fd, (struct sockaddr*)&addr, len);
+    thread_.join();
+    close(fd);
+    close(fd_);
+    for (size_t i = 0; i < held_.size(); ++i)
+      close(held_[i]);
+  }
+
+  string url() const {
+    return string("http://") + (ipv6_ ? "[::1]" : "127.0.0.1") + ":" +
+           to_string(port_) + "/cache";
+  }
+
+  /// The loopback address with |port|.
+  socklen_t Address(int port, struct sockaddr_storage* storage) const {
+    memset(storage, 0, sizeof(*storage));
+    if (ipv6_) {
+      struct sockaddr_in6* addr = (struct sockaddr_in6*)storage;
+      addr->sin6_family = AF_INET6;
+      addr->sin6_addr = in6addr_loopback;
+      addr->sin6_port = htons(port);
+      return sizeof(*addr);
+    }
+    struct sockaddr_in* addr = (struct sockaddr_in*)storage;
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr->sin_port = htons(port);
+    return sizeof(*addr);
+  }
+
+  void Run() {
+    for (;;) {
+      int fd = accept(fd_, NULL, NULL);
+      if (quit_) {
+        close(fd);
+        return;
+      }
+      if (fd >= 0)
+        Serve(fd);
+    }
+  }
+
+  void Serve(int fd) {
+    string request;
+    char buf[4096];
+    size_t end_of_headers;
+    while ((end_of_headers = request.find("\r\n\r\n")) == string::npos) {
+      ssize_t len = read(fd, buf, sizeof(buf));
+      if (len <= 0)
+        break;
+      request.append(buf, len);
+    }
+    ++requests_;
+    size_t host = request.find("\r\nHost: ");
+    if (host != string::npos) {
+      lock_guard<mutex> lock(mutex_);
+      host_ = request.substr(host + 8, request.find("\r\n", host + 8) -
+                                           (host + 8));
+    }
+    if (silent_) {
+      // Hold the connection without replying.
+      held_.push_back(fd);
+      return;
+    }
+    size_t length = 0;
+    size_t pos = request.find("Content-Length: ");
+    if (pos != string::npos)
+      length = strtoul(request.c_str() + pos + 16, NULL, 10);
+    string body = request.substr(end_of_headers + 4);
+    while (body.size() < length) {
+      ssize_t len = read(fd, buf, sizeof(buf));
+      if (len <= 0)
+        break;
+      body.append(buf, len);
+    }
+
+    string method = request.substr(0, request.find(' '));
+    size_t path_start = method.size() + 1;
+    string path = request.substr(path_start,
+                                 request.find(' ', path_start) - path_start);
+    int status = 400;
+    string reply;
+    if (path.compare(0, 7, "/cache/") == 0) {
+      path = path.substr(7);
+      lock_guard<mutex> lock(mutex_);
+      if (method == "PUT") {
+        files_[path] = body;
+        status = 201;
+      } else if (method == "GET") {
+        map<string, string>::iterator i = files_.find(path);
+        status = i == files_.end() ? 404 : 200;
+        if (i != files_.end())
+          reply = i->second;
+      }
+    }
+    if (status_)
+      status = status_;
+    string response = "HTTP/1.1 " + to_string(status) + " X\r\n" +
+                      "Content-Length: " + to_string(reply.size()) + "\r\n" +
+                      "\r\n" + reply;
+    for (size_t sent = 0; sent < response.size();) {
+      size_t size = response.size() - sent;
+      if (trickle_) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+        size = 1;
+      }
+#ifdef MSG_NOSIGNAL
+      ssize_t len = send(fd, response.data() + sent, size, MSG_NOSIGNAL);
+#else
+      ssize_t len = send(fd, response.data() + sent, size, 0);
+#endif
+      if (len <= 0)
+        break;
+      sent += len;
+    }
+    close(fd);
+  }
+
+  size_t file_count() {
+    lock_guard<mutex> lock(mutex_);
+    return files_.size();
+  }
+
+  bool ipv6_;
+  /// Whether the loopback interface has the address family.
+  bool bound_;
+  int fd_;
+  int port_;
+  atomic<bool> quit_;
+  /// Whether to leave requests unanswered.
+  atomic<bool> silent_;
+  /// Whether to send replies a byte at a time, slowly.
+  atomic<bool> trickle_;
+  /// Status to reply with instead of the right one, if not 0.
+  atomic<int> status_;
+  atomic<int> requests_;
+  vector<int> held_;
+  mutex mutex_;
+  map<string, string> files_;
+  /// The Host header of the last request.
+  string host_;
+  thread thread_;
+};
+
+}  // anonymous namespace
+
+TEST(RemoteCacheTest, GetAndPut) {
+  TestServer server;
+  string err, contents;
+  {
+    unique_ptr<RemoteCache> cache(RemoteCache::Create(server.url(), 5000,
+                                                      &err));
+    ASSERT_TRUE(cache.get()) << err;
+    EXPECT_EQ(RemoteCache::kNotFound, cache->Get("cas/1", &contents));
+    cache->PutAsync("cas/1", "contents");
+    cache->PutAsync("cas/2", string(100000, 'x'));
+  }
+  // The uploads are done when the cache is destroyed.
+  EXPECT_EQ(2u, server.file_count());
+
+  unique_ptr<RemoteCache> cache(RemoteCache::Create(server.url(), 5000, &err));
+  EXPECT_EQ(RemoteCache::kFound, cache->Get("cas/1", &contents));
+  EXPECT_EQ("contents", contents);
+  EXPECT_EQ(RemoteCache::kFound, cache->Get("cas/2", &contents));
+  EXPECT_EQ(string(100000, 'x'), contents);
+  EXPECT_TRUE(cache->enabled());
+}
+
+TEST(RemoteCacheTest, Ipv6Host) {
+  TestServer server(true);
+  if (!server.bound_)
+    return;  // No IPv6 here.
+  string err, contents;
+  unique_ptr<RemoteCache> cache(RemoteCache::Create(server.url(), 5000, &err));
+  ASSERT_TRUE(cache.get()) << err;
+  EXPECT_EQ(RemoteCache::kNotFound, cache->Get("cas/1", &contents));
+  lock_guard<mutex> lock(server.mutex_);
+  EXPECT_EQ("[::1]:" + to_string(server.port_), server.host_);
+}
+
+TEST(RemoteCacheTest, BadUrl) {
+  string err;
+  EXPECT_FALSE(RemoteCache::Create("https://example.com/", 5000, &err));
+  EXPECT_EQ("unsupported URL 'https://example.com/', "
+            "expected http://host[:port][/path]", err);
+  EXPECT_FALSE(RemoteCache::Create("http:///path", 5000, &err));
+  EXPECT_EQ("no host in URL 'http:///path'", err);
+}
+
+TEST(RemoteCacheTest, DisabledAfterErrors) {
+  TestServer server;
+  server.status_ = 500;
+  string err, contents;
+  unique_ptr<RemoteCache> cache(RemoteCache::Create(server.url(), 5000, &err));
+  for (int i = 0; i < RemoteCache::kMaxErrors; ++i) {
+    EXPECT_TRUE(cache->enabled());
+    EXPECT_EQ(RemoteCache::kError, cache->Get("ac/1", &contents));
+  }
+  EXPECT_FALSE(cache->enabled());
+
+  // No more requests are made.
+  int requests = server.requests_;
+  EXPECT_EQ(RemoteCache::kError, cache->Get("ac/1", &contents));
+  cache->PutAsync("ac/1", "contents");
+  cache.reset();
+  EXPECT_EQ(requests, server.requests_);
+}
+
+TEST(RemoteCacheTest, DropsUploadsWhenBehind) {
+  TestServer server;
+  server.silent_ = true;
+  string err;
+  unique_ptr<RemoteCache> cache(RemoteCache::Create(server.url(), 200, &err));
+  // The first upload is pending until the server times out, so the second
+  // one is dropped instead of waited for.
+  string half(RemoteCache::kMaxPendingUploadBytes / 2 + 1, 'x');
+  EXPECT_TRUE(cache->PutAsync("cas/1", half));
+  EXPECT_FALSE(cache->PutAsync("cas/2", half));
+  EXPECT_TRUE(cache->PutAsync("cas/3", "small"));
+}
+
+TEST(RemoteCacheTest, Timeout) {
+  TestServer server;
+  server.silent_ = true;
+  string err, contents;
+  unique_ptr<RemoteCache> cache(RemoteCache::Create(server.url(), 100, &err));
+  EXPECT_EQ(RemoteCache::kError, cache->Get("ac/1", &contents));
+}
+
+TEST(RemoteCacheTest, TrickleTimesOut) {
+  TestServer server;
+  server.trickle_ = true;
+  string err, contents;
+  unique_ptr<RemoteCache> cache(RemoteCache::Create(server.url(), 200, &err));
+  EXPECT_EQ(RemoteCache::kError, cache->Get("ac/1", &contents));
+}
+
+namespace {
+
+struct RemoteActionCacheTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    // These tests do real disk accesses, so create a temp dir.
+    temp_dir_.CreateAndEnter("Ninja-RemoteActionCacheTest");
+    AssertParse(&state_, "build out: cat in\n");
+  }
+
+  virtual void TearDown() {
+    temp_dir_.Cleanup();
+  }
+
+  /// Wait for a remote lookup of |cache| to finish.  Returns false if none
+  /// does within a few seconds.
+  bool WaitForRemoteRestored(ActionCache* cache, Edge** edge, bool* hit,
+                             string* output) {
+    for (int i = 0; i < 500; ++i) {
+      if (cache->NextRemoteRestored(edge, hit, output))
+        return true;
+      this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    return false;
+  }
+
+  ScopedTempDir temp_dir_;
+  RealDiskInterface disk_;
+  TestServer server_;
+};
+
+}  // anonymous namespace
+
+TEST_F(RemoteActionCacheTest, ShareBetweenLocalCaches) {
+  Edge* edge = GetNode("out")->in_edge();
+  string err, output;
+  ASSERT_TRUE(disk_.WriteFile("in", "contents"));
+  ASSERT_TRUE(disk_.WriteFile("out", "contents"));
+  {
+    ActionCache cache("cache1", 1 << 20);
+    ASSERT_TRUE(cache.Open(&err));
+    cache.SetRemote(RemoteCache::Create(server_.url(), 5000, &err));
+    EXPECT_FALSE(cache.Restore(edge, &output));
+    EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "printed", NULL, &err));
+  }
+  // The blobs of the output and the printed output, and the entry.
+  EXPECT_EQ(3u, server_.file_count());
+
+  ASSERT_EQ(0, disk_.RemoveFile("out"));
+  {
+    ActionCache cache("cache2", 1 << 20);
+    ASSERT_TRUE(cache.Open(&err));
+    cache.SetRemote(RemoteCache::Create(server_.url(), 5000, &err));
+    atomic<int> wakes(0);
+    cache.set_wake([&wakes]() { ++wakes; });
+    EXPECT_FALSE(cache.Restore(edge, &output));
+    ASSERT_TRUE(cache.StartRemoteRestore(edge));
+    Edge* restored = NULL;
+    bool hit = false;
+    ASSERT_TRUE(WaitForRemoteRestored(&cache, &restored, &hit, &output));
+    EXPECT_EQ(edge, restored);
+    EXPECT_TRUE(hit);
+    EXPECT_EQ("printed", output);
+    EXPECT_EQ(0u, cache.remote_lookups());
+    EXPECT_EQ(1, wakes);
+  }
+  string contents;
+  EXPECT_EQ(0, disk_.ReadFile("out", &contents, &err));
+  EXPECT_EQ("contents", contents);
+
+  // The local cache kept copies.
+  server_.status_ = 500;
+  ASSERT_EQ(0, disk_.RemoveFile("out"));
+  ActionCache cache("cache2", 1 << 20);
+  ASSERT_TRUE(cache.Open(&err));
+  EXPECT_TRUE(cache.Restore(edge, &output));
+}
+
+TEST_F(RemoteActionCacheTest, TamperedBlob) {
+  Edge* edge = GetNode("out")->in_edge();
+  string err, output;
+  ASSERT_TRUE(disk_.WriteFile("in", "contents"));
+  ASSERT_TRUE(disk_.WriteFile("out", "contents"));
+  {
+    ActionCache cache("cache1", 1 << 20);
+    ASSERT_TRUE(cache.Open(&err));
+    cache.SetRemote(RemoteCache::Create(server_.url(), 5000, &err));
+    EXPECT_TRUE(cache.Store(edge, vector<Node*>(), "", NULL, &err));
+  }
+  {
+    lock_guard<mutex> lock(server_.mutex_);
+    server_.files_["cas/" + Sha256Hex("contents")] = "tampered";
+  }
+
+  // The blob doesn't have the digest of the entry, so it isn't used.
+  ASSERT_EQ(0, disk_.RemoveFile("out"));
+  ActionCache cache("cache2", 1 << 20);
+  ASSERT_TRUE(cache.Open(&err));
+  cache.SetRemote(RemoteCache::Create(server_.url(), 5000, &err));
+  ASSERT_TRUE(cache.StartRemoteRestore(edge));
+  Edge* restored = NULL;
+  bool hit = true;
+  ASSERT_TRUE(WaitForRemoteRestored(&cache, &restored, &hit, &output));
+  EXPECT_FALSE(hit);
+  string contents;
+  EXPECT_EQ(DiskInterface::NotFound, disk_.ReadFile("out", &contents, &err));
+}
+
+TEST_F(RemoteActionCacheTest, LookupDoesNotBlock) {
+  Edge* edge = GetNode("out")->in_edge();
+  string err, output;
+  server_.silent_ = true;
+  ActionCache cache("cache", 1 << 20);
+  ASSERT_TRUE(cache.Open(&err));
+  cache.SetRemote(RemoteCache::Create(server_.url(), 200, &err));
+  ASSERT_TRUE(cache.StartRemoteRestore(edge));
+  Edge* restored = NULL;
+  bool hit = true;
+  EXPECT_FALSE(cache.NextRemoteRestored(&restored, &hit, &output));
+  EXPECT_EQ(1u, cache.remote_lookups());
+
+  // The lookup finishes as a miss once the server times out.
+  ASSERT_TRUE(WaitForRemoteRestored(&cache, &restored, &hit, &output));
+  EXPECT_EQ(edge, restored);
+  EXPECT_FALSE(hit);
+  EXPECT_EQ(0u, cache.remote_lookups());
+}
+
+#endif  // _WIN32
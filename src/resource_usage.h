@@ -0,0 +1,47 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_RESOURCE_USAGE_H_
+#define NINJA_RESOURCE_USAGE_H_
+
+/// Resources used by a finished command, as reported by the operating
+/// system when reaping it.  Fields the platform doesn't report are zero.
+struct ResourceUsage {
+  ResourceUsage()
+      : user_time_millis(0), system_time_millis(0), max_rss_kb(0),
+        input_blocks(0), output_blocks(0) {}
+
+  bool empty() const {
+    return !user_time_millis && !system_time_millis && !max_rss_kb &&
+           !input_blocks && !output_blocks;
+  }
+
+  bool operator==(const ResourceUsage& o) const {
+    return user_time_millis == o.user_time_millis &&
+           system_time_millis == o.system_time_millis &&
+           max_rss_kb == o.max_rss_kb && input_blocks == o.input_blocks &&
+           output_blocks == o.output_blocks;
+  }
+
+  /// CPU time spent in user and kernel mode.
+  int user_time_millis;
+  int system_time_millis;
+  /// Peak resident set size of the largest process in the command.
+  int max_rss_kb;
+  /// Number of file system block reads and writes.
+  int input_blocks;
+  int output_blocks;
+};
+
+#endif  // NINJA_RESOURCE_USAGE_H_
@@ -0,0 +1,149 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "schedule_estimator.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "graph.h"
+#include "state.h"
+
+using namespace std;
+
+namespace {
+
+typedef priority_queue<const Edge*, vector<const Edge*>, EdgePriorityLess>
+    ReadyQueue;
+
+int64_t Duration(const Edge* edge, int64_t default_duration_millis) {
+  return edge->prev_elapsed_time_millis != -1 ? edge->prev_elapsed_time_millis
+                                              : default_duration_millis;
+}
+
+/// |edge| is done: queue the commands that waited only for it, and finish
+/// the phony edges that did.
+void Release(const Edge* edge, unordered_map<const Edge*, int>* blocker_count,
+             const unordered_map<const Edge*, vector<const Edge*> >& dependents,
+             ReadyQueue* ready) {
+  unordered_map<const Edge*, vector<const Edge*> >::const_iterator waiting =
+      dependents.find(edge);
+  if (waiting == dependents.end())
+    return;
+  for (const Edge* dependent : waiting->second) {
+    if (--(*blocker_count)[dependent] > 0)
+      continue;
+    if (dependent->is_phony())
+      Release(dependent, blocker_count, dependents, ready);
+    else
+      ready->push(dependent);
+  }
+}
+
+}  // anonymous namespace
+
+void ScheduleEstimator::EdgeStarted(const Edge* edge,
+                                    int64_t start_time_millis) {
+  waiting_.erase(edge);
+  running_[edge] = start_time_millis;
+}
+
+int ScheduleEstimator::AddBlockers(const Edge* edge,
+                                   BlockerCounts* blocker_count,
+                                   Dependents* dependents) const {
+  // Set first, so that a cycle of phony edges ends.
+  (*blocker_count)[edge] = 0;
+  vector<const Edge*> blockers;
+  for (const Node* input : edge->inputs_) {
+    const Edge* producer = input->in_edge();
+    if (!producer)
+      continue;
+    if (producer->is_phony()) {
+      BlockerCounts::const_iterator counted = blocker_count->find(producer);
+      int count = counted != blocker_count->end()
+                      ? counted->second
+                      : AddBlockers(producer, blocker_count, dependents);
+      if (count > 0)
+        blockers.push_back(producer);
+    } else if (waiting_.count(producer) || running_.count(producer)) {
+      blockers.push_back(producer);
+    }
+  }
+  sort(blockers.begin(), blockers.end());
+  blockers.erase(unique(blockers.begin(), blockers.end()), blockers.end());
+  for (const Edge* blocker : blockers)
+    (*dependents)[blocker].push_back(edge);
+  (*blocker_count)[edge] = (int)blockers.size();
+  return (int)blockers.size();
+}
+
+int64_t ScheduleEstimator::Predict(int64_t time_millis,
+                                   int64_t default_duration_millis) const {
+  BlockerCounts blocker_count;
+  Dependents dependents;
+  ReadyQueue ready;
+  for (const Edge* edge : waiting_) {
+    if (AddBlockers(edge, &blocker_count, &dependents) == 0)
+      ready.push(edge);
+  }
+
+  // Commands running, the one finishing first on top.  Those that already
+  // took longer than last time are taken to finish now.
+  typedef pair<int64_t, const Edge*> Finish;
+  priority_queue<Finish, vector<Finish>, greater<Finish> > running;
+  unordered_map<const Pool*, int> pool_use;
+  for (unordered_map<const Edge*, int64_t>::const_iterator r =
+           running_.begin();
+       r != running_.end(); ++r) {
+    int64_t end = r->second + Duration(r->first, default_duration_millis);
+    running.push(make_pair(max(end, time_millis), r->first));
+    ++pool_use[r->first->pool()];
+  }
+
+  // Commands ready but held back by their full pool.
+  unordered_map<const Pool*, ReadyQueue> delayed;
+  int64_t now = time_millis;
+  for (;;) {
+    while ((int)running.size() < parallelism_ && !ready.empty()) {
+      const Edge* edge = ready.top();
+      ready.pop();
+      const Pool* pool = edge->pool();
+      if (pool->depth() > 0 && pool_use[pool] >= pool->depth()) {
+        delayed[pool].push(edge);
+        continue;
+      }
+      ++pool_use[pool];
+      running.push(
+          make_pair(now + Duration(edge, default_duration_millis), edge));
+    }
+    if (running.empty())
+      break;
+
+    now = running.top().first;
+    const Edge* edge = running.top().second;
+    running.pop();
+    const Pool* pool = edge->pool();
+    --pool_use[pool];
+    unordered_map<const Pool*, ReadyQueue>::iterator held =
+        delayed.find(pool);
+    if (held != delayed.end() && !held->second.empty()) {
+      ready.push(held->second.top());
+      held->second.pop();
+    }
+    Release(edge, &blocker_count, dependents, &ready);
+  }
+  return now - time_millis;
+}
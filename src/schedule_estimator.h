@@ -0,0 +1,65 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_SCHEDULE_ESTIMATOR_H_
+#define NINJA_SCHEDULE_ESTIMATOR_H_
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "util.h"  // int64_t
+
+struct Edge;
+
+/// Predicts when a running build will be done by simulating the rest of
+/// its schedule: each command still to run starts once the commands it
+/// depends on are done and a -j slot and its pool allow, in the order the
+/// Plan would start them, and takes as long as it did the previous time.
+/// Phony edges are done as soon as what they depend on is.
+/// For the %T placeholder of NINJA_STATUS.
+struct ScheduleEstimator {
+  explicit ScheduleEstimator(int parallelism) : parallelism_(parallelism) {}
+
+  /// Follow the commands of the build, as told to Status.
+  void EdgeAdded(const Edge* edge) { waiting_.insert(edge); }
+  void EdgeRemoved(const Edge* edge) { waiting_.erase(edge); }
+  void EdgeStarted(const Edge* edge, int64_t start_time_millis);
+  void EdgeFinished(const Edge* edge) { running_.erase(edge); }
+
+  /// Predict how long after |time_millis| the build will be done, with
+  /// commands that have no previous duration taking
+  /// |default_duration_millis|.
+  int64_t Predict(int64_t time_millis, int64_t default_duration_millis) const;
+
+ private:
+  typedef std::unordered_map<const Edge*, int> BlockerCounts;
+  typedef std::unordered_map<const Edge*, std::vector<const Edge*> >
+      Dependents;
+
+  /// Count the commands and phony edges that |edge| still waits for in
+  /// |blocker_count|, and add |edge| to their |dependents|.  Phony edges,
+  /// which the Plan doesn't tell about, are counted on the way, once each
+  /// however many edges depend on them.  Returns the count for |edge|.
+  int AddBlockers(const Edge* edge, BlockerCounts* blocker_count,
+                  Dependents* dependents) const;
+
+  int parallelism_;
+  /// Commands not started yet.
+  std::unordered_set<const Edge*> waiting_;
+  /// Commands running, with their start times.
+  std::unordered_map<const Edge*, int64_t> running_;
+};
+
+#endif  // NINJA_SCHEDULE_ESTIMATOR_H_
@@ -0,0 +1,121 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "schedule_estimator.h"
+
+#include "graph.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+struct ScheduleEstimatorTest : public StateTestWithBuiltinRules {
+  Edge* Add(ScheduleEstimator* estimator, const char* output,
+            int64_t duration) {
+    Edge* edge = GetNode(output)->in_edge();
+    edge->prev_elapsed_time_millis = duration;
+    estimator->EdgeAdded(edge);
+    return edge;
+  }
+};
+
+}  // anonymous namespace
+
+TEST_F(ScheduleEstimatorTest, Parallelism) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat in\n"
+"build c: cat in\n");
+
+  ScheduleEstimator one(1);
+  Add(&one, "a", 30);
+  Add(&one, "b", 10);
+  Add(&one, "c", 20);
+  EXPECT_EQ(60, one.Predict(0, 0));
+
+  ScheduleEstimator two(2);
+  Add(&two, "a", 30);
+  Add(&two, "b", 10);
+  Add(&two, "c", 20);
+  EXPECT_EQ(30, two.Predict(0, 0));
+}
+
+TEST_F(ScheduleEstimatorTest, RunningAndDependencies) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat in\n"
+"build ab: phony a b\n"
+"build c: cat ab\n");
+
+  ScheduleEstimator estimator(4);
+  Edge* a = Add(&estimator, "a", 100);
+  Edge* b = Add(&estimator, "b", 10);
+  Add(&estimator, "c", 0);
+  GetNode("c")->in_edge()->prev_elapsed_time_millis = -1;
+  estimator.EdgeStarted(a, 0);
+  estimator.EdgeStarted(b, 0);
+
+  // a ends at 100, then c takes the default 5.
+  EXPECT_EQ(65, estimator.Predict(40, 5));
+
+  // a taking longer than last time makes it end now.
+  EXPECT_EQ(5, estimator.Predict(150, 5));
+
+  estimator.EdgeFinished(a);
+  estimator.EdgeFinished(b);
+  EXPECT_EQ(5, estimator.Predict(150, 5));
+}
+
+TEST_F(ScheduleEstimatorTest, Pool) {
+  AssertParse(&state_,
+"pool link\n"
+"  depth = 1\n"
+"rule link\n"
+"  command = link $out\n"
+"  pool = link\n"
+"build a: link in\n"
+"build b: link in\n"
+"build c: cat in\n");
+
+  ScheduleEstimator estimator(4);
+  Add(&estimator, "a", 10);
+  Add(&estimator, "b", 10);
+  Add(&estimator, "c", 15);
+  EXPECT_EQ(20, estimator.Predict(0, 0));
+}
+
+TEST_F(ScheduleEstimatorTest, SharedPhony) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat in\n"
+"build headers: phony a b\n"
+"build all_headers: phony headers in\n"
+"build c: cat all_headers\n"
+"build d: cat headers all_headers\n");
+
+  ScheduleEstimator estimator(4);
+  Add(&estimator, "a", 10);
+  Add(&estimator, "b", 20);
+  Add(&estimator, "c", 5);
+  Add(&estimator, "d", 7);
+  // c and d wait for both phony edges, which are done with b.
+  EXPECT_EQ(27, estimator.Predict(0, 0));
+
+  estimator.EdgeStarted(GetNode("a")->in_edge(), 0);
+  estimator.EdgeStarted(GetNode("b")->in_edge(), 0);
+  estimator.EdgeFinished(GetNode("a")->in_edge());
+  estimator.EdgeFinished(GetNode("b")->in_edge());
+  EXPECT_EQ(7, estimator.Predict(30, 0));
+}
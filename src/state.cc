@@ -19,6 +19,7 @@
 
 #include "edit_distance.h"
 #include "graph.h"
+#include "metrics.h"
 #include "util.h"
 
 using namespace std;
@@ -84,6 +85,7 @@ Pool* State::LookupPool(const string& pool_name) {
 }
 
 Edge* State::AddEdge(const Rule* rule) {
+  METRIC_COUNT("edge alloc", 1);
   Edge* edge = new Edge();
   edge->rule_ = rule;
   edge->pool_ = &State::kDefaultPool;
@@ -97,12 +99,14 @@ Node* State::GetNode(StringPiece path, uint64_t slash_bits) {
   Node* node = LookupNode(path);
   if (node)
     return node;
+  METRIC_COUNT("node alloc", 1);
   node = new Node(path.AsString(), slash_bits);
   paths_[node->path()] = node;
   return node;
 }
 
 Node* State::LookupNode(StringPiece path) const {
+  METRIC_COUNT("node lookup", 1);
   Paths::const_iterator i = paths_.find(path);
   if (i != paths_.end())
     return i->second;
@@ -47,6 +47,10 @@ struct Pool {
   const std::string& name() const { return name_; }
   int current_use() const { return current_use_; }
 
+  /// Change the depth, e.g. to try another one in a simulated build.  Only
+  /// valid while no edges are scheduled.
+  void set_depth(int depth) { depth_ = depth; }
+
   /// true if the Pool might delay this edge
   bool ShouldDelayEdge() const { return depth_ != 0; }
 
@@ -17,6 +17,8 @@
 
 #include <string>
 
+#include "resource_usage.h"
+
 struct BuildConfig;
 struct Edge;
 struct Explanations;
@@ -29,11 +31,19 @@ struct Status {
   virtual void BuildEdgeStarted(const Edge* edge,
                                 int64_t start_time_millis) = 0;
   virtual void BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
-                                 int64_t end_time_millis, bool success,
+                                 int64_t end_time_millis,
+                                 const ResourceUsage& usage, bool success,
                                  const std::string& output) = 0;
   virtual void BuildStarted() = 0;
   virtual void BuildFinished() = 0;
 
+  /// Milliseconds from |time_millis| after which Refresh() is due even if
+  /// nothing else happens by then, or -1 if it isn't.
+  virtual int64_t RefreshTimeoutMillis(int64_t time_millis) { return -1; }
+  /// Catch up at |time_millis| with what was left for later, such as a
+  /// status line whose redraw was throttled.
+  virtual void Refresh(int64_t time_millis) {}
+
   /// Set the Explanations instance to use to report explanations,
   /// argument can be nullptr if no explanations need to be printed
   /// (which is the default).
@@ -26,6 +26,8 @@
 #include <stdarg.h>
 #include <stdlib.h>
 
+#include <algorithm>
+
 #ifdef _WIN32
 #include <fcntl.h>
 #include <io.h>
@@ -36,14 +38,16 @@
 
 using namespace std;
 
+const int64_t StatusPrinter::kSchedulePredictionIntervalMillis = 1000;
+
 Status* Status::factory(const BuildConfig& config) {
   return new StatusPrinter(config);
 }
 
 StatusPrinter::StatusPrinter(const BuildConfig& config)
     : config_(config), started_edges_(0), finished_edges_(0), total_edges_(0),
-      running_edges_(0), progress_status_format_(NULL),
-      current_rate_(config.parallelism) {
+      running_edges_(0), schedule_estimator_(config.parallelism),
+      progress_status_format_(NULL), current_rate_(config.parallelism) {
   // Don't do anything fancy in verbose mode.
   if (config_.verbosity != BuildConfig::NORMAL)
     printer_.set_smart_terminal(false);
@@ -51,10 +55,25 @@ StatusPrinter::StatusPrinter(const BuildConfig& config)
   progress_status_format_ = getenv("NINJA_STATUS");
   if (!progress_status_format_)
     progress_status_format_ = "[%f/%t] ";
+  for (const char* s = progress_status_format_; *s; ++s) {
+    if (*s == '%' && *++s == 'T')
+      predict_schedule_ = true;
+    if (!*s)
+      break;
+  }
+
+  if (const char* refresh = getenv("NINJA_STATUS_REFRESH_MILLIS")) {
+    char* end;
+    long long value = strtoll(refresh, &end, 10);
+    if (*end == 0 && value > 0)
+      refresh_interval_millis_ = value;
+  }
 }
 
 void StatusPrinter::EdgeAddedToPlan(const Edge* edge) {
   ++total_edges_;
+  if (predict_schedule_)
+    schedule_estimator_.EdgeAdded(edge);
 
   // Do we know how long did this edge take last time?
   if (edge->prev_elapsed_time_millis != -1) {
@@ -69,6 +88,8 @@ void StatusPrinter::EdgeAddedToPlan(const Edge* edge) {
 
 void StatusPrinter::EdgeRemovedFromPlan(const Edge* edge) {
   --total_edges_;
+  if (predict_schedule_)
+    schedule_estimator_.EdgeRemoved(edge);
 
   // Do we know how long did this edge take last time?
   if (edge->prev_elapsed_time_millis != -1) {
@@ -86,9 +107,11 @@ void StatusPrinter::BuildEdgeStarted(const Edge* edge,
   ++started_edges_;
   ++running_edges_;
   time_millis_ = start_time_millis;
+  if (predict_schedule_)
+    schedule_estimator_.EdgeStarted(edge, start_time_millis);
 
   if (edge->use_console() || printer_.is_smart_terminal())
-    PrintStatus(edge, start_time_millis);
+    PrintStatus(edge, start_time_millis, edge->use_console());
 
   if (edge->use_console())
     printer_.SetConsoleLocked(true);
@@ -173,14 +196,39 @@ void StatusPrinter::RecalculateProgressPrediction() {
   time_predicted_percentage_ = cpu_time_millis_ / total_cpu_time_millis;
 }
 
+void StatusPrinter::UpdateSchedulePrediction(int64_t time_millis) {
+  if (schedule_remaining_millis_ != -1 &&
+      time_millis - schedule_prediction_millis_ <
+          kSchedulePredictionIntervalMillis)
+    return;
+
+  // Commands without a previous duration take the average of those run
+  // so far, or else of the previous durations.
+  int64_t default_duration_millis;
+  if (finished_edges_)
+    default_duration_millis = cpu_time_millis_ / finished_edges_;
+  else if (eta_predictable_edges_total_)
+    default_duration_millis =
+        eta_predictable_cpu_time_total_millis_ / eta_predictable_edges_total_;
+  else
+    return;
+
+  schedule_remaining_millis_ =
+      schedule_estimator_.Predict(time_millis, default_duration_millis);
+  schedule_prediction_millis_ = time_millis;
+}
+
 void StatusPrinter::BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
-                                      int64_t end_time_millis, bool success,
+                                      int64_t end_time_millis,
+                                      const ResourceUsage& usage, bool success,
                                       const string& output) {
   time_millis_ = end_time_millis;
   ++finished_edges_;
 
   int64_t elapsed = end_time_millis - start_time_millis;
   cpu_time_millis_ += elapsed;
+  if (predict_schedule_)
+    schedule_estimator_.EdgeFinished(edge);
 
   // Do we know how long did this edge take last time?
   if (edge->prev_elapsed_time_millis != -1) {
@@ -196,8 +244,10 @@ void StatusPrinter::BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
   if (config_.verbosity == BuildConfig::QUIET)
     return;
 
+  // Output and failures are printed right away, after the status of their
+  // edge.
   if (!edge->use_console())
-    PrintStatus(edge, end_time_millis);
+    PrintStatus(edge, end_time_millis, !success || !output.empty());
 
   --running_edges_;
 
@@ -228,11 +278,12 @@ void StatusPrinter::BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
     // (Launching subprocesses in pseudo ttys doesn't work because there are
     // only a few hundred available on some systems, and ninja can launch
     // thousands of parallel compile commands.)
-    string final_output;
-    if (!printer_.supports_color())
-      final_output = StripAnsiEscapeCodes(output);
-    else
-      final_output = output;
+    const string* final_output = &output;
+    string stripped_output;
+    if (!printer_.supports_color()) {
+      stripped_output = StripAnsiEscapeCodes(output);
+      final_output = &stripped_output;
+    }
 
 #ifdef _WIN32
     // Fix extra CR being added on Windows, writing out CR CR LF (#773)
@@ -240,7 +291,7 @@ void StatusPrinter::BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
     _setmode(_fileno(stdout), _O_BINARY);
 #endif
 
-    printer_.PrintOnNewLine(final_output);
+    printer_.PrintOnNewLine(*final_output);
 
 #ifdef _WIN32
     fflush(stdout);
@@ -253,13 +304,38 @@ void StatusPrinter::BuildStarted() {
   started_edges_ = 0;
   finished_edges_ = 0;
   running_edges_ = 0;
+  last_status_millis_ = -1;
+  pending_status_edge_ = nullptr;
 }
 
 void StatusPrinter::BuildFinished() {
+  // Show the final state of the build.
+  if (pending_status_edge_) {
+    DrawStatusLine(pending_status_edge_, pending_status_millis_);
+    pending_status_edge_ = nullptr;
+  }
   printer_.SetConsoleLocked(false);
   printer_.PrintOnNewLine("");
 }
 
+int64_t StatusPrinter::RefreshTimeoutMillis(int64_t time_millis) {
+  if (!pending_status_edge_)
+    return -1;
+  return max<int64_t>(
+      last_status_millis_ + refresh_interval_millis_ - time_millis, 0);
+}
+
+void StatusPrinter::Refresh(int64_t time_millis) {
+  // Otherwise a burst of edges followed by a long command would leave the
+  // line showing the end of the burst for the whole command.
+  if (!pending_status_edge_ ||
+      time_millis - last_status_millis_ < refresh_interval_millis_)
+    return;
+  last_status_millis_ = time_millis;
+  DrawStatusLine(pending_status_edge_, time_millis);
+  pending_status_edge_ = nullptr;
+}
+
 string StatusPrinter::FormatProgressStatus(const char* progress_status_format,
                                            int64_t time_millis) const {
   string out;
@@ -384,6 +460,25 @@ string StatusPrinter::FormatProgressStatus(const char* progress_status_format,
         break;
       }
 
+        // Remaining time from the simulated schedule, human-readable.
+      case 'T': {
+        int64_t sec = -1;  // To be printed as "?".
+        if (schedule_remaining_millis_ != -1) {
+          // Count down between predictions.
+          sec = max(schedule_remaining_millis_ -
+                        (time_millis_ - schedule_prediction_millis_),
+                    (int64_t)0) / 1000;
+        }
+        if (sec < 0)
+          snprintf(buf, sizeof(buf), "?");
+        else if (sec >= 60 * 60)
+          snprintf(buf, sizeof(buf), FORMAT_TIME_HMMSS(sec));
+        else
+          snprintf(buf, sizeof(buf), FORMAT_TIME_MMSS(sec));
+        out += buf;
+        break;
+      }
+
       // Percentage of time spent out of the predicted time total
       case 'P': {
         snprintf(buf, sizeof(buf), "%3i%%",
@@ -404,7 +499,8 @@ string StatusPrinter::FormatProgressStatus(const char* progress_status_format,
   return out;
 }
 
-void StatusPrinter::PrintStatus(const Edge* edge, int64_t time_millis) {
+void StatusPrinter::PrintStatus(const Edge* edge, int64_t time_millis,
+                                bool force) {
   if (explanations_) {
     // Collect all explanations for the current edge's outputs.
     std::vector<std::string> explanations;
@@ -425,7 +521,27 @@ void StatusPrinter::PrintStatus(const Edge* edge, int64_t time_millis) {
       || config_.verbosity == BuildConfig::NO_STATUS_UPDATE)
     return;
 
+  // When thousands of edges a second finish, drawing each of their status
+  // lines slows the build down, and nobody can read them anyway.  Only a
+  // smart terminal overwrites the line, so elsewhere every line is kept.
+  if (refresh_interval_millis_ > 0 && printer_.is_smart_terminal()) {
+    if (!force && last_status_millis_ >= 0 &&
+        time_millis - last_status_millis_ < refresh_interval_millis_) {
+      pending_status_edge_ = edge;
+      pending_status_millis_ = time_millis;
+      return;
+    }
+    last_status_millis_ = time_millis;
+    pending_status_edge_ = nullptr;
+  }
+
+  DrawStatusLine(edge, time_millis);
+}
+
+void StatusPrinter::DrawStatusLine(const Edge* edge, int64_t time_millis) {
   RecalculateProgressPrediction();
+  if (predict_schedule_)
+    UpdateSchedulePrediction(time_millis);
 
   bool force_full_command = config_.verbosity == BuildConfig::VERBOSE;
 
@@ -18,6 +18,7 @@
 
 #include "explanations.h"
 #include "line_printer.h"
+#include "schedule_estimator.h"
 #include "status.h"
 
 /// Implementation of the Status interface that prints the status as
@@ -31,11 +32,17 @@ struct StatusPrinter : Status {
 
   virtual void BuildEdgeStarted(const Edge* edge, int64_t start_time_millis);
   virtual void BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
-                                 int64_t end_time_millis, bool success,
+                                 int64_t end_time_millis,
+                                 const ResourceUsage& usage, bool success,
                                  const std::string& output);
   virtual void BuildStarted();
   virtual void BuildFinished();
 
+  /// Time until the status line left for later is due, if any.
+  virtual int64_t RefreshTimeoutMillis(int64_t time_millis);
+  /// Draw the status line left for later once it is due.
+  virtual void Refresh(int64_t time_millis);
+
   virtual void Info(const char* msg, ...);
   virtual void Warning(const char* msg, ...);
   virtual void Error(const char* msg, ...);
@@ -56,7 +63,13 @@ struct StatusPrinter : Status {
   }
 
  private:
-  void PrintStatus(const Edge* edge, int64_t time_millis);
+  /// Print the status line for |edge|.  On a smart terminal, redraws less
+  /// than |refresh_interval_millis_| apart are left for later, unless
+  /// |force| is set.
+  void PrintStatus(const Edge* edge, int64_t time_millis, bool force);
+
+  /// Draw the status line for |edge|.
+  void DrawStatusLine(const Edge* edge, int64_t time_millis);
 
   const BuildConfig& config_;
 
@@ -86,6 +99,19 @@ struct StatusPrinter : Status {
 
   void RecalculateProgressPrediction();
 
+  /// Whether the status format has the %T placeholder.
+  bool predict_schedule_ = false;
+  /// Follows the build for %T.
+  ScheduleEstimator schedule_estimator_;
+  /// How long the rest of the build was predicted to take, or -1, and
+  /// when.  Simulating the rest of the build takes time, so the prediction
+  /// is only redone every kSchedulePredictionIntervalMillis.
+  int64_t schedule_remaining_millis_ = -1;
+  int64_t schedule_prediction_millis_ = 0;
+  static const int64_t kSchedulePredictionIntervalMillis;
+
+  void UpdateSchedulePrediction(int64_t time_millis);
+
   /// Prints progress output.
   LinePrinter printer_;
 
@@ -95,6 +121,15 @@ struct StatusPrinter : Status {
   /// The custom progress status format to use.
   const char* progress_status_format_;
 
+  /// Minimum time between two redraws of the status line, from
+  /// NINJA_STATUS_REFRESH_MILLIS; 0 redraws it for every edge.
+  int64_t refresh_interval_millis_ = 0;
+  /// When the status line was last drawn, or -1.
+  int64_t last_status_millis_ = -1;
+  /// The edge whose status was left for later, if any, and the time then.
+  const Edge* pending_status_edge_ = nullptr;
+  int64_t pending_status_millis_ = 0;
+
   template <size_t S>
   void SnprintfRate(double rate, char (&buf)[S], const char* format) const {
     if (rate == -1)
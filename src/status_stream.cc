@@ -0,0 +1,284 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "status_stream.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "graph.h"
+#include "json.h"
+#include "metrics.h"
+#include "version.h"
+
+using namespace std;
+
+const int StatusStream::kVersion = 1;
+const size_t StatusStream::kMaxBufferSize = 1 << 20;
+const int StatusStream::kDrainTimeoutMillis = 5000;
+const int StatusStream::kFlushIntervalMillis = 100;
+const size_t StatusStream::kMaxOutputSize = 64 << 10;
+
+namespace {
+
+string FormatMessage(const char* msg, va_list ap) {
+  char buf[4096];
+  vsnprintf(buf, sizeof(buf), msg, ap);
+  return buf;
+}
+
+string Quote(const string& s) {
+  return "\"" + EncodeJSONString(s) + "\"";
+}
+
+string Outputs(const Edge* edge) {
+  string outputs = "[";
+  for (vector<Node*>::const_iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o) {
+    if (o != edge->outputs_.begin())
+      outputs += ",";
+    outputs += Quote((*o)->path());
+  }
+  return outputs + "]";
+}
+
+}  // anonymous namespace
+
+StatusStream* StatusStream::Create(Status* status, const string& path,
+                                   string* err) {
+#ifdef _WIN32
+  *err = "not supported on Windows";
+  return NULL;
+#else
+  // O_NONBLOCK makes opening a FIFO without a reader fail with ENXIO
+  // rather than wait, and writes return EAGAIN rather than wait.
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK,
+                0666);
+  if (fd < 0) {
+    *err = path + ": " +
+           (errno == ENXIO ? "FIFO has no reader" : strerror(errno));
+    return NULL;
+  }
+  SetCloseOnExec(fd);
+  return new StatusStream(status, fd);
+#endif
+}
+
+StatusStream::StatusStream(Status* status, int fd)
+    : status_(status), fd_(fd), dropped_(0) {
+  Send("\"type\":\"start\",\"version\":" + to_string(kVersion) +
+       ",\"ninja\":" + Quote(kNinjaVersion));
+}
+
+StatusStream::~StatusStream() {
+#ifndef _WIN32
+  int64_t deadline = GetTimeMillis() + kDrainTimeoutMillis;
+  while (fd_ >= 0 && !buffer_.empty()) {
+    int64_t timeout = deadline - GetTimeMillis();
+    if (timeout <= 0)
+      break;
+    pollfd pfd = { fd_, POLLOUT, 0 };
+    if (poll(&pfd, 1, (int)timeout) < 0 && errno != EINTR)
+      break;
+    Flush();
+  }
+  if (fd_ >= 0)
+    close(fd_);
+#endif
+}
+
+void StatusStream::Send(const string& event) {
+  Flush();
+  if (fd_ < 0)
+    return;
+  // Keep room for the event telling about the dropped ones.
+  const size_t kReserved = 64;
+  if (buffer_.size() + event.size() + 3 > kMaxBufferSize - kReserved) {
+    ++dropped_;
+    return;
+  }
+  if (dropped_ > 0) {
+    buffer_ += "{\"type\":\"dropped\",\"count\":" + to_string(dropped_) +
+               "}\n";
+    dropped_ = 0;
+  }
+  buffer_ += "{" + event + "}\n";
+  Flush();
+}
+
+void StatusStream::Flush() {
+#ifndef _WIN32
+  if (fd_ < 0 || buffer_.empty())
+    return;
+
+  // A reader that went away must stop the stream rather than kill ninja:
+  // block SIGPIPE, and take it if the write raised it.
+  sigset_t pipe_set, old_set;
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+  size_t written = 0;
+  int error = 0;
+  while (written < buffer_.size()) {
+    ssize_t ret = write(fd_, buffer_.data() + written,
+                        buffer_.size() - written);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        error = errno;
+      break;
+    }
+    written += ret;
+  }
+  sigset_t pending;
+  sigpending(&pending);
+  if (sigismember(&pending, SIGPIPE) && !sigismember(&old_set, SIGPIPE)) {
+    int sig;
+    sigwait(&pipe_set, &sig);
+  }
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+  buffer_.erase(0, written);
+  if (error) {
+    close(fd_);
+    fd_ = -1;
+    buffer_.clear();
+    status_->Warning("event stream: %s; no longer writing events",
+                     strerror(error));
+  }
+#endif
+}
+
+void StatusStream::EdgeAddedToPlan(const Edge* edge) {
+  status_->EdgeAddedToPlan(edge);
+  Send("\"type\":\"edge_added\",\"id\":" + to_string(edge->id_) +
+       ",\"rule\":" + Quote(edge->rule().name()) +
+       ",\"outputs\":" + Outputs(edge));
+}
+
+void StatusStream::EdgeRemovedFromPlan(const Edge* edge) {
+  status_->EdgeRemovedFromPlan(edge);
+  Send("\"type\":\"edge_removed\",\"id\":" + to_string(edge->id_));
+}
+
+void StatusStream::BuildEdgeStarted(const Edge* edge,
+                                    int64_t start_time_millis) {
+  status_->BuildEdgeStarted(edge, start_time_millis);
+  Send("\"type\":\"edge_started\",\"id\":" + to_string(edge->id_) +
+       ",\"start_ms\":" + to_string(start_time_millis) +
+       ",\"description\":" + Quote(edge->GetBinding("description")) +
+       ",\"command\":" + Quote(edge->EvaluateCommand()));
+}
+
+void StatusStream::BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
+                                     int64_t end_time_millis,
+                                     const ResourceUsage& usage, bool success,
+                                     const string& output) {
+  status_->BuildEdgeFinished(edge, start_time_millis, end_time_millis, usage,
+                             success, output);
+  string event = "\"type\":\"edge_finished\",\"id\":" + to_string(edge->id_) +
+                 ",\"start_ms\":" + to_string(start_time_millis) +
+                 ",\"end_ms\":" + to_string(end_time_millis) +
+                 ",\"duration_ms\":" +
+                 to_string(end_time_millis - start_time_millis) +
+                 ",\"success\":" + (success ? "true" : "false") +
+                 ",\"outputs\":" + Outputs(edge);
+  if (!usage.empty()) {
+    event += ",\"user_ms\":" + to_string(usage.user_time_millis) +
+             ",\"system_ms\":" + to_string(usage.system_time_millis) +
+             ",\"max_rss_kb\":" + to_string(usage.max_rss_kb);
+  }
+  if (output.size() > kMaxOutputSize) {
+    // Cut at the start of a UTF-8 sequence, so that the event stays
+    // readable and still fits in the buffer.
+    size_t size = kMaxOutputSize;
+    while (size > 0 && (output[size] & 0xC0) == 0x80)
+      --size;
+    event += ",\"output\":" + Quote(output.substr(0, size)) +
+             ",\"truncated\":true";
+  } else if (!output.empty()) {
+    event += ",\"output\":" + Quote(output);
+  }
+  Send(event);
+}
+
+void StatusStream::BuildStarted() {
+  status_->BuildStarted();
+  Send("\"type\":\"build_started\"");
+}
+
+void StatusStream::BuildFinished() {
+  status_->BuildFinished();
+  Send("\"type\":\"build_finished\"");
+}
+
+int64_t StatusStream::RefreshTimeoutMillis(int64_t time_millis) {
+  int64_t timeout = status_->RefreshTimeoutMillis(time_millis);
+  // Otherwise the events waiting would only go out with the next one.
+  if (fd_ >= 0 && !buffer_.empty() &&
+      (timeout < 0 || timeout > kFlushIntervalMillis))
+    timeout = kFlushIntervalMillis;
+  return timeout;
+}
+
+void StatusStream::Refresh(int64_t time_millis) {
+  status_->Refresh(time_millis);
+  Flush();
+}
+
+void StatusStream::SetExplanations(Explanations* explanations) {
+  status_->SetExplanations(explanations);
+}
+
+void StatusStream::SendMessage(const char* level, const string& message) {
+  Send(string("\"type\":\"message\",\"level\":\"") + level +
+       "\",\"message\":" + Quote(message));
+}
+
+void StatusStream::Info(const char* msg, ...) {
+  va_list ap;
+  va_start(ap, msg);
+  string message = FormatMessage(msg, ap);
+  va_end(ap);
+  status_->Info("%s", message.c_str());
+  SendMessage("info", message);
+}
+
+void StatusStream::Warning(const char* msg, ...) {
+  va_list ap;
+  va_start(ap, msg);
+  string message = FormatMessage(msg, ap);
+  va_end(ap);
+  status_->Warning("%s", message.c_str());
+  SendMessage("warning", message);
+}
+
+void StatusStream::Error(const char* msg, ...) {
+  va_list ap;
+  va_start(ap, msg);
+  string message = FormatMessage(msg, ap);
+  va_end(ap);
+  status_->Error("%s", message.c_str());
+  SendMessage("error", message);
+}
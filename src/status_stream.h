@@ -0,0 +1,88 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_STATUS_STREAM_H_
+#define NINJA_STATUS_STREAM_H_
+
+#include <memory>
+#include <string>
+
+#include "status.h"
+
+/// Implementation of the Status interface that writes the events of the
+/// build, one JSON object a line, to a file or FIFO for other programs to
+/// follow, and passes every call on to another Status.
+///
+/// Writes never block the build: events wait in a buffer until the reader
+/// takes them, and when the buffer is full, new events are dropped and
+/// counted in a "dropped" event.  The buffer is also written out every
+/// kFlushIntervalMillis while the build waits for commands.
+struct StatusStream : public Status {
+  /// Version of the format, in the first event.
+  static const int kVersion;
+  /// Size of the buffer of events the reader hasn't taken yet.
+  static const size_t kMaxBufferSize;
+  /// How long to wait at the end for the reader to take the last events.
+  static const int kDrainTimeoutMillis;
+  /// How often to retry writing the buffer while events wait in it.
+  static const int kFlushIntervalMillis;
+  /// Longest command output in an event; longer output is truncated.
+  static const size_t kMaxOutputSize;
+
+  /// Start writing events to |path|, which can be a FIFO, in which case it
+  /// must have a reader already.  Returns NULL and fills in |err| on error.
+  /// Takes ownership of |status| on success.
+  static StatusStream* Create(Status* status, const std::string& path,
+                              std::string* err);
+  /// Writes the events left, waiting up to kDrainTimeoutMillis.
+  virtual ~StatusStream();
+
+  // Status
+  virtual void EdgeAddedToPlan(const Edge* edge);
+  virtual void EdgeRemovedFromPlan(const Edge* edge);
+  virtual void BuildEdgeStarted(const Edge* edge, int64_t start_time_millis);
+  virtual void BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
+                                 int64_t end_time_millis,
+                                 const ResourceUsage& usage, bool success,
+                                 const std::string& output);
+  virtual void BuildStarted();
+  virtual void BuildFinished();
+  virtual int64_t RefreshTimeoutMillis(int64_t time_millis);
+  virtual void Refresh(int64_t time_millis);
+  virtual void SetExplanations(Explanations* explanations);
+  virtual void Info(const char* msg, ...);
+  virtual void Warning(const char* msg, ...);
+  virtual void Error(const char* msg, ...);
+
+ private:
+  StatusStream(Status* status, int fd);
+
+  /// Queue an event, given as JSON without its braces, and write what the
+  /// reader can take.
+  void Send(const std::string& event);
+
+  /// Write as much of |buffer_| as can be written without blocking.
+  void Flush();
+
+  void SendMessage(const char* level, const std::string& message);
+
+  std::unique_ptr<Status> status_;
+  /// -1 once the reader went away.
+  int fd_;
+  std::string buffer_;
+  /// Number of events dropped since the last one sent.
+  size_t dropped_;
+};
+
+#endif  // NINJA_STATUS_STREAM_H_
@@ -0,0 +1,223 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "status_stream.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <thread>
+
+#include "graph.h"
+#include "test.h"
+
+using namespace std;
+
+#ifndef _WIN32
+
+namespace {
+
+/// A Status that keeps the warnings it gets.
+struct RecordingStatus : public Status {
+  explicit RecordingStatus(vector<string>* warnings) : warnings_(warnings) {}
+  virtual void EdgeAddedToPlan(const Edge* edge) {}
+  virtual void EdgeRemovedFromPlan(const Edge* edge) {}
+  virtual void BuildEdgeStarted(const Edge* edge, int64_t start_time_millis) {}
+  virtual void BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
+                                 int64_t end_time_millis,
+                                 const ResourceUsage& usage, bool success,
+                                 const string& output) {}
+  virtual void BuildStarted() {}
+  virtual void BuildFinished() {}
+  virtual void SetExplanations(Explanations* explanations) {}
+  virtual void Info(const char* msg, ...) {}
+  virtual void Warning(const char* msg, ...) { warnings_->push_back(msg); }
+  virtual void Error(const char* msg, ...) {}
+
+  vector<string>* warnings_;
+};
+
+struct StatusStreamTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    // These tests do real disk accesses, so create a temp dir.
+    temp_dir_.CreateAndEnter("Ninja-StatusStreamTest");
+    AssertParse(&state_,
+"build out: cat in\n"
+"  description = CAT it\n");
+    edge_ = GetNode("out")->in_edge();
+  }
+
+  virtual void TearDown() { temp_dir_.Cleanup(); }
+
+  StatusStream* Create(const string& path) {
+    string err;
+    StatusStream* stream =
+        StatusStream::Create(new RecordingStatus(&warnings_), path, &err);
+    EXPECT_TRUE(stream) << err;
+    return stream;
+  }
+
+  /// Read |fd| until the writer closes it.
+  static void ReadAll(int fd, string* contents) {
+    char buf[4096];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) != 0) {
+      if (len > 0)
+        contents->append(buf, len);
+      else if (errno != EINTR && errno != EAGAIN)
+        break;
+    }
+  }
+
+  ScopedTempDir temp_dir_;
+  Edge* edge_;
+  vector<string> warnings_;
+};
+
+}  // anonymous namespace
+
+TEST_F(StatusStreamTest, Events) {
+  StatusStream* stream = Create("events.json");
+  stream->BuildStarted();
+  stream->EdgeAddedToPlan(edge_);
+  stream->BuildEdgeStarted(edge_, 10);
+  stream->BuildEdgeFinished(edge_, 10, 25, ResourceUsage(), false, "oops\n");
+  stream->Warning("careful with %s", "that");
+  stream->BuildFinished();
+  delete stream;
+
+  string contents, err;
+  RealDiskInterface disk;
+  ASSERT_EQ(DiskInterface::Okay,
+            disk.ReadFile("events.json", &contents, &err));
+  vector<string> lines;
+  for (size_t start = 0, end; (end = contents.find('\n', start)) !=
+       string::npos; start = end + 1)
+    lines.push_back(contents.substr(start, end - start));
+
+  ASSERT_EQ(7u, lines.size());
+  EXPECT_EQ(0u, lines[0].find("{\"type\":\"start\",\"version\":1,"));
+  EXPECT_EQ("{\"type\":\"build_started\"}", lines[1]);
+  EXPECT_EQ("{\"type\":\"edge_added\",\"id\":0,\"rule\":\"cat\","
+            "\"outputs\":[\"out\"]}", lines[2]);
+  EXPECT_EQ("{\"type\":\"edge_started\",\"id\":0,\"start_ms\":10,"
+            "\"description\":\"CAT it\",\"command\":\"cat in > out\"}",
+            lines[3]);
+  EXPECT_EQ("{\"type\":\"edge_finished\",\"id\":0,\"start_ms\":10,"
+            "\"end_ms\":25,\"duration_ms\":15,\"success\":false,"
+            "\"outputs\":[\"out\"],\"output\":\"oops\\n\"}", lines[4]);
+  EXPECT_EQ("{\"type\":\"message\",\"level\":\"warning\","
+            "\"message\":\"careful with that\"}", lines[5]);
+  EXPECT_EQ("{\"type\":\"build_finished\"}", lines[6]);
+}
+
+TEST_F(StatusStreamTest, TruncatesLongOutput) {
+  StatusStream* stream = Create("events.json");
+  stream->BuildEdgeFinished(edge_, 0, 1, ResourceUsage(), true,
+                            string(2 << 20, 'x'));
+  delete stream;
+
+  string contents, err;
+  RealDiskInterface disk;
+  ASSERT_EQ(DiskInterface::Okay,
+            disk.ReadFile("events.json", &contents, &err));
+  EXPECT_EQ(string::npos, contents.find("\"type\":\"dropped\""));
+  EXPECT_NE(string::npos,
+            contents.find("\"output\":\"" +
+                          string(StatusStream::kMaxOutputSize, 'x') +
+                          "\",\"truncated\":true}\n"));
+}
+
+TEST_F(StatusStreamTest, FifoWithoutReader) {
+  ASSERT_EQ(0, mkfifo("fifo", 0600));
+  string err;
+  RecordingStatus* status = new RecordingStatus(&warnings_);
+  EXPECT_FALSE(StatusStream::Create(status, "fifo", &err));
+  EXPECT_EQ("fifo: FIFO has no reader", err);
+  delete status;
+}
+
+TEST_F(StatusStreamTest, SlowReaderDropsEvents) {
+  ASSERT_EQ(0, mkfifo("fifo", 0600));
+  int fd = open("fifo", O_RDONLY | O_NONBLOCK);
+  ASSERT_GE(fd, 0);
+  StatusStream* stream = Create("fifo");
+
+  // Nobody reads yet: this must neither block nor grow without bound.
+  string output(10000, 'x');
+  for (int i = 0; i < 200; ++i)
+    stream->BuildEdgeFinished(edge_, 0, 1, ResourceUsage(), true, output);
+  stream->BuildFinished();
+
+  string contents;
+  thread reader(ReadAll, fd, &contents);
+  delete stream;
+  reader.join();
+  close(fd);
+
+  EXPECT_LT(contents.size(), StatusStream::kMaxBufferSize + 100000);
+  EXPECT_NE(string::npos, contents.find("{\"type\":\"dropped\",\"count\":"));
+  EXPECT_NE(string::npos, contents.find("{\"type\":\"build_finished\"}\n"));
+  EXPECT_TRUE(warnings_.empty());
+}
+
+TEST_F(StatusStreamTest, RefreshFlushes) {
+  ASSERT_EQ(0, mkfifo("fifo", 0600));
+  int fd = open("fifo", O_RDONLY | O_NONBLOCK);
+  ASSERT_GE(fd, 0);
+  StatusStream* stream = Create("fifo");
+  EXPECT_EQ(-1, stream->RefreshTimeoutMillis(0));
+
+  // More than the FIFO holds, so some of it waits in the buffer.
+  string output(10000, 'x');
+  for (int i = 0; i < 20; ++i)
+    stream->BuildEdgeFinished(edge_, 0, 1, ResourceUsage(), true, output);
+  stream->BuildFinished();
+  EXPECT_EQ(StatusStream::kFlushIntervalMillis,
+            stream->RefreshTimeoutMillis(0));
+
+  // Without further events, refreshing writes out the rest.
+  string contents;
+  char buf[4096];
+  while (contents.find("{\"type\":\"build_finished\"}\n") ==
+         string::npos) {
+    ssize_t len = read(fd, buf, sizeof(buf));
+    if (len > 0)
+      contents.append(buf, len);
+    else
+      stream->Refresh(0);
+  }
+  EXPECT_EQ(-1, stream->RefreshTimeoutMillis(0));
+  delete stream;
+  close(fd);
+}
+
+TEST_F(StatusStreamTest, ReaderGoesAway) {
+  ASSERT_EQ(0, mkfifo("fifo", 0600));
+  int fd = open("fifo", O_RDONLY | O_NONBLOCK);
+  ASSERT_GE(fd, 0);
+  StatusStream* stream = Create("fifo");
+  close(fd);
+
+  stream->BuildStarted();
+  stream->BuildFinished();
+  ASSERT_EQ(1u, warnings_.size());
+  EXPECT_EQ("event stream: %s; no longer writing events", warnings_[0]);
+  delete stream;
+}
+
+#endif  // _WIN32
@@ -0,0 +1,218 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "status_tracer.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "graph.h"
+#include "json.h"
+
+using namespace std;
+
+const int64_t StatusTracer::kMinMetricMicros = 100;
+
+namespace {
+
+// Events of ninja itself go in process 1, and those of edges in process 2.
+const int kNinjaPid = 1;
+const int kEdgesPid = 2;
+
+string FormatMessage(const char* msg, va_list ap) {
+  char buf[4096];
+  vsnprintf(buf, sizeof(buf), msg, ap);
+  return buf;
+}
+
+string MetadataEvent(const char* kind, int pid, int tid, const string& name) {
+  return string("\"name\":\"") + kind + "\",\"ph\":\"M\",\"pid\":" +
+         to_string(pid) + ",\"tid\":" + to_string(tid) +
+         ",\"args\":{\"name\":\"" + EncodeJSONString(name) + "\"}";
+}
+
+}  // anonymous namespace
+
+StatusTracer* StatusTracer::Create(Status* status, const string& path,
+                                   string* err) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (!file) {
+    *err = path + ": " + strerror(errno);
+    return NULL;
+  }
+  return new StatusTracer(status, file);
+}
+
+StatusTracer::StatusTracer(Status* status, FILE* file)
+    : status_(status), start_micros_(GetTimeMicros()), file_(file),
+      events_written_(0) {
+  lock_guard<mutex> lock(mutex_);
+  threads_[this_thread::get_id()] = 0;
+  fputs("[\n", file_);
+  WriteEvent(MetadataEvent("process_name", kNinjaPid, 0, "ninja"));
+  WriteEvent(MetadataEvent("thread_name", kNinjaPid, 0, "main"));
+  WriteEvent(MetadataEvent("process_name", kEdgesPid, 0, "edges"));
+  g_metrics->set_observer(this);
+}
+
+StatusTracer::~StatusTracer() {
+  if (g_metrics->observer() == this)
+    g_metrics->set_observer(NULL);
+  lock_guard<mutex> lock(mutex_);
+  // The closing bracket is optional in the format, so a trace cut short
+  // still loads.
+  fputs("\n]\n", file_);
+  fclose(file_);
+}
+
+void StatusTracer::WriteEvent(const string& event) {
+  // Each event but the first starts with the comma that separates it from
+  // the previous one.
+  if (events_written_ > 0)
+    fputs(",\n", file_);
+  ++events_written_;
+  fputs("{", file_);
+  fputs(event.c_str(), file_);
+  fputs("}", file_);
+}
+
+void StatusTracer::WriteCompleteEvent(const string& name, const char* category,
+                                      int pid, int tid, int64_t start_micros,
+                                      int64_t end_micros, const string& args) {
+  string event = "\"name\":\"" + EncodeJSONString(name) + "\",\"cat\":\"" +
+                 category + "\",\"ph\":\"X\",\"ts\":" +
+                 to_string(start_micros - start_micros_) + ",\"dur\":" +
+                 to_string(end_micros - start_micros) + ",\"pid\":" +
+                 to_string(pid) + ",\"tid\":" + to_string(tid);
+  if (!args.empty())
+    event += ",\"args\":{" + args + "}";
+  WriteEvent(event);
+}
+
+int StatusTracer::ThreadId() {
+  thread::id id = this_thread::get_id();
+  map<thread::id, int>::iterator i = threads_.find(id);
+  if (i != threads_.end())
+    return i->second;
+  int tid = (int)threads_.size();
+  threads_[id] = tid;
+  WriteEvent(MetadataEvent("thread_name", kNinjaPid, tid,
+                           "helper " + to_string(tid)));
+  return tid;
+}
+
+void StatusTracer::EdgeAddedToPlan(const Edge* edge) {
+  status_->EdgeAddedToPlan(edge);
+}
+
+void StatusTracer::EdgeRemovedFromPlan(const Edge* edge) {
+  status_->EdgeRemovedFromPlan(edge);
+}
+
+void StatusTracer::BuildEdgeStarted(const Edge* edge,
+                                    int64_t start_time_millis) {
+  status_->BuildEdgeStarted(edge, start_time_millis);
+
+  lock_guard<mutex> lock(mutex_);
+  size_t lane = 0;
+  while (lane < lanes_.size() && lanes_[lane])
+    ++lane;
+  if (lane == lanes_.size()) {
+    lanes_.push_back(false);
+    WriteEvent(MetadataEvent("thread_name", kEdgesPid, (int)lane + 1,
+                             "lane " + to_string(lane + 1)));
+  }
+  lanes_[lane] = true;
+  running_[edge] = make_pair((int)lane, GetTimeMicros());
+}
+
+void StatusTracer::BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
+                                     int64_t end_time_millis,
+                                     const ResourceUsage& usage, bool success,
+                                     const string& output) {
+  status_->BuildEdgeFinished(edge, start_time_millis, end_time_millis, usage,
+                             success, output);
+
+  lock_guard<mutex> lock(mutex_);
+  map<const Edge*, pair<int, int64_t> >::iterator i = running_.find(edge);
+  if (i == running_.end())
+    return;
+  int lane = i->second.first;
+  int64_t start_micros = i->second.second;
+  running_.erase(i);
+  lanes_[lane] = false;
+
+  string name = edge->outputs_.empty() ? edge->rule().name()
+                                       : edge->outputs_[0]->path();
+  string args = "\"rule\":\"" + EncodeJSONString(edge->rule().name()) +
+                "\",\"success\":" + (success ? "true" : "false");
+  WriteCompleteEvent(name, "edge", kEdgesPid, lane + 1, start_micros,
+                     GetTimeMicros(), args);
+}
+
+void StatusTracer::BuildStarted() {
+  status_->BuildStarted();
+}
+
+void StatusTracer::BuildFinished() {
+  status_->BuildFinished();
+  lock_guard<mutex> lock(mutex_);
+  fflush(file_);
+}
+
+int64_t StatusTracer::RefreshTimeoutMillis(int64_t time_millis) {
+  return status_->RefreshTimeoutMillis(time_millis);
+}
+
+void StatusTracer::Refresh(int64_t time_millis) {
+  status_->Refresh(time_millis);
+}
+
+void StatusTracer::SetExplanations(Explanations* explanations) {
+  status_->SetExplanations(explanations);
+}
+
+void StatusTracer::Info(const char* msg, ...) {
+  va_list ap;
+  va_start(ap, msg);
+  string message = FormatMessage(msg, ap);
+  va_end(ap);
+  status_->Info("%s", message.c_str());
+}
+
+void StatusTracer::Warning(const char* msg, ...) {
+  va_list ap;
+  va_start(ap, msg);
+  string message = FormatMessage(msg, ap);
+  va_end(ap);
+  status_->Warning("%s", message.c_str());
+}
+
+void StatusTracer::Error(const char* msg, ...) {
+  va_list ap;
+  va_start(ap, msg);
+  string message = FormatMessage(msg, ap);
+  va_end(ap);
+  status_->Error("%s", message.c_str());
+}
+
+void StatusTracer::MetricRecorded(const Metric* metric, int64_t start_micros,
+                                  int64_t end_micros) {
+  if (end_micros - start_micros < kMinMetricMicros)
+    return;
+  lock_guard<mutex> lock(mutex_);
+  WriteCompleteEvent(metric->name, "ninja", kNinjaPid, ThreadId(),
+                     start_micros, end_micros, "");
+}
@@ -0,0 +1,105 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_STATUS_TRACER_H_
+#define NINJA_STATUS_TRACER_H_
+
+#include <stdio.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "status.h"
+
+/// Implementation of the Status interface that writes a trace of the build,
+/// in the Chrome trace event format read by chrome://tracing and Perfetto,
+/// and passes every call on to another Status.
+///
+/// Each edge is a complete event on a "lane": the lowest lane that is free
+/// when the edge starts, so that there are as many lanes as commands ran
+/// at once.  The measurements of METRIC_RECORD, which the tracer observes,
+/// are events of the thread that made them, so that ninja's own phases such
+/// as loading the manifest and logs, scanning and planning show up too.
+struct StatusTracer : public Status, public MetricsObserver {
+  /// Measurements shorter than this are left out of the trace, to keep it
+  /// small: there is one for each stat() of a file, for example.
+  static const int64_t kMinMetricMicros;
+
+  /// Start writing a trace to |path|, and observe |g_metrics|, which must
+  /// be set.  Returns NULL and fills in |err| on error.  Takes ownership
+  /// of |status| on success.
+  static StatusTracer* Create(Status* status, const std::string& path,
+                              std::string* err);
+  /// Completes the trace.
+  virtual ~StatusTracer();
+
+  // Status
+  virtual void EdgeAddedToPlan(const Edge* edge);
+  virtual void EdgeRemovedFromPlan(const Edge* edge);
+  virtual void BuildEdgeStarted(const Edge* edge, int64_t start_time_millis);
+  virtual void BuildEdgeFinished(Edge* edge, int64_t start_time_millis,
+                                 int64_t end_time_millis,
+                                 const ResourceUsage& usage, bool success,
+                                 const std::string& output);
+  virtual void BuildStarted();
+  virtual void BuildFinished();
+  virtual int64_t RefreshTimeoutMillis(int64_t time_millis);
+  virtual void Refresh(int64_t time_millis);
+  virtual void SetExplanations(Explanations* explanations);
+  virtual void Info(const char* msg, ...);
+  virtual void Warning(const char* msg, ...);
+  virtual void Error(const char* msg, ...);
+
+  // MetricsObserver
+  virtual void MetricRecorded(const Metric* metric, int64_t start_micros,
+                              int64_t end_micros);
+
+ private:
+  StatusTracer(Status* status, FILE* file);
+
+  /// Write an event, given as JSON without its braces.  |mutex_| must be
+  /// held.
+  void WriteEvent(const std::string& event);
+
+  /// Write a complete event.  |mutex_| must be held.
+  void WriteCompleteEvent(const std::string& name, const char* category,
+                          int pid, int tid, int64_t start_micros,
+                          int64_t end_micros, const std::string& args);
+
+  /// The id of the thread running this, for events of process 1.  |mutex_|
+  /// must be held.
+  int ThreadId();
+
+  std::unique_ptr<Status> status_;
+  /// Events are relative to this time, in microseconds.
+  int64_t start_micros_;
+
+  std::mutex mutex_;
+  /// Guarded by |mutex_|.
+  FILE* file_;
+  size_t events_written_;
+  /// Lane and start time of each running edge.
+  std::map<const Edge*, std::pair<int, int64_t> > running_;
+  /// Whether each lane runs an edge.
+  std::vector<bool> lanes_;
+  /// Ids of the threads that made measurements, the first one being 0.
+  std::map<std::thread::id, int> threads_;
+};
+
+#endif  // NINJA_STATUS_TRACER_H_
@@ -0,0 +1,133 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "status_tracer.h"
+
+#include "build.h"
+#include "graph.h"
+#include "status_printer.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+struct StatusTracerTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    // These tests do real disk accesses, so create a temp dir.
+    temp_dir_.CreateAndEnter("Ninja-StatusTracerTest");
+    old_metrics_ = g_metrics;
+    g_metrics = &metrics_;
+    config_.verbosity = BuildConfig::QUIET;
+  }
+
+  virtual void TearDown() {
+    g_metrics = old_metrics_;
+    temp_dir_.Cleanup();
+  }
+
+  StatusTracer* Create() {
+    string err;
+    StatusTracer* tracer =
+        StatusTracer::Create(new StatusPrinter(config_), "trace.json", &err);
+    EXPECT_TRUE(tracer) << err;
+    return tracer;
+  }
+
+  string Trace() {
+    string contents, err;
+    EXPECT_EQ(0, disk_.ReadFile("trace.json", &contents, &err));
+    return contents;
+  }
+
+  ScopedTempDir temp_dir_;
+  RealDiskInterface disk_;
+  Metrics metrics_;
+  Metrics* old_metrics_;
+  BuildConfig config_;
+};
+
+size_t Count(const string& haystack, const string& needle) {
+  size_t count = 0;
+  for (size_t pos = haystack.find(needle); pos != string::npos;
+       pos = haystack.find(needle, pos + 1))
+    ++count;
+  return count;
+}
+
+}  // anonymous namespace
+
+TEST_F(StatusTracerTest, Lanes) {
+  AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat in\n"
+"build c: cat in\n");
+  Edge* a = GetNode("a")->in_edge();
+  Edge* b = GetNode("b")->in_edge();
+  Edge* c = GetNode("c")->in_edge();
+
+  StatusTracer* tracer = Create();
+  tracer->BuildStarted();
+  tracer->BuildEdgeStarted(a, 0);
+  tracer->BuildEdgeStarted(b, 0);
+  tracer->BuildEdgeFinished(a, 0, 1, ResourceUsage(), true, "");
+  // c takes the lane a left.
+  tracer->BuildEdgeStarted(c, 1);
+  tracer->BuildEdgeFinished(b, 0, 2, ResourceUsage(), false, "");
+  tracer->BuildEdgeFinished(c, 1, 2, ResourceUsage(), true, "");
+  tracer->BuildFinished();
+  delete tracer;
+
+  string trace = Trace();
+  EXPECT_EQ(0u, trace.find("[\n{"));
+  EXPECT_EQ(trace.size() - 3, trace.rfind("\n]\n"));
+  EXPECT_EQ(1u, Count(trace, "\"lane 1\""));
+  EXPECT_EQ(1u, Count(trace, "\"lane 2\""));
+  EXPECT_EQ(0u, Count(trace, "\"lane 3\""));
+  EXPECT_EQ(3u, Count(trace, "\"ph\":\"X\""));
+  EXPECT_NE(string::npos, trace.find("\"name\":\"a\",\"cat\":\"edge\""));
+  EXPECT_NE(string::npos, trace.find("\"pid\":2,\"tid\":1,"
+                                     "\"args\":{\"rule\":\"cat\","
+                                     "\"success\":true}"));
+  EXPECT_NE(string::npos, trace.find("\"pid\":2,\"tid\":2,"
+                                     "\"args\":{\"rule\":\"cat\","
+                                     "\"success\":false}"));
+}
+
+TEST_F(StatusTracerTest, Metrics) {
+  StatusTracer* tracer = Create();
+  EXPECT_EQ(tracer, metrics_.observer());
+  Metric* load = metrics_.NewMetric("load");
+  Metric* stat = metrics_.NewMetric("stat");
+  int64_t now = GetTimeMicros();
+  tracer->MetricRecorded(load, now, now + 1000);
+  tracer->MetricRecorded(stat, now, now + 1);
+  delete tracer;
+  EXPECT_EQ(NULL, metrics_.observer());
+
+  // Short measurements are left out.
+  string trace = Trace();
+  EXPECT_NE(string::npos, trace.find("\"name\":\"load\",\"cat\":\"ninja\","
+                                     "\"ph\":\"X\""));
+  EXPECT_NE(string::npos, trace.find("\"dur\":1000,\"pid\":1,\"tid\":0}"));
+  EXPECT_EQ(string::npos, trace.find("\"stat\""));
+}
+
+TEST_F(StatusTracerTest, BadPath) {
+  string err;
+  Status* status = new StatusPrinter(config_);
+  EXPECT_FALSE(StatusTracer::Create(status, "missing/trace.json", &err));
+  EXPECT_EQ(0u, err.find("missing/trace.json: "));
+  delete status;
+}
@@ -21,10 +21,17 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <spawn.h>
 
-#if defined(USE_PPOLL)
+#include <algorithm>
+#include <climits>
+
+#if defined(USE_EPOLL)
+#include <sys/epoll.h>
+#elif defined(USE_PPOLL)
 #include <poll.h>
 #else
 #include <sys/select.h>
@@ -36,19 +43,59 @@ extern char** environ;
 
 using namespace std;
 
-Subprocess::Subprocess(bool use_console) : fd_(-1), pid_(-1),
-                                           use_console_(use_console) {
+#ifndef USE_EPOLL
+namespace {
+
+timespec MillisToTimespec(int64_t millis) {
+  timespec ts;
+  ts.tv_sec = millis / 1000;
+  ts.tv_nsec = (millis % 1000) * 1000000;
+  return ts;
+}
+
+}  // namespace
+#endif  // !USE_EPOLL
+
+#ifdef USE_EPOLL
+namespace {
+
+// Set in the epoll data of a pidfd, to tell it from the Subprocess's pipe.
+const uint64_t kPidfdTag = 1;
+
+int PidfdOpen(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return syscall(SYS_pidfd_open, pid, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+}  // namespace
+#endif  // USE_EPOLL
+
+Subprocess::Subprocess(bool use_console) : fd_(-1), pid_(-1), status_(0),
+#ifdef USE_EPOLL
+                                           pidfd_(-1),
+#endif
+                                           use_console_(use_console),
+                                           running_index_(0) {
 }
 
 Subprocess::~Subprocess() {
   if (fd_ >= 0)
-    close(fd_);
+    ClosePipe();
+#ifdef USE_EPOLL
+  if (pidfd_ >= 0)
+    ClosePidfd();
+#endif
   // Reap child if forgotten.
   if (pid_ != -1)
     Finish();
 }
 
-bool Subprocess::Start(SubprocessSet* set, const string& command) {
+bool Subprocess::Start(SubprocessSet* set, const string& command,
+                       bool direct_exec) {
   int output_pipe[2];
   if (pipe(output_pipe) < 0)
     Fatal("pipe: %s", strerror(errno));
@@ -61,6 +108,16 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
 #endif  // !USE_PPOLL
   SetCloseOnExec(fd_);
 
+#ifdef USE_EPOLL
+  epoll_fd_ = set->epoll_fd_;
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = reinterpret_cast<uintptr_t>(this);
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd_, &event) < 0)
+    Fatal("epoll_ctl: %s", strerror(errno));
+#endif
+
   posix_spawn_file_actions_t action;
   int err = posix_spawn_file_actions_init(&action);
   if (err != 0)
@@ -117,11 +174,40 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
   if (err != 0)
     Fatal("posix_spawnattr_setflags: %s", strerror(err));
 
-  const char* spawned_args[] = { "/bin/sh", "-c", command.c_str(), NULL };
-  err = posix_spawn(&pid_, "/bin/sh", &action, &attr,
-        const_cast<char**>(spawned_args), environ);
-  if (err != 0)
-    Fatal("posix_spawn: %s", strerror(err));
+  // Skip the shell's startup for commands it would only split into words.
+  vector<string> args;
+  if (direct_exec && SplitSimpleShellCommand(command, &args)) {
+    vector<char*> argv;
+    for (vector<string>::iterator i = args.begin(); i != args.end(); ++i)
+      argv.push_back(const_cast<char*>(i->c_str()));
+    argv.push_back(NULL);
+    err = posix_spawnp(&pid_, argv[0], &action, &attr, &argv[0], environ);
+    // If that failed, e.g. because the program doesn't exist, let the
+    // shell report the error the usual way.
+  } else {
+    err = -1;
+  }
+  if (err != 0) {
+    const char* spawned_args[] = { "/bin/sh", "-c", command.c_str(), NULL };
+    err = posix_spawn(&pid_, "/bin/sh", &action, &attr,
+          const_cast<char**>(spawned_args), environ);
+    if (err != 0)
+      Fatal("posix_spawn: %s", strerror(err));
+  }
+
+#ifdef USE_EPOLL
+  // Older kernels don't have pidfds; EOF on the pipe is then the only sign
+  // that the command is done.
+  pidfd_ = PidfdOpen(pid_);
+  if (pidfd_ >= 0) {
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = reinterpret_cast<uintptr_t>(this) | kPidfdTag;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, pidfd_, &event) < 0)
+      Fatal("epoll_ctl: %s", strerror(errno));
+  }
+#endif
 
   err = posix_spawnattr_destroy(&attr);
   if (err != 0)
@@ -135,25 +221,82 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
 }
 
 void Subprocess::OnPipeReady() {
-  char buf[4 << 10];
+  // Commands with lots of output would otherwise need many wakeups.
+  char buf[64 << 10];
   ssize_t len = read(fd_, buf, sizeof(buf));
   if (len > 0) {
-    buf_.append(buf, len);
+    output_.Append(buf, len);
   } else {
     if (len < 0)
       Fatal("read: %s", strerror(errno));
-    close(fd_);
-    fd_ = -1;
+    ClosePipe();
   }
 }
 
-ExitStatus Subprocess::Finish() {
-  assert(pid_ != -1);
-  int status;
-  if (waitpid(pid_, &status, 0) < 0)
-    Fatal("waitpid(%d): %s", pid_, strerror(errno));
+void Subprocess::ClosePipe() {
+#ifdef USE_EPOLL
+  // Closing fd_ alone doesn't unregister it while a child that was just
+  // spawned still holds a copy of it, which would leave an event pointing
+  // at this object after it's deleted.
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd_, NULL) < 0)
+    Fatal("epoll_ctl: %s", strerror(errno));
+#endif
+  close(fd_);
+  fd_ = -1;
+}
+
+#ifdef USE_EPOLL
+void Subprocess::OnProcessExit() {
+  ClosePidfd();
+  Reap();
+
+  // Take what's left in the pipe, but don't wait for EOF: a background
+  // process started by the command may hold the pipe open for much longer.
+  if (fd_ >= 0) {
+    if (fcntl(fd_, F_SETFL, O_NONBLOCK) < 0)
+      Fatal("fcntl: %s", strerror(errno));
+    char buf[64 << 10];
+    ssize_t len;
+    while ((len = read(fd_, buf, sizeof(buf))) > 0)
+      output_.Append(buf, len);
+    if (len < 0 && errno != EAGAIN)
+      Fatal("read: %s", strerror(errno));
+    ClosePipe();
+  }
+}
+
+void Subprocess::ClosePidfd() {
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, pidfd_, NULL) < 0)
+    Fatal("epoll_ctl: %s", strerror(errno));
+  close(pidfd_);
+  pidfd_ = -1;
+}
+#endif  // USE_EPOLL
+
+void Subprocess::Reap() {
+  struct rusage ru;
+  if (wait4(pid_, &status_, 0, &ru) < 0)
+    Fatal("wait4(%d): %s", pid_, strerror(errno));
   pid_ = -1;
 
+  usage_.user_time_millis =
+      ru.ru_utime.tv_sec * 1000 + ru.ru_utime.tv_usec / 1000;
+  usage_.system_time_millis =
+      ru.ru_stime.tv_sec * 1000 + ru.ru_stime.tv_usec / 1000;
+#ifdef __APPLE__
+  usage_.max_rss_kb = ru.ru_maxrss / 1024;  // Reported in bytes.
+#else
+  usage_.max_rss_kb = ru.ru_maxrss;
+#endif
+  usage_.input_blocks = ru.ru_inblock;
+  usage_.output_blocks = ru.ru_oublock;
+}
+
+ExitStatus Subprocess::Finish() {
+  if (pid_ != -1)
+    Reap();
+  int status = status_;
+
 #ifdef _AIX
   if (WIFEXITED(status) && WEXITSTATUS(status) & 0x80) {
     // Map the shell's exit code used for signal failure (128 + signal) to the
@@ -177,11 +320,15 @@ ExitStatus Subprocess::Finish() {
 }
 
 bool Subprocess::Done() const {
+#ifdef USE_EPOLL
+  return fd_ == -1 && pidfd_ == -1;
+#else
   return fd_ == -1;
+#endif
 }
 
-const string& Subprocess::GetOutput() const {
-  return buf_;
+const string& Subprocess::GetOutput() {
+  return output_.str();
 }
 
 int SubprocessSet::interrupted_;
@@ -223,6 +370,26 @@ SubprocessSet::SubprocessSet() {
     Fatal("sigaction: %s", strerror(errno));
   if (sigaction(SIGHUP, &act, &old_hup_act_) < 0)
     Fatal("sigaction: %s", strerror(errno));
+
+  if (pipe(wake_pipe_) < 0)
+    Fatal("pipe: %s", strerror(errno));
+  for (int i = 0; i < 2; ++i) {
+    SetCloseOnExec(wake_pipe_[i]);
+    fcntl(wake_pipe_[i], F_SETFL, fcntl(wake_pipe_[i], F_GETFL) | O_NONBLOCK);
+  }
+
+#ifdef USE_EPOLL
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0)
+    Fatal("epoll_create1: %s", strerror(errno));
+  // The wake pipe is the only registration without a Subprocess.
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = 0;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_pipe_[0], &event) < 0)
+    Fatal("epoll_ctl: %s", strerror(errno));
+#endif
 }
 
 SubprocessSet::~SubprocessSet() {
@@ -236,20 +403,87 @@ SubprocessSet::~SubprocessSet() {
     Fatal("sigaction: %s", strerror(errno));
   if (sigprocmask(SIG_SETMASK, &old_mask_, 0) < 0)
     Fatal("sigprocmask: %s", strerror(errno));
+#ifdef USE_EPOLL
+  close(epoll_fd_);
+#endif
+  close(wake_pipe_[0]);
+  close(wake_pipe_[1]);
 }
 
-Subprocess *SubprocessSet::Add(const string& command, bool use_console) {
+void SubprocessSet::Wake() {
+  char c = 0;
+  // If the pipe is full, DoWork() is bound to wake up already.
+  while (write(wake_pipe_[1], &c, 1) < 0 && errno == EINTR) {}
+}
+
+void SubprocessSet::DrainWakePipe() {
+  char buf[64];
+  while (read(wake_pipe_[0], buf, sizeof(buf)) > 0 || errno == EINTR) {}
+}
+
+Subprocess *SubprocessSet::Add(const string& command, bool use_console,
+                               bool direct_exec) {
   Subprocess *subprocess = new Subprocess(use_console);
-  if (!subprocess->Start(this, command)) {
+  if (!subprocess->Start(this, command, direct_exec)) {
     delete subprocess;
     return 0;
   }
+  subprocess->running_index_ = running_.size();
   running_.push_back(subprocess);
   return subprocess;
 }
 
-#ifdef USE_PPOLL
-bool SubprocessSet::DoWork() {
+void SubprocessSet::Finish(Subprocess* subproc) {
+  Subprocess* last = running_.back();
+  running_[subproc->running_index_] = last;
+  last->running_index_ = subproc->running_index_;
+  running_.pop_back();
+  finished_.push(subproc);
+}
+
+#if defined(USE_EPOLL)
+bool SubprocessSet::DoWork(int64_t timeout_millis) {
+  epoll_event events[64];
+  interrupted_ = 0;
+  int timeout = timeout_millis < 0 ? -1 : (int)min<int64_t>(timeout_millis,
+                                                             INT_MAX);
+  int ret = epoll_pwait(epoll_fd_, events, sizeof(events) / sizeof(events[0]),
+                        timeout, &old_mask_);
+  if (ret == -1) {
+    if (errno != EINTR) {
+      perror("ninja: epoll_pwait");
+      return false;
+    }
+    return IsInterrupted();
+  }
+
+  HandlePendingInterruption();
+  if (IsInterrupted())
+    return true;
+
+  for (int i = 0; i < ret; ++i) {
+    uint64_t data = events[i].data.u64;
+    if (data == 0) {
+      DrainWakePipe();
+      continue;
+    }
+    Subprocess* subproc = reinterpret_cast<Subprocess*>(data & ~kPidfdTag);
+    // A pidfd event earlier in this batch may have finished it already.
+    if (subproc->Done())
+      continue;
+    if (data & kPidfdTag)
+      subproc->OnProcessExit();
+    else
+      subproc->OnPipeReady();
+    if (subproc->Done())
+      Finish(subproc);
+  }
+
+  return IsInterrupted();
+}
+
+#elif defined(USE_PPOLL)
+bool SubprocessSet::DoWork(int64_t timeout_millis) {
   vector<pollfd> fds;
   nfds_t nfds = 0;
 
@@ -262,9 +496,14 @@ bool SubprocessSet::DoWork() {
     fds.push_back(pfd);
     ++nfds;
   }
+  pollfd wake_pfd = { wake_pipe_[0], POLLIN, 0 };
+  fds.push_back(wake_pfd);
+  ++nfds;
 
   interrupted_ = 0;
-  int ret = ppoll(&fds.front(), nfds, NULL, &old_mask_);
+  timespec timeout = MillisToTimespec(timeout_millis);
+  int ret = ppoll(&fds.front(), nfds, timeout_millis < 0 ? NULL : &timeout,
+                  &old_mask_);
   if (ret == -1) {
     if (errno != EINTR) {
       perror("ninja: ppoll");
@@ -277,29 +516,35 @@ bool SubprocessSet::DoWork() {
   if (IsInterrupted())
     return true;
 
+  if (fds.back().revents)
+    DrainWakePipe();
+
+  // Keep the ones still running, in order, in a single pass.
   nfds_t cur_nfd = 0;
-  for (vector<Subprocess*>::iterator i = running_.begin();
-       i != running_.end(); ) {
-    int fd = (*i)->fd_;
-    if (fd < 0)
-      continue;
-    assert(fd == fds[cur_nfd].fd);
-    if (fds[cur_nfd++].revents) {
-      (*i)->OnPipeReady();
-      if ((*i)->Done()) {
-        finished_.push(*i);
-        i = running_.erase(i);
-        continue;
+  size_t kept = 0;
+  for (size_t i = 0; i < running_.size(); ++i) {
+    Subprocess* subproc = running_[i];
+    int fd = subproc->fd_;
+    if (fd >= 0) {
+      assert(fd == fds[cur_nfd].fd);
+      if (fds[cur_nfd++].revents) {
+        subproc->OnPipeReady();
+        if (subproc->Done()) {
+          finished_.push(subproc);
+          continue;
+        }
       }
     }
-    ++i;
+    subproc->running_index_ = kept;
+    running_[kept++] = subproc;
   }
+  running_.resize(kept);
 
   return IsInterrupted();
 }
 
-#else  // !defined(USE_PPOLL)
-bool SubprocessSet::DoWork() {
+#else  // !defined(USE_EPOLL) && !defined(USE_PPOLL)
+bool SubprocessSet::DoWork(int64_t timeout_millis) {
   fd_set set;
   int nfds = 0;
   FD_ZERO(&set);
@@ -313,9 +558,14 @@ bool SubprocessSet::DoWork() {
         nfds = fd+1;
     }
   }
+  FD_SET(wake_pipe_[0], &set);
+  if (nfds < wake_pipe_[0] + 1)
+    nfds = wake_pipe_[0] + 1;
 
   interrupted_ = 0;
-  int ret = pselect(nfds, &set, 0, 0, 0, &old_mask_);
+  timespec timeout = MillisToTimespec(timeout_millis);
+  int ret = pselect(nfds, &set, 0, 0, timeout_millis < 0 ? NULL : &timeout,
+                    &old_mask_);
   if (ret == -1) {
     if (errno != EINTR) {
       perror("ninja: pselect");
@@ -328,23 +578,29 @@ bool SubprocessSet::DoWork() {
   if (IsInterrupted())
     return true;
 
-  for (vector<Subprocess*>::iterator i = running_.begin();
-       i != running_.end(); ) {
-    int fd = (*i)->fd_;
+  if (FD_ISSET(wake_pipe_[0], &set))
+    DrainWakePipe();
+
+  // Keep the ones still running, in order, in a single pass.
+  size_t kept = 0;
+  for (size_t i = 0; i < running_.size(); ++i) {
+    Subprocess* subproc = running_[i];
+    int fd = subproc->fd_;
     if (fd >= 0 && FD_ISSET(fd, &set)) {
-      (*i)->OnPipeReady();
-      if ((*i)->Done()) {
-        finished_.push(*i);
-        i = running_.erase(i);
+      subproc->OnPipeReady();
+      if (subproc->Done()) {
+        finished_.push(subproc);
         continue;
       }
     }
-    ++i;
+    subproc->running_index_ = kept;
+    running_[kept++] = subproc;
   }
+  running_.resize(kept);
 
   return IsInterrupted();
 }
-#endif  // !defined(USE_PPOLL)
+#endif  // !defined(USE_EPOLL) && !defined(USE_PPOLL)
 
 Subprocess* SubprocessSet::NextFinished() {
   if (finished_.empty())
@@ -359,7 +615,7 @@ void SubprocessSet::Clear() {
        i != running_.end(); ++i)
     // Since the foreground process is in our process group, it will receive
     // the interruption signal (i.e. SIGINT or SIGTERM) at the same time as us.
-    if (!(*i)->use_console_)
+    if (!(*i)->use_console_ && (*i)->pid_ != -1)
       kill(-(*i)->pid_, interrupted_);
   for (vector<Subprocess*>::iterator i = running_.begin();
        i != running_.end(); ++i)
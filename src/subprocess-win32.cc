@@ -23,9 +23,18 @@
 
 using namespace std;
 
+namespace {
+
+/// The completion key posted by SubprocessSet::Wake(), which no Subprocess
+/// can have.
+Subprocess* const kWakeKey = reinterpret_cast<Subprocess*>(1);
+
+}  // anonymous namespace
+
 Subprocess::Subprocess(bool use_console) : child_(NULL) , overlapped_(),
                                            is_reading_(false),
-                                           use_console_(use_console) {
+                                           use_console_(use_console),
+                                           running_index_(0) {
 }
 
 Subprocess::~Subprocess() {
@@ -74,7 +83,8 @@ HANDLE Subprocess::SetupPipe(HANDLE ioport) {
   return output_write_child;
 }
 
-bool Subprocess::Start(SubprocessSet* set, const string& command) {
+bool Subprocess::Start(SubprocessSet* set, const string& command,
+                       bool /*direct_exec*/) {
   HANDLE child_pipe = SetupPipe(set->ioport_);
 
   SECURITY_ATTRIBUTES security_attributes;
@@ -123,8 +133,9 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
       CloseHandle(nul);
       pipe_ = NULL;
       // child_ is already NULL;
-      buf_ = "CreateProcess failed: The system cannot find the file "
-          "specified.\n";
+      const char kError[] = "CreateProcess failed: The system cannot find "
+          "the file specified.\n";
+      output_.Append(kError, sizeof(kError) - 1);
       return true;
     } else {
       fprintf(stderr, "\nCreateProcess failed. Command attempted:\n\"%s\"\n",
@@ -166,7 +177,7 @@ void Subprocess::OnPipeReady() {
   }
 
   if (is_reading_ && bytes)
-    buf_.append(overlapped_buf_, bytes);
+    output_.Append(overlapped_buf_, bytes);
 
   memset(&overlapped_, 0, sizeof(overlapped_));
   is_reading_ = true;
@@ -195,6 +206,20 @@ ExitStatus Subprocess::Finish() {
   DWORD exit_code = 0;
   GetExitCodeProcess(child_, &exit_code);
 
+  // Only CPU times are readily available; the other fields stay zero.
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (GetProcessTimes(child_, &creation_time, &exit_time, &kernel_time,
+                      &user_time)) {
+    // FILETIME counts 100ns intervals.
+    ULARGE_INTEGER t;
+    t.LowPart = user_time.dwLowDateTime;
+    t.HighPart = user_time.dwHighDateTime;
+    usage_.user_time_millis = (int)(t.QuadPart / 10000);
+    t.LowPart = kernel_time.dwLowDateTime;
+    t.HighPart = kernel_time.dwHighDateTime;
+    usage_.system_time_millis = (int)(t.QuadPart / 10000);
+  }
+
   CloseHandle(child_);
   child_ = NULL;
 
@@ -207,8 +232,8 @@ bool Subprocess::Done() const {
   return pipe_ == NULL;
 }
 
-const string& Subprocess::GetOutput() const {
-  return buf_;
+const string& Subprocess::GetOutput() {
+  return output_.str();
 }
 
 HANDLE SubprocessSet::ioport_;
@@ -238,26 +263,42 @@ BOOL WINAPI SubprocessSet::NotifyInterrupted(DWORD dwCtrlType) {
   return FALSE;
 }
 
-Subprocess *SubprocessSet::Add(const string& command, bool use_console) {
+Subprocess *SubprocessSet::Add(const string& command, bool use_console,
+                               bool direct_exec) {
   Subprocess *subprocess = new Subprocess(use_console);
-  if (!subprocess->Start(this, command)) {
+  if (!subprocess->Start(this, command, direct_exec)) {
     delete subprocess;
     return 0;
   }
-  if (subprocess->child_)
+  if (subprocess->child_) {
+    subprocess->running_index_ = running_.size();
     running_.push_back(subprocess);
-  else
+  } else {
     finished_.push(subprocess);
+  }
   return subprocess;
 }
 
-bool SubprocessSet::DoWork() {
+void SubprocessSet::Finish(Subprocess* subproc) {
+  Subprocess* last = running_.back();
+  running_[subproc->running_index_] = last;
+  last->running_index_ = subproc->running_index_;
+  running_.pop_back();
+  finished_.push(subproc);
+}
+
+bool SubprocessSet::DoWork(int64_t timeout_millis) {
   DWORD bytes_read;
   Subprocess* subproc;
   OVERLAPPED* overlapped;
 
+  DWORD timeout = timeout_millis < 0 ? INFINITE
+                                     : (DWORD)min<int64_t>(timeout_millis,
+                                                           INFINITE - 1);
   if (!GetQueuedCompletionStatus(ioport_, &bytes_read, (PULONG_PTR)&subproc,
-                                 &overlapped, INFINITE)) {
+                                 &overlapped, timeout)) {
+    if (!overlapped && GetLastError() == WAIT_TIMEOUT)
+      return false;
     if (GetLastError() != ERROR_BROKEN_PIPE)
       Win32Fatal("GetQueuedCompletionStatus");
   }
@@ -266,20 +307,24 @@ bool SubprocessSet::DoWork() {
                 // delivered by NotifyInterrupted above.
     return true;
 
+  if (subproc == kWakeKey) // Delivered by Wake().
+    return false;
+
   subproc->OnPipeReady();
 
-  if (subproc->Done()) {
-    vector<Subprocess*>::iterator end =
-        remove(running_.begin(), running_.end(), subproc);
-    if (running_.end() != end) {
-      finished_.push(subproc);
-      running_.resize(end - running_.begin());
-    }
-  }
+  // Only finish it once, if several completions report it done.
+  if (subproc->Done() && subproc->running_index_ < running_.size() &&
+      running_[subproc->running_index_] == subproc)
+    Finish(subproc);
 
   return false;
 }
 
+void SubprocessSet::Wake() {
+  if (!PostQueuedCompletionStatus(ioport_, 0, (ULONG_PTR)kWakeKey, NULL))
+    Win32Fatal("PostQueuedCompletionStatus");
+}
+
 Subprocess* SubprocessSet::NextFinished() {
   if (finished_.empty())
     return NULL;
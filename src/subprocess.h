@@ -15,6 +15,8 @@
 #ifndef NINJA_SUBPROCESS_H_
 #define NINJA_SUBPROCESS_H_
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 #include <queue>
@@ -34,6 +36,8 @@
 #endif
 
 #include "exit_status.h"
+#include "output_spool.h"
+#include "resource_usage.h"
 
 /// Subprocess wraps a single async subprocess.  It is entirely
 /// passive: it expects the caller to notify it when its fds are ready
@@ -48,14 +52,21 @@ struct Subprocess {
 
   bool Done() const;
 
-  const std::string& GetOutput() const;
+  const std::string& GetOutput();
+  /// Move the output out of the subprocess, once it is done.
+  std::string TakeOutput() { return output_.Take(); }
+
+  /// Resources used by the process, valid after Finish().
+  const ResourceUsage& usage() const { return usage_; }
 
  private:
   Subprocess(bool use_console);
-  bool Start(struct SubprocessSet* set, const std::string& command);
+  bool Start(struct SubprocessSet* set, const std::string& command,
+             bool direct_exec);
   void OnPipeReady();
 
-  std::string buf_;
+  OutputSpool output_;
+  ResourceUsage usage_;
 
 #ifdef _WIN32
   /// Set up pipe_ as the parent-side pipe of the subprocess; return the
@@ -65,32 +76,70 @@ struct Subprocess {
   HANDLE child_;
   HANDLE pipe_;
   OVERLAPPED overlapped_;
-  char overlapped_buf_[4 << 10];
+  char overlapped_buf_[64 << 10];
   bool is_reading_;
 #else
+  /// Stop watching and close the pipe.
+  void ClosePipe();
+  /// Wait for the process to exit and record its status and usage.
+  void Reap();
+
   int fd_;
   pid_t pid_;
+  /// Wait status of the process, valid once pid_ is -1.
+  int status_;
+#ifdef USE_EPOLL
+  /// Called when pidfd_ reports that the process exited.
+  void OnProcessExit();
+  void ClosePidfd();
+
+  /// The SubprocessSet's epoll instance that fd_ and pidfd_ are registered
+  /// with.
+  int epoll_fd_;
+  /// A pidfd for the process while it runs, if the kernel supports them.
+  /// The process is then done when it exits, rather than when every
+  /// process holding the pipe has closed it.
+  int pidfd_;
+#endif
 #endif
   bool use_console_;
+  /// Position in the SubprocessSet's running_ while it runs.
+  size_t running_index_;
 
   friend struct SubprocessSet;
 };
 
-/// SubprocessSet runs a ppoll/pselect() loop around a set of Subprocesses.
+/// SubprocessSet runs an epoll/ppoll/pselect() loop around a set of
+/// Subprocesses.
 /// DoWork() waits for any state change in subprocesses; finished_
 /// is a queue of subprocesses as they finish.
 struct SubprocessSet {
   SubprocessSet();
   ~SubprocessSet();
 
-  Subprocess* Add(const std::string& command, bool use_console = false);
-  bool DoWork();
+  /// Start |command|.  With |direct_exec|, a command simple enough to not
+  /// need the shell is run without it (ignored on Windows, which never uses
+  /// a shell).
+  Subprocess* Add(const std::string& command, bool use_console = false,
+                  bool direct_exec = false);
+  /// Wait for a subprocess to make progress, or for Wake(), but at most
+  /// |timeout_millis| unless it is negative.  Returns true if interrupted.
+  bool DoWork(int64_t timeout_millis = -1);
   Subprocess* NextFinished();
   void Clear();
 
+  /// Make a DoWork() that is waiting, or the next one, return, so that the
+  /// caller can look at work finished outside of the set.  May be called
+  /// from any thread.
+  void Wake();
+
   std::vector<Subprocess*> running_;
   std::queue<Subprocess*> finished_;
 
+  /// Move |subproc| from running_ to finished_, in constant time, by
+  /// moving the last one running into its place.
+  void Finish(Subprocess* subproc);
+
 #ifdef _WIN32
   static BOOL WINAPI NotifyInterrupted(DWORD dwCtrlType);
   static HANDLE ioport_;
@@ -107,6 +156,16 @@ struct SubprocessSet {
   struct sigaction old_term_act_;
   struct sigaction old_hup_act_;
   sigset_t old_mask_;
+  /// A pipe that Wake() writes to and DoWork() waits on along with the
+  /// subprocesses.
+  int wake_pipe_[2];
+  /// Empty the wake pipe once DoWork() has seen it.
+  void DrainWakePipe();
+#ifdef USE_EPOLL
+  /// Every running subprocess's pipe is registered here once, in Start(),
+  /// so that DoWork() only visits the subprocesses that are ready.
+  int epoll_fd_;
+#endif
 #endif
 };
 
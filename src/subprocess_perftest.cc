@@ -0,0 +1,119 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the throughput of SubprocessSet with many commands running at
+// once: commands writing their output in many small pieces, so that the
+// cost of a DoWork() wakeup with lots of running subprocesses dominates,
+// and short commands run with and without the shell.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+#include "subprocess.h"
+
+using namespace std;
+
+namespace {
+
+#ifdef _WIN32
+const char kChattyCommand[] =
+    "cmd /c for /l %i in (1,1,100) do @echo line %i";
+const char kShortCommand[] = "cmd /c rem";
+#else
+const char kChattyCommand[] =
+    "i=0; while [ $i -lt 100 ]; do echo line $i; i=$((i+1)); done";
+const char kShortCommand[] = "true";
+#endif
+
+/// Run |total| copies of |command|, |parallelism| at a time.
+/// Returns the time taken in milliseconds, or -1 on failure.
+int RunCommands(const char* command, bool direct_exec, int parallelism,
+                int total) {
+  SubprocessSet subprocs;
+  int started = 0, finished = 0;
+  int64_t start = GetTimeMillis();
+  while (finished < total) {
+    while (started < total && (int)subprocs.running_.size() < parallelism) {
+      if (!subprocs.Add(command, false, direct_exec)) {
+        fprintf(stderr, "failed to start command\n");
+        return -1;
+      }
+      ++started;
+    }
+    if (subprocs.DoWork()) {
+      fprintf(stderr, "interrupted\n");
+      return -1;
+    }
+    while (Subprocess* subproc = subprocs.NextFinished()) {
+      if (subproc->Finish() != ExitSuccess) {
+        fprintf(stderr, "command failed: %s\n", subproc->GetOutput().c_str());
+        return -1;
+      }
+      delete subproc;
+      ++finished;
+    }
+  }
+  return (int)(GetTimeMillis() - start);
+}
+
+}  // anonymous namespace
+
+int main(int argc, char* argv[]) {
+  int parallelism = argc > 1 ? atoi(argv[1]) : 256;
+  int total = argc > 2 ? atoi(argv[2]) : 2048;
+  if (parallelism <= 0 || total <= 0) {
+    fprintf(stderr, "usage: subprocess_perftest [parallelism] [commands]\n");
+    return 1;
+  }
+
+  struct {
+    const char* name;
+    const char* command;
+    bool direct_exec;
+  } kRuns[] = {
+    { "chatty commands", kChattyCommand, false },
+    { "short commands", kShortCommand, false },
+    { "short commands, direct_exec", kShortCommand, true },
+  };
+
+  for (size_t r = 0; r < sizeof(kRuns) / sizeof(kRuns[0]); ++r) {
+    vector<int> times;
+    for (int j = 0; j < 3; ++j) {
+      int delta = RunCommands(kRuns[r].command, kRuns[r].direct_exec,
+                              parallelism, total);
+      if (delta < 0)
+        return 1;
+      times.push_back(delta);
+    }
+
+    int min = times[0];
+    int max = times[0];
+    float total_time = 0;
+    for (size_t i = 0; i < times.size(); ++i) {
+      total_time += times[i];
+      if (times[i] < min)
+        min = times[i];
+      else if (times[i] > max)
+        max = times[i];
+    }
+
+    printf("%s (%d, -j%d): min %dms  max %dms  avg %.1fms\n", kRuns[r].name,
+           total, parallelism, min, max, total_time / times.size());
+  }
+  return 0;
+}
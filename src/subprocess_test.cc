@@ -14,6 +14,7 @@
 
 #include "subprocess.h"
 
+#include "metrics.h"
 #include "test.h"
 
 #ifndef _WIN32
@@ -22,6 +23,9 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <unistd.h>
+#ifdef USE_EPOLL
+#include <sys/syscall.h>
+#endif
 #endif
 
 using namespace std;
@@ -38,6 +42,21 @@ struct SubprocessTest : public testing::Test {
   SubprocessSet subprocs_;
 };
 
+#ifdef USE_EPOLL
+/// Whether the kernel lets SubprocessSet watch its commands with pidfds.
+bool HavePidfds() {
+#ifdef SYS_pidfd_open
+  int fd = syscall(SYS_pidfd_open, getpid(), 0);
+  if (fd < 0)
+    return false;
+  close(fd);
+  return true;
+#else
+  return false;
+#endif
+}
+#endif
+
 }  // anonymous namespace
 
 // Run a command that fails and emits to stderr.
@@ -176,6 +195,102 @@ TEST_F(SubprocessTest, SetWithSingle) {
   ASSERT_EQ(1u, subprocs_.finished_.size());
 }
 
+TEST_F(SubprocessTest, Wake) {
+  // With nothing running, DoWork() would otherwise wait forever.
+  subprocs_.Wake();
+  EXPECT_FALSE(subprocs_.DoWork());
+  EXPECT_EQ(0u, subprocs_.finished_.size());
+}
+
+TEST_F(SubprocessTest, Timeout) {
+  // With nothing running, DoWork() would otherwise wait forever.
+  EXPECT_FALSE(subprocs_.DoWork(10));
+  EXPECT_EQ(0u, subprocs_.finished_.size());
+}
+
+#ifndef _WIN32
+TEST_F(SubprocessTest, DirectExec) {
+  // The quoted argument would be split or expanded by a shell that got a
+  // mangled command line.
+  Subprocess* subproc = subprocs_.Add("printf '%s|' a\\ b '$HOME'", false,
+                                      true);
+  ASSERT_NE((Subprocess *) 0, subproc);
+
+  while (!subproc->Done()) {
+    subprocs_.DoWork();
+  }
+  ASSERT_EQ(ExitSuccess, subproc->Finish());
+  EXPECT_EQ("a b|$HOME|", subproc->GetOutput());
+}
+
+TEST_F(SubprocessTest, DirectExecFallsBackToShell) {
+  // Commands that need the shell still get it.
+  Subprocess* subproc = subprocs_.Add("echo a && echo $((1 + 1))", false,
+                                      true);
+  ASSERT_NE((Subprocess *) 0, subproc);
+  // A missing program is reported by the shell, as without direct_exec.
+  Subprocess* missing = subprocs_.Add("ninja_no_such_command", false, true);
+  ASSERT_NE((Subprocess *) 0, missing);
+
+  while (!subproc->Done() || !missing->Done()) {
+    subprocs_.DoWork();
+  }
+  ASSERT_EQ(ExitSuccess, subproc->Finish());
+  EXPECT_EQ("a\n2\n", subproc->GetOutput());
+  EXPECT_EQ(ExitFailure, missing->Finish());
+  EXPECT_NE(string::npos, missing->GetOutput().find("ninja_no_such_command"));
+}
+
+TEST_F(SubprocessTest, LargeOutput) {
+  // More than OutputSpool::kDefaultThreshold, so part of it is spooled.
+  Subprocess* subproc =
+      subprocs_.Add("head -c 3000000 /dev/zero | tr '\\0' x; echo end");
+  ASSERT_NE((Subprocess *) 0, subproc);
+
+  while (!subproc->Done()) {
+    subprocs_.DoWork();
+  }
+  ASSERT_EQ(ExitSuccess, subproc->Finish());
+  string output = subproc->TakeOutput();
+  ASSERT_EQ(3000004u, output.size());
+  EXPECT_EQ(string(3000000, 'x') + "end\n", output);
+}
+
+TEST_F(SubprocessTest, BackgroundProcessHoldsPipe) {
+  // The background sleep keeps the output pipe open after the shell exits.
+  int64_t start = GetTimeMillis();
+  Subprocess* subproc = subprocs_.Add("sleep 5 & echo started");
+  ASSERT_NE((Subprocess *) 0, subproc);
+
+  while (!subproc->Done()) {
+    subprocs_.DoWork();
+  }
+  ASSERT_EQ(ExitSuccess, subproc->Finish());
+  EXPECT_EQ("started\n", subproc->GetOutput());
+#ifdef USE_EPOLL
+  // With pidfds, the command is done as soon as the shell exits.  Without
+  // them (older kernels, or a sandbox filtering the syscall) it has to
+  // wait for the sleep to close the pipe.
+  if (HavePidfds())
+    EXPECT_LT(GetTimeMillis() - start, 4000);
+#else
+  (void)start;
+#endif
+}
+
+TEST_F(SubprocessTest, ResourceUsage) {
+  Subprocess* subproc = subprocs_.Add(kSimpleCommand);
+  ASSERT_NE((Subprocess *) 0, subproc);
+
+  while (!subproc->Done()) {
+    subprocs_.DoWork();
+  }
+  ASSERT_EQ(ExitSuccess, subproc->Finish());
+  // Any process has a resident set; CPU times may round down to zero.
+  EXPECT_GT(subproc->usage().max_rss_kb, 0);
+}
+#endif
+
 TEST_F(SubprocessTest, SetWithMulti) {
   Subprocess* processes[3];
   const char* kCommands[3] = {
@@ -376,6 +376,72 @@ void GetShellEscapedString(const string& input, string* result) {
 }
 
 
+// Words that mean something else to the shell when used as a command name.
+static bool IsShellBuiltin(const string& word) {
+  static const char* const kBuiltins[] = {
+    // Reserved words.
+    "!", "{", "}", "case", "do", "done", "elif", "else", "esac", "fi", "for",
+    "function", "if", "in", "select", "then", "time", "until", "while",
+    // Builtins that have to run in the shell itself.
+    ".", ":", "alias", "bg", "break", "cd", "command", "continue", "eval",
+    "exec", "exit", "export", "fg", "getopts", "hash", "jobs", "local",
+    "read", "readonly", "return", "set", "shift", "source", "times", "trap",
+    "type", "ulimit", "umask", "unalias", "unset", "wait",
+  };
+  for (size_t i = 0; i < sizeof(kBuiltins) / sizeof(kBuiltins[0]); ++i) {
+    if (word == kBuiltins[i])
+      return true;
+  }
+  return false;
+}
+
+bool SplitSimpleShellCommand(const string& command, vector<string>* args) {
+  args->clear();
+  bool in_word = false;
+  for (size_t i = 0; i < command.size(); ++i) {
+    char c = command[i];
+    switch (c) {
+      case ' ':
+      case '\t':
+        in_word = false;
+        continue;
+      case '\'': {
+        size_t end = command.find('\'', i + 1);
+        if (end == string::npos)
+          return false;
+        if (!in_word)
+          args->push_back(string());
+        args->back().append(command, i + 1, end - i - 1);
+        in_word = true;
+        i = end;
+        continue;
+      }
+      case '\\':
+        if (i + 1 == command.size() || command[i + 1] == '\n')
+          return false;
+        c = command[++i];
+        break;
+      // '#' and '~' are only special at the start of a word, but are rare
+      // elsewhere, so don't bother.
+      case '#': case '~':
+      case '\n': case '|': case '&': case ';': case '<': case '>': case '(':
+      case ')': case '$': case '`': case '"': case '*': case '?': case '[':
+      case ']': case '{': case '}': case '!':
+        return false;
+      case '=':
+        // A variable assignment before the command.
+        if (args->empty() || (args->size() == 1 && in_word))
+          return false;
+        break;
+    }
+    if (!in_word)
+      args->push_back(string());
+    args->back().push_back(c);
+    in_word = true;
+  }
+  return !args->empty() && !IsShellBuiltin(args->front());
+}
+
 void GetWin32EscapedString(const string& input, string* result) {
   assert(result);
   if (!StringNeedsWin32Escaping(input)) {
@@ -73,6 +73,14 @@ void CanonicalizePath(char* path, size_t* len, uint64_t* slash_bits);
 void GetShellEscapedString(const std::string& input, std::string* result);
 void GetWin32EscapedString(const std::string& input, std::string* result);
 
+/// Split a shell command into its arguments, if it's simple enough that
+/// running it without the shell gives the same result: words separated by
+/// blanks, with single quotes and backslashes for quoting.  Returns false
+/// for anything else the shell would interpret, e.g. operators, variables,
+/// globs, assignments, redirections or builtins.
+bool SplitSimpleShellCommand(const std::string& command,
+                             std::vector<std::string>* args);
+
 /// Read a file to a string (in text mode: with CRLF conversion
 /// on Windows).
 /// Returns -errno and fills in \a err on error.
@@ -486,6 +486,46 @@ TEST(PathEscaping, SensibleWin32PathsAreNotNeedlesslyEscaped) {
   EXPECT_EQ(path, result);
 }
 
+TEST(SplitSimpleShellCommand, Simple) {
+  vector<string> args;
+  EXPECT_TRUE(SplitSimpleShellCommand("cc  -c\tfoo.c -o foo.o -DX=1", &args));
+  ASSERT_EQ(6u, args.size());
+  EXPECT_EQ("cc", args[0]);
+  EXPECT_EQ("-c", args[1]);
+  EXPECT_EQ("foo.c", args[2]);
+  EXPECT_EQ("-DX=1", args[5]);
+}
+
+TEST(SplitSimpleShellCommand, Quoting) {
+  // What GetShellEscapedString() produces is understood.
+  string escaped = "cp ";
+  GetShellEscapedString("it's a file", &escaped);
+  escaped += " out\\ put ''";
+  vector<string> args;
+  EXPECT_TRUE(SplitSimpleShellCommand(escaped, &args));
+  ASSERT_EQ(4u, args.size());
+  EXPECT_EQ("it's a file", args[1]);
+  EXPECT_EQ("out put", args[2]);
+  EXPECT_EQ("", args[3]);
+
+  EXPECT_TRUE(SplitSimpleShellCommand("echo '$HOME && *'", &args));
+  ASSERT_EQ(2u, args.size());
+  EXPECT_EQ("$HOME && *", args[1]);
+}
+
+TEST(SplitSimpleShellCommand, NeedsShell) {
+  const char* kCommands[] = {
+    "", "   ", "a && b", "a; b", "a | b", "a > out", "a < in", "echo $HOME",
+    "echo `date`", "echo \"quoted\"", "ls *.c", "ls ~", "FOO=1 cc",
+    "cd dir", "exit 1", "echo 'unterminated", "echo trailing\\",
+    "echo a\\\nb", "a\nb", "(a)", "a &", "[ -f x ]",
+  };
+  for (size_t i = 0; i < sizeof(kCommands) / sizeof(kCommands[0]); ++i) {
+    vector<string> args;
+    EXPECT_FALSE(SplitSimpleShellCommand(kCommands[i], &args)) << kCommands[i];
+  }
+}
+
 TEST(StripAnsiEscapeCodes, EscapeAtEnd) {
   string stripped = StripAnsiEscapeCodes("foo\33");
   EXPECT_EQ("foo", stripped);
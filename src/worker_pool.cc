@@ -0,0 +1,341 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "worker_pool.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "subprocess.h"
+#include "util.h"
+
+using namespace std;
+
+#ifndef _WIN32
+
+extern char** environ;
+
+namespace {
+
+/// Largest output accepted from a worker, beyond which its length is taken
+/// for garbage rather than allocated.
+const unsigned long kMaxResponseSize = 1UL << 30;
+
+bool WriteAll(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(fd, data, len);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+/// Read exactly |len| bytes.  Returns false at the end of the file, with
+/// errno set to 0, or on error.
+bool ReadAll(int fd, char* data, size_t len) {
+  while (len > 0) {
+    ssize_t count = read(fd, data, len);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (count == 0) {
+      errno = 0;
+      return false;
+    }
+    data += count;
+    len -= count;
+  }
+  return true;
+}
+
+string ReadError(const char* what) {
+  return errno ? string(what) + ": " + strerror(errno)
+               : "worker exited during request";
+}
+
+}  // anonymous namespace
+
+Worker::~Worker() {
+  if (in_fd_ >= 0)
+    close(in_fd_);
+  if (out_fd_ >= 0)
+    close(out_fd_);
+  if (pid_ != -1) {
+    // Closing stdin asks the worker to exit; don't wait for it to finish
+    // whatever it is doing.
+    kill(-pid_, SIGTERM);
+    while (waitpid(pid_, NULL, 0) < 0 && errno == EINTR) {}
+  }
+}
+
+bool Worker::Start(SubprocessSet* set, string* err) {
+  int to_worker[2], from_worker[2];
+  if (pipe(to_worker) < 0)
+    Fatal("pipe: %s", strerror(errno));
+  if (pipe(from_worker) < 0)
+    Fatal("pipe: %s", strerror(errno));
+  // The child's copies are made by dup2(), which doesn't keep the flag.
+  SetCloseOnExec(to_worker[0]);
+  SetCloseOnExec(to_worker[1]);
+  SetCloseOnExec(from_worker[0]);
+  SetCloseOnExec(from_worker[1]);
+
+  posix_spawn_file_actions_t action;
+  int ret = posix_spawn_file_actions_init(&action);
+  if (ret != 0)
+    Fatal("posix_spawn_file_actions_init: %s", strerror(ret));
+  ret = posix_spawn_file_actions_adddup2(&action, to_worker[0], 0);
+  if (ret != 0)
+    Fatal("posix_spawn_file_actions_adddup2: %s", strerror(ret));
+  ret = posix_spawn_file_actions_adddup2(&action, from_worker[1], 1);
+  if (ret != 0)
+    Fatal("posix_spawn_file_actions_adddup2: %s", strerror(ret));
+
+  posix_spawnattr_t attr;
+  ret = posix_spawnattr_init(&attr);
+  if (ret != 0)
+    Fatal("posix_spawnattr_init: %s", strerror(ret));
+  ret = posix_spawnattr_setsigmask(&attr, &set->old_mask_);
+  if (ret != 0)
+    Fatal("posix_spawnattr_setsigmask: %s", strerror(ret));
+  // Like commands, workers get their own process group, so that ctrl-c
+  // doesn't reach them.
+  ret = posix_spawnattr_setflags(&attr,
+                                 POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+  if (ret != 0)
+    Fatal("posix_spawnattr_setflags: %s", strerror(ret));
+
+  const char* spawned_args[] = { "/bin/sh", "-c", command_.c_str(), NULL };
+  ret = posix_spawn(&pid_, "/bin/sh", &action, &attr,
+                    const_cast<char**>(spawned_args), environ);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&action);
+  close(to_worker[0]);
+  close(from_worker[1]);
+  in_fd_ = to_worker[1];
+  out_fd_ = from_worker[0];
+
+  if (ret != 0) {
+    pid_ = -1;
+    *err = string("posix_spawn: ") + strerror(ret);
+    return false;
+  }
+  return true;
+}
+
+bool Worker::Send(const string& data, string* err) {
+  if (!WriteAll(in_fd_, data.data(), data.size())) {
+    *err = string("writing request: ") + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool Worker::ReadLine(string* line, string* err) {
+  line->clear();
+  for (;;) {
+    char c;
+    if (!ReadAll(out_fd_, &c, 1)) {
+      *err = ReadError("reading response");
+      return false;
+    }
+    if (c == '\n')
+      return true;
+    *line += c;
+    if (line->size() > 64) {
+      *err = "malformed response";
+      return false;
+    }
+  }
+}
+
+bool Worker::Read(size_t length, string* data, string* err) {
+  data->resize(length);
+  if (length > 0 && !ReadAll(out_fd_, &(*data)[0], length)) {
+    *err = ReadError("reading response");
+    return false;
+  }
+  return true;
+}
+
+bool Worker::Run(const string& request, int* exit_code, string* output,
+                 string* err) {
+  broken_ = true;
+  string header;
+  if (!Send(to_string(request.size()) + "\n" + request, err) ||
+      !ReadLine(&header, err))
+    return false;
+
+  unsigned long length;
+  char trailing;
+  if (sscanf(header.c_str(), "%d %lu%c", exit_code, &length, &trailing) != 2 ||
+      length > kMaxResponseSize) {
+    *err = "malformed response '" + header + "'";
+    return false;
+  }
+  if (!Read(length, output, err))
+    return false;
+  broken_ = false;
+  return true;
+}
+
+void Worker::Kill() {
+  if (pid_ != -1)
+    kill(-pid_, SIGKILL);
+}
+
+WorkerPool::WorkerPool(SubprocessSet* set) : set_(set) {}
+
+WorkerPool::~WorkerPool() {
+  Clear();
+  for (map<string, vector<Worker*> >::iterator i = idle_.begin();
+       i != idle_.end(); ++i) {
+    for (vector<Worker*>::iterator w = i->second.begin();
+         w != i->second.end(); ++w)
+      delete *w;
+  }
+}
+
+WorkerRequest* WorkerPool::Add(const string& worker_command,
+                               const string& command) {
+  vector<Worker*>& idle = idle_[worker_command];
+  Worker* worker;
+  if (!idle.empty()) {
+    worker = idle.back();
+    idle.pop_back();
+  } else {
+    worker = new Worker(worker_command);
+    string err;
+    if (!worker->Start(set_, &err)) {
+      delete worker;
+      // Fail the request like a command that can't be run.
+      WorkerRequest* request = new WorkerRequest(NULL, command);
+      request->output_ = "ninja: starting worker '" + worker_command +
+                         "': " + err + "\n";
+      requests_.insert(request);
+      lock_guard<mutex> lock(mutex_);
+      finished_.push(request);
+      return request;
+    }
+  }
+
+  WorkerRequest* request = new WorkerRequest(worker, command);
+  requests_.insert(request);
+  request->thread_ = thread(&WorkerPool::Run, this, request);
+  return request;
+}
+
+void WorkerPool::Run(WorkerRequest* request) {
+  // Writing to a worker that exited must fail rather than kill ninja.  The
+  // signal is sent to this thread, and dropped when it ends.
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  int exit_code;
+  string err;
+  if (request->worker_->Run(request->command_, &exit_code, &request->output_,
+                            &err)) {
+    request->status_ = exit_code == 0 ? ExitSuccess : ExitFailure;
+  } else {
+    request->status_ = ExitFailure;
+    request->output_ = "ninja: worker '" + request->worker_->command_ +
+                       "': " + err + "\n";
+  }
+
+  {
+    lock_guard<mutex> lock(mutex_);
+    finished_.push(request);
+  }
+  set_->Wake();
+}
+
+WorkerRequest* WorkerPool::NextFinished() {
+  WorkerRequest* request;
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (finished_.empty())
+      return NULL;
+    request = finished_.front();
+    finished_.pop();
+  }
+  if (request->thread_.joinable())
+    request->thread_.join();
+  requests_.erase(request);
+
+  if (Worker* worker = request->worker_) {
+    request->worker_ = NULL;
+    if (worker->broken_)
+      delete worker;
+    else
+      idle_[worker->command_].push_back(worker);
+  }
+  return request;
+}
+
+void WorkerPool::Clear() {
+  for (set<WorkerRequest*>::iterator i = requests_.begin();
+       i != requests_.end(); ++i) {
+    if ((*i)->worker_)
+      (*i)->worker_->Kill();
+  }
+  for (set<WorkerRequest*>::iterator i = requests_.begin();
+       i != requests_.end(); ++i) {
+    if ((*i)->thread_.joinable())
+      (*i)->thread_.join();
+    delete (*i)->worker_;
+    delete *i;
+  }
+  requests_.clear();
+  lock_guard<mutex> lock(mutex_);
+  finished_ = queue<WorkerRequest*>();
+}
+
+#else  // _WIN32
+
+WorkerPool::WorkerPool(SubprocessSet* set) : set_(set) {}
+
+WorkerPool::~WorkerPool() {}
+
+WorkerRequest* WorkerPool::Add(const string& worker_command,
+                               const string& command) {
+  return NULL;
+}
+
+WorkerRequest* WorkerPool::NextFinished() {
+  return NULL;
+}
+
+void WorkerPool::Clear() {}
+
+void WorkerPool::Run(WorkerRequest* request) {}
+
+#endif  // _WIN32
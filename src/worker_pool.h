@@ -0,0 +1,147 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_WORKER_POOL_H_
+#define NINJA_WORKER_POOL_H_
+
+#include <map>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "exit_status.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+struct SubprocessSet;
+
+#ifndef _WIN32
+/// A long-lived process started by a shell command, and the pipes to its
+/// stdin and stdout.
+struct Worker {
+  explicit Worker(const std::string& command)
+      : command_(command), pid_(-1), in_fd_(-1), out_fd_(-1), broken_(false) {}
+  /// Close the worker's stdin and wait for it to exit.
+  ~Worker();
+
+  /// Start the worker in its own process group, with the signal mask that
+  /// |set| gives commands.
+  bool Start(SubprocessSet* set, std::string* err);
+
+  /// Write |data| to the worker's stdin.
+  bool Send(const std::string& data, std::string* err);
+  /// Read a line, without its newline, from the worker's stdout.
+  bool ReadLine(std::string* line, std::string* err);
+  /// Read exactly |length| bytes from the worker's stdout.
+  bool Read(size_t length, std::string* data, std::string* err);
+
+  /// Send |request| and wait for the response.  Returns false and fills in
+  /// |err| if the worker doesn't answer properly, after which it is broken.
+  bool Run(const std::string& request, int* exit_code, std::string* output,
+           std::string* err);
+
+  /// Stop the worker in the middle of a request.
+  void Kill();
+
+  std::string command_;
+  pid_t pid_;
+  int in_fd_;
+  int out_fd_;
+  bool broken_;
+};
+#else
+struct Worker;
+#endif
+
+/// A command handed to a persistent worker; the counterpart of a Subprocess
+/// for a command run on its own.
+struct WorkerRequest {
+  /// Valid once the request is returned by WorkerPool::NextFinished().
+  ExitStatus status() const { return status_; }
+  std::string TakeOutput() {
+    std::string output;
+    output.swap(output_);
+    return output;
+  }
+
+ private:
+  WorkerRequest(Worker* worker, const std::string& command)
+      : worker_(worker), command_(command), status_(ExitFailure) {}
+
+  /// The worker handling the request, owned by the request until it is
+  /// given back to the pool.
+  Worker* worker_;
+  std::string command_;
+  ExitStatus status_;
+  std::string output_;
+  /// Sends the request and waits for the response.
+  std::thread thread_;
+
+  friend struct WorkerPool;
+};
+
+/// WorkerPool keeps long-lived worker processes for commands with a costly
+/// startup, such as compilers running on a virtual machine.  Workers are
+/// started by a shell command and pooled by that command; each handles one
+/// request at a time, and ninja starts as many as it has requests in flight.
+///
+/// The protocol is length-prefixed, on the worker's stdin and stdout:
+///   request:  "<length>\n<command>"
+///   response: "<exit code> <length>\n<output>"
+/// with lengths in bytes, in decimal.  A worker should exit when its stdin
+/// is closed.  A worker that exits or answers malformed responses fails the
+/// request and is not reused.
+///
+/// Workers aren't supported on Windows: Add() returns NULL there.
+struct WorkerPool {
+  /// |set| is woken up whenever a request finishes.
+  explicit WorkerPool(SubprocessSet* set);
+  /// Drops the requests in flight and stops every worker.
+  ~WorkerPool();
+
+  /// Send |command| to an idle worker started by |worker_command|, or to a
+  /// new one.  Returns NULL if workers aren't supported.
+  WorkerRequest* Add(const std::string& worker_command,
+                     const std::string& command);
+
+  /// Next request with a response, or NULL.  The caller owns the request.
+  WorkerRequest* NextFinished();
+
+  /// Kill the workers handling requests, and drop the requests.
+  void Clear();
+
+ private:
+  /// Body of a request's thread.
+  void Run(WorkerRequest* request);
+
+  SubprocessSet* set_;
+  /// Idle workers, by the command that started them.
+  std::map<std::string, std::vector<Worker*> > idle_;
+  /// Requests not yet returned by NextFinished().
+  std::set<WorkerRequest*> requests_;
+
+  std::mutex mutex_;
+  /// Requests whose response has arrived.  Guarded by |mutex_|.
+  std::queue<WorkerRequest*> finished_;
+
+  WorkerPool(const WorkerPool&);
+  void operator=(const WorkerPool&);
+};
+
+#endif  // NINJA_WORKER_POOL_H_
@@ -0,0 +1,138 @@
+// Copyright 2024 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "worker_pool.h"
+
+#include "metrics.h"
+#include "subprocess.h"
+#include "test.h"
+
+using namespace std;
+
+#ifndef _WIN32
+
+namespace {
+
+/// A worker that runs each request in its own shell, so that $$ tells the
+/// worker apart.
+const char kShellWorker[] =
+    "sh -c '"
+    "while read len; do "
+    "  cmd=$(head -c \"$len\"); "
+    "  out=$(eval \"$cmd\" 2>&1); code=$?; "
+    "  printf \"%d %d\\n%s\" \"$code\" \"${#out}\" \"$out\"; "
+    "done'";
+
+struct WorkerPoolTest : public testing::Test {
+  WorkerPoolTest() : workers_(&subprocs_) {}
+
+  /// Wait for the next request to finish, as RealCommandRunner does.
+  WorkerRequest* Wait() {
+    WorkerRequest* request;
+    while ((request = workers_.NextFinished()) == NULL)
+      subprocs_.DoWork();
+    return request;
+  }
+
+  SubprocessSet subprocs_;
+  WorkerPool workers_;
+};
+
+}  // anonymous namespace
+
+TEST_F(WorkerPoolTest, Run) {
+  WorkerRequest* request = workers_.Add(kShellWorker, "echo hello");
+  ASSERT_TRUE(request);
+  EXPECT_EQ(request, Wait());
+  EXPECT_EQ(ExitSuccess, request->status());
+  EXPECT_EQ("hello", request->TakeOutput());
+  delete request;
+
+  request = workers_.Add(kShellWorker, "echo failed; false");
+  ASSERT_TRUE(request);
+  EXPECT_EQ(request, Wait());
+  EXPECT_EQ(ExitFailure, request->status());
+  EXPECT_EQ("failed", request->TakeOutput());
+  delete request;
+}
+
+TEST_F(WorkerPoolTest, ReusesIdleWorkers) {
+  WorkerRequest* request = workers_.Add(kShellWorker, "echo $$");
+  ASSERT_TRUE(request);
+  EXPECT_EQ(request, Wait());
+  string first_pid = request->TakeOutput();
+  delete request;
+
+  request = workers_.Add(kShellWorker, "echo $$");
+  ASSERT_TRUE(request);
+  EXPECT_EQ(request, Wait());
+  EXPECT_EQ(first_pid, request->TakeOutput());
+  delete request;
+}
+
+TEST_F(WorkerPoolTest, StartsWorkersForConcurrentRequests) {
+  WorkerRequest* first = workers_.Add(kShellWorker, "sleep 0.1; echo $$");
+  WorkerRequest* second = workers_.Add(kShellWorker, "sleep 0.1; echo $$");
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(second);
+
+  WorkerRequest* done[2] = { Wait(), Wait() };
+  EXPECT_NE(done[0], done[1]);
+  EXPECT_NE(done[0]->TakeOutput(), done[1]->TakeOutput());
+  delete done[0];
+  delete done[1];
+}
+
+TEST_F(WorkerPoolTest, BrokenWorker) {
+  // Exits without answering.
+  WorkerRequest* request = workers_.Add("read len", "echo hello");
+  ASSERT_TRUE(request);
+  EXPECT_EQ(request, Wait());
+  EXPECT_EQ(ExitFailure, request->status());
+  EXPECT_EQ("ninja: worker 'read len': worker exited during request\n",
+            request->TakeOutput());
+  delete request;
+
+  // Reads the request before answering, so that it can't exit before
+  // the request is written.
+  request = workers_.Add("read len; echo nonsense", "echo hello");
+  ASSERT_TRUE(request);
+  EXPECT_EQ(request, Wait());
+  EXPECT_EQ(ExitFailure, request->status());
+  EXPECT_EQ("ninja: worker 'read len; echo nonsense': malformed response "
+            "'nonsense'\n",
+            request->TakeOutput());
+  delete request;
+
+  // An output too large to be true isn't allocated.
+  request = workers_.Add("read len; echo 0 99999999999999", "echo hello");
+  ASSERT_TRUE(request);
+  EXPECT_EQ(request, Wait());
+  EXPECT_EQ(ExitFailure, request->status());
+  EXPECT_EQ("ninja: worker 'read len; echo 0 99999999999999': malformed "
+            "response '0 99999999999999'\n",
+            request->TakeOutput());
+  delete request;
+}
+
+TEST_F(WorkerPoolTest, Clear) {
+  WorkerRequest* request = workers_.Add(kShellWorker, "sleep 10");
+  ASSERT_TRUE(request);
+  int64_t start = GetTimeMillis();
+  workers_.Clear();
+  EXPECT_LT(GetTimeMillis() - start, 5000);
+  EXPECT_EQ(NULL, workers_.NextFinished());
+}
+
+#endif  // !_WIN32